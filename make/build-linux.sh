@@ -23,7 +23,7 @@ then
    #LINK_OPTIONS="-native"
    # needed to be told where to find libm on LinuxMint 14
    LINK_OPTIONS="-native -L/usr/lib/x86_64-linux-gnu"
-   LINK_LIBS="-lm"
+   LINK_LIBS="-lm -lpthread"
 
 # default to GCC
 else
@@ -32,14 +32,16 @@ else
    
    OPTI="-O3 -ffast-math"
    LINK_OPTIONS=
-   LINK_LIBS="-lm"
+   LINK_LIBS="-lm -lpthread"
 fi
 
 LANG="-x c -ansi -std=iso9899:199409 -pedantic"
 WARN="-Wall -Wextra -Wcast-align -Wwrite-strings -Wpointer-arith -Wredundant-decls -Wdisabled-optimization"
 ARCH="-mfpmath=sse -msse"
+# add -DMINILIGHT_STATS for profiling timers and counters
+DEFS=""
 
-COMPILE_OPTIONS="-c $LANG $OPTI $ARCH $WARN -Isrc"
+COMPILE_OPTIONS="-c $LANG $OPTI $ARCH $WARN $DEFS -Isrc"
 
 
 # compile and link
@@ -49,12 +51,22 @@ $COMPILER --version
 
 $COMPILER $COMPILE_OPTIONS ../src/*.c
 
-$LINKER $LINK_OPTIONS -o minilight-c *.o $LINK_LIBS
+# check the library interface also compiles as C++ (if there is a C++
+# compiler)
+if which c++
+then
+   echo '#include "MiniLightLib.h"' | c++ -x c++ -fsyntax-only -Wall -Wextra \
+      -pedantic -I../src - || exit 1
+fi
+
+# library (all but the command-line program), and the program as its client
+ar rcs libminilight.a `ls *.o | grep -vx MiniLight.o`
+$LINKER $LINK_OPTIONS -o minilight-c MiniLight.o libminilight.a $LINK_LIBS
 
 
-# move executable and return from build directory
+# move executable and library, and return from build directory
 
-mv minilight-c ..
+mv minilight-c libminilight.a ..
 cd ..
 rm obj/*
 
@@ -26,8 +26,10 @@ LANG="-x c -ansi -std=iso9899:199409 -pedantic"
 WARN="-Wall -Wextra -Wcast-align -Wwrite-strings -Wpointer-arith -Wredundant-decls -Wdisabled-optimization"
 CPU="-arch x86_64"
 ARCH=""
+# add -DMINILIGHT_STATS for profiling timers and counters
+DEFS=""
 
-COMPILE_OPTIONS="-c $LANG $OPTI $CPU $ARCH $WARN -Isrc"
+COMPILE_OPTIONS="-c $LANG $OPTI $CPU $ARCH $WARN $DEFS -Isrc"
 LINK_OPTIONS=$CPU
 
 
@@ -38,12 +40,22 @@ $COMPILER --version
 
 $COMPILER $COMPILE_OPTIONS ../src/*.c
 
-$LINKER $LINK_OPTIONS -o minilight-c *.o
+# check the library interface also compiles as C++ (if there is a C++
+# compiler)
+if which c++
+then
+   echo '#include "MiniLightLib.h"' | c++ -x c++ -fsyntax-only -Wall -Wextra \
+      -pedantic -I../src - || exit 1
+fi
 
+# library (all but the command-line program), and the program as its client
+ar rcs libminilight.a `ls *.o | grep -vx MiniLight.o`
+$LINKER $LINK_OPTIONS -o minilight-c MiniLight.o libminilight.a
 
-# move executable and return from build directory
 
-mv minilight-c ..
+# move executable and library, and return from build directory
+
+mv minilight-c libminilight.a ..
 cd ..
 rm obj/*
 
@@ -8,7 +8,9 @@
 ------------------------------------------------------------------------------*/
 
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "Rgbe.h"
 
@@ -33,7 +35,7 @@ static Exception ImageRead
    if( !pFileIn ) return ERROR_FILE;
 
    e = RgbeRead( pFileIn, &pHeader_o->width, &pHeader_o->height, pIterations_o,
-      paPixels_o );
+      pHeader_o->aTile, paPixels_o );
    if( e ) return fclose( pFileIn ), e;
 
    if( EOF == fclose( pFileIn ) ) return ERROR_FILE;
@@ -59,6 +61,11 @@ Exception ImageConstruct
    (*ppImage_o)->head.width  = width;
    (*ppImage_o)->head.height = height;
 
+   (*ppImage_o)->head.aTile[0] = 0;
+   (*ppImage_o)->head.aTile[1] = 0;
+   (*ppImage_o)->head.aTile[2] = width;
+   (*ppImage_o)->head.aTile[3] = height;
+
    (*ppImage_o)->iterations = 0;
    (*ppImage_o)->aPixels = (Vector3f*)calloc( (*ppImage_o)->head.width *
       (*ppImage_o)->head.height, sizeof(Vector3f) );
@@ -134,7 +141,8 @@ bool ImageCheckHeader
 {
    return
       (pI->head.width  == pIh->width)  &&
-      (pI->head.height == pIh->height);
+      (pI->head.height == pIh->height) &&
+      !memcmp( pI->head.aTile, pIh->aTile, sizeof(pIh->aTile) );
 }
 
 
@@ -147,6 +155,45 @@ int32u ImageGetIterations
 }
 
 
+real64 ImageMean
+(
+   const Image* pI
+)
+{
+   static const Vector3f ONE = { { 1.0, 1.0, 1.0 } };
+
+   const int32u length = pI->head.width * pI->head.height;
+   real64       sum    = 0.0;
+   int32u       i;
+   for( i = length;  i-- > 0; )
+   {
+      sum += Vector3fDot( pI->aPixels + i, &ONE );
+   }
+
+   return length ? sum / ((real64)length * 3.0) : 0.0;
+}
+
+
+real64 ImageRmsDifference
+(
+   const Image* pI,
+   const Image* pOther
+)
+{
+   const int32u length = pI->head.width * pI->head.height;
+   real64       sum    = 0.0;
+   int32u       i;
+   for( i = length;  i-- > 0; )
+   {
+      const Vector3f negative   = Vector3fMulF( pOther->aPixels + i, -1.0 );
+      const Vector3f difference = Vector3fAdd( pI->aPixels + i, &negative );
+      sum += Vector3fDot( &difference, &difference );
+   }
+
+   return length ? sqrt( sum / ((real64)length * 3.0) ) : 0.0;
+}
+
+
 Exception ImageWrite
 (
    const Image* pI,
@@ -202,3 +249,34 @@ void ImageAddToImage
 
    pI_io->iterations += pOther->iterations;
 }
+
+
+void ImagePlaceTile
+(
+   Image*       pI_io,
+   const Image* pTile
+)
+{
+   int32u x, y;
+
+   /* whole is only as converged as its least converged tile */
+   if( !pI_io->iterations || (pTile->iterations < pI_io->iterations) )
+   {
+      pI_io->iterations = pTile->iterations;
+   }
+
+   for( y = pTile->head.height;  y-- > 0; )
+   {
+      for( x = pTile->head.width;  x-- > 0; )
+      {
+         const int32u fx = pTile->head.aTile[0] + x;
+         const int32u fy = pTile->head.aTile[1] + y;
+
+         if( (fx < pI_io->head.width) && (fy < pI_io->head.height) )
+         {
+            pI_io->aPixels[ fx + (fy * pI_io->head.width) ] =
+               pTile->aPixels[ x + (y * pTile->head.width) ];
+         }
+      }
+   }
+}
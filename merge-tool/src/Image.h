@@ -23,6 +23,9 @@ struct ImageHeader
 {
    int32u width;
    int32u height;
+
+   /* placement in whole frame: x0 y0 frameWidth frameHeight */
+   int32u aTile[4];
 };
 
 typedef struct ImageHeader ImageHeader;
@@ -88,6 +91,26 @@ int32u ImageGetIterations
 );
 
 
+/**
+ * Mean of all pixels' channels.
+ */
+real64 ImageMean
+(
+   const Image* pI
+);
+
+
+/**
+ * Root-mean-square difference from another image, over all pixels' channels
+ * (the images being the same size).
+ */
+real64 ImageRmsDifference
+(
+   const Image* pI,
+   const Image* pOther
+);
+
+
 Exception ImageWrite
 (
    const Image* pI,
@@ -113,6 +136,17 @@ void ImageAddToImage
 );
 
 
+/**
+ * Copy a tile into its placement (pI being the whole frame). Iterations become
+ * the least of the tiles placed.
+ */
+void ImagePlaceTile
+(
+   Image*       pI,
+   const Image* pTile
+);
+
+
 
 
 #endif
@@ -149,15 +149,18 @@ Exception RgbeReadHeader
    FILE*   pFileIn,
    int32u* pWidth_o,
    int32u* pHeight_o,
-   int32u* pIterations_o
+   int32u* pIterations_o,
+   int32u  aTile_o[4]
 )
 {
+   bool isTile = false;
+
    bool b;
    Exception e = RgbeIsRecognised( pFileIn, &b );
    if( e || !b ) return e ? e : ERROR_RGBE_INVALID;
 
    {
-      /* read iterations */
+      /* read iterations and tile */
       char s[ 11 ];
       do
       {
@@ -170,6 +173,14 @@ Exception RgbeReadHeader
             if( EOF == fscanf( pFileIn, "%u", pIterations_o ) )
                return ERROR_FILE;
          }
+         else if( !strncmp( s, "TILE=", 5 ) )
+         {
+            /* step back to after key, and read values */
+            if( fseek( pFileIn, 5L - (long)strlen( s ), SEEK_CUR ) ||
+               (4 != fscanf( pFileIn, "%u %u %u %u", &aTile_o[0], &aTile_o[1],
+               &aTile_o[2], &aTile_o[3] )) ) return ERROR_RGBE_INVALID;
+            isTile = true;
+         }
 
          e = nextLine( pFileIn, s[strlen( s ) - 1] );
          if( e ) return e;
@@ -183,6 +194,23 @@ Exception RgbeReadHeader
 
       /* conditioning */
       if( !checkDimensions( *pWidth_o, *pHeight_o ) ) return ERROR_RGBE_SIZE;
+
+      /* not a tile: whole frame */
+      if( !isTile )
+      {
+         aTile_o[0] = 0;
+         aTile_o[1] = 0;
+         aTile_o[2] = *pWidth_o;
+         aTile_o[3] = *pHeight_o;
+      }
+      /* tile must be inside frame */
+      else if( (aTile_o[0] > aTile_o[2]) ||
+         (*pWidth_o > (aTile_o[2] - aTile_o[0])) ||
+         (aTile_o[1] > aTile_o[3]) ||
+         (*pHeight_o > (aTile_o[3] - aTile_o[1])) )
+      {
+         return ERROR_RGBE_SIZE;
+      }
    }
 
    return 0;
@@ -234,10 +262,12 @@ Exception RgbeRead
    int32u*    pWidth_o,
    int32u*    pHeight_o,
    int32u*    pIterations_o,
+   int32u     aTile_o[4],
    Vector3f** paPixels_o
 )
 {
-   Exception e = RgbeReadHeader( pFileIn, pWidth_o, pHeight_o, pIterations_o );
+   Exception e = RgbeReadHeader( pFileIn, pWidth_o, pHeight_o, pIterations_o,
+      aTile_o );
    if( e ) return e;
 
    if( paPixels_o )
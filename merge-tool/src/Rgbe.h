@@ -40,12 +40,17 @@ Exception RgbeIsRecognised
 );
 
 
+/**
+ * @param aTile_o placement in whole frame (x0 y0 frameWidth frameHeight) --
+ *        from the TILE header variable, else 0 0 width height
+ */
 Exception RgbeReadHeader
 (
    FILE*   pFileIn,
    int32u* pWidth_o,
    int32u* pHeight_o,
-   int32u* pIterations_o
+   int32u* pIterations_o,
+   int32u  aTile_o[4]
 );
 
 
@@ -64,6 +69,7 @@ Exception RgbeRead
    int32u*    pWidth_o,
    int32u*    pHeight_o,
    int32u*    pIterations_o,
+   int32u     aTile_o[4],
    Vector3f** paPixels_o
 );
 
@@ -31,22 +31,35 @@ static const char URL[]    = "http://www.hxa.name/minilight";
 
 static const char DESCRIPTION[] =
 "MiniLightMerge accumulates separate MiniLight RGBE renders into a\n"
-"single image.\n";
+"single image -- or stitches separately rendered tiles into one, or\n"
+"measures renders' error against a reference.\n";
 static const char USAGE[] =
 "Usage:\n"
-"  minilightmerge imageFilePathName imageFilePathName ...\n";
+"  minilightmerge imageFilePathName imageFilePathName ...\n"
+"  minilightmerge --stitch tileFilePathName tileFilePathName ...\n"
+"  minilightmerge --compare referenceFilePathName imageFilePathName ...\n";
 
 static const char DETAILS[] =
 "All input images should be the same size. (Any not matching the first\n"
 "are ignored.)\n"
 "All input images should be unique. (Duplicates merely waste effort.)\n"
-"No more than 256 input images can be given at once.\n";
+"No more than 256 input images can be given at once.\n"
+"\n"
+"Tiles (from minilight --region) should all be of the same frame size.\n"
+"(Any not matching the first are ignored, and later overlapping tiles\n"
+"overwrite earlier.) The output has the least iterations of the tiles.\n";
+
+static const char COMPARING[] =
+"Compared images get their RMS difference from the reference (over all\n"
+"pixel channels), and that relative to the reference's mean. To compare\n"
+"ways of rendering at equal time, render each with minilight --time-limit\n"
+"(and the reference much longer).\n";
 
 
 /* templates */
 static const char BANNER_MESSAGE[] = "\n  %s - %s\n\n";
 static const char HELP_MESSAGE[]   =
-   "\n  %s\n  %s\n  %s\n\n%s\n%s\n%s\n";
+   "\n  %s\n  %s\n  %s\n\n%s\n%s\n%s\n%s\n";
 
 
 
@@ -110,10 +123,83 @@ static void average
 }
 
 
+static int32u stitch
+(
+   char**             asFilePathName,
+   const int          namesLength,
+   const ImageHeader* pFirstHeader,
+   Image*             pWholeImage_o
+)
+{
+   Exception e;
+   int    iName = 0;
+   int32u covered = 0;
+
+   for( ;  (iName < namesLength) && (iName < 256);  ++iName )
+   {
+      Image* pTile;
+
+      /* only frame size must match -- placement differs */
+      e = ImageConstructRead( asFilePathName[iName], &pTile );
+      if( !e && (pTile->head.aTile[2] == pFirstHeader->aTile[2]) &&
+         (pTile->head.aTile[3] == pFirstHeader->aTile[3]) )
+      {
+         ImagePlaceTile( pWholeImage_o, pTile );
+         covered += pTile->head.width * pTile->head.height;
+
+         printf( "tile:  (%u) %u %u %u %u %s\n", ImageGetIterations( pTile ),
+            pTile->head.aTile[0], pTile->head.aTile[1], pTile->head.width,
+            pTile->head.height, asFilePathName[iName] );
+      }
+      else
+      {
+         warning( e, asFilePathName[iName] );
+      }
+      ImageDestruct( pTile );
+   }
+
+   return covered;
+}
+
+
+static void compare
+(
+   char**       asFilePathName,
+   const int    namesLength,
+   const Image* pReference
+)
+{
+   Exception    e;
+   int          iName = 0;
+   const real64 mean  = ImageMean( pReference );
+
+   for( ;  iName < namesLength;  ++iName )
+   {
+      Image* pImage;
+
+      e = ImageConstructRead( asFilePathName[iName], &pImage );
+      if( !e && ImageCheckHeader( pImage, &pReference->head ) )
+      {
+         const real64 rmse = ImageRmsDifference( pImage, pReference );
+
+         printf( "image: (%u) rmse %.5g relative %.4f %s\n",
+            ImageGetIterations( pImage ), rmse, mean > 0.0 ? rmse / mean :
+            0.0, asFilePathName[iName] );
+      }
+      else
+      {
+         warning( e, asFilePathName[iName] );
+      }
+      ImageDestruct( pImage );
+   }
+}
+
+
 static void write
 (
    const Image* pSumImage,
-   char**       asFilePathName
+   char**       asFilePathName,
+   const char*  sSuffix
 )
 {
    Exception e;
@@ -134,7 +220,7 @@ static void write
       strcat( sOutFilePathName, "." );
       sprintf( sOutFilePathName + prefixLen + 1, "%08X",
          (int32u)time(0) & 0xFFFFFFFFu );
-      strcat( sOutFilePathName, ".mlm.rgbe" );
+      strcat( sOutFilePathName, sSuffix );
    }
 
    e = ImageWrite( pSumImage, sOutFilePathName );
@@ -163,7 +249,53 @@ int main
    /* check for help request */
    if( (argc <= 1) || !strcmp(argv[1], "-?") || !strcmp(argv[1], "--help") )
    {
-      printf( HELP_MESSAGE, TITLE, AUTHOR, URL, DESCRIPTION, USAGE, DETAILS );
+      printf( HELP_MESSAGE, TITLE, AUTHOR, URL, DESCRIPTION, USAGE, DETAILS,
+         COMPARING );
+   }
+   /* stitch tiles */
+   else if( !strcmp(argv[1], "--stitch") )
+   {
+      char**    asFilePathName = argv + 2;
+      Image*    pWholeImage;
+      Exception e;
+      int32u    covered;
+
+      /* first tile sets the frame size for the rest */
+      ImageHeader firstHeader;
+      {
+         if( argc <= 2 ) error( "no tiles given", 0 );
+         e = ImageReadHeader( asFilePathName[0], &firstHeader );
+         error( e, asFilePathName[0] );
+         printf( "size:  %u %u\n", firstHeader.aTile[2], firstHeader.aTile[3] );
+      }
+
+      e = ImageConstruct( firstHeader.aTile[2], firstHeader.aTile[3],
+         &pWholeImage );
+      error( e, 0 );
+
+      covered = stitch( asFilePathName, argc - 2, &firstHeader, pWholeImage );
+      printf( "coverage: %.1f%%\n", 100.0 * (real64)covered /
+         ((real64)firstHeader.aTile[2] * (real64)firstHeader.aTile[3]) );
+
+      write( pWholeImage, asFilePathName, ".mls.rgbe" );
+
+      ImageDestruct( pWholeImage );
+   }
+   /* compare images to a reference */
+   else if( !strcmp(argv[1], "--compare") )
+   {
+      Image*    pReference;
+      Exception e;
+
+      if( argc <= 3 ) error( "no images given", 0 );
+      e = ImageConstructRead( argv[2], &pReference );
+      error( e, argv[2] );
+      printf( "reference: (%u) %s\n", ImageGetIterations( pReference ),
+         argv[2] );
+
+      compare( argv + 3, argc - 3, pReference );
+
+      ImageDestruct( pReference );
    }
    /* execute */
    else
@@ -184,7 +316,7 @@ int main
       error( e, 0 );
 
       average( asFilePathName, argc, &firstHeader, pSumImage );
-      write( pSumImage, asFilePathName );
+      write( pSumImage, asFilePathName, ".mlm.rgbe" );
 
       ImageDestruct( pSumImage );
    }
@@ -0,0 +1,70 @@
+#!/bin/bash
+
+
+# --- check the README's memory figure for large scenes ---
+#
+# usage: terrain-check.sh [executable [n]]
+#
+# Makes the terrain (terrain.py, default 16,785,218 triangles) in a temporary
+# directory, renders a few iterations of it, and fails (exit 1) if the peak
+# resident memory is over the budget: 240 bytes per triangle, plus 16 MB for
+# the program and image (4.0 GB at the default size). Needs Python 3, and
+# about 250 MB of temporary disk.
+
+
+SCENES=`cd \`dirname "$0"\` && pwd`
+EXECUTABLE=${1:-$SCENES/../minilight-c}
+N=${2:-2897}
+ITERATIONS=2
+
+# (absolute, since rendering is from the temporary directory)
+EXECUTABLE=`cd \`dirname "$EXECUTABLE"\` && pwd`/`basename "$EXECUTABLE"`
+if [ ! -x "$EXECUTABLE" ]
+then
+   echo "no executable: $EXECUTABLE (build it first)"
+   exit 2
+fi
+
+
+# make the terrain in a temporary directory
+
+WORK=`mktemp -d "${TMPDIR:-/tmp}/terrain-check.XXXXXX"` || exit 2
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK"
+
+python3 "$SCENES/terrain.py" $N || exit 2
+
+
+# render, and measure the peak resident memory (by the child's rusage, in
+# bytes)
+
+PEAK=`python3 - "$EXECUTABLE" $ITERATIONS <<'EOF'
+import resource, subprocess, sys
+status = subprocess.call([sys.argv[1], '--iterations', sys.argv[2],
+   'terrain.ml.txt'], stdout=sys.stderr)
+peak = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+# (Linux gives KiB, MacOS bytes)
+print(peak if sys.platform == 'darwin' else peak * 1024)
+sys.exit(status)
+EOF` || { echo "render failed"; exit 2; }
+
+
+# compare with the budget
+
+TRIANGLES=$(( 2 * N * N ))
+BUDGET=$(( (240 * TRIANGLES) + (16 * 1024 * 1024) ))
+
+echo
+echo "triangles: $TRIANGLES"
+echo "peak:      $(( PEAK / 1048576 )) MiB"
+echo "budget:    $(( BUDGET / 1048576 )) MiB"
+
+if [ $PEAK -gt $BUDGET ]
+then
+   echo "FAILED: over budget"
+   exit 1
+fi
+echo "passed"
+
+
+exit
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+
+#-------------------------------------------------------------------------------
+#
+#  MiniLight C : minimal global illumination renderer
+#  Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+#
+#  http://www.hxa.name/minilight
+#
+#-------------------------------------------------------------------------------
+
+
+# Make a large test scene: a heightfield terrain, n x n quads over 100 m, as a
+# binary PLY mesh, and a model importing and viewing it.
+#
+# usage: terrain.py [n [amplitude]]
+#
+# Writes terrain.ply and terrain.ml.txt in the working directory (render from
+# there). The default n of 2897 makes 16,785,218 triangles (over 2^24), the
+# scale the README's memory figure is for.
+
+
+import array
+import math
+import struct
+import sys
+
+
+n         = int(sys.argv[1]) if len(sys.argv) > 1 else 2897
+amplitude = float(sys.argv[2]) if len(sys.argv) > 2 else 1.0
+size      = 100.0
+
+with open('terrain.ply', 'wb') as f:
+   f.write(b'ply\nformat binary_little_endian 1.0\n'
+      b'element vertex %d\nproperty float x\nproperty float y\n'
+      b'property float z\nelement face %d\n'
+      b'property list uchar int vertex_indices\nend_header\n' %
+      ((n + 1) * (n + 1), n * n))
+
+   # vertexs, a row at a time
+   for j in range(n + 1):
+      row = array.array('f')
+      z = size * j / n
+      for i in range(n + 1):
+         x = size * i / n
+         y = (amplitude * 2.0 * math.sin(x * 0.3) * math.cos(z * 0.2)) + \
+            (amplitude * 0.3 * math.sin((x * 3.1) + (z * 2.3)))
+         row.extend((x, y, z))
+      f.write(row.tobytes())
+
+   # quads (split into triangles when read)
+   for j in range(n):
+      row = bytearray()
+      for i in range(n):
+         a = (j * (n + 1)) + i
+         row += struct.pack('<Biiii', 4, a, a + n + 1, a + n + 2, a + 1)
+      f.write(row)
+
+with open('terrain.ml.txt', 'w') as f:
+   f.write('#MiniLight\n\n1\n\n160 120\n(50 12 -10) (0 -0.35 1) 60\n\n'
+      '(3000 3000 3000) (0.1 0.09 0.07)\n\n'
+      'import terrain.ply (0.6 0.5 0.4) (0 0 0)\n')
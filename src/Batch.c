@@ -0,0 +1,324 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "Exceptions.h"
+
+#include "Batch.h"
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Work shared by the rendering threads.
+ */
+struct Views
+{
+   const Scene*     pScene;
+   bool             isTiled;
+   bool             isBidirectional;
+   IrradianceCache* pCache;
+   const Camera*    aCameras;
+   int32            camerasLength;
+   const Image*     pImageTemplate;
+   int32            iterations;
+   real64           targetNoise;
+   const char*      sImageFilePathname;
+   const int32u*    aSeeds;
+
+   /* next view to take, and first exception thrown (or 0) */
+   volatile int32   next;
+   volatile int     exception;
+};
+
+typedef struct Views Views;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static void renderView
+(
+   jmp_buf      jmpBuf,
+   const Views* pViews,
+   int32        view,
+   Image*       pImage,
+   const char*  sImageFilePathname
+)
+{
+   Random random = RandomCreateSeeded( pViews->aSeeds[view] );
+
+   FILE* pImageFile;
+   int32 frameNo;
+
+   for( frameNo = 1;  frameNo <= pViews->iterations;  ++frameNo )
+   {
+      CameraFrame( &pViews->aCameras[view], pViews->pScene, pViews->isTiled,
+         pViews->isBidirectional, pViews->pCache, 0, &random, pImage );
+
+      /* end early if noise is low enough */
+      if( (pViews->targetNoise > 0.0) &&
+         (frameNo >= IMAGE_NOISE_ITERATIONS_MIN) &&
+         (ImageNoise( pImage, frameNo ) <= pViews->targetNoise) )
+      {
+         break;
+      }
+   }
+   frameNo = frameNo <= pViews->iterations ? frameNo : pViews->iterations;
+
+   /* write image file */
+   pImageFile = fopen( sImageFilePathname, "wb" );
+   throwExceptions( jmpBuf, !pImageFile, ERROR_WRITE_IO );
+
+   ImageFormatted( pImage, frameNo, jmpBuf, pImageFile );
+
+   throwExceptions( jmpBuf, (EOF == fclose( pImageFile )), ERROR_WRITE_IO );
+
+   printf( "view %i: (%i) %s\n", view, frameNo, sImageFilePathname );
+   fflush( stdout );
+}
+
+
+/**
+ * Thread body: take and render views until none remain (or any thread has
+ * failed).
+ */
+static void* renderViews
+(
+   void* pViewsV
+)
+{
+   Views* pViews = (Views*)pViewsV;
+
+   /* (volatile, since set between setjmp and longjmp) */
+   Image* volatile pImage             = 0;
+   char*  volatile sImageFilePathname = 0;
+
+   jmp_buf   jmpBuf;
+   const int exception = setjmp( jmpBuf );
+
+   /* try */
+   if( !exception )
+   {
+      int32 view;
+      while( !pViews->exception && ((view = __sync_fetch_and_add(
+         &pViews->next, 1 )) < pViews->camerasLength) )
+      {
+         pImage = ImageConstructBlank( pViews->pImageTemplate, jmpBuf );
+         sImageFilePathname = BatchNumberedPathname( jmpBuf,
+            pViews->sImageFilePathname, view );
+
+         renderView( jmpBuf, pViews, view, pImage, sImageFilePathname );
+
+         ImageDestruct( pImage );
+         pImage = 0;
+         free( sImageFilePathname );
+         sImageFilePathname = 0;
+      }
+   }
+   /* catch: keep the first, and stop the other threads */
+   else
+   {
+      __sync_bool_compare_and_swap( &pViews->exception, 0, exception );
+
+      if( pImage )
+      {
+         ImageDestruct( pImage );
+      }
+      free( sImageFilePathname );
+   }
+
+   return 0;
+}
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+Camera* BatchReadCameras
+(
+   jmp_buf     jmpBuf,
+   const char* sFilePathname,
+   int32*      pCamerasLength_o
+)
+{
+   Camera* aCameras = (Camera*)throwAllocExceptions( jmpBuf,
+      calloc( 0, sizeof(Camera) ) );
+   FILE*   pIn      = fopen( sFilePathname, "r" );
+   throwExceptions( jmpBuf, !pIn, ERROR_READ_IO );
+
+   *pCamerasLength_o = 0;
+
+   /* read views, until end of file */
+   for( ;; )
+   {
+      /* read next non blank char */
+      char s[2];
+      const int r = fscanf( pIn, "%1s", s );
+
+      /* throw non-EOF failure */
+      const int code = ferror( pIn ) ? ERROR_READ_IO : 0;
+      clearerr( pIn );
+      throwExceptions( jmpBuf, (bool)code, code );
+
+      /* if char was found, put back, else end reading */
+      if( 1 != r )
+      {
+         break;
+      }
+      throwExceptions( jmpBuf, (EOF == ungetc( s[0], pIn )), ERROR_READ_IO );
+
+      /* read a view, and append */
+      {
+         const Camera c = CameraCreate( pIn, jmpBuf );
+
+         aCameras = (Camera*)throwAllocExceptions( jmpBuf, realloc( aCameras,
+            ++*pCamerasLength_o * sizeof(Camera) ) );
+         aCameras[*pCamerasLength_o - 1] = c;
+      }
+   }
+
+   throwExceptions( jmpBuf, (EOF == fclose( pIn )), ERROR_READ_IO );
+
+   /* must have something */
+   throwExceptions( jmpBuf, (*pCamerasLength_o < 1), ERROR_READ_TRUNC );
+
+   return aCameras;
+}
+
+
+char* BatchNumberedPathname
+(
+   jmp_buf     jmpBuf,
+   const char* sImageFilePathname,
+   int32       number
+)
+{
+   static const char EXTENSION[] = ".rgbe";
+
+   size_t nameLength = strlen( sImageFilePathname );
+   bool   isExtended = false;
+
+   char* sPathname;
+   if( (nameLength >= 5) &&
+      !strcmp( sImageFilePathname + nameLength - 5, EXTENSION ) )
+   {
+      nameLength -= 5;
+      isExtended = true;
+   }
+
+   sPathname = (char*)throwAllocExceptions( jmpBuf,
+      calloc( nameLength + 13 + sizeof(EXTENSION), sizeof(char) ) );
+   memcpy( sPathname, sImageFilePathname, nameLength );
+   sprintf( sPathname + nameLength, ".%04i", number );
+   if( isExtended )
+   {
+      strcat( sPathname, EXTENSION );
+   }
+
+   return sPathname;
+}
+
+
+void BatchRender
+(
+   jmp_buf          jmpBuf,
+   const Scene*     pScene,
+   bool             isTiled,
+   bool             isBidirectional,
+   IrradianceCache* pCache,
+   const Camera*    aCameras,
+   int32            camerasLength,
+   const Image*     pImageTemplate,
+   int32            iterations,
+   real64           targetNoise,
+   int32            threadsLength,
+   Random*          pRandom,
+   const char*      sImageFilePathname
+)
+{
+   Views      views;
+   pthread_t* aThreads;
+   int32      i, started = 0;
+
+   /* no more threads than views */
+   threadsLength = threadsLength < camerasLength ? threadsLength :
+      camerasLength;
+   threadsLength = threadsLength < BATCH_THREADS_MAX ? threadsLength :
+      BATCH_THREADS_MAX;
+   threadsLength = threadsLength > 1 ? threadsLength : 1;
+
+   views.pScene             = pScene;
+   views.isTiled            = isTiled;
+   views.isBidirectional    = isBidirectional;
+   views.pCache             = pCache;
+   views.aCameras           = aCameras;
+   views.camerasLength      = camerasLength;
+   views.pImageTemplate     = pImageTemplate;
+   views.iterations         = iterations;
+   views.targetNoise        = targetNoise;
+   views.sImageFilePathname = sImageFilePathname;
+   views.next               = 0;
+   views.exception          = 0;
+
+   /* seed every view now, independently of thread scheduling (and large
+      enough to be used as given) */
+   {
+      int32u* aSeeds = (int32u*)throwAllocExceptions( jmpBuf,
+         calloc( camerasLength > 0 ? camerasLength : 1, sizeof(int32u) ) );
+      for( i = camerasLength;  i-- > 0; )
+      {
+         aSeeds[i] = (RandomInt32u( pRandom ) | 0x100u) & 0xFFFFFFFFu;
+      }
+      views.aSeeds = aSeeds;
+   }
+
+   aThreads = (pthread_t*)throwAllocExceptions( jmpBuf,
+      calloc( threadsLength, sizeof(pthread_t) ) );
+
+   /* start other threads (any that fail to start just leave more views for
+      the rest), and join in with this one */
+   for( i = 0;  i < (threadsLength - 1);  ++i )
+   {
+      if( !pthread_create( &aThreads[started], 0, renderViews, &views ) )
+      {
+         ++started;
+      }
+   }
+   renderViews( &views );
+
+   for( i = started;  i-- > 0;  pthread_join( aThreads[i], 0 ) ) {}
+
+   free( aThreads );
+   free( (int32u*)views.aSeeds );
+
+   /* rethrow any thread's exception */
+   throwExceptions( jmpBuf, (bool)views.exception, views.exception );
+}
+
+
+int32 BatchProcessorsCount()
+{
+   const long count = sysconf( _SC_NPROCESSORS_ONLN );
+
+   return count < 1 ? 1 :
+      (count > BATCH_THREADS_MAX ? BATCH_THREADS_MAX : (int32)count);
+}
@@ -0,0 +1,117 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Batch_h
+#define Batch_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Random.h"
+#include "Image.h"
+#include "Scene.h"
+#include "Camera.h"
+
+
+
+
+/**
+ * Rendering of many views of one scene.<br/><br/>
+ *
+ * The scene (and its index) is made once, for all the views' eye positions,
+ * then shared, read-only, by threads that each take whole views in turn. Each
+ * view has its own image and random generator (seeded in advance, so the
+ * result does not depend on the thread scheduling -- except with an
+ * irradiance cache, which the views share, and add to, as they go).<br/><br/>
+ *
+ * A camera file holds view definitions, as in the model file:
+ * <pre>
+ *    viewposition viewdirection viewangle
+ *    viewposition viewdirection viewangle
+ *    ...
+ * </pre>
+ * Each view's image file is numbered: "name.0000.rgbe" for "name.rgbe".
+ */
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Read all view definitions from a camera file.
+ *
+ * @return array of cameras (to be freed by caller)
+ */
+Camera* BatchReadCameras
+(
+   jmp_buf     jmpBuf,
+   const char* sFilePathname,
+   int32*      pCamerasLength_o
+);
+
+/**
+ * Make a numbered image file pathname: "name.0001.rgbe" for "name.rgbe" (or
+ * "name.0001" for "name").
+ *
+ * @return pathname (to be freed by caller)
+ */
+char* BatchNumberedPathname
+(
+   jmp_buf     jmpBuf,
+   const char* sImageFilePathname,
+   int32       number
+);
+
+/**
+ * Render all views, each to its own numbered image file.
+ *
+ * @param isTiled as for CameraFrame
+ * @param isBidirectional as for CameraFrame
+ * @param pCache as for CameraFrame
+ * @param pImageTemplate frame size and region (and noise tracking) for every
+ *        view
+ * @param targetNoise stop a view early at this relative noise, or 0
+ */
+void BatchRender
+(
+   jmp_buf          jmpBuf,
+   const Scene*     pScene,
+   bool             isTiled,
+   bool             isBidirectional,
+   IrradianceCache* pCache,
+   const Camera*    aCameras,
+   int32            camerasLength,
+   const Image*     pImageTemplate,
+   int32            iterations,
+   real64           targetNoise,
+   int32            threadsLength,
+   Random*          pRandom,
+   const char*      sImageFilePathname
+);
+
+/**
+ * Number of processors available (for a default threads length).
+ */
+int32 BatchProcessorsCount();
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Maximum number of threads.
+ */
+#define BATCH_THREADS_MAX 256
+
+
+
+
+#endif
@@ -0,0 +1,598 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <math.h>
+
+#include "Stats.h"
+#include "SurfacePoint.h"
+
+#include "BidirectionalTracer.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const real64 PI = 3.14159265358979;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Path node: a surface point (or, first on the eye path, only the eye's
+ * position), with the path's throughput to it, and the probability densities
+ * (per area) of reaching it from either way.
+ */
+struct Node
+{
+   SurfacePoint point;
+
+   /* contribution of the path up to here, divided by its probability */
+   Vector3f     throughput;
+
+   /* densities of sampling this node: from the one before it on its own path,
+      and from the one after it (as the other path would) */
+   real64       pdfForward;
+   real64       pdfReverse;
+};
+
+typedef struct Node Node;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static real64 square
+(
+   real64 r
+)
+{
+   return r * r;
+}
+
+
+/**
+ * Square of the ratio of a node's reverse probability density to its forward
+ * one (1 if it has none, being degenerate).
+ */
+static real64 pdfRatio2
+(
+   real64 reverse,
+   real64 forward
+)
+{
+   return (forward > 0.0) ? square( reverse / forward ) : 1.0;
+}
+
+
+/**
+ * Multiple importance sampling weight for sky sampling, by the power
+ * heuristic: from the ratio of the other (hemisphere sampling's) probability
+ * density to its own.
+ */
+static real64 skyWeight
+(
+   real64 pdfRatio
+)
+{
+   return 1.0 / (1.0 + square( pdfRatio ));
+}
+
+
+static Vector3f directionTo
+(
+   const Node* pFrom,
+   const Node* pTo
+)
+{
+   const Vector3f v = Vector3fSub( &pTo->point.position,
+      &pFrom->point.position );
+
+   return Vector3fUnitized( &v );
+}
+
+
+/**
+ * Probability density (per area) of choosing a point on an emitter, as
+ * SceneEmitter does (0 if the emitter is degenerate).
+ */
+static real64 emitterPdf
+(
+   const BidirectionalTracer* pB,
+   const SurfacePoint*        pEmitter
+)
+{
+   const real64 area = SurfacePointArea( pEmitter ) *
+      (real64)SceneEmittersCount( pB->pScene );
+
+   return (area > 0.0) ? 1.0 / area : 0.0;
+}
+
+
+/**
+ * Probability density (per area) of a path going on from a node to another,
+ * having come from a third -- or, if that is 0, of emitting from the node.
+ */
+static real64 nodePdf
+(
+   const Node* pFrom,
+   const Node* pNode,
+   const Node* pTo
+)
+{
+   const Vector3f toVector      = Vector3fSub( &pTo->point.position,
+      &pNode->point.position );
+   const real64   distance2     = Vector3fDot( &toVector, &toVector );
+   const Vector3f toDirection   = Vector3fUnitized( &toVector );
+   const Vector3f backDirection = Vector3fNegative( &toDirection );
+
+   real64 pdf;
+   if( pFrom )
+   {
+      const Vector3f fromDirection = directionTo( pNode, pFrom );
+      pdf = SurfacePointNextDirectionPdf( &pNode->point, &fromDirection,
+         &toDirection );
+   }
+   else
+   {
+      /* cosine-weighted, from front face only */
+      const real64 cosOut = SurfacePointCosine( &pNode->point, &toDirection );
+      pdf = (cosOut > 0.0) ? cosOut / PI : 0.0;
+   }
+
+   /* per solid angle to per area (with infinity clamped-out) */
+   return pdf * fabs( SurfacePointCosine( &pTo->point, &backDirection ) ) /
+      (distance2 >= 1e-6 ? distance2 : 1e-6);
+}
+
+
+/**
+ * Multiple importance sampling weight for a path made by joining the eye
+ * path's first t nodes to the emitter path's first s nodes -- by the power
+ * heuristic, over all the other joinings making the same path (but joining
+ * straight to the eye, which is not done).
+ */
+static real64 joinWeight
+(
+   const BidirectionalTracer* pB,
+   const Node                 aEye[],
+   int32                      t,
+   const Node                 aLight[],
+   int32                      s
+)
+{
+   const Node* pEye       = &aEye[t - 1];
+   const Node* pEyeBack   = &aEye[t - 2];
+   const Node* pLight     = (s > 0) ? &aLight[s - 1] : 0;
+   const Node* pLightBack = (s > 1) ? &aLight[s - 2] : 0;
+
+   /* reverse densities of the nodes at the join (and the ones before them),
+      as the join makes them -- the rest are as the paths were made */
+   const real64 eyeReverse       = pLight ? nodePdf( pLightBack, pLight,
+      pEye ) : emitterPdf( pB, &pEye->point );
+   const real64 eyeBackReverse   = (t > 3) ? nodePdf( pLight, pEye,
+      pEyeBack ) : 0.0;
+   const real64 lightReverse     = pLight ? nodePdf( pEyeBack, pEye, pLight ) :
+      0.0;
+   const real64 lightBackReverse = pLightBack ? nodePdf( pEye, pLight,
+      pLightBack ) : 0.0;
+
+   /* sum the other joinings' densities, relative to this one's: moving the
+      join toward the eye (as far as its second node), then toward the
+      emitter */
+   real64 sum = 0.0, ratio = 1.0;
+   int32  i;
+   for( i = t - 1;  i > 1;  --i )
+   {
+      ratio *= pdfRatio2( (i == t - 1) ? eyeReverse : ((i == t - 2) ?
+         eyeBackReverse : aEye[i].pdfReverse), aEye[i].pdfForward );
+      sum   += ratio;
+   }
+   ratio = 1.0;
+   for( i = s;  i-- > 0; )
+   {
+      ratio *= pdfRatio2( (i == s - 1) ? lightReverse : ((i == s - 2) ?
+         lightBackReverse : aLight[i].pdfReverse), aLight[i].pdfForward );
+      sum   += ratio;
+   }
+
+   return 1.0 / (1.0 + sum);
+}
+
+
+/**
+ * Whether a surface point is unshadowed from another.
+ */
+static bool isVisible
+(
+   const BidirectionalTracer* pB,
+   const SurfacePoint*        pFrom,
+   const Vector3f*            pDirection,
+   const SurfacePoint*        pTo
+)
+{
+   SurfacePoint hit;
+   STATS_COUNT( STATS_RAYS_SHADOW );
+
+   return !SceneIntersection( pB->pScene, &pFrom->position, pDirection, pFrom,
+      &hit ) || SurfacePointIsSame( pTo, &hit );
+}
+
+
+/**
+ * Make the emitter path.
+ *
+ * @return nodes made (0 if there are no emitters)
+ */
+static int32 lightPath
+(
+   const BidirectionalTracer* pB,
+   Random*                    pRandom,
+   Node                       aLight[]
+)
+{
+   int32 length = 0;
+
+   /* get position on an emitter, and direction from it */
+   if( SceneEmitter( pB->pScene, pRandom, &aLight[0].point ) &&
+      (emitterPdf( pB, &aLight[0].point ) > 0.0) )
+   {
+      Vector3f direction = SurfacePointEmitDirection( &aLight[0].point,
+         pRandom );
+
+      /* emission, divided by the probabilities of its point and direction
+         (the cosines cancel, leaving pi) */
+      const real64 pdf        = emitterPdf( pB, &aLight[0].point );
+      Vector3f     throughput = Vector3fMulF(
+         &aLight[0].point.pTriangle->pMaterial->emitivity, PI / pdf );
+
+      aLight[0].throughput = Vector3fMulF(
+         &aLight[0].point.pTriangle->pMaterial->emitivity, 1.0 / pdf );
+      aLight[0].pdfForward = pdf;
+      aLight[0].pdfReverse = 0.0;
+
+      for( length = 1;  length < BIDIRECTIONAL_NODES_MAX;  ++length )
+      {
+         Node*          pNode         = &aLight[length];
+         const Node*    pBack         = &aLight[length - 1];
+         const Vector3f backDirection = Vector3fNegative( &direction );
+         Vector3f       color;
+
+         STATS_COUNT( STATS_RAYS_BOUNCE );
+         if( !SceneIntersection( pB->pScene, &pBack->point.position,
+            &direction, &pBack->point, &pNode->point ) )
+         {
+            break;
+         }
+
+         pNode->throughput = throughput;
+         pNode->pdfForward = nodePdf( (length > 1) ? &aLight[length - 2] : 0,
+            pBack, pNode );
+         pNode->pdfReverse = 0.0;
+         if( length > 1 )
+         {
+            aLight[length - 2].pdfReverse = nodePdf( pNode, pBack,
+               &aLight[length - 2] );
+         }
+
+         /* reflect (as RayTracer does) */
+         if( !SurfacePointNextDirection( &pNode->point, pRandom,
+            &backDirection, &direction, &color ) )
+         {
+            ++length;
+            break;
+         }
+         throughput = Vector3fMulV( &throughput, &color );
+      }
+   }
+
+   return length;
+}
+
+
+/**
+ * Radiance, reflected to the eye path's node before, from joining the eye
+ * path's last node to a fresh emitter sample.
+ */
+static Vector3f joinEmitter
+(
+   const BidirectionalTracer* pB,
+   const Node                 aEye[],
+   int32                      t,
+   Random*                    pRandom
+)
+{
+   Vector3f radiance = Vector3fZERO;
+
+   const Node* pEye = &aEye[t - 1];
+   Node        emitter;
+
+   if( SceneEmitter( pB->pScene, pRandom, &emitter.point ) )
+   {
+      const Vector3f emitDirection     = directionTo( pEye, &emitter );
+      const Vector3f backEmitDirection = Vector3fNegative( &emitDirection );
+      const Vector3f backDirection     = directionTo( pEye, &aEye[t - 2] );
+
+      /* emission by solid angle, divided by the probability of choosing the
+         emitter */
+      const Vector3f emission = Vector3fMulF(
+         &emitter.point.pTriangle->pMaterial->emitivity,
+         SurfacePointSolidAngle( &emitter.point, &pEye->point.position,
+         &backEmitDirection ) * (real64)SceneEmittersCount( pB->pScene ) );
+
+      emitter.pdfForward = emitterPdf( pB, &emitter.point );
+      emitter.pdfReverse = 0.0;
+
+      radiance = SurfacePointReflection( &pEye->point, &emitDirection,
+         &emission, &backDirection );
+
+      if( !Vector3fIsZero( &radiance ) && isVisible( pB, &pEye->point,
+         &emitDirection, &emitter.point ) )
+      {
+         radiance = Vector3fMulV( &radiance, &pEye->throughput );
+         radiance = Vector3fMulF( &radiance, joinWeight( pB, aEye, t,
+            &emitter, 1 ) );
+      }
+      else
+      {
+         radiance = Vector3fZERO;
+      }
+   }
+
+   return radiance;
+}
+
+
+/**
+ * Radiance, reflected to the eye path's node before, from joining the eye
+ * path's last node to the emitter path's s-th node.
+ */
+static Vector3f join
+(
+   const BidirectionalTracer* pB,
+   const Node                 aEye[],
+   int32                      t,
+   const Node                 aLight[],
+   int32                      s
+)
+{
+   const Node*    pEye               = &aEye[t - 1];
+   const Node*    pLight             = &aLight[s - 1];
+   const Vector3f joinVector         = Vector3fSub( &pLight->point.position,
+      &pEye->point.position );
+   const real64   distance2          = Vector3fDot( &joinVector, &joinVector );
+   const Vector3f joinDirection      = Vector3fUnitized( &joinVector );
+   const Vector3f backJoinDirection  = Vector3fNegative( &joinDirection );
+   const Vector3f eyeBackDirection   = directionTo( pEye, &aEye[t - 2] );
+   const Vector3f lightBackDirection = directionTo( pLight, &aLight[s - 2] );
+
+   /* light at the emitter path's node, reflected to the eye path's node, and
+      reflected there (the ideal diffuse BRDF being symmetric, with each
+      node's cosine to the other), over the distance squared */
+   Vector3f radiance = SurfacePointReflection( &pLight->point,
+      &backJoinDirection, &pLight->throughput, &lightBackDirection );
+   radiance = SurfacePointReflection( &pEye->point, &joinDirection, &radiance,
+      &eyeBackDirection );
+
+   if( !Vector3fIsZero( &radiance ) && isVisible( pB, &pEye->point,
+      &joinDirection, &pLight->point ) )
+   {
+      radiance = Vector3fMulV( &radiance, &pEye->throughput );
+      radiance = Vector3fMulF( &radiance, joinWeight( pB, aEye, t, aLight,
+         s ) / (distance2 >= 1e-6 ? distance2 : 1e-6) );
+   }
+   else
+   {
+      radiance = Vector3fZERO;
+   }
+
+   return radiance;
+}
+
+
+/**
+ * Radiance, reflected to the eye path's node before, from a sky (or ground)
+ * sample at the eye path's last node.
+ */
+static Vector3f sampleSky
+(
+   const BidirectionalTracer* pB,
+   const Node                 aEye[],
+   int32                      t,
+   Random*                    pRandom
+)
+{
+   Vector3f radiance = Vector3fZERO;
+
+   const Node*    pEye          = &aEye[t - 1];
+   const Vector3f backDirection = directionTo( pEye, &aEye[t - 2] );
+
+   /* get direction, and check it faces the surface's ray side */
+   Vector3f     skyDirection;
+   const real64 pdf          = SceneSkyDirection( pB->pScene,
+      &pEye->point.position, pRandom, &skyDirection );
+   const real64 directionPdf = (pdf > 0.0) ? SurfacePointNextDirectionPdf(
+      &pEye->point, &backDirection, &skyDirection ) : 0.0;
+
+   if( directionPdf > 0.0 )
+   {
+      SurfacePoint hit;
+      bool         isHit;
+      STATS_COUNT( STATS_RAYS_SHADOW );
+      isHit = SceneIntersection( pB->pScene, &pEye->point.position,
+         &skyDirection, &pEye->point, &hit );
+
+      /* check if unshadowed */
+      if( !isHit )
+      {
+         const Vector3f backSkyDirection = Vector3fNegative( &skyDirection );
+         const Vector3f emission         = SceneDefaultEmission( pB->pScene,
+            &backSkyDirection );
+         const Vector3f emissionAll      = Vector3fMulF( &emission,
+            skyWeight( directionPdf / pdf ) / pdf );
+
+         radiance = SurfacePointReflection( &pEye->point, &skyDirection,
+            &emissionAll, &backDirection );
+         radiance = Vector3fMulV( &radiance, &pEye->throughput );
+      }
+   }
+
+   return radiance;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+BidirectionalTracer BidirectionalTracerCreate
+(
+   const Scene* pScene
+)
+{
+   BidirectionalTracer b;
+   b.pScene = pScene;
+
+   return b;
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+Vector3f BidirectionalTracerRadiance
+(
+   const BidirectionalTracer* pB,
+   const Vector3f*            pRayOrigin,
+   const Vector3f*            pRayDirection,
+   Random*                    pRandom
+)
+{
+   Vector3f radiance = Vector3fZERO;
+
+   const bool isSkyLight = SceneSkyProbability( pB->pScene ) > 0.0;
+
+   Node  aLight[BIDIRECTIONAL_NODES_MAX];
+   Node  aEye[BIDIRECTIONAL_NODES_MAX];
+   int32 lightsLength, t;
+
+   Vector3f direction    = *pRayDirection;
+   real64   directionPdf = 0.0;
+   Vector3f throughput   = Vector3fONE;
+
+   /* make the emitter path whole first */
+   lightsLength = lightPath( pB, pRandom, aLight );
+
+   /* start the eye path at the eye */
+   aEye[0].point.pTriangle = 0;
+   aEye[0].point.pInstance = 0;
+   aEye[0].point.position  = *pRayOrigin;
+   aEye[0].throughput      = Vector3fONE;
+   aEye[0].pdfForward      = 0.0;
+   aEye[0].pdfReverse      = 0.0;
+
+   /* advance the eye path a node at a time, joining each to the lights */
+   for( t = 2;  t <= BIDIRECTIONAL_NODES_MAX;  ++t )
+   {
+      Node*          pNode         = &aEye[t - 1];
+      const Node*    pBack         = &aEye[t - 2];
+      const Vector3f backDirection = Vector3fNegative( &direction );
+      bool           isHit;
+      Vector3f       color;
+
+      /* intersect ray with scene, making the next node */
+      STATS_COUNT( (t > 2) ? STATS_RAYS_BOUNCE : STATS_RAYS_PRIMARY );
+      isHit = SceneIntersection( pB->pScene, &pBack->point.position,
+         &direction, (t > 2) ? &pBack->point : 0, &pNode->point );
+
+      if( !isHit )
+      {
+         /* no hit: default/background scene emission (for first-hit whole,
+            else weighted against sky sampling finding the same light) */
+         const real64 pdf = ((t > 2) && isSkyLight) ? SceneSkyPdf( pB->pScene,
+            &pBack->point.position, &direction ) : 0.0;
+
+         Vector3f emission = SceneDefaultEmission( pB->pScene,
+            &backDirection );
+         if( pdf > 0.0 )
+         {
+            emission = Vector3fMulF( &emission, 1.0 - skyWeight( directionPdf
+               / pdf ) );
+         }
+         emission = Vector3fMulV( &emission, &throughput );
+         radiance = Vector3fAdd( &radiance, &emission );
+
+         break;
+      }
+
+      STATS_COUNT( STATS_PATH_VERTEXES );
+
+      pNode->throughput = throughput;
+      pNode->pdfForward = (t > 2) ? nodePdf( &aEye[t - 3], pBack, pNode ) :
+         0.0;
+      pNode->pdfReverse = 0.0;
+      if( t > 4 )
+      {
+         aEye[t - 3].pdfReverse = nodePdf( pNode, pBack, &aEye[t - 3] );
+      }
+
+      /* emitter hit */
+      if( !Vector3fIsZero( &pNode->point.pTriangle->pMaterial->emitivity ) )
+      {
+         Vector3f emission = SurfacePointEmission( &pNode->point,
+            &pBack->point.position, &backDirection, false );
+         if( !Vector3fIsZero( &emission ) )
+         {
+            emission = Vector3fMulV( &emission, &throughput );
+            emission = Vector3fMulF( &emission, joinWeight( pB, aEye, t,
+               aLight, 0 ) );
+            radiance = Vector3fAdd( &radiance, &emission );
+         }
+      }
+
+      /* joins to the lights: sky, an emitter sample, and the emitter path */
+      STATS_TIMER_BEGIN( STATS_PHASE_EMITTERS )
+      {
+         Vector3f joined = joinEmitter( pB, aEye, t, pRandom );
+         int32    s;
+
+         if( isSkyLight )
+         {
+            const Vector3f sky = sampleSky( pB, aEye, t, pRandom );
+            joined = Vector3fAdd( &joined, &sky );
+         }
+
+         for( s = 2;  s <= lightsLength;  ++s )
+         {
+            const Vector3f light = join( pB, aEye, t, aLight, s );
+            joined = Vector3fAdd( &joined, &light );
+         }
+
+         radiance = Vector3fAdd( &radiance, &joined );
+      }
+      STATS_TIMER_END( STATS_PHASE_EMITTERS )
+
+      /* reflect (as RayTracer does) */
+      if( !SurfacePointNextDirection( &pNode->point, pRandom, &backDirection,
+         &direction, &color ) )
+      {
+         break;
+      }
+      directionPdf = SurfacePointNextDirectionPdf( &pNode->point,
+         &backDirection, &direction );
+      throughput   = Vector3fMulV( &throughput, &color );
+   }
+
+   return radiance;
+}
@@ -0,0 +1,97 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef BidirectionalTracer_h
+#define BidirectionalTracer_h
+
+
+#include "Random.h"
+#include "Vector3f.h"
+#include "Scene.h"
+
+
+
+
+/**
+ * Bidirectional path tracer: an alternative to RayTracer, for light that is
+ * hard to reach from the eye (small, enclosed, or only indirectly seen
+ * emitters).<br/><br/>
+ *
+ * Each trace makes two paths: one from an emitter (chosen, and a point on it,
+ * as for emitter sampling, then going in a cosine-weighted direction), and
+ * one from the eye. Every node of the eye path is joined, by a shadow ray, to
+ * every node of the emitter path -- and to a fresh emitter sample, and to any
+ * emitter it hits. All those ways of making the same path are weighted by
+ * multiple importance sampling (the power heuristic, of their probability
+ * densities over surface area).<br/><br/>
+ *
+ * Joining emitter paths directly to the eye (splatting onto other pixels) is
+ * not done, so each sample stays its own pixel's.<br/><br/>
+ *
+ * The sky (and ground) is a light only to the eye path: by sampling it at each
+ * node, and by escaping to it, weighted against each other (as RayTracer
+ * does).<br/><br/>
+ *
+ * Paths are cut at BIDIRECTIONAL_NODES_MAX nodes each way -- losing as good as
+ * nothing, with reflectivities under 0.9.<br/><br/>
+ *
+ * Constant.
+ *
+ * @invariants
+ * * pScene is not 0
+ */
+
+struct BidirectionalTracer
+{
+   const Scene* pScene;
+};
+
+typedef struct BidirectionalTracer BidirectionalTracer;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+BidirectionalTracer BidirectionalTracerCreate
+(
+   const Scene*
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Radiance returned from a trace.
+ */
+Vector3f BidirectionalTracerRadiance
+(
+   const BidirectionalTracer*,
+   const Vector3f*            pRayOrigin,
+   const Vector3f*            pRayDirection,
+   Random*                    pRandom
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Most nodes of each path (the eye's counting the eye).
+ */
+#define BIDIRECTIONAL_NODES_MAX 64
+
+
+
+
+#endif
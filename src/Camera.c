@@ -12,74 +12,158 @@
 
 #include "Exceptions.h"
 #include "RayTracer.h"
+#include "BidirectionalTracer.h"
 
 #include "Camera.h"
 
 
 
 
-/* initialisation ----------------------------------------------------------- */
+/* implementation ----------------------------------------------------------- */
 
-Camera CameraCreate
+/**
+ * Condition view direction, and make the rest of the view frame from it.
+ */
+static void makeViewFrame
 (
-   FILE*   pIn,
-   jmp_buf jmpBuf
+   Camera* pC
 )
 {
-   Camera c;
-
    const Vector3f Y = {{ 0.0, 1.0, 0.0 }};
    const Vector3f Z = {{ 0.0, 0.0, 1.0 }};
 
-   /* read and condition view definition */
+   pC->viewDirection = Vector3fUnitized( &pC->viewDirection );
+   /* if degenerate, default to Z */
+   if( Vector3fIsZero( &pC->viewDirection ) )
    {
-      real32 viewAngleF = 0.0f;
-      c.viewPosition  = Vector3fRead( pIn, jmpBuf );
-      c.viewDirection = Vector3fRead( pIn, jmpBuf );
-      throwReadExceptions( pIn, jmpBuf, 1, fscanf( pIn, "%g", &viewAngleF ) );
-      c.viewAngle = (real64)viewAngleF;
-
-      c.viewDirection = Vector3fUnitized( &c.viewDirection );
-      /* if degenerate, default to Z */
-      if( Vector3fIsZero( &c.viewDirection ) )
-      {
-         c.viewDirection = Z;
-      }
-
-      /* clamp and convert to radians */
-      c.viewAngle = (c.viewAngle < VIEW_ANGLE_MIN ? VIEW_ANGLE_MIN :
-         (c.viewAngle > VIEW_ANGLE_MAX ? VIEW_ANGLE_MAX : c.viewAngle)) *
-         (3.14159265358979 / 180.0);
+      pC->viewDirection = Z;
    }
 
    /* make other directions of view coord frame */
    {
       /* make trial 'right', using viewDirection and assuming 'up' is Y */
-      const Vector3f uxv = Vector3fCross( &Y, &c.viewDirection );
-      c.up    = Y;
-      c.right = Vector3fUnitized( &uxv );
+      const Vector3f uxv = Vector3fCross( &Y, &pC->viewDirection );
+      pC->up    = Y;
+      pC->right = Vector3fUnitized( &uxv );
 
       /* check 'right' is valid
          -- i.e. viewDirection was not co-linear with 'up' */
-      if( !Vector3fIsZero( &c.right ) )
+      if( !Vector3fIsZero( &pC->right ) )
       {
          /* use 'right', and make 'up' properly orthogonal */
-         const Vector3f vxr = Vector3fCross( &c.viewDirection, &c.right );
-         c.up = Vector3fUnitized( &vxr );
+         const Vector3f vxr = Vector3fCross( &pC->viewDirection, &pC->right );
+         pC->up = Vector3fUnitized( &vxr );
       }
       /* else, assume a different 'up' and redo */
       else
       {
          /* 'up' is Z if viewDirection is down, otherwise -Z */
-         const Vector3f z = c.viewDirection.xyz[1] < 0.0 ?
+         const Vector3f z = pC->viewDirection.xyz[1] < 0.0 ?
             Z : Vector3fNegative( &Z );
          /* remake 'right' */
-         const Vector3f uxv = Vector3fCross( &z, &c.viewDirection );
-         c.up    = z;
-         c.right = Vector3fUnitized( &uxv );
+         const Vector3f uxv = Vector3fCross( &z, &pC->viewDirection );
+         pC->up    = z;
+         pC->right = Vector3fUnitized( &uxv );
+      }
+   }
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+Camera CameraCreate
+(
+   FILE*   pIn,
+   jmp_buf jmpBuf
+)
+{
+   /* read view definition */
+   real32 viewAngleF = 0.0f;
+   const Vector3f viewPosition  = Vector3fRead( pIn, jmpBuf );
+   const Vector3f viewDirection = Vector3fRead( pIn, jmpBuf );
+   throwReadExceptions( pIn, jmpBuf, 1, fscanf( pIn, "%g", &viewAngleF ) );
+
+   return CameraCreateView( &viewPosition, &viewDirection,
+      (real64)viewAngleF );
+}
+
+
+Camera CameraCreateView
+(
+   const Vector3f* pViewPosition,
+   const Vector3f* pViewDirection,
+   real64          viewAngle
+)
+{
+   Camera c;
+
+   /* condition view definition */
+   c.viewPosition  = *pViewPosition;
+   c.viewDirection = *pViewDirection;
+
+   /* clamp and convert to radians */
+   c.viewAngle = (viewAngle < VIEW_ANGLE_MIN ? VIEW_ANGLE_MIN :
+      (viewAngle > VIEW_ANGLE_MAX ? VIEW_ANGLE_MAX : viewAngle)) *
+      (3.14159265358979 / 180.0);
+
+   makeViewFrame( &c );
+
+   return c;
+}
+
+
+Camera CameraCreateOnPath
+(
+   const Camera aKeys[],
+   int32        keysLength,
+   real64       t
+)
+{
+   Camera c;
+
+   /* find segment, and position in it */
+   const int32  last    = keysLength - 1;
+   const real64 segment = (t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t)) *
+      (real64)last;
+   const int32  k       = (int32)segment < last ? (int32)segment : last;
+   const real64 u       = segment - (real64)k;
+
+   /* the segment's two keys, and their neighbours (repeated at ends) */
+   const Camera* k0 = &aKeys[k > 0 ? k - 1 : 0];
+   const Camera* k1 = &aKeys[k];
+   const Camera* k2 = &aKeys[k < last ? k + 1 : last];
+   const Camera* k3 = &aKeys[(k + 1) < last ? k + 2 : last];
+
+   /* position: Catmull-Rom spline through the keys (smooth motion) */
+   {
+      const real64 u2 = u * u, u3 = u2 * u;
+      const real64 w0 = 0.5 * (-u3 + (2.0 * u2) - u);
+      const real64 w1 = 0.5 * ((3.0 * u3) - (5.0 * u2) + 2.0);
+      const real64 w2 = 0.5 * ((-3.0 * u3) + (4.0 * u2) + u);
+      const real64 w3 = 0.5 * (u3 - u2);
+      int i;
+
+      for( i = 3;  i-- > 0; )
+      {
+         c.viewPosition.xyz[i] = (w0 * k0->viewPosition.xyz[i]) +
+            (w1 * k1->viewPosition.xyz[i]) + (w2 * k2->viewPosition.xyz[i]) +
+            (w3 * k3->viewPosition.xyz[i]);
       }
    }
 
+   /* direction and angle: linear between the segment's keys */
+   {
+      const Vector3f d1 = Vector3fMulF( &k1->viewDirection, 1.0 - u );
+      const Vector3f d2 = Vector3fMulF( &k2->viewDirection, u );
+      c.viewDirection = Vector3fAdd( &d1, &d2 );
+
+      c.viewAngle = (k1->viewAngle * (1.0 - u)) + (k2->viewAngle * u);
+   }
+
+   makeViewFrame( &c );
+
    return c;
 }
 
@@ -88,55 +172,102 @@ Camera CameraCreate
 
 /* queries ------------------------------------------------------------------ */
 
-void CameraFrame
+Vector3f CameraSampleDirection
 (
    const Camera* pC,
-   const Scene*  pScene,
-   Random*       pRandom,
-   Image*        pImage_o
+   const Image*  pImage,
+   int32         x,
+   int32         y,
+   Random*       pRandom
 )
 {
-   const RayTracer rayTracer = RayTracerCreate( pScene );
+   const real64 width   = (real64)pImage->width;
+   const real64 height  = (real64)pImage->height;
+   const real64 tanView = tan( pC->viewAngle * 0.5 );
 
-   const real64 width  = (real64)pImage_o->width;
-   const real64 height = (real64)pImage_o->height;
+   /* make image plane XY displacement vector [-1,+1) coefficients, with
+      sub-pixel jitter */
+   const real64 cx = (( ((real64)x + RandomReal64( pRandom )) * 2.0 / width  )
+      - 1.0) * tanView;
+   const real64 cy = (( ((real64)y + RandomReal64( pRandom )) * 2.0 / height )
+      - 1.0) * tanView * (height / width);
 
-   /* step through image pixels, sampling them */
-   int32 y, x;
-   for( y = pImage_o->height;  y-- > 0; )
+   /* make image plane offset vector, by scaling the view definition by the
+      coefficients */
+   const Vector3f rcx    = Vector3fMulF( &pC->right, cx );
+   const Vector3f ucy    = Vector3fMulF( &pC->up,    cy );
+   const Vector3f offset = Vector3fAdd( &rcx, &ucy );
+
+   /* add image offset vector to view direction */
+   const Vector3f sdv = Vector3fAdd( &pC->viewDirection, &offset );
+   return Vector3fUnitized( &sdv );
+}
+
+
+void CameraFrame
+(
+   const Camera*    pC,
+   const Scene*     pScene,
+   bool             isTiled,
+   bool             isBidirectional,
+   IrradianceCache* pCache,
+   PathGuide*       pGuide,
+   Random*          pRandom,
+   Image*           pImage_o
+)
+{
+   const RayTracer           rayTracer           = RayTracerCreateGuided(
+      pScene, pGuide );
+   const BidirectionalTracer bidirectionalTracer =
+      BidirectionalTracerCreate( pScene );
+
+   /* pixel width at unit distance (for the irradiance cache) */
+   const real64 pixelWidth = 2.0 * tan( pC->viewAngle * 0.5 ) /
+      (real64)pImage_o->width;
+
+   /* region bounds (y here is bottom-left origin) */
+   const int32 x0 = pImage_o->aRegion[0];
+   const int32 x1 = pImage_o->aRegion[2];
+   const int32 y0 = pImage_o->height - pImage_o->aRegion[3];
+   const int32 y1 = pImage_o->height - pImage_o->aRegion[1];
+
+   /* rows are tiles a region wide */
+   const int32 tileWidth  = isTiled ? CAMERA_TILE_SIZE : (x1 - x0);
+   const int32 tileHeight = isTiled ? CAMERA_TILE_SIZE : 1;
+
+   /* step through image region pixels, by tiles, sampling them */
+   int32 ty, tx, y, x;
+   for( ty = y1;  ty > y0;  ty -= tileHeight )
    {
-      for( x = pImage_o->width;  x-- > 0; )
+      for( tx = x1;  tx > x0;  tx -= tileWidth )
       {
-         /* make sample ray direction, stratified by pixels */
-         Vector3f sampleDirection;
+         for( y = ty;  y-- > ((ty - tileHeight) > y0 ? (ty - tileHeight) :
+            y0); )
          {
-            const real64 tanView = tan( pC->viewAngle * 0.5 );
-
-            /* make image plane XY displacement vector [-1,+1) coefficients,
-               with sub-pixel jitter */
-            const real64 cx = (( ((real64)x + RandomReal64( pRandom )) *
-               2.0 / width  ) - 1.0) * tanView;
-            const real64 cy = (( ((real64)y + RandomReal64( pRandom )) *
-               2.0 / height ) - 1.0) * tanView * (height / width);
-
-            /* make image plane offset vector,
-               by scaling the view definition by the coefficients */
-            const Vector3f rcx    = Vector3fMulF( &pC->right, cx );
-            const Vector3f ucy    = Vector3fMulF( &pC->up,    cy );
-            const Vector3f offset = Vector3fAdd( &rcx, &ucy );
-
-            /* add image offset vector to view direction */
-            const Vector3f sdv = Vector3fAdd( &pC->viewDirection, &offset );
-            sampleDirection = Vector3fUnitized( &sdv );
-         }
+            for( x = tx;  x-- > ((tx - tileWidth) > x0 ? (tx - tileWidth) :
+               x0); )
+            {
+               /* make sample ray direction, stratified by pixels */
+               const Vector3f sampleDirection = CameraSampleDirection( pC,
+                  pImage_o, x, y, pRandom );
 
-         {
-            /* get radiance from RayTracer */
-            const Vector3f radiance = RayTracerRadiance( &rayTracer,
-               &pC->viewPosition, &sampleDirection, pRandom, 0 );
+               {
+                  /* get radiance from RayTracer (or BidirectionalTracer,
+                     or IrradianceCache) */
+                  const Vector3f radiance = pCache ?
+                     IrradianceCacheRadiance( pCache, &pC->viewPosition,
+                     &sampleDirection, pixelWidth, pImage_o->width,
+                     pRandom ) :
+                     (isBidirectional ?
+                     BidirectionalTracerRadiance( &bidirectionalTracer,
+                     &pC->viewPosition, &sampleDirection, pRandom ) :
+                     RayTracerRadiance( &rayTracer, &pC->viewPosition,
+                     &sampleDirection, pRandom ));
 
-            /* add radiance to image */
-            ImageAddToPixel( pImage_o, x, y, &radiance );
+                  /* add radiance to image */
+                  ImageAddToPixel( pImage_o, x, y, &radiance );
+               }
+            }
          }
       }
    }
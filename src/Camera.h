@@ -19,6 +19,8 @@
 #include "Vector3f.h"
 #include "Image.h"
 #include "Scene.h"
+#include "IrradianceCache.h"
+#include "PathGuide.h"
 
 
 
@@ -26,7 +28,8 @@
 /**
  * View definition and rasterizer.<br/><br/>
  *
- * CameraFrame() accumulates a frame to the image.<br/><br/>
+ * CameraFrame() accumulates a frame to the image (or just to its
+ * region).<br/><br/>
  *
  * Constant.
  *
@@ -63,6 +66,31 @@ Camera CameraCreate
    jmp_buf jmpBuf
 );
 
+/**
+ * @param viewAngle in degrees
+ */
+Camera CameraCreateView
+(
+   const Vector3f* pViewPosition,
+   const Vector3f* pViewDirection,
+   real64          viewAngle
+);
+
+/**
+ * Camera at a point along a path through key cameras (spaced evenly in t):
+ * position on a smooth spline through the keys' positions, direction and
+ * angle interpolated linearly.
+ *
+ * @param keysLength at least one
+ * @param t from 0 (first key) to 1 (last key)
+ */
+Camera CameraCreateOnPath
+(
+   const Camera aKeys[],
+   int32        keysLength,
+   real64       t
+);
+
 
 
 
@@ -73,15 +101,40 @@ Camera CameraCreate
  */
 #define CameraEyePoint( pC ) ((pC)->viewPosition)
 
+/**
+ * Direction of a sample ray through a pixel (jittered within it).
+ *
+ * @param x y pixel of the image's whole frame, with bottom-left origin
+ */
+Vector3f CameraSampleDirection
+(
+   const Camera*,
+   const Image*  pImage,
+   int32         x,
+   int32         y,
+   Random*       pRandom
+);
+
 /**
  * Accumulate a frame of samples to the image.
+ *
+ * @param isTiled whether to step through pixels in square tiles (for locality
+ *        of the geometry reached), instead of rows
+ * @param isBidirectional whether to trace by BidirectionalTracer, instead of
+ *        RayTracer
+ * @param pCache irradiance cache to trace by instead (adding to it), or 0
+ * @param pGuide path guide for RayTracer to sample by (and teach), or 0
  */
 void CameraFrame
 (
    const Camera*,
-   const Scene*  pScene,
-   Random*       pRandom,
-   Image*        pImage_o
+   const Scene*     pScene,
+   bool             isTiled,
+   bool             isBidirectional,
+   IrradianceCache* pCache,
+   PathGuide*       pGuide,
+   Random*          pRandom,
+   Image*           pImage_o
 );
 
 
@@ -95,6 +148,11 @@ void CameraFrame
 #define VIEW_ANGLE_MIN  10.0
 #define VIEW_ANGLE_MAX 160.0
 
+/**
+ * Pixels square, of tiles, when stepping through by them.
+ */
+#define CAMERA_TILE_SIZE 16
+
 
 
 
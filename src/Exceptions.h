@@ -60,8 +60,14 @@ void throwExceptions
 
 /* constants ---------------------------------------------------------------- */
 
+/* (values are also the library status codes, in MiniLightLib.h) */
+
 #define ERROR_UNSPECIFIED  -1
 
+#define ERROR_FORMAT_UNREC  1
+#define ERROR_ARGUMENT      2
+#define ERROR_FILE        128
+
 #define ERROR_READ_IO     256
 #define ERROR_READ_TRUNC  257
 #define ERROR_READ_INVAL  258
@@ -70,6 +76,10 @@ void throwExceptions
 
 #define ERROR_ALLOC       512
 
+#define ERROR_PROCESS     640
+
+#define ERROR_STATE       768
+
 
 
 
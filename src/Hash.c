@@ -0,0 +1,74 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "Hash.h"
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+long64u HashBytes
+(
+   const void* pBytes,
+   size_t      length,
+   long64u     hash
+)
+{
+   const byteu* p = (const byteu*)pBytes;
+   for( ;  length-- > 0;  hash *= HASH_PRIME )
+   {
+      hash ^= (long64u)*(p++);
+   }
+
+   return hash;
+}
+
+
+void HashWrite
+(
+   long64u hash,
+   char*   sHex_o
+)
+{
+   /* (in halves, since C89 printf has no long long conversion) */
+   sprintf( sHex_o, "%08lx%08lx", (unsigned long)(hash >> 32),
+      (unsigned long)(hash & 0xFFFFFFFFUL) );
+}
+
+
+bool HashRead
+(
+   const char* sHex,
+   long64u*    pHash_o
+)
+{
+   static const char DIGITS[] = "0123456789abcdef";
+
+   const size_t length = strlen( sHex );
+   size_t       i;
+
+   *pHash_o = 0;
+   for( i = 0;  i < length;  ++i )
+   {
+      const char* pDigit = strchr( DIGITS, tolower( (unsigned char)sHex[i] ) );
+      if( !pDigit )
+      {
+         return false;
+      }
+      *pHash_o = (*pHash_o << 4) | (long64u)(pDigit - DIGITS);
+   }
+
+   return (length > 0) && (length <= 16);
+}
@@ -0,0 +1,84 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Hash_h
+#define Hash_h
+
+
+#include <stddef.h>
+
+#include "Primitives.h"
+
+
+
+
+/**
+ * Hash of bytes: FNV-1a, 64 bit.<br/><br/>
+ *
+ * For naming and finding scenes (in SceneCache and Server) -- not for
+ * security.
+ *
+ * @implementation
+ * http://www.isthe.com/chongo/tech/comp/fnv/
+ */
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/* start value (offset basis), and multiplier (prime) -- (built from 32-bit
+   halves, since C89 has no 64-bit literals) */
+#define HASH_START (((long64u)0xCBF29CE4UL << 32) | 0x84222325UL)
+#define HASH_PRIME (((long64u)0x00000100UL << 32) | 0x000001B3UL)
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Continue a hash with more bytes.
+ *
+ * @param hash HASH_START, or a hash to continue
+ */
+long64u HashBytes
+(
+   const void* pBytes,
+   size_t      length,
+   long64u     hash
+);
+
+/**
+ * Write a hash as 16 hex digits.
+ *
+ * @param sHex_o at least 17 chars
+ */
+void HashWrite
+(
+   long64u hash,
+   char*   sHex_o
+);
+
+/**
+ * Read a hash from (1 to 16) hex digits, as all the string.
+ *
+ * @return whether it was valid
+ */
+bool HashRead
+(
+   const char* sHex,
+   long64u*    pHash_o
+);
+
+
+
+
+#endif
@@ -10,6 +10,7 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "Exceptions.h"
 
@@ -23,6 +24,9 @@
 /* image file comment */
 static const char MINILIGHT_URI[] = "http://www.hxa.name/minilight";
 
+/* ITU-R BT.709 standard RGB luminance weighting */
+static const Vector3f RGB_LUMINANCE = {{ 0.2126, 0.7152, 0.0722 }};
+
 
 
 
@@ -69,6 +73,28 @@ static int32u toRgbe
 }
 
 
+/**
+ * Convert 32bit RGBE format into FP RGB.
+ */
+static Vector3f fromRgbe
+(
+   const byteu rgbe[4]
+)
+{
+   Vector3f rgb = Vector3fZERO;
+
+   if( rgbe[3] > 0 )
+   {
+      const real64 amount = ldexp( 1.0, (int)rgbe[3] - (128 + 8) );
+
+      int i;
+      for( i = 3;  i-- > 0;  rgb.xyz[i] = ((real64)rgbe[i] + 0.5) * amount ) {}
+   }
+
+   return rgb;
+}
+
+
 
 
 /* initialisation ----------------------------------------------------------- */
@@ -92,9 +118,41 @@ Image* ImageConstruct
    pI->height = pI->height < 1 ? 1 :
       (pI->height > IMAGE_DIM_MAX ? IMAGE_DIM_MAX : pI->height);
 
+   /* whole frame region */
+   pI->aRegion[0] = 0;
+   pI->aRegion[1] = 0;
+   pI->aRegion[2] = pI->width;
+   pI->aRegion[3] = pI->height;
+
    /* allocate pixels */
    pI->aPixels = (Vector3f*)throwAllocExceptions( jmpBuf,
-      calloc( pI->width * pI->height, sizeof(Vector3f) ) );
+      calloc( ImageRegionLength( pI ), sizeof(Vector3f) ) );
+
+   return pI;
+}
+
+
+Image* ImageConstructBlank
+(
+   const Image* pOther,
+   jmp_buf      jmpBuf
+)
+{
+   Image* pI = (Image*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(Image) ) );
+
+   pI->width  = pOther->width;
+   pI->height = pOther->height;
+   memcpy( pI->aRegion, pOther->aRegion, sizeof(pI->aRegion) );
+
+   /* allocate pixels */
+   pI->aPixels = (Vector3f*)throwAllocExceptions( jmpBuf,
+      calloc( ImageRegionLength( pI ), sizeof(Vector3f) ) );
+
+   if( pOther->aSquares )
+   {
+      ImageTrackNoise( pI, jmpBuf );
+   }
 
    return pI;
 }
@@ -106,6 +164,7 @@ void ImageDestruct
 )
 {
    /* free pixels */
+   free( pI->aSquares );
    free( pI->aPixels );
 
    free( pI );
@@ -116,6 +175,111 @@ void ImageDestruct
 
 /* commands ----------------------------------------------------------------- */
 
+bool ImageSetRegion
+(
+   Image*      pI,
+   jmp_buf     jmpBuf,
+   const int32 aRegion[4]
+)
+{
+   int32 aClamped[4];
+   bool  isSet;
+
+   /* clamp to frame */
+   int i;
+   for( i = 4;  i-- > 0; )
+   {
+      const int32 max = (i & 1) ? pI->height : pI->width;
+      aClamped[i] = aRegion[i] < 0 ? 0 :
+         (aRegion[i] > max ? max : aRegion[i]);
+   }
+
+   isSet = (aClamped[2] > aClamped[0]) & (aClamped[3] > aClamped[1]);
+   if( isSet )
+   {
+      for( i = 4;  i-- > 0;  pI->aRegion[i] = aClamped[i] ) {}
+
+      /* reallocate pixels */
+      free( pI->aPixels );
+      pI->aPixels = 0;
+      pI->aPixels = (Vector3f*)throwAllocExceptions( jmpBuf,
+         calloc( ImageRegionLength( pI ), sizeof(Vector3f) ) );
+   }
+
+   return isSet;
+}
+
+
+void ImageTrackNoise
+(
+   Image*  pI,
+   jmp_buf jmpBuf
+)
+{
+   if( !pI->aSquares )
+   {
+      pI->aSquares = (real64*)throwAllocExceptions( jmpBuf,
+         calloc( ImageRegionLength( pI ), sizeof(real64) ) );
+   }
+}
+
+
+int32 ImageAddFormatted
+(
+   Image*  pI,
+   jmp_buf jmpBuf,
+   FILE*   pIn
+)
+{
+   int32 iteration = 0;
+
+   /* read header */
+   {
+      char  line[256];
+      int32 width = 0, height = 0;
+
+      /* ID, then variables until blank line */
+      throwReadExceptions( pIn, jmpBuf, 1,
+         (0 != fgets( line, sizeof(line), pIn )) );
+      throwExceptions( jmpBuf, !!strncmp( line, "#?RADIANCE", 10 ),
+         ERROR_READ_INVAL );
+      do
+      {
+         throwReadExceptions( pIn, jmpBuf, 1,
+            (0 != fgets( line, sizeof(line), pIn )) );
+         sscanf( line, "ITERATION=%i", &iteration );
+      }
+      while( '\n' != line[0] );
+
+      /* width, height -- must match region */
+      throwReadExceptions( pIn, jmpBuf, 2,
+         fscanf( pIn, "-Y %i +X %i", &height, &width ) );
+      throwExceptions( jmpBuf, ('\n' != fgetc( pIn )) |
+         (width != ImageRegionWidth( pI )) |
+         (height != ImageRegionHeight( pI )) | (iteration < 1),
+         ERROR_READ_INVAL );
+   }
+
+   /* read pixels, and add with iterations weighting */
+   {
+      int32 i;
+      for( i = 0;  i < ImageRegionLength( pI );  ++i )
+      {
+         byteu rgbe[4];
+         throwReadExceptions( pIn, jmpBuf, 4,
+            (int)fread( rgbe, 1, sizeof(rgbe), pIn ) );
+         {
+            const Vector3f rgb = fromRgbe( rgbe );
+            const Vector3f sum = Vector3fMulF( &rgb, (real64)iteration );
+            pI->aPixels[i] = Vector3fAdd( &pI->aPixels[i], &sum );
+         }
+      }
+   }
+
+   return iteration;
+}
+
+
 void ImageAddToPixel
 (
    Image*          pI,
@@ -124,11 +288,22 @@ void ImageAddToPixel
    const Vector3f* pRadiance
 )
 {
-   /* only inside image bounds */
-   if( (x >= 0) & (x < pI->width) & (y >= 0) & (y < pI->height) )
+   /* flip to top-left origin */
+   y = pI->height - 1 - y;
+
+   /* only inside region bounds */
+   if( (x >= pI->aRegion[0]) & (x < pI->aRegion[2]) &
+      (y >= pI->aRegion[1]) & (y < pI->aRegion[3]) )
    {
-      const int32 index = x + ((pI->height - 1 - y) * pI->width);
+      const int32 index = (x - pI->aRegion[0]) +
+         ((y - pI->aRegion[1]) * ImageRegionWidth( pI ));
       pI->aPixels[index] = Vector3fAdd( &pI->aPixels[index], pRadiance );
+
+      if( pI->aSquares )
+      {
+         const real64 luminance = Vector3fDot( pRadiance, &RGB_LUMINANCE );
+         pI->aSquares[index] += luminance * luminance;
+      }
    }
 }
 
@@ -161,17 +336,26 @@ void ImageFormatted
       throwWriteExceptions( pOut_o, jmpBuf,
          fprintf( pOut_o, "SOFTWARE=%s\n", MINILIGHT_URI ) );
       throwWriteExceptions( pOut_o, jmpBuf,
-         fprintf( pOut_o, "ITERATION=%i\n\n", iteration ) );
+         fprintf( pOut_o, "ITERATION=%i\n", iteration ) );
 
-      /* write width, height */
+      /* write placement in frame, if a tile */
+      if( ImageIsTile( pI ) )
+      {
+         throwWriteExceptions( pOut_o, jmpBuf,
+            fprintf( pOut_o, "TILE=%i %i %i %i\n", pI->aRegion[0],
+            pI->aRegion[1], pI->width, pI->height ) );
+      }
+
+      /* write width, height (of region) */
       throwWriteExceptions( pOut_o, jmpBuf,
-         fprintf( pOut_o, "-Y %i +X %i\n", pI->height, pI->width ) );
+         fprintf( pOut_o, "\n-Y %i +X %i\n", ImageRegionHeight( pI ),
+         ImageRegionWidth( pI ) ) );
    }
 
    /* write pixels */
    {
       int32 i, b;
-      for( i = 0;  i < (pI->width * pI->height);  ++i )
+      for( i = 0;  i < ImageRegionLength( pI );  ++i )
       {
          const Vector3f pd   = Vector3fMulF( &pI->aPixels[i], divider );
          const int32u   rgbe = toRgbe( &pd );
@@ -185,3 +369,65 @@ void ImageFormatted
       }
    }
 }
+
+
+void ImageRgbe
+(
+   const Image* pI,
+   int32        iteration,
+   byteu*       aRgbe_o
+)
+{
+   const real64 divider = 1.0 / (real64)(iteration >= 1 ? iteration : 1);
+
+   int32 i, b;
+   for( i = ImageRegionLength( pI );  i-- > 0; )
+   {
+      const Vector3f pd   = Vector3fMulF( &pI->aPixels[i], divider );
+      const int32u   rgbe = toRgbe( &pd );
+
+      for( b = 4;  b-- > 0; )
+      {
+         aRgbe_o[(i * 4) + (3 - b)] = (byteu)((rgbe >> (b * 8)) & 0xFFu);
+      }
+   }
+}
+
+
+real64 ImageNoise
+(
+   const Image* pI,
+   int32        iteration
+)
+{
+   real64 noise = REAL64_MAX;
+
+   if( pI->aSquares && (iteration > 1) )
+   {
+      const real64 n = (real64)iteration;
+
+      real64 varianceSum = 0.0, meanSum = 0.0;
+      int32 i;
+      for( i = ImageRegionLength( pI );  i-- > 0; )
+      {
+         /* sample mean and (unbiased) sample variance of the pixel */
+         const real64 mean     = Vector3fDot( &pI->aPixels[i], &RGB_LUMINANCE )
+            / n;
+         const real64 variance = (pI->aSquares[i] - (mean * mean * n)) /
+            (n - 1.0);
+
+         /* variance of the mean is variance over sample count */
+         varianceSum += (variance > 0.0 ? variance : 0.0) / n;
+         meanSum     += mean;
+      }
+
+      /* RMS of standard errors, relative to mean of means */
+      if( meanSum > 0.0 )
+      {
+         const real64 pixelsCount = (real64)ImageRegionLength( pI );
+         noise = sqrt( varianceSum / pixelsCount ) / (meanSum / pixelsCount);
+      }
+   }
+
+   return noise;
+}
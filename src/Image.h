@@ -28,20 +28,36 @@
  * <cite>http://radsite.lbl.gov/radiance/refer/filefmts.pdf</cite>
  * <cite>'Real Pixels'; Ward; Graphics Gems 2, AP; 1991.</cite><br/><br/>
  *
+ * Can optionally track the spread of the samples, to estimate noise.<br/><br/>
+ *
+ * Can hold just a rectangular region of the whole frame (a tile), which is
+ * then written with a TILE=x0 y0 width height header variable giving its
+ * placement in the frame.<br/><br/>
+ *
  * Mutable.
  *
  * @invariants
  * * width  >= 1 and <= IMAGE_DIM_MAX
  * * height >= 1 and <= IMAGE_DIM_MAX
- * * aPixels length == (width * height)
+ * * aRegion is x0 y0 x1 y1: top-left (inclusive) and bottom-right (exclusive)
+ *   pixel corners, within width and height, and not empty
+ * * aPixels length == ImageRegionLength
+ * * aSquares is 0, or length == ImageRegionLength
  */
 
 struct Image
 {
+   /* whole frame */
    int32     width;
    int32     height;
 
+   /* held part of frame */
+   int32     aRegion[4];
+
    Vector3f* aPixels;
+
+   /* sums of squared sample luminances, if tracking noise */
+   real64*   aSquares;
 };
 
 typedef struct Image Image;
@@ -57,6 +73,16 @@ Image* ImageConstruct
    jmp_buf jmpBuf
 );
 
+/**
+ * Empty image of the same frame and region as another (and tracking noise if
+ * it does).
+ */
+Image* ImageConstructBlank
+(
+   const Image* pOther,
+   jmp_buf      jmpBuf
+);
+
 void ImageDestruct
 (
    Image* pI
@@ -68,7 +94,45 @@ void ImageDestruct
 /* commands ----------------------------------------------------------------- */
 
 /**
- * Accumulate (add, not just assign) a value to the image.
+ * Restrict to a region of the frame (before adding any samples). Clamped to
+ * the frame -- if that leaves it empty, nothing is changed.
+ *
+ * @param aRegion x0 y0 x1 y1 (top-left origin, x1 and y1 exclusive)
+ * @return whether region was set
+ */
+bool ImageSetRegion
+(
+   Image*      pI,
+   jmp_buf     jmpBuf,
+   const int32 aRegion[4]
+);
+
+/**
+ * Start tracking sample spread, for ImageNoise (before adding any samples).
+ */
+void ImageTrackNoise
+(
+   Image*  pI,
+   jmp_buf jmpBuf
+);
+
+/**
+ * Accumulate an image read from the serialised format (as written by
+ * ImageFormatted, and of the same region size), weighted by its iterations.
+ *
+ * @return iterations of the read image
+ */
+int32 ImageAddFormatted
+(
+   Image*  pI,
+   jmp_buf jmpBuf,
+   FILE*   pIn
+);
+
+/**
+ * Accumulate (add, not just assign) a value to the image. (Coordinates are
+ * of the whole frame, with bottom-left origin; outside the region is
+ * ignored.)
  */
 void ImageAddToPixel
 (
@@ -83,6 +147,17 @@ void ImageAddToPixel
 
 /* queries ------------------------------------------------------------------ */
 
+#define ImageRegionWidth( pI )  ((pI)->aRegion[2] - (pI)->aRegion[0])
+#define ImageRegionHeight( pI ) ((pI)->aRegion[3] - (pI)->aRegion[1])
+#define ImageRegionLength( pI ) \
+   (ImageRegionWidth( pI ) * ImageRegionHeight( pI ))
+
+/**
+ * Whether holding a region smaller than the whole frame.
+ */
+#define ImageIsTile( pI ) (ImageRegionLength( pI ) != ((pI)->width * \
+   (pI)->height))
+
 /**
  * Write the image to a serialised format.
  */
@@ -94,16 +169,46 @@ void ImageFormatted
    FILE*        pOut_o
 );
 
+/**
+ * Convert the pixels to RGBE, without writing (the same values as
+ * ImageFormatted writes).
+ *
+ * @param aRgbe_o ImageRegionLength * 4 bytes, by rows from top-left
+ */
+void ImageRgbe
+(
+   const Image* pI,
+   int32        iteration,
+   byteu*       aRgbe_o
+);
+
+/**
+ * Relative noise: RMS standard error of the pixel means, over mean pixel
+ * luminance. (Assumes one sample per pixel per iteration, and noise tracking
+ * -- else returns the maximum real.)
+ */
+real64 ImageNoise
+(
+   const Image* pI,
+   int32        iteration
+);
+
 
 
 
 /* constants ---------------------------------------------------------------- */
 
 /**
- * Image dimension max.
+ * Image dimension max (so pixel counts, up to its square, are well within
+ * int32).
  */
 #define IMAGE_DIM_MAX ((int32)4000)
 
+/**
+ * Minimum iterations for a meaningful ImageNoise estimate.
+ */
+#define IMAGE_NOISE_ITERATIONS_MIN 8
+
 
 
 
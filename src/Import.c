@@ -0,0 +1,781 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Exceptions.h"
+
+#include "Import.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/* bytes read from a file at once */
+#define READ_BUFFER 65536
+
+/* PLY header limits */
+#define PLY_ELEMENTS_MAX   16
+#define PLY_PROPERTIES_MAX 32
+
+/* PLY property types, by size in bytes (and signedness, and realness) */
+static const char* const PLY_TYPES[] = { "char", "int8", "uchar", "uint8",
+   "short", "int16", "ushort", "uint16", "int", "int32", "uint", "uint32",
+   "float", "float32", "double", "float64", 0 };
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Named material, from an OBJ material library.
+ */
+struct Named
+{
+   char     sName[64];
+   Material material;
+};
+
+typedef struct Named Named;
+
+
+/**
+ * PLY property: type (index into PLY_TYPES / 2), and list count type, or -1.
+ */
+struct PlyProperty
+{
+   char sName[32];
+   int  type;
+   int  countType;
+};
+
+typedef struct PlyProperty PlyProperty;
+
+struct PlyElement
+{
+   char        sName[32];
+   long        length;
+   PlyProperty aProperties[PLY_PROPERTIES_MAX];
+   int         propertiesLength;
+};
+
+typedef struct PlyElement PlyElement;
+
+
+/**
+ * Buffered file, and what is kept while reading it.
+ */
+struct Reader
+{
+   FILE*     pFile;
+   byteu*    aBuffer;
+   size_t    length;
+   size_t    position;
+
+   /* current line (terminated, without line end) */
+   char*     sLine;
+   size_t    lineCapacity;
+
+   Vector3f* aVertexs;
+   int32     vertexsLength;
+   int32     vertexsCapacity;
+
+   Named*    aMaterials;
+   int32     materialsLength;
+
+   /* polygon being made, as vertex indexs */
+   int32*    aPolygon;
+   int32     polygonCapacity;
+};
+
+typedef struct Reader Reader;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Refill the buffer.
+ *
+ * @return whether anything more was read
+ */
+static bool refill
+(
+   Reader* pR,
+   jmp_buf jmpBuf
+)
+{
+   pR->length   = fread( pR->aBuffer, 1, READ_BUFFER, pR->pFile );
+   pR->position = 0;
+   throwExceptions( jmpBuf, (bool)ferror( pR->pFile ), ERROR_READ_IO );
+
+   return pR->length > 0;
+}
+
+
+/**
+ * Read a line, into sLine.
+ *
+ * @return false if at end of file
+ */
+static bool readLine
+(
+   Reader* pR,
+   jmp_buf jmpBuf
+)
+{
+   size_t length = 0;
+   bool   isLine = false;
+
+   for( ;; )
+   {
+      const byteu* pStart;
+      const byteu* pEnd;
+      size_t       chunk;
+
+      if( (pR->position >= pR->length) && !refill( pR, jmpBuf ) )
+      {
+         break;
+      }
+      isLine = true;
+
+      /* take up to the line end (or all the buffer) */
+      pStart = pR->aBuffer + pR->position;
+      pEnd   = (const byteu*)memchr( pStart, '\n', pR->length -
+         pR->position );
+      chunk  = (pEnd ? (size_t)(pEnd - pStart) : (pR->length -
+         pR->position));
+
+      if( (length + chunk + 1) > pR->lineCapacity )
+      {
+         pR->lineCapacity = (length + chunk + 1) * 2;
+         pR->sLine = (char*)throwAllocExceptions( jmpBuf,
+            realloc( pR->sLine, pR->lineCapacity ) );
+      }
+      memcpy( pR->sLine + length, pStart, chunk );
+      length       += chunk;
+      pR->position += chunk + (pEnd ? 1 : 0);
+
+      if( pEnd )
+      {
+         break;
+      }
+   }
+
+   /* (without any carriage return) */
+   if( isLine )
+   {
+      length -= (length > 0) && ('\r' == pR->sLine[length - 1]);
+      pR->sLine[length] = 0;
+   }
+
+   return isLine;
+}
+
+
+static void readBytes
+(
+   Reader* pR,
+   jmp_buf jmpBuf,
+   byteu*  pBytes_o,
+   size_t  length
+)
+{
+   while( length > 0 )
+   {
+      size_t chunk;
+
+      throwExceptions( jmpBuf, (pR->position >= pR->length) &&
+         !refill( pR, jmpBuf ), ERROR_READ_TRUNC );
+
+      chunk = (pR->length - pR->position) < length ?
+         (pR->length - pR->position) : length;
+      memcpy( pBytes_o, pR->aBuffer + pR->position, chunk );
+      pR->position += chunk;
+      pBytes_o     += chunk;
+      length       -= chunk;
+   }
+}
+
+
+/**
+ * Skip spaces and tabs.
+ */
+static const char* skipSpace
+(
+   const char* s
+)
+{
+   for( ;  (' ' == *s) || ('\t' == *s);  ++s ) {}
+   return s;
+}
+
+
+/**
+ * Whether a line starts with a keyword (followed by a space, or end).
+ *
+ * @param psRest_o after the keyword (and its spaces)
+ */
+static bool isKeyword
+(
+   const char*  sLine,
+   const char*  sKeyword,
+   const char** psRest_o
+)
+{
+   const size_t length = strlen( sKeyword );
+   sLine = skipSpace( sLine );
+
+   if( strncmp( sLine, sKeyword, length ) || !(!sLine[length] ||
+      (' ' == sLine[length]) || ('\t' == sLine[length])) )
+   {
+      return false;
+   }
+
+   *psRest_o = skipSpace( sLine + length );
+   return true;
+}
+
+
+/**
+ * Read three reals (as single precision, like the model format).
+ *
+ * @return whether all were read
+ */
+static bool readReals
+(
+   const char* s,
+   Vector3f*   pV_o
+)
+{
+   int i;
+   for( i = 0;  i < 3;  ++i )
+   {
+      char* sEnd;
+      pV_o->xyz[i] = (real64)(float)strtod( s, &sEnd );
+      if( sEnd == s )
+      {
+         return false;
+      }
+      s = sEnd;
+   }
+
+   return true;
+}
+
+
+static void appendVertex
+(
+   Reader*         pR,
+   jmp_buf         jmpBuf,
+   const Vector3f* pVertex
+)
+{
+   if( pR->vertexsLength == pR->vertexsCapacity )
+   {
+      throwExceptions( jmpBuf, (pR->vertexsCapacity > (INT32_MAX / 2)),
+         ERROR_ALLOC );
+      pR->vertexsCapacity = pR->vertexsCapacity ? pR->vertexsCapacity * 2 :
+         1024;
+      pR->aVertexs = (Vector3f*)throwAllocExceptions( jmpBuf,
+         realloc( pR->aVertexs, (size_t)pR->vertexsCapacity *
+         sizeof(Vector3f) ) );
+   }
+   pR->aVertexs[pR->vertexsLength++] = *pVertex;
+}
+
+
+static void appendPolygon
+(
+   Reader* pR,
+   jmp_buf jmpBuf,
+   int32   length,
+   int32   index
+)
+{
+   if( length >= pR->polygonCapacity )
+   {
+      pR->polygonCapacity = (length + 1) * 2;
+      pR->aPolygon = (int32*)throwAllocExceptions( jmpBuf,
+         realloc( pR->aPolygon, (size_t)pR->polygonCapacity *
+         sizeof(int32) ) );
+   }
+   pR->aPolygon[length] = index;
+}
+
+
+/**
+ * Pass on the polygon, as a fan of triangles.
+ */
+static void passPolygon
+(
+   const Reader*          pR,
+   jmp_buf                jmpBuf,
+   int32                  length,
+   const Material*        pMaterial,
+   ImportTriangleFunction triangle,
+   void*                  pContext
+)
+{
+   int32 i;
+   for( i = 2;  i < length;  ++i )
+   {
+      Vector3f aVertexs[3];
+      aVertexs[0] = pR->aVertexs[pR->aPolygon[0]];
+      aVertexs[1] = pR->aVertexs[pR->aPolygon[i - 1]];
+      aVertexs[2] = pR->aVertexs[pR->aPolygon[i]];
+
+      triangle( pContext, jmpBuf, aVertexs, pMaterial );
+   }
+}
+
+
+/**
+ * Read an OBJ material library, appending its materials (ignoring it if it
+ * cannot be read).
+ */
+static void readMaterials
+(
+   Reader*         pR,
+   jmp_buf         jmpBuf,
+   const char*     sPathname,
+   const Material* pDefault
+)
+{
+   FILE*    pIn = fopen( sPathname, "r" );
+   char     sLine[1024];
+   Vector3f kd, ke;
+
+   /* index of the material being read (not a pointer: appending moves them) */
+   int32    current = -1;
+
+   if( !pIn )
+   {
+      return;
+   }
+
+   while( fgets( sLine, sizeof(sLine), pIn ) )
+   {
+      const char* sRest;
+      Vector3f    v;
+
+      /* start material */
+      if( isKeyword( sLine, "newmtl", &sRest ) )
+      {
+         Named* aMore;
+
+         /* finish previous */
+         if( current >= 0 )
+         {
+            pR->aMaterials[current].material = MaterialCreate( &kd, &ke );
+         }
+
+         aMore = (Named*)realloc( pR->aMaterials,
+            (pR->materialsLength + 1) * sizeof(Named) );
+         if( !aMore )
+         {
+            fclose( pIn );
+            throwExceptions( jmpBuf, true, ERROR_ALLOC );
+         }
+         pR->aMaterials = aMore;
+
+         current = pR->materialsLength++;
+         sscanf( sRest, "%63s", pR->aMaterials[current].sName );
+         kd = pDefault->reflectivity;
+         ke = Vector3fZERO;
+      }
+      /* diffuse, and emission */
+      else if( (current >= 0) && isKeyword( sLine, "Kd", &sRest ) &&
+         readReals( sRest, &v ) )
+      {
+         kd = v;
+      }
+      else if( (current >= 0) && isKeyword( sLine, "Ke", &sRest ) &&
+         readReals( sRest, &v ) )
+      {
+         ke = v;
+      }
+   }
+   if( current >= 0 )
+   {
+      pR->aMaterials[current].material = MaterialCreate( &kd, &ke );
+   }
+
+   fclose( pIn );
+}
+
+
+static void readObj
+(
+   Reader*                pR,
+   jmp_buf                jmpBuf,
+   const char*            sPathname,
+   const Material*        pDefault,
+   ImportTriangleFunction triangle,
+   void*                  pContext
+)
+{
+   /* index of the current material, or -1 for the default (not a pointer:
+      reading libraries moves them) */
+   int32 current = -1;
+
+   while( readLine( pR, jmpBuf ) )
+   {
+      const char* s;
+
+      /* vertex */
+      if( isKeyword( pR->sLine, "v", &s ) )
+      {
+         Vector3f v;
+         throwExceptions( jmpBuf, !readReals( s, &v ), ERROR_READ_INVAL );
+         appendVertex( pR, jmpBuf, &v );
+      }
+      /* face: vertex indexs (from 1, or negative from the last) */
+      else if( isKeyword( pR->sLine, "f", &s ) )
+      {
+         int32 length = 0;
+
+         while( *(s = skipSpace( s )) )
+         {
+            char* sEnd;
+            long  index = strtol( s, &sEnd, 10 );
+
+            index += (index < 0) ? (long)pR->vertexsLength : -1L;
+            throwExceptions( jmpBuf, (sEnd == s) || (index < 0) ||
+               (index >= (long)pR->vertexsLength), ERROR_READ_INVAL );
+            appendPolygon( pR, jmpBuf, length++, (int32)index );
+
+            /* (skip any texture and normal indexs) */
+            for( s = sEnd;  *s && (' ' != *s) && ('\t' != *s);  ++s ) {}
+         }
+
+         passPolygon( pR, jmpBuf, length, (current >= 0) ?
+            &pR->aMaterials[current].material : pDefault, triangle,
+            pContext );
+      }
+      /* material */
+      else if( isKeyword( pR->sLine, "usemtl", &s ) )
+      {
+         char sName[64] = "";
+
+         sscanf( s, "%63s", sName );
+         for( current = pR->materialsLength;  (current-- > 0) &&
+            strcmp( pR->aMaterials[current].sName, sName ); ) {}
+      }
+      /* material libraries (relative to this file) */
+      else if( isKeyword( pR->sLine, "mtllib", &s ) )
+      {
+         const char* pSlash = strrchr( sPathname, '/' );
+         const char* pBack  = strrchr( sPathname, '\\' );
+         const size_t directoryLength = (pBack > pSlash ? pBack : pSlash) ?
+            (size_t)((pBack > pSlash ? pBack : pSlash) - sPathname) + 1 : 0;
+
+         while( *(s = skipSpace( s )) )
+         {
+            const char* sEnd = s;
+            char*       sLibrary;
+
+            for( ;  *sEnd && (' ' != *sEnd) && ('\t' != *sEnd);  ++sEnd ) {}
+
+            sLibrary = (char*)throwAllocExceptions( jmpBuf,
+               malloc( directoryLength + (size_t)(sEnd - s) + 1 ) );
+            memcpy( sLibrary, sPathname, directoryLength );
+            memcpy( sLibrary + directoryLength, s, (size_t)(sEnd - s) );
+            sLibrary[directoryLength + (size_t)(sEnd - s)] = 0;
+
+            readMaterials( pR, jmpBuf, sLibrary, pDefault );
+            free( sLibrary );
+
+            s = sEnd;
+         }
+      }
+      /* (others ignored) */
+   }
+}
+
+
+/**
+ * Read a PLY value, of a type, as a real.
+ */
+static real64 readPlyValue
+(
+   Reader* pR,
+   jmp_buf jmpBuf,
+   int     type
+)
+{
+   static const int SIZES[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+   byteu   aBytes[8];
+   long64u u = 0;
+   int     i;
+
+   readBytes( pR, jmpBuf, aBytes, SIZES[type] );
+
+   /* assemble little-endian */
+   for( i = SIZES[type];  i-- > 0;  u = (u << 8) | aBytes[i] ) {}
+
+   switch( type )
+   {
+      case 0 : return (real64)(signed char)u;
+      case 1 : return (real64)u;
+      case 2 : return (real64)(short)u;
+      case 3 : return (real64)u;
+      case 4 : return (real64)(int32)u;
+      case 5 : return (real64)u;
+      case 6 :
+      {
+         const int32u u32 = (int32u)u;
+         float        f;
+         memcpy( &f, &u32, sizeof(f) );
+         return (real64)f;
+      }
+      default :
+      {
+         real64 d;
+         memcpy( &d, &u, sizeof(d) );
+         return d;
+      }
+   }
+}
+
+
+static int plyType
+(
+   jmp_buf     jmpBuf,
+   const char* sType
+)
+{
+   int i;
+   for( i = 0;  PLY_TYPES[i] && strcmp( PLY_TYPES[i], sType );  ++i ) {}
+   throwExceptions( jmpBuf, !PLY_TYPES[i], ERROR_READ_INVAL );
+
+   return i / 2;
+}
+
+
+static void readPly
+(
+   Reader*                pR,
+   jmp_buf                jmpBuf,
+   const Material*        pDefault,
+   ImportTriangleFunction triangle,
+   void*                  pContext
+)
+{
+   PlyElement aElements[PLY_ELEMENTS_MAX];
+   int        elementsLength = 0, e;
+   bool       isFormat       = false;
+
+   /* read header */
+   readLine( pR, jmpBuf );
+   for( ;; )
+   {
+      const char* s;
+
+      throwExceptions( jmpBuf, !readLine( pR, jmpBuf ), ERROR_READ_TRUNC );
+
+      if( isKeyword( pR->sLine, "end_header", &s ) )
+      {
+         break;
+      }
+      else if( isKeyword( pR->sLine, "format", &s ) )
+      {
+         isFormat = !strncmp( s, "binary_little_endian", 20 );
+      }
+      else if( isKeyword( pR->sLine, "element", &s ) )
+      {
+         PlyElement* pE = &aElements[elementsLength];
+
+         throwExceptions( jmpBuf, (elementsLength >= PLY_ELEMENTS_MAX) ||
+            (2 != sscanf( s, "%31s %ld", pE->sName, &pE->length )) ||
+            (pE->length < 0), ERROR_READ_INVAL );
+         pE->propertiesLength = 0;
+         ++elementsLength;
+      }
+      else if( isKeyword( pR->sLine, "property", &s ) )
+      {
+         PlyElement*  pE;
+         PlyProperty* pP;
+         char         sType[16], sCountType[16], sIndexType[16];
+
+         /* (a property must follow its element) */
+         throwExceptions( jmpBuf, (elementsLength <= 0), ERROR_READ_INVAL );
+         pE = &aElements[elementsLength - 1];
+         throwExceptions( jmpBuf, (pE->propertiesLength >=
+            PLY_PROPERTIES_MAX), ERROR_READ_INVAL );
+         pP = &pE->aProperties[pE->propertiesLength];
+
+         if( 3 == sscanf( s, "list %15s %15s %31s", sCountType, sIndexType,
+            pP->sName ) )
+         {
+            pP->countType = plyType( jmpBuf, sCountType );
+            pP->type      = plyType( jmpBuf, sIndexType );
+         }
+         else
+         {
+            throwExceptions( jmpBuf, (2 != sscanf( s, "%15s %31s", sType,
+               pP->sName )), ERROR_READ_INVAL );
+            pP->countType = -1;
+            pP->type      = plyType( jmpBuf, sType );
+         }
+         ++pE->propertiesLength;
+      }
+      /* (comments, and others, ignored) */
+   }
+   throwExceptions( jmpBuf, !isFormat, ERROR_FORMAT_UNREC );
+
+   /* read elements */
+   for( e = 0;  e < elementsLength;  ++e )
+   {
+      const PlyElement* pE       = &aElements[e];
+      const bool        isVertex = !strcmp( pE->sName, "vertex" );
+      const bool        isFace   = !strcmp( pE->sName, "face" );
+      long              r;
+
+      if( isVertex )
+      {
+         throwExceptions( jmpBuf, (pE->length >= (long)INT32_MAX) ||
+            pR->vertexsLength, ERROR_READ_INVAL );
+         pR->vertexsCapacity = (int32)pE->length;
+         pR->aVertexs = (Vector3f*)throwAllocExceptions( jmpBuf,
+            calloc( pR->vertexsCapacity + 1, sizeof(Vector3f) ) );
+      }
+
+      for( r = 0;  r < pE->length;  ++r )
+      {
+         Vector3f vertex = Vector3fZERO;
+         int32    length = 0;
+         int      p;
+
+         for( p = 0;  p < pE->propertiesLength;  ++p )
+         {
+            const PlyProperty* pP = &pE->aProperties[p];
+
+            /* list: of vertex indexs for a face, else skipped */
+            if( pP->countType >= 0 )
+            {
+               const bool isIndexs = isFace &&
+                  (!strcmp( pP->sName, "vertex_indices" ) ||
+                  !strcmp( pP->sName, "vertex_index" ));
+               const real64 count  = readPlyValue( pR, jmpBuf,
+                  pP->countType );
+               int32 i;
+
+               throwExceptions( jmpBuf, (count < 0.0) || (count > 65536.0),
+                  ERROR_READ_INVAL );
+               for( i = 0;  i < (int32)count;  ++i )
+               {
+                  const real64 index = readPlyValue( pR, jmpBuf, pP->type );
+                  if( isIndexs )
+                  {
+                     throwExceptions( jmpBuf, !((index >= 0.0) &&
+                        (index < (real64)pR->vertexsLength)),
+                        ERROR_READ_INVAL );
+                     appendPolygon( pR, jmpBuf, length++, (int32)index );
+                  }
+               }
+            }
+            /* value: a vertex coordinate, else skipped */
+            else
+            {
+               const real64 value = readPlyValue( pR, jmpBuf, pP->type );
+               if( isVertex && !pP->sName[1] && (pP->sName[0] >= 'x') &&
+                  (pP->sName[0] <= 'z') )
+               {
+                  /* (single precision, as all vertexs) */
+                  vertex.xyz[pP->sName[0] - 'x'] = (real64)(float)value;
+               }
+            }
+         }
+
+         if( isVertex )
+         {
+            pR->aVertexs[pR->vertexsLength++] = vertex;
+         }
+         else if( isFace )
+         {
+            passPolygon( pR, jmpBuf, length, pDefault, triangle, pContext );
+         }
+      }
+   }
+}
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+void ImportRead
+(
+   jmp_buf                jmpBuf,
+   const char*            sPathname,
+   const Material*        pDefault,
+   ImportTriangleFunction triangle,
+   void*                  pContext
+)
+{
+   /* (volatile, since set between setjmp and longjmp) */
+   Reader* volatile pR = 0;
+
+   jmp_buf   jmpBufImport;
+   const int status = setjmp( jmpBufImport );
+
+   /* try */
+   if( !status )
+   {
+      pR = (Reader*)throwAllocExceptions( jmpBufImport,
+         calloc( 1, sizeof(Reader) ) );
+      pR->aBuffer = (byteu*)throwAllocExceptions( jmpBufImport,
+         malloc( READ_BUFFER ) );
+
+      pR->pFile = fopen( sPathname, "rb" );
+      throwExceptions( jmpBufImport, !pR->pFile, ERROR_FILE );
+
+      /* PLY by its magic number, else OBJ */
+      refill( pR, jmpBufImport );
+      if( (pR->length >= 4) && !memcmp( pR->aBuffer, "ply", 3 ) &&
+         (('\n' == pR->aBuffer[3]) || ('\r' == pR->aBuffer[3])) )
+      {
+         readPly( pR, jmpBufImport, pDefault, triangle, pContext );
+      }
+      else
+      {
+         readObj( pR, jmpBufImport, sPathname, pDefault, triangle,
+            pContext );
+      }
+   }
+
+   /* finally: clean up */
+   if( pR )
+   {
+      if( pR->pFile )
+      {
+         fclose( pR->pFile );
+      }
+      free( pR->aPolygon );
+      free( pR->aMaterials );
+      free( pR->aVertexs );
+      free( pR->sLine );
+      free( pR->aBuffer );
+      free( pR );
+   }
+
+   /* rethrow */
+   if( status )
+   {
+      longjmp( jmpBuf, status );
+   }
+}
@@ -0,0 +1,81 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Import_h
+#define Import_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Vector3f.h"
+#include "Triangle.h"
+
+
+
+
+/**
+ * Reading of triangle mesh files made by other programs.<br/><br/>
+ *
+ * Files are streamed (read a buffer at a time), each triangle passed on as it
+ * is made, so memory held is only the file's vertexs (which its faces can
+ * refer to anywhere) and materials.<br/><br/>
+ *
+ * Formats (chosen by content):
+ * <ul>
+ * <li>Wavefront OBJ: 'v' vertexs and 'f' faces (polygons made into fans of
+ * triangles; texture and normal indexs ignored); 'usemtl' materials, from
+ * 'mtllib' files (relative to the OBJ file), with Kd as reflectivity and Ke
+ * as emitivity. Faces without a known material have the default.</li>
+ * <li>PLY, binary little-endian: 'vertex' element x y z properties, and
+ * 'face' element vertex_indices list. All faces have the default material.
+ * </li>
+ * </ul>
+ * Coordinates are taken as they are, but in single precision (as the model
+ * format's), and vertex order too (so front faces, for emission, are as in the
+ * file).
+ */
+
+
+/**
+ * Receiver of triangles, with a context for them.
+ */
+typedef void (*ImportTriangleFunction)
+(
+   void*           pContext,
+   jmp_buf         jmpBuf,
+   const Vector3f  aVertexs[3],
+   const Material* pMaterial
+);
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Read a mesh file.
+ *
+ * @param pDefault material for faces without one
+ * @param triangle given each triangle read
+ */
+void ImportRead
+(
+   jmp_buf                jmpBuf,
+   const char*            sPathname,
+   const Material*        pDefault,
+   ImportTriangleFunction triangle,
+   void*                  pContext
+);
+
+
+
+
+#endif
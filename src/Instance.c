@@ -0,0 +1,222 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <math.h>
+
+#include "Exceptions.h"
+
+#include "Instance.h"
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static Vector3f transformPoint
+(
+   const real64    aTransform[12],
+   const Vector3f* pPoint
+)
+{
+   Vector3f p;
+   int      i;
+   for( i = 3;  i-- > 0; )
+   {
+      const real64* m = aTransform + (i * 4);
+      p.xyz[i] = (m[0] * pPoint->xyz[0]) + (m[1] * pPoint->xyz[1]) +
+         (m[2] * pPoint->xyz[2]) + m[3];
+   }
+
+   return p;
+}
+
+
+static Vector3f transformVector
+(
+   const real64    aTransform[12],
+   const Vector3f* pVector
+)
+{
+   Vector3f v;
+   int      i;
+   for( i = 3;  i-- > 0; )
+   {
+      const real64* m = aTransform + (i * 4);
+      v.xyz[i] = (m[0] * pVector->xyz[0]) + (m[1] * pVector->xyz[1]) +
+         (m[2] * pVector->xyz[2]);
+   }
+
+   return v;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+Prototype PrototypeCreate
+(
+   const Triangle* aTriangles,
+   int32           trianglesLength,
+   jmp_buf         jmpBuf
+)
+{
+   Prototype p;
+
+   throwExceptions( jmpBuf, (trianglesLength <= 0), ERROR_READ_INVAL );
+
+   p.aTriangles      = aTriangles;
+   p.trianglesLength = trianglesLength;
+
+   /* (there are no eyes in object space, so a vertex stands in) */
+   p.pIndex = SpatialIndexConstruct( aTriangles[0].apVertexs[0], 1,
+      aTriangles, trianglesLength, jmpBuf );
+
+   return p;
+}
+
+
+Instance InstanceCreate
+(
+   const Prototype* pPrototype,
+   const Vector3f   aAxes[4],
+   jmp_buf          jmpBuf
+)
+{
+   Instance instance;
+   int      i, j;
+
+   instance.pPrototype = pPrototype;
+
+   /* to world: axes as columns, then origin */
+   for( i = 3;  i-- > 0; )
+   {
+      for( j = 4;  j-- > 0;  instance.aToWorld[(i * 4) + j] =
+         aAxes[j].xyz[i] ) {}
+   }
+
+   /* to object: inverse (by cofactors) */
+   {
+      Vector3f aCross[3];
+      real64   determinant;
+
+      for( i = 3;  i-- > 0;  aCross[i] = Vector3fCross( &aAxes[(i + 1) % 3],
+         &aAxes[(i + 2) % 3] ) ) {}
+      determinant = Vector3fDot( &aAxes[0], &aCross[0] );
+
+      throwExceptions( jmpBuf, !(fabs( determinant ) > 0.0) ||
+         !(fabs( 1.0 / determinant ) < REAL64_MAX), ERROR_READ_INVAL );
+
+      for( i = 3;  i-- > 0; )
+      {
+         real64* m = instance.aToObject + (i * 4);
+         for( j = 3;  j-- > 0;  m[j] = aCross[i].xyz[j] / determinant ) {}
+         m[3] = -Vector3fDot( &aCross[i], &aAxes[3] ) / determinant;
+      }
+   }
+
+   /* world bound: of the corners of the prototype's index bound */
+   {
+      const real64* aObjectBound = pPrototype->pIndex->aBound;
+      int           c;
+
+      for( c = 8;  c-- > 0; )
+      {
+         Vector3f corner, p;
+         for( j = 3;  j-- > 0;  corner.xyz[j] = aObjectBound[j +
+            (((c >> j) & 1) * 3)] ) {}
+         p = transformPoint( instance.aToWorld, &corner );
+
+         for( j = 6;  j-- > 0; )
+         {
+            if( (7 == c) || ((instance.aBound[j] > p.xyz[j % 3]) ^ (j > 2)) )
+            {
+               instance.aBound[j] = p.xyz[j % 3];
+            }
+         }
+      }
+
+      for( j = 6;  j-- > 0;  instance.aBound[j] += (j > 2 ? TOLERANCE :
+         -TOLERANCE) ) {}
+   }
+
+   return instance;
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+bool InstanceIntersection
+(
+   const Instance*  pI,
+   const Vector3f*  pRayOrigin,
+   const Vector3f*  pRayDirection,
+   const void*      lastHit,
+   real64*          pDistance,
+   const Triangle** ppHitObject_o,
+   Vector3f*        pHitPosition_o
+)
+{
+   /* ray in object space (with the same parameterisation, so distances along
+      it are as in world space) */
+   const Vector3f origin    = transformPoint( pI->aToObject, pRayOrigin );
+   const Vector3f direction = transformVector( pI->aToObject, pRayDirection );
+   Vector3f       start;
+
+   if( SpatialIndexEnter( pI->pPrototype->pIndex, &origin, &direction,
+      *pDistance, &start ) )
+   {
+      const Triangle* pHit = 0;
+      Vector3f        hitPosition;
+
+      SpatialIndexIntersection( pI->pPrototype->pIndex, &origin, &direction,
+         lastHit, &start, &pHit, &hitPosition );
+
+      if( pHit )
+      {
+         const Vector3f position = transformPoint( pI->aToWorld,
+            &hitPosition );
+         const Vector3f ray      = Vector3fSub( &position, pRayOrigin );
+         const real64   distance = sqrt( Vector3fDot( &ray, &ray ) );
+
+         if( distance < *pDistance )
+         {
+            *pDistance      = distance;
+            *ppHitObject_o  = pHit;
+            *pHitPosition_o = position;
+
+            return true;
+         }
+      }
+   }
+
+   return false;
+}
+
+
+void InstanceTriangle
+(
+   const Instance* pI,
+   const Triangle* pObjectTriangle,
+   Vector3f        aVertexs_o[3],
+   Triangle*       pWorldTriangle_o
+)
+{
+   int i;
+   for( i = 3;  i-- > 0; )
+   {
+      aVertexs_o[i] = transformPoint( pI->aToWorld,
+         pObjectTriangle->apVertexs[i] );
+      pWorldTriangle_o->apVertexs[i] = &aVertexs_o[i];
+   }
+   pWorldTriangle_o->pMaterial = pObjectTriangle->pMaterial;
+}
@@ -0,0 +1,146 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Instance_h
+#define Instance_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Vector3f.h"
+#include "Triangle.h"
+#include "SpatialIndex.h"
+
+
+
+
+/**
+ * Object defined once, and placed many times by instances.<br/><br/>
+ *
+ * Its triangles are in object space, and indexed there (once, whatever the
+ * instances).<br/><br/>
+ *
+ * Constant.
+ *
+ * @invariants
+ * * trianglesLength > 0
+ * * pIndex is not 0
+ */
+
+struct Prototype
+{
+   const Triangle*     aTriangles;
+   int32               trianglesLength;
+
+   const SpatialIndex* pIndex;
+};
+
+typedef struct Prototype Prototype;
+
+
+
+
+/**
+ * Placement of a prototype, by an affine transform.<br/><br/>
+ *
+ * Its triangles are not copied: rays are transformed into object space to
+ * intersect the prototype's index, and a hit triangle is transformed back
+ * when its geometry is needed.<br/><br/>
+ *
+ * Constant.
+ *
+ * @invariants
+ * * pPrototype is not 0
+ * * aToObject is the inverse of aToWorld
+ * * aBound encompasses the transformed prototype index bound
+ */
+
+struct Instance
+{
+   const Prototype* pPrototype;
+
+   /* transforms: 3x4, by rows (last column translation) */
+   real64           aToWorld[12];
+   real64           aToObject[12];
+
+   /* world bound: lower corner in [0-2], upper corner in [3-5] */
+   real64           aBound[6];
+};
+
+typedef struct Instance Instance;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * Index a prototype's triangles (which must outlive it).
+ */
+Prototype PrototypeCreate
+(
+   const Triangle* aTriangles,
+   int32           trianglesLength,
+   jmp_buf         jmpBuf
+);
+
+/**
+ * @param aAxes the object's x, y, and z axes, then its origin, in world space
+ *        (must be invertible)
+ */
+Instance InstanceCreate
+(
+   const Prototype* pPrototype,
+   const Vector3f   aAxes[4],
+   jmp_buf          jmpBuf
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Nearest intersection of ray with the instance's triangles, if nearer than a
+ * distance.
+ *
+ * @param lastHit triangle (of this instance) not to hit, or 0
+ * @param pDistance nearest distance so far, updated if hit
+ * @return whether hit (and then the outputs set)
+ */
+bool InstanceIntersection
+(
+   const Instance*,
+   const Vector3f*  pRayOrigin,
+   const Vector3f*  pRayDirection,
+   const void*      lastHit,
+   real64*          pDistance,
+   const Triangle** ppHitObject_o,
+   Vector3f*        pHitPosition_o
+);
+
+/**
+ * One of the prototype's triangles as placed, made of given vertexs storage.
+ *
+ * @param aVertexs_o storage, referred to by the triangle (so must outlive it)
+ */
+void InstanceTriangle
+(
+   const Instance*,
+   const Triangle* pObjectTriangle,
+   Vector3f        aVertexs_o[3],
+   Triangle*       pWorldTriangle_o
+);
+
+
+
+
+#endif
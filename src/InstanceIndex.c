@@ -0,0 +1,321 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <stdlib.h>
+
+#include "Exceptions.h"
+#include "Stats.h"
+
+#include "InstanceIndex.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/* instances in a leaf, at most */
+static const int32 MAX_ITEMS = 2;
+
+/* deep enough for any median-split tree of int32 items */
+#define MAX_DEPTH 64
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Branch (length 0): children are nodes first and first + 1.
+ * Leaf: instances are apInstances[first] onwards, for length.
+ */
+struct InstanceNode
+{
+   real64 aBound[6];
+   int32  first;
+   int32  length;
+};
+
+typedef struct InstanceNode InstanceNode;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static real64 centre
+(
+   const Instance* pInstance,
+   int             axis
+)
+{
+   return (pInstance->aBound[axis] + pInstance->aBound[axis + 3]) * 0.5;
+}
+
+
+/**
+ * Partially sort, so the instance at the middle is in place, with none
+ * greater before it and none lesser after (along the axis).
+ */
+static void partition
+(
+   const Instance** apInstances,
+   int32            length,
+   int32            middle,
+   int              axis
+)
+{
+   int32 low = 0, high = length - 1;
+
+   while( low < high )
+   {
+      const real64 pivot = centre( apInstances[(low + high) / 2], axis );
+      int32        i = low, j = high;
+
+      while( i <= j )
+      {
+         for( ;  centre( apInstances[i], axis ) < pivot;  ++i ) {}
+         for( ;  centre( apInstances[j], axis ) > pivot;  --j ) {}
+         if( i <= j )
+         {
+            const Instance* pSwap = apInstances[i];
+            apInstances[i++]      = apInstances[j];
+            apInstances[j--]      = pSwap;
+         }
+      }
+
+      if( middle <= j )
+      {
+         high = j;
+      }
+      else if( middle >= i )
+      {
+         low = i;
+      }
+      else
+      {
+         break;
+      }
+   }
+}
+
+
+static void construct
+(
+   InstanceIndex* pI,
+   int32          node,
+   int32          first,
+   int32          length
+)
+{
+   InstanceNode* pNode = &pI->aNodes[node];
+   real64        aCentres[6];
+   int32         i;
+   int           j;
+
+   /* bound instances, and their centres */
+   for( i = first;  i < (first + length);  ++i )
+   {
+      for( j = 6;  j-- > 0; )
+      {
+         const real64 b = pI->apInstances[i]->aBound[j];
+         const real64 c = centre( pI->apInstances[i], j % 3 );
+         if( (i == first) || ((pNode->aBound[j] > b) ^ (j > 2)) )
+         {
+            pNode->aBound[j] = b;
+         }
+         if( (i == first) || ((aCentres[j] > c) ^ (j > 2)) )
+         {
+            aCentres[j] = c;
+         }
+      }
+   }
+
+   /* make leaf */
+   if( length <= MAX_ITEMS )
+   {
+      pNode->first  = first;
+      pNode->length = length;
+   }
+   /* make branch: split at median, along longest axis, and recurse */
+   else
+   {
+      const int32 half = length / 2;
+      int         axis = 0;
+
+      for( j = 3;  j-- > 1; )
+      {
+         if( (aCentres[j + 3] - aCentres[j]) >
+            (aCentres[axis + 3] - aCentres[axis]) )
+         {
+            axis = j;
+         }
+      }
+
+      partition( pI->apInstances + first, length, half, axis );
+
+      pNode->first  = pI->nodesLength;
+      pNode->length = 0;
+      pI->nodesLength += 2;
+
+      construct( pI, pNode->first,     first,        half );
+      construct( pI, pNode->first + 1, first + half, length - half );
+   }
+}
+
+
+/**
+ * Distance ray enters bound, if before a distance, else REAL64_MAX.
+ */
+static real64 enterBound
+(
+   const real64    aBound[6],
+   const Vector3f* pRayOrigin,
+   const Vector3f* pRayInverse,
+   real64          distance
+)
+{
+   real64 enter = 0.0, leave = distance;
+   int    i;
+
+   for( i = 3;  i-- > 0; )
+   {
+      /* (an infinite inverse, from a zero direction, gives infinities for
+         origins outside, so a miss; and NaNs, which compare false, inside) */
+      const real64 a = (aBound[i]     - pRayOrigin->xyz[i]) *
+         pRayInverse->xyz[i];
+      const real64 b = (aBound[i + 3] - pRayOrigin->xyz[i]) *
+         pRayInverse->xyz[i];
+      enter = (a < b ? a : b) > enter ? (a < b ? a : b) : enter;
+      leave = (a > b ? a : b) < leave ? (a > b ? a : b) : leave;
+   }
+
+   return enter <= leave ? enter : REAL64_MAX;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+InstanceIndex* InstanceIndexConstruct
+(
+   const Instance* aInstances,
+   int32           instancesLength,
+   jmp_buf         jmpBuf
+)
+{
+   InstanceIndex* pI = (InstanceIndex*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(InstanceIndex) ) );
+   int32 i;
+
+   pI->instancesLength = instancesLength;
+   pI->apInstances     = (const Instance**)throwAllocExceptions( jmpBuf,
+      calloc( instancesLength, sizeof(Instance*) ) );
+   for( i = instancesLength;  i-- > 0;  pI->apInstances[i] = &aInstances[i] )
+   {}
+
+   /* (a binary tree of n leafs has 2n - 1 nodes) */
+   pI->aNodes = (InstanceNode*)throwAllocExceptions( jmpBuf,
+      calloc( ((size_t)instancesLength * 2), sizeof(InstanceNode) ) );
+   pI->nodesLength = 1;
+   construct( pI, 0, 0, instancesLength );
+
+   return pI;
+}
+
+
+void InstanceIndexDestruct
+(
+   InstanceIndex* pI
+)
+{
+   free( pI->aNodes );
+   free( (Instance**)pI->apInstances );
+   free( pI );
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+bool InstanceIndexIntersection
+(
+   const InstanceIndex* pI,
+   const Vector3f*      pRayOrigin,
+   const Vector3f*      pRayDirection,
+   const void*          lastHit,
+   const Instance*      pLastInstance,
+   real64*              pDistance,
+   const Triangle**     ppHitObject_o,
+   const Instance**     ppHitInstance_o,
+   Vector3f*            pHitPosition_o
+)
+{
+   int32    aStack[MAX_DEPTH];
+   int32    depth = 0;
+   bool     isHit = false;
+   Vector3f inverse;
+   int      i;
+
+   for( i = 3;  i-- > 0;  inverse.xyz[i] = 1.0 / pRayDirection->xyz[i] ) {}
+
+   /* visit nodes the ray enters (before the nearest hit so far), nearer
+      child first */
+   aStack[depth++] = 0;
+   while( depth > 0 )
+   {
+      const InstanceNode* pNode = &pI->aNodes[aStack[--depth]];
+
+      STATS_COUNT( STATS_NODE_VISITS );
+
+      if( enterBound( pNode->aBound, pRayOrigin, &inverse, *pDistance ) ==
+         REAL64_MAX )
+      {
+         continue;
+      }
+
+      /* leaf: intersect instances */
+      if( pNode->length )
+      {
+         for( i = pNode->first;  i < (pNode->first + pNode->length);  ++i )
+         {
+            const Instance* pInstance = pI->apInstances[i];
+            if( InstanceIntersection( pInstance, pRayOrigin, pRayDirection,
+               (pInstance == pLastInstance) ? lastHit : 0, pDistance,
+               ppHitObject_o, pHitPosition_o ) )
+            {
+               *ppHitInstance_o = pInstance;
+               isHit            = true;
+            }
+         }
+      }
+      /* branch: push children, farther first */
+      else
+      {
+         const real64 d0 = enterBound( pI->aNodes[pNode->first].aBound,
+            pRayOrigin, &inverse, *pDistance );
+         const real64 d1 = enterBound( pI->aNodes[pNode->first + 1].aBound,
+            pRayOrigin, &inverse, *pDistance );
+         const int32  nearer = pNode->first + (d1 < d0 ? 1 : 0);
+
+         if( (d0 > d1 ? d0 : d1) < REAL64_MAX )
+         {
+            aStack[depth++] = pNode->first + (d1 < d0 ? 0 : 1);
+         }
+         if( (d0 < d1 ? d0 : d1) < REAL64_MAX )
+         {
+            aStack[depth++] = nearer;
+         }
+      }
+   }
+
+   return isHit;
+}
@@ -0,0 +1,102 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef InstanceIndex_h
+#define InstanceIndex_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Vector3f.h"
+#include "Triangle.h"
+#include "Instance.h"
+
+
+
+
+/**
+ * Top level of a two-level spatial index: over instances, each of whose
+ * prototypes has its own index (the bottom level).<br/><br/>
+ *
+ * Constant.<br/><br/>
+ *
+ * @implementation
+ * Bounding volume hierarchy: binary, split at the median instance along the
+ * longest axis of their bounds' centres, stored as an array of nodes (children
+ * adjacent, after their parent), with leafs holding a run of the (reordered)
+ * instance pointers.
+ *
+ * @invariants
+ * * nodesLength >= 1
+ * * each node's bound encompasses its instances' bounds
+ */
+
+struct InstanceIndex
+{
+   struct InstanceNode* aNodes;
+   int32                nodesLength;
+
+   const Instance**     apInstances;
+   int32                instancesLength;
+};
+
+typedef struct InstanceIndex InstanceIndex;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * @param aInstances at least one (to outlive the index)
+ */
+InstanceIndex* InstanceIndexConstruct
+(
+   const Instance* aInstances,
+   int32           instancesLength,
+   jmp_buf         jmpBuf
+);
+
+void InstanceIndexDestruct
+(
+   InstanceIndex*
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Nearest intersection of ray with an instance's triangle, if nearer than a
+ * distance (as InstanceIntersection).
+ *
+ * @param pRayDirection unitized
+ * @param pLastInstance instance of lastHit, or 0
+ * @return whether hit (and then the outputs set)
+ */
+bool InstanceIndexIntersection
+(
+   const InstanceIndex*,
+   const Vector3f*      pRayOrigin,
+   const Vector3f*      pRayDirection,
+   const void*          lastHit,
+   const Instance*      pLastInstance,
+   real64*              pDistance,
+   const Triangle**     ppHitObject_o,
+   const Instance**     ppHitInstance_o,
+   Vector3f*            pHitPosition_o
+);
+
+
+
+
+#endif
@@ -0,0 +1,665 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <math.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "Exceptions.h"
+#include "Stats.h"
+#include "RayTracer.h"
+
+#include "IrradianceCache.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const real64 PI = 3.14159265358979;
+
+/* a record is not used at a point it is in front of, by more than this
+   fraction of its radius */
+static const real64 FRONT_TOLERANCE = 0.05;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Indirect irradiance at a point, and how it changes nearby.
+ */
+struct Record
+{
+   Vector3f       position;
+   Vector3f       normal;
+   real64         radius;
+
+   /* irradiance, and its gradient (of each channel) for turning the normal
+      (as an axis) */
+   Vector3f       irradiance;
+   Vector3f       aRotation[3];
+
+   /* next in the same cell */
+   struct Record* pNext;
+};
+
+typedef struct Record Record;
+
+
+/**
+ * Octree cell: its subcells (or 0s), and its records.
+ */
+struct Cell
+{
+   struct Cell* apSubCells[8];
+   Record*      pRecords;
+};
+
+typedef struct Cell Cell;
+
+
+struct IrradianceCache
+{
+   const Scene*     pScene;
+
+   /* octree: the root cell (also holding any records outside it), and its
+      lower corner and size */
+   Cell             root;
+   Vector3f         rootPosition;
+   real64           rootSize;
+   int32            recordsLength;
+
+   pthread_rwlock_t lock;
+};
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Tangent and cotangent making a coordinate frame with a normal.
+ */
+static void makeFrame
+(
+   const Vector3f* pNormal,
+   Vector3f*       pTangent_o,
+   Vector3f*       pCotangent_o
+)
+{
+   const Vector3f X = {{ 1.0, 0.0, 0.0 }};
+   const Vector3f Y = {{ 0.0, 1.0, 0.0 }};
+
+   /* (from the axis least along the normal) */
+   const Vector3f t = Vector3fCross( fabs( pNormal->xyz[0] ) < 0.6 ? &X : &Y,
+      pNormal );
+   *pTangent_o   = Vector3fUnitized( &t );
+   *pCotangent_o = Vector3fCross( pNormal, pTangent_o );
+}
+
+
+/**
+ * Direction in a coordinate frame, from polar angle sine and cosine, and
+ * azimuth.
+ */
+static Vector3f frameDirection
+(
+   const Vector3f* pTangent,
+   const Vector3f* pCotangent,
+   const Vector3f* pNormal,
+   real64          sinTheta,
+   real64          cosTheta,
+   real64          phi
+)
+{
+   const Vector3f tx  = Vector3fMulF( pTangent,   cos( phi ) * sinTheta );
+   const Vector3f cy  = Vector3fMulF( pCotangent, sin( phi ) * sinTheta );
+   const Vector3f nz  = Vector3fMulF( pNormal,    cosTheta );
+   const Vector3f sum = Vector3fAdd( &tx, &cy );
+
+   return Vector3fAdd( &sum, &nz );
+}
+
+
+/**
+ * Add a difference of two strata's radiances, times a coefficient, along a
+ * direction, to each channel's gradient.
+ */
+static void addGradient
+(
+   Vector3f        aGradient[3],
+   const Vector3f* pDirection,
+   real64          coefficient,
+   const Vector3f* pRadianceA,
+   const Vector3f* pRadianceB
+)
+{
+   int32 c;
+   for( c = 3;  c-- > 0; )
+   {
+      const Vector3f g = Vector3fMulF( pDirection, coefficient *
+         (pRadianceA->xyz[c] - pRadianceB->xyz[c]) );
+      aGradient[c] = Vector3fAdd( &aGradient[c], &g );
+   }
+}
+
+
+/**
+ * Make a record at a surface point: trace stratified paths over the
+ * hemisphere, and sum them (with Ward and Heckbert's gradients).<br/><br/>
+ *
+ * The translational gradient only limits the radius: from single paths it is
+ * too noisy to extrapolate by.
+ */
+static void makeRecord
+(
+   const IrradianceCache* pC,
+   const SurfacePoint*    pPoint,
+   const Vector3f*        pNormal,
+   real64                 footprint,
+   real64                 reachMax,
+   Random*                pRandom,
+   Record*                pRecord_o
+)
+{
+   const RayTracer rayTracer = RayTracerCreate( pC->pScene );
+
+   /* each stratum's radiance, and inverse distance to what it hit (or 0) */
+   Vector3f aRadiances[IRRADIANCE_CACHE_THETAS][IRRADIANCE_CACHE_PHIS];
+   real64   aInverses[IRRADIANCE_CACHE_THETAS][IRRADIANCE_CACHE_PHIS];
+   real64   inverses = 0.0;
+
+   /* translational gradient, of each channel */
+   Vector3f aTranslation[3];
+
+   const real64 M = (real64)IRRADIANCE_CACHE_THETAS;
+   const real64 N = (real64)IRRADIANCE_CACHE_PHIS;
+
+   Vector3f tangent, cotangent;
+   int32    j, k, c;
+
+   makeFrame( pNormal, &tangent, &cotangent );
+
+   pRecord_o->position   = pPoint->position;
+   pRecord_o->normal     = *pNormal;
+   pRecord_o->irradiance = Vector3fZERO;
+   for( c = 3;  c-- > 0; )
+   {
+      pRecord_o->aRotation[c] = Vector3fZERO;
+      aTranslation[c]         = Vector3fZERO;
+   }
+   pRecord_o->pNext = 0;
+
+   /* trace a path through each stratum (cosine-weighted: uniform in sine
+      squared of the polar angle, and in azimuth) */
+   for( k = 0;  k < IRRADIANCE_CACHE_PHIS;  ++k )
+   {
+      for( j = 0;  j < IRRADIANCE_CACHE_THETAS;  ++j )
+      {
+         const real64   sin2      = ((real64)j + RandomReal64( pRandom )) / M;
+         const real64   phi       = 2.0 * PI * ((real64)k +
+            RandomReal64( pRandom )) / N;
+         const Vector3f direction = frameDirection( &tangent, &cotangent,
+            pNormal, sqrt( sin2 ), sqrt( 1.0 - sin2 ), phi );
+
+         SurfacePoint hit;
+         aRadiances[j][k] = Vector3fZERO;
+         aInverses[j][k]  = 0.0;
+
+         STATS_COUNT( STATS_RAYS_BOUNCE );
+         if( SceneIntersection( pC->pScene, &pPoint->position, &direction,
+            pPoint, &hit ) )
+         {
+            const Vector3f back     = Vector3fNegative( &direction );
+            const Vector3f ray      = Vector3fSub( &hit.position,
+               &pPoint->position );
+            const real64   distance = sqrt( Vector3fDot( &ray, &ray ) );
+
+            aRadiances[j][k] = RayTracerReflected( &rayTracer, &back, &hit,
+               pRandom );
+            aInverses[j][k]  = distance > 0.0 ? 1.0 / distance : 0.0;
+         }
+
+         pRecord_o->irradiance = Vector3fAdd( &pRecord_o->irradiance,
+            &aRadiances[j][k] );
+         inverses += aInverses[j][k];
+      }
+   }
+
+   /* gradients */
+   for( k = 0;  k < IRRADIANCE_CACHE_PHIS;  ++k )
+   {
+      const int32    kPrevious = (k + IRRADIANCE_CACHE_PHIS - 1) %
+         IRRADIANCE_CACHE_PHIS;
+      const Vector3f middle    = frameDirection( &tangent, &cotangent,
+         pNormal, 1.0, 0.0, 2.0 * PI * ((real64)k + 0.5) / N );
+      const Vector3f around    = frameDirection( &tangent, &cotangent,
+         pNormal, 1.0, 0.0, (2.0 * PI * (real64)k / N) + (PI * 0.5) );
+      const Vector3f aroundMid = Vector3fCross( pNormal, &middle );
+
+      for( j = 0;  j < IRRADIANCE_CACHE_THETAS;  ++j )
+      {
+         /* turning: tangent of the stratum's middle polar angle */
+         const real64 sin2Mid = ((real64)j + 0.5) / M;
+         addGradient( pRecord_o->aRotation, &aroundMid,
+            (PI / (M * N)) * sqrt( sin2Mid / (1.0 - sin2Mid) ),
+            &aRadiances[j][k], &Vector3fZERO );
+
+         /* moving: across the edge with the stratum nearer the normal, at
+            the nearer distance */
+         if( j > 0 )
+         {
+            const real64 sin2 = (real64)j / M;
+            addGradient( aTranslation, &middle, (2.0 * PI / N) *
+               sqrt( sin2 ) * (1.0 - sin2) * (aInverses[j - 1][k] >
+               aInverses[j][k] ? aInverses[j - 1][k] : aInverses[j][k]),
+               &aRadiances[j][k], &aRadiances[j - 1][k] );
+         }
+
+         /* ... and across the edge with the previous azimuth's stratum */
+         addGradient( aTranslation, &around,
+            (sqrt( ((real64)j + 1.0) / M ) - sqrt( (real64)j / M )) *
+            (aInverses[j][kPrevious] > aInverses[j][k] ?
+            aInverses[j][kPrevious] : aInverses[j][k]),
+            &aRadiances[j][k], &aRadiances[j][kPrevious] );
+      }
+   }
+
+   /* irradiance: each stratum has pi / (M * N) of it */
+   pRecord_o->irradiance = Vector3fMulF( &pRecord_o->irradiance,
+      PI / (M * N) );
+
+   /* radius: harmonic mean distance, limited by the gradient, and clamped
+      so its reach is within some pixels */
+   {
+      const real64 mean     = Vector3fDot( &pRecord_o->irradiance,
+         &Vector3fONE ) / 3.0;
+      const Vector3f g01    = Vector3fAdd( &aTranslation[0],
+         &aTranslation[1] );
+      const Vector3f g      = Vector3fAdd( &g01, &aTranslation[2] );
+      const real64 gradient = sqrt( Vector3fDot( &g, &g ) ) / 3.0;
+
+      const real64 min = IRRADIANCE_CACHE_REACH_MIN * footprint /
+         IRRADIANCE_CACHE_ACCURACY;
+      const real64 max = reachMax * footprint /
+         IRRADIANCE_CACHE_ACCURACY;
+
+      real64 radius = (inverses > 0.0) ? (M * N) / inverses : max;
+      if( (gradient * radius) > mean )
+      {
+         radius = mean / gradient;
+      }
+      pRecord_o->radius = radius < min ? min : (radius > max ? max : radius);
+   }
+}
+
+
+/**
+ * Add a cell's usable records' weighted irradiances (and its subcells'), at
+ * a point.
+ */
+static void interpolate
+(
+   const Cell*     pCell,
+   const Vector3f* pCellPosition,
+   real64          cellSize,
+   bool            isRoot,
+   const Vector3f* pPosition,
+   const Vector3f* pNormal,
+   Vector3f*       pSum_io,
+   real64*         pWeights_io
+)
+{
+   const Record* pR;
+   int32         i;
+
+   /* skip cells not reaching the point (records reach at most half their
+      cell's size out of it) */
+   for( i = 3;  !isRoot && (i-- > 0); )
+   {
+      if( (pPosition->xyz[i] < (pCellPosition->xyz[i] - (cellSize * 0.5))) |
+         (pPosition->xyz[i] > (pCellPosition->xyz[i] + (cellSize * 1.5))) )
+      {
+         return;
+      }
+   }
+
+   for( pR = pCell->pRecords;  pR;  pR = pR->pNext )
+   {
+      /* Ward's error: of distance, over radius, and of normal */
+      const Vector3f offset = Vector3fSub( pPosition, &pR->position );
+      const real64   turn   = 1.0 - Vector3fDot( pNormal, &pR->normal );
+      const real64   error  = (sqrt( Vector3fDot( &offset, &offset ) ) /
+         pR->radius) + sqrt( turn > 0.0 ? turn : 0.0 );
+
+      /* near enough, and not in front */
+      const Vector3f normals = Vector3fAdd( pNormal, &pR->normal );
+      if( (error < IRRADIANCE_CACHE_ACCURACY) && ((Vector3fDot( &offset,
+         &normals ) * 0.5) >= -(FRONT_TOLERANCE * pR->radius)) )
+      {
+         /* weight falling to 0 at the error limit */
+         const real64   weight = (1.0 / (error > 1e-9 ? error : 1e-9)) -
+            (1.0 / IRRADIANCE_CACHE_ACCURACY);
+         const Vector3f axis   = Vector3fCross( &pR->normal, pNormal );
+
+         int32 c;
+         for( c = 3;  c-- > 0; )
+         {
+            const real64 e = pR->irradiance.xyz[c] +
+               Vector3fDot( &axis, &pR->aRotation[c] );
+            pSum_io->xyz[c] += weight * (e > 0.0 ? e : 0.0);
+         }
+         *pWeights_io += weight;
+      }
+   }
+
+   for( i = 8;  i-- > 0; )
+   {
+      if( pCell->apSubCells[i] )
+      {
+         const real64 half = cellSize * 0.5;
+         Vector3f     position;
+         int32        j;
+         for( j = 3;  j-- > 0; )
+         {
+            position.xyz[j] = pCellPosition->xyz[j] +
+               ((i >> j) & 1 ? half : 0.0);
+         }
+
+         interpolate( pCell->apSubCells[i], &position, half, false, pPosition,
+            pNormal, pSum_io, pWeights_io );
+      }
+   }
+}
+
+
+/**
+ * Add a record to the octree: in the deepest cell containing it that is at
+ * least twice its reach (or the root, if outside it). Any cell that cannot
+ * be allocated ends the descent.
+ */
+static void insert
+(
+   IrradianceCache* pC,
+   Record*          pRecord
+)
+{
+   const real64 reach = IRRADIANCE_CACHE_ACCURACY * pRecord->radius;
+
+   Cell*    pCell    = &pC->root;
+   Vector3f position = pC->rootPosition;
+   real64   size     = pC->rootSize;
+   bool     isInside = true;
+   int32    depth, j;
+
+   for( j = 3;  j-- > 0; )
+   {
+      isInside &= (pRecord->position.xyz[j] >= position.xyz[j]) &
+         (pRecord->position.xyz[j] <= (position.xyz[j] + size));
+   }
+
+   for( depth = 0;  isInside && (depth < IRRADIANCE_CACHE_DEPTH_MAX) &&
+      (reach <= (size * 0.25));  ++depth )
+   {
+      /* subcell containing the record */
+      const real64 half = size * 0.5;
+      int32        i    = 0;
+      for( j = 3;  j-- > 0; )
+      {
+         if( pRecord->position.xyz[j] >= (position.xyz[j] + half) )
+         {
+            i |= 1 << j;
+            position.xyz[j] += half;
+         }
+      }
+      size = half;
+
+      if( !pCell->apSubCells[i] )
+      {
+         pCell->apSubCells[i] = (Cell*)calloc( 1, sizeof(Cell) );
+         if( !pCell->apSubCells[i] )
+         {
+            break;
+         }
+      }
+      pCell = pCell->apSubCells[i];
+   }
+
+   pRecord->pNext  = pCell->pRecords;
+   pCell->pRecords = pRecord;
+   ++pC->recordsLength;
+}
+
+
+static void freeCell
+(
+   Cell* pCell,
+   bool  isRoot
+)
+{
+   int32 i;
+   for( i = 8;  i-- > 0; )
+   {
+      if( pCell->apSubCells[i] )
+      {
+         freeCell( pCell->apSubCells[i], false );
+      }
+   }
+
+   while( pCell->pRecords )
+   {
+      Record* pNext = pCell->pRecords->pNext;
+      free( pCell->pRecords );
+      pCell->pRecords = pNext;
+   }
+
+   if( !isRoot )
+   {
+      free( pCell );
+   }
+}
+
+
+/**
+ * Indirect irradiance at a surface point: interpolated from the records, or
+ * from a new one.
+ */
+static Vector3f irradiance
+(
+   IrradianceCache*    pC,
+   const SurfacePoint* pPoint,
+   const Vector3f*     pNormal,
+   real64              footprint,
+   real64              reachMax,
+   Random*             pRandom
+)
+{
+   Vector3f sum     = Vector3fZERO;
+   real64   weights = 0.0;
+
+   pthread_rwlock_rdlock( &pC->lock );
+   interpolate( &pC->root, &pC->rootPosition, pC->rootSize, true,
+      &pPoint->position, pNormal, &sum, &weights );
+   pthread_rwlock_unlock( &pC->lock );
+
+   if( weights > 0.0 )
+   {
+      return Vector3fMulF( &sum, 1.0 / weights );
+   }
+   else
+   {
+      /* make a record (outside the lock), and keep it if it can be */
+      Record   record;
+      Record*  pKept = (Record*)malloc( sizeof(Record) );
+      makeRecord( pC, pPoint, pNormal, footprint, reachMax, pRandom,
+         &record );
+
+      if( pKept )
+      {
+         *pKept = record;
+         pthread_rwlock_wrlock( &pC->lock );
+         insert( pC, pKept );
+         pthread_rwlock_unlock( &pC->lock );
+      }
+
+      return record.irradiance;
+   }
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+IrradianceCache* IrradianceCacheConstruct
+(
+   jmp_buf      jmpBuf,
+   const Scene* pScene
+)
+{
+   IrradianceCache* pC = (IrradianceCache*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(IrradianceCache) ) );
+
+   if( pthread_rwlock_init( &pC->lock, 0 ) )
+   {
+      free( pC );
+      throwExceptions( jmpBuf, true, ERROR_ALLOC );
+   }
+
+   pC->pScene = pScene;
+
+   /* root: a cube around the scene index's bound */
+   {
+      const real64* aBound = pScene->pIndex->aBound;
+      int32 i;
+      for( i = 3;  i-- > 0; )
+      {
+         const real64 extent = aBound[i + 3] - aBound[i];
+         pC->rootPosition.xyz[i] = aBound[i];
+         pC->rootSize = extent > pC->rootSize ? extent : pC->rootSize;
+      }
+      pC->rootSize = pC->rootSize > 0.0 ? pC->rootSize * (1.0 + 1e-6) : 1.0;
+   }
+
+   return pC;
+}
+
+
+void IrradianceCacheDestruct
+(
+   IrradianceCache* pC
+)
+{
+   if( pC )
+   {
+      freeCell( &pC->root, true );
+      pthread_rwlock_destroy( &pC->lock );
+
+      free( pC );
+   }
+}
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+Vector3f IrradianceCacheRadiance
+(
+   IrradianceCache* pC,
+   const Vector3f*  pRayOrigin,
+   const Vector3f*  pRayDirection,
+   real64           pixelWidth,
+   int32            imageWidth,
+   Random*          pRandom
+)
+{
+   Vector3f radiance;
+
+   /* most reach, in pixels: less in narrow images */
+   const real64 across   = (real64)imageWidth / IRRADIANCE_CACHE_ACROSS_MIN;
+   const real64 reachMax = across < IRRADIANCE_CACHE_REACH_MAX ?
+      (across > IRRADIANCE_CACHE_REACH_MIN ? across :
+      IRRADIANCE_CACHE_REACH_MIN) : IRRADIANCE_CACHE_REACH_MAX;
+
+   const Vector3f rayBackDirection = Vector3fNegative( pRayDirection );
+
+   /* intersect ray with scene, making surface point of intersection */
+   SurfacePoint surfacePoint;
+   bool         isHit;
+   STATS_COUNT( STATS_RAYS_PRIMARY );
+   isHit = SceneIntersection( pC->pScene, pRayOrigin, pRayDirection, 0,
+      &surfacePoint );
+
+   if( isHit )
+   {
+      const RayTracer rayTracer = RayTracerCreate( pC->pScene );
+      const Vector3f* pReflectivity =
+         &surfacePoint.pTriangle->pMaterial->reflectivity;
+
+      /* emission (whole), and light straight from emitters and sky */
+      const Vector3f emission = SurfacePointEmission( &surfacePoint,
+         pRayOrigin, &rayBackDirection, false );
+      const Vector3f direct   = RayTracerDirect( &rayTracer,
+         &rayBackDirection, &surfacePoint, pRandom );
+      radiance = Vector3fAdd( &emission, &direct );
+
+      STATS_COUNT( STATS_PATH_VERTEXES );
+
+      /* indirect: cached irradiance, of the side seen, reflected by the
+         ideal diffuse BRDF (reflectivity / pi) */
+      if( !Vector3fIsZero( pReflectivity ) )
+      {
+         const Vector3f ray      = Vector3fSub( &surfacePoint.position,
+            pRayOrigin );
+         Vector3f       normal   = SurfacePointNormal( &surfacePoint );
+         Vector3f       incoming;
+         if( Vector3fDot( &normal, &rayBackDirection ) < 0.0 )
+         {
+            normal = Vector3fNegative( &normal );
+         }
+
+         incoming = irradiance( pC, &surfacePoint, &normal, pixelWidth *
+            sqrt( Vector3fDot( &ray, &ray ) ), reachMax, pRandom );
+         incoming = Vector3fMulV( &incoming, pReflectivity );
+         incoming = Vector3fMulF( &incoming, 1.0 / PI );
+         radiance = Vector3fAdd( &radiance, &incoming );
+      }
+   }
+   else
+   {
+      radiance = SceneDefaultEmission( pC->pScene, &rayBackDirection );
+   }
+
+   return radiance;
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+int32 IrradianceCacheRecordsCount
+(
+   IrradianceCache* pC
+)
+{
+   int32 count;
+
+   pthread_rwlock_rdlock( &pC->lock );
+   count = pC->recordsLength;
+   pthread_rwlock_unlock( &pC->lock );
+
+   return count;
+}
@@ -0,0 +1,159 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef IrradianceCache_h
+#define IrradianceCache_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Random.h"
+#include "Vector3f.h"
+#include "Scene.h"
+
+
+
+
+/**
+ * Irradiance cache: an alternative to tracing paths fully, for the smooth
+ * indirect light of ideal diffuse surfaces.<br/><br/>
+ *
+ * At a trace's first hit, emission and direct light are sampled as usual
+ * (as RayTracer's first step), but the indirect light comes from records of
+ * irradiance at sparse points nearby, interpolated -- a record only being
+ * made (from IRRADIANCE_CACHE_THETAS * IRRADIANCE_CACHE_PHIS stratified
+ * paths over the hemisphere) where none is near enough.<br/><br/>
+ *
+ * Records hold the indirect irradiance, with its rotational gradient (for
+ * extrapolating to turned normals), and a radius of validity (the harmonic
+ * mean distance of what their paths hit, so records are denser near other
+ * surfaces -- limited by the translational gradient, and clamped so they
+ * reach between a few and many pixels' widths where made, and fewer in small
+ * images, so each has at least some records across). A record is used
+ * at a point if near enough, in position and normal, for
+ * IRRADIANCE_CACHE_ACCURACY (Ward's error measure), and not in front of it.
+ * <br/><br/>
+ *
+ * Records are kept in an octree (each in the deepest cell still twice the
+ * size of its reach), and live as long as the cache: over every iteration,
+ * and every view of the same scene, on any number of threads (lookups share
+ * a read lock, and making a record takes the write lock only to add it).
+ * So the result converges to the cache's, not the exact: fast, and smooth,
+ * but with any error of the records kept. Which records are made depends on
+ * which thread reaches where first.<br/><br/>
+ *
+ * Mutable (thread-safe).
+ *
+ * @implementation
+ * 'A Ray Tracing Solution for Diffuse Interreflection'; Ward, Rubinstein,
+ * Clear; SIGGRAPH 1988.<br/>
+ * 'Irradiance Gradients'; Ward, Heckbert; Eurographics Rendering Workshop
+ * 1992.
+ */
+
+typedef struct IrradianceCache IrradianceCache;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * Empty cache for an indexed scene (the scene to outlive the cache).
+ */
+IrradianceCache* IrradianceCacheConstruct
+(
+   jmp_buf      jmpBuf,
+   const Scene* pScene
+);
+
+void IrradianceCacheDestruct
+(
+   IrradianceCache*
+);
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+/**
+ * Radiance returned from a trace, with indirect light from the cache (adding
+ * a record if needed).
+ *
+ * @param pixelWidth width of a pixel at unit distance from the eye (for
+ *        spacing records)
+ * @param imageWidth in pixels (for spacing records also)
+ */
+Vector3f IrradianceCacheRadiance
+(
+   IrradianceCache*,
+   const Vector3f*  pRayOrigin,
+   const Vector3f*  pRayDirection,
+   real64           pixelWidth,
+   int32            imageWidth,
+   Random*          pRandom
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Number of records made so far.
+ */
+int32 IrradianceCacheRecordsCount
+(
+   IrradianceCache*
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Largest error (Ward's measure) a record is used with: smaller makes more
+ * records, and less blotches.
+ */
+#define IRRADIANCE_CACHE_ACCURACY 0.2
+
+/**
+ * Strata of a record's hemisphere: by angle from the normal, and around it.
+ */
+#define IRRADIANCE_CACHE_THETAS 16
+#define IRRADIANCE_CACHE_PHIS   48
+
+/**
+ * Record reach limits (how far away it can be used: its radius times the
+ * accuracy), in pixel widths at the distance made from (but see
+ * IRRADIANCE_CACHE_ACROSS_MIN).
+ */
+#define IRRADIANCE_CACHE_REACH_MIN  4.0
+#define IRRADIANCE_CACHE_REACH_MAX 64.0
+
+/**
+ * Fewest largest reaches across an image: in narrower images, the most reach
+ * is less (down to the least) -- else at low resolutions a few records would
+ * cover the whole view.
+ */
+#define IRRADIANCE_CACHE_ACROSS_MIN 8.0
+
+/**
+ * Most depth of the octree.
+ */
+#define IRRADIANCE_CACHE_DEPTH_MAX 32
+
+
+
+
+#endif
@@ -0,0 +1,521 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "Exceptions.h"
+
+#include "LightTree.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const real64 PI = 3.14159265358979;
+
+static const Vector3f RGB_LUMINANCE = {{ 0.2126, 0.7152, 0.0722 }};
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Tree node: its emitters' bound, cone of normals (axis, and cosine and sine
+ * of its spread angle), and total power (luminance flux, leaving out pi) --
+ * and its second child (the first following it), or, as a leaf, its emitter.
+ */
+struct Node
+{
+   real64   aBound[6];
+   Vector3f axis;
+   real64   cosSpread;
+   real64   sinSpread;
+   real64   power;
+
+   int32    second;
+   int32    emitter;
+   int32    parent;
+};
+
+typedef struct Node Node;
+
+
+/**
+ * Emitter, as placed, for building.
+ */
+struct Item
+{
+   real64   aBound[6];
+   Vector3f centre;
+   Vector3f normal;
+   real64   power;
+};
+
+typedef struct Item Item;
+
+
+struct LightTree
+{
+   /* nodes (root first), and each emitter's leaf */
+   Node*  aNodes;
+   int32  nodesLength;
+   int32* aLeaves;
+};
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Cone bounding two cones.
+ */
+static void mergeCones
+(
+   const Vector3f* pAxisA,
+   real64          spreadA,
+   const Vector3f* pAxisB,
+   real64          spreadB,
+   Vector3f*       pAxis_o,
+   real64*         pSpread_o
+)
+{
+   if( spreadA < spreadB )
+   {
+      mergeCones( pAxisB, spreadB, pAxisA, spreadA, pAxis_o, pSpread_o );
+   }
+   else
+   {
+      const real64 cosBetween = Vector3fDot( pAxisA, pAxisB );
+      const real64 between    = acos( cosBetween < -1.0 ? -1.0 :
+         (cosBetween > 1.0 ? 1.0 : cosBetween) );
+      const real64 spread     = (spreadA + between + spreadB) * 0.5;
+
+      /* wider cone holds the other, or together they span everything */
+      *pAxis_o   = *pAxisA;
+      *pSpread_o = ((between + spreadB) <= spreadA) ? spreadA : PI;
+
+      if( ((between + spreadB) > spreadA) && (spread < PI) )
+      {
+         /* turn the wider's axis toward the other's, by what the new spread
+            adds */
+         const Vector3f along = Vector3fMulF( pAxisA, cosBetween );
+         const Vector3f away  = Vector3fSub( pAxisB, &along );
+         const Vector3f side  = Vector3fUnitized( &away );
+
+         if( !Vector3fIsZero( &side ) )
+         {
+            const Vector3f a = Vector3fMulF( pAxisA, cos( spread - spreadA ) );
+            const Vector3f b = Vector3fMulF( &side, sin( spread - spreadA ) );
+            const Vector3f axis = Vector3fAdd( &a, &b );
+
+            *pAxis_o   = Vector3fUnitized( &axis );
+            *pSpread_o = spread;
+         }
+      }
+   }
+}
+
+
+/**
+ * Cosine of the difference of two angles (0 to pi), clamped to at least 0 --
+ * from their cosines and sines.
+ */
+static real64 cosLess
+(
+   real64 cosA,
+   real64 sinA,
+   real64 cosB,
+   real64 sinB
+)
+{
+   return (cosA >= cosB) ? 1.0 : (cosA * cosB) + (sinA * sinB);
+}
+
+
+/**
+ * Estimated contribution of a node's emitters to a surface point: power over
+ * squared distance, by the most the emitting and receiving cosines can be
+ * (0 if neither can be positive). (Without trigonometry: only by cosines and
+ * sines.)
+ */
+static real64 importance
+(
+   const Node*     pN,
+   const Vector3f* pPosition,
+   const Vector3f* pNormal
+)
+{
+   Vector3f toward;
+   real64   radius2 = 0.0, distance2, cosines = 1.0;
+   int      i;
+
+   /* bound centre, and its radius */
+   for( i = 3;  i-- > 0; )
+   {
+      const real64 half = (pN->aBound[i + 3] - pN->aBound[i]) * 0.5;
+      toward.xyz[i] = (pN->aBound[i] + half) - pPosition->xyz[i];
+      radius2 += half * half;
+   }
+   distance2 = Vector3fDot( &toward, &toward );
+
+   /* (inside the bound, any angle is possible) */
+   if( distance2 > radius2 )
+   {
+      /* angle the bound spans, as seen from the point */
+      const real64   sinBound = sqrt( radius2 / distance2 );
+      const real64   cosBound = sqrt( 1.0 - (sinBound * sinBound) );
+      const Vector3f direction = Vector3fMulF( &toward, 1.0 /
+         sqrt( distance2 ) );
+
+      /* emitting angle, less the spread, less the bound's */
+      const real64   cosEmit  = -Vector3fDot( &pN->axis, &direction );
+      const real64   cosOut   = cosLess( cosEmit, sqrt( fabs( 1.0 -
+         (cosEmit * cosEmit) ) ), pN->cosSpread, pN->sinSpread );
+      const real64   cosEmit2 = cosLess( cosOut, sqrt( fabs( 1.0 -
+         (cosOut * cosOut) ) ), cosBound, sinBound );
+
+      /* receiving angle, less the bound's */
+      const real64   cosIn      = Vector3fDot( pNormal, &direction );
+      const real64   cosReceive = cosLess( cosIn, sqrt( fabs( 1.0 -
+         (cosIn * cosIn) ) ), cosBound, sinBound );
+
+      cosines = ((cosEmit2 > 0.0) && (cosReceive > 0.0)) ?
+         cosEmit2 * cosReceive : 0.0;
+   }
+
+   return pN->power * cosines / (distance2 > radius2 ? distance2 : radius2);
+}
+
+
+/**
+ * Probability of choosing a node's first child.
+ */
+static real64 firstShare
+(
+   const LightTree* pT,
+   const Node*      pN,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal
+)
+{
+   const real64 first  = importance( pN + 1, pPosition, pNormal );
+   const real64 second = importance( &pT->aNodes[pN->second], pPosition,
+      pNormal );
+
+   /* (if neither can contribute, it does not matter) */
+   return (first + second) > 0.0 ? first / (first + second) : 0.5;
+}
+
+
+/**
+ * Put the middle-ranked item (by centre along an axis) in the middle of a
+ * range of the order, lower-ranked before it, higher after (Hoare's select).
+ */
+static void selectMiddle
+(
+   const Item* aItems,
+   int32*      aOrder,
+   int32       begin,
+   int32       end,
+   int         axis
+)
+{
+   const int32 middle = begin + ((end - begin) / 2);
+   int32       low    = begin;
+   int32       high   = end - 1;
+
+   while( low < high )
+   {
+      const real64 pivot = aItems[aOrder[low + ((high - low) / 2)]].centre.
+         xyz[axis];
+      int32        i     = low;
+      int32        j     = high;
+
+      while( i <= j )
+      {
+         while( aItems[aOrder[i]].centre.xyz[axis] < pivot ) { ++i; }
+         while( aItems[aOrder[j]].centre.xyz[axis] > pivot ) { --j; }
+         if( i <= j )
+         {
+            const int32 swap = aOrder[i];
+            aOrder[i++] = aOrder[j];
+            aOrder[j--] = swap;
+         }
+      }
+
+      if( middle <= j )
+      {
+         high = j;
+      }
+      else if( middle >= i )
+      {
+         low = i;
+      }
+      else
+      {
+         break;
+      }
+   }
+}
+
+
+/**
+ * Make the node for a range of the order (and its subnodes), splitting at
+ * the middle by the widest axis of the items' centres.
+ *
+ * @return index of the node
+ */
+static int32 build
+(
+   LightTree*  pT,
+   const Item* aItems,
+   int32*      aOrder,
+   int32       begin,
+   int32       end,
+   int32       parent
+)
+{
+   const int32 index = pT->nodesLength++;
+   Node*       pN    = &pT->aNodes[index];
+   int         j;
+
+   pN->parent = parent;
+
+   if( (end - begin) == 1 )
+   {
+      /* leaf: the emitter's own */
+      const Item* pItem = &aItems[aOrder[begin]];
+      for( j = 6;  j-- > 0;  pN->aBound[j] = pItem->aBound[j] ) {}
+      pN->axis      = pItem->normal;
+      pN->cosSpread = 1.0;
+      pN->sinSpread = 0.0;
+      pN->power     = pItem->power;
+      pN->second    = -1;
+      pN->emitter   = aOrder[begin];
+
+      pT->aLeaves[aOrder[begin]] = index;
+   }
+   else
+   {
+      real64 aCentres[6];
+      int    axis = 0;
+      int32  i;
+
+      /* widest axis of the centres */
+      for( j = 3;  j-- > 0; )
+      {
+         aCentres[j]     = aItems[aOrder[begin]].centre.xyz[j];
+         aCentres[j + 3] = aCentres[j];
+      }
+      for( i = begin;  i < end;  ++i )
+      {
+         for( j = 3;  j-- > 0; )
+         {
+            const real64 c = aItems[aOrder[i]].centre.xyz[j];
+            aCentres[j]     = c < aCentres[j]     ? c : aCentres[j];
+            aCentres[j + 3] = c > aCentres[j + 3] ? c : aCentres[j + 3];
+         }
+      }
+      for( j = 3;  j-- > 0; )
+      {
+         axis = ((aCentres[j + 3] - aCentres[j]) > (aCentres[axis + 3] -
+            aCentres[axis])) ? j : axis;
+      }
+
+      selectMiddle( aItems, aOrder, begin, end, axis );
+
+      /* halves, then their union */
+      pN->emitter = -1;
+      build( pT, aItems, aOrder, begin, begin + ((end - begin) / 2), index );
+      pN->second = build( pT, aItems, aOrder, begin + ((end - begin) / 2),
+         end, index );
+      {
+         const Node* pA = pN + 1;
+         const Node* pB = &pT->aNodes[pN->second];
+         real64      spread;
+
+         for( j = 3;  j-- > 0; )
+         {
+            pN->aBound[j]     = pA->aBound[j] < pB->aBound[j] ?
+               pA->aBound[j] : pB->aBound[j];
+            pN->aBound[j + 3] = pA->aBound[j + 3] > pB->aBound[j + 3] ?
+               pA->aBound[j + 3] : pB->aBound[j + 3];
+         }
+         mergeCones( &pA->axis, acos( pA->cosSpread ), &pB->axis,
+            acos( pB->cosSpread ), &pN->axis, &spread );
+         pN->cosSpread = cos( spread );
+         pN->sinSpread = sin( spread );
+         pN->power     = pA->power + pB->power;
+      }
+   }
+
+   return index;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+LightTree* LightTreeConstruct
+(
+   jmp_buf          jmpBuf,
+   const Triangle** apEmitters,
+   const Instance** apEmitterInstances,
+   int32            emittersLength
+)
+{
+   LightTree* pT = (LightTree*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(LightTree) ) );
+   Item*      aItems;
+   int32*     aOrder;
+   int32      i;
+
+   throwExceptions( jmpBuf, (emittersLength >= (INT32_MAX / 2)),
+      ERROR_ALLOC );
+
+   /* (a tree of n leaves has 2n - 1 nodes) */
+   pT->aNodes  = (Node*)calloc( ((size_t)emittersLength * 2) + 1,
+      sizeof(Node) );
+   pT->aLeaves = (int32*)calloc( (size_t)emittersLength + 1, sizeof(int32) );
+   aItems      = (Item*)calloc( (size_t)emittersLength + 1, sizeof(Item) );
+   aOrder      = (int32*)calloc( (size_t)emittersLength + 1, sizeof(int32) );
+   if( !pT->aNodes || !pT->aLeaves || !aItems || !aOrder )
+   {
+      free( aOrder );
+      free( aItems );
+      LightTreeDestruct( pT );
+      throwExceptions( jmpBuf, true, ERROR_ALLOC );
+   }
+
+   /* emitters, as placed */
+   for( i = 0;  i < emittersLength;  ++i )
+   {
+      Vector3f        aVertexs[3];
+      Triangle        placed;
+      const Triangle* pTriangle = apEmitters[i];
+      int             j;
+      if( apEmitterInstances[i] )
+      {
+         InstanceTriangle( apEmitterInstances[i], pTriangle, aVertexs,
+            &placed );
+         pTriangle = &placed;
+      }
+
+      TriangleBound( pTriangle, aItems[i].aBound );
+      for( j = 3;  j-- > 0;  aItems[i].centre.xyz[j] = (aItems[i].aBound[j] +
+         aItems[i].aBound[j + 3]) * 0.5 ) {}
+      aItems[i].normal = TriangleNormal( pTriangle );
+      aItems[i].power  = Vector3fDot( &pTriangle->pMaterial->emitivity,
+         &RGB_LUMINANCE ) * TriangleArea( pTriangle );
+
+      aOrder[i] = i;
+   }
+
+   if( emittersLength > 0 )
+   {
+      build( pT, aItems, aOrder, 0, emittersLength, -1 );
+   }
+
+   free( aOrder );
+   free( aItems );
+
+   return pT;
+}
+
+
+void LightTreeDestruct
+(
+   LightTree* pT
+)
+{
+   if( pT )
+   {
+      free( pT->aLeaves );
+      free( pT->aNodes );
+
+      free( pT );
+   }
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+int32 LightTreeSelect
+(
+   const LightTree* pT,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal,
+   Random*          pRandom,
+   real64*          pProbability_o
+)
+{
+   int32 emitter = -1;
+
+   *pProbability_o = 0.0;
+
+   if( pT->nodesLength > 0 )
+   {
+      /* descend, choosing children by their shares */
+      const Node* pN = pT->aNodes;
+      *pProbability_o = 1.0;
+
+      while( pN->emitter < 0 )
+      {
+         const real64 share = firstShare( pT, pN, pPosition, pNormal );
+         if( RandomReal64( pRandom ) < share )
+         {
+            pN = pN + 1;
+            *pProbability_o *= share;
+         }
+         else
+         {
+            pN = &pT->aNodes[pN->second];
+            *pProbability_o *= 1.0 - share;
+         }
+      }
+
+      emitter = pN->emitter;
+   }
+
+   return emitter;
+}
+
+
+real64 LightTreeProbability
+(
+   const LightTree* pT,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal,
+   int32            emitter
+)
+{
+   real64 probability = 1.0;
+   int32  index       = pT->aLeaves[emitter];
+
+   /* ascend, taking the shares that choose the way down */
+   while( pT->aNodes[index].parent >= 0 )
+   {
+      const int32  parent = pT->aNodes[index].parent;
+      const real64 share  = firstShare( pT, &pT->aNodes[parent], pPosition,
+         pNormal );
+
+      probability *= (index == (parent + 1)) ? share : 1.0 - share;
+      index = parent;
+   }
+
+   return probability;
+}
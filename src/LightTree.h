@@ -0,0 +1,110 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef LightTree_h
+#define LightTree_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Random.h"
+#include "Vector3f.h"
+#include "Triangle.h"
+#include "Instance.h"
+
+
+
+
+/**
+ * Light tree: a hierarchy over the emitters, for choosing one by its
+ * estimated contribution to a surface point, instead of uniformly.<br/><br/>
+ *
+ * A binary tree (split at the median of the emitters' centres, along the
+ * widest axis), each node holding its emitters' bound, total power, and the
+ * cone bounding their normals. Choosing descends from the root, taking each
+ * child by its share of the two's importance: power over squared distance,
+ * by the cosines (at their most, given the bound's spread and the cone's)
+ * of the emitting and receiving angles. So near emitters facing the point,
+ * that it faces, are chosen most, and ones behind it, or facing away, never
+ * -- and a choice costs steps of the tree's depth, not of the number of
+ * emitters.<br/><br/>
+ *
+ * Constant.
+ *
+ * @implementation
+ * 'Importance Sampling of Many Lights with Adaptive Tree Splitting'; Estevez,
+ * Kulla; HPG 2018 (without the splitting).
+ */
+
+typedef struct LightTree LightTree;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * Tree over emitters (as Scene holds them: triangles, with their instances or
+ * 0s -- to outlive the tree).
+ */
+LightTree* LightTreeConstruct
+(
+   jmp_buf          jmpBuf,
+   const Triangle** apEmitters,
+   const Instance** apEmitterInstances,
+   int32            emittersLength
+);
+
+void LightTreeDestruct
+(
+   LightTree*
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Monte-carlo select an emitter, by its estimated contribution to a surface
+ * point.
+ *
+ * @param pNormal of the surface, on the side light is received
+ * @param pProbability_o probability of selecting it
+ * @return index of the emitter, or -1 if none
+ */
+int32 LightTreeSelect
+(
+   const LightTree*,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal,
+   Random*          pRandom,
+   real64*          pProbability_o
+);
+
+/**
+ * Probability of LightTreeSelect selecting an emitter.
+ *
+ * @param pNormal as for LightTreeSelect
+ * @param emitter index
+ */
+real64 LightTreeProbability
+(
+   const LightTree*,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal,
+   int32            emitter
+);
+
+
+
+
+#endif
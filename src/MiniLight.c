@@ -8,19 +8,21 @@
 ------------------------------------------------------------------------------*/
 
 
+#define _POSIX_C_SOURCE 199309L
+
 #include <math.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "Primitives.h"
 #include "Exceptions.h"
-#include "Random.h"
-#include "Image.h"
-#include "Scene.h"
-#include "Camera.h"
+#include "MiniLightLib.h"
+#include "Preview.h"
+#include "Server.h"
 
 
 
@@ -31,7 +33,8 @@
  * Handles command-line UI, and runs the main progressive-refinement render
  * loop.<br/><br/>
  *
- * Supply a model file pathname as the command-line argument. Or -? for help.
+ * Supply a model file pathname as the command-line argument, optionally
+ * preceded by options. Or -? for help.
  */
 
 
@@ -48,8 +51,66 @@ static const char DESCRIPTION[] =
 "MiniLight is a minimal global illumination renderer.";
 static const char USAGE[] =
 "usage:\n"
-"  minilight modelFilePathName\n"
+"  minilight [options] modelFilePathName\n"
+"  minilight [--cache n] --serve socketPathName\n"
 "\n"
+"options:\n";
+static const char* OPTIONS[] = {
+"  --iterations n        render n iterations (instead of the model's)\n"
+"  --seed hex            random seed, up to 8 hex digits (also the image\n"
+"                        file name id)\n"
+"  --output pathname     image file pathname (instead of the generated)\n"
+"  --region x0 y0 x1 y1  render only this rectangle of the image (pixels,\n"
+"                        from top-left, x1 y1 exclusive), written as a tile\n"
+"                        (for assembling with: minilightmerge --stitch)\n",
+"  --time-limit seconds  render until the wall-clock time limit (instead of\n"
+"                        the model's iterations), finishing with the last\n"
+"                        iteration that fits, and its image saved\n"
+"  --target-noise ratio  also stop when the estimated relative noise (RMS\n"
+"                        pixel standard error over mean) is this or less\n",
+"  --bidirectional       trace by bidirectional path tracing (for light from\n"
+"                        small, enclosed, or only indirectly seen emitters)\n"
+"  --photon-mapping      render by progressive photon mapping (for interiors\n"
+"                        lit mostly indirectly), each iteration a pass over\n"
+"                        all processors\n",
+"  --irradiance-cache    trace indirect light on diffuse surfaces from a\n"
+"                        cache of irradiance records, interpolated, made as\n"
+"                        needed and kept for every iteration and view\n"
+"  --path-guiding        sample bounces by a guide learned over the first\n"
+"                        iterations (for longer renders of interiors)\n",
+"  --preview pathname    stream in-progress images to this FIFO, or - for\n"
+"                        stdout (see src/Preview.h for the format)\n"
+"  --preview-every n     ... every n iterations (default 1)\n"
+"  --preview-ms t        ... or when t milliseconds have passed\n",
+"  --scene-cache path    keep read and indexed scenes in this directory, to\n"
+"                        reuse in later runs of the same model and view\n"
+"  --scene-cache-size mb limit the directory to this many megabytes\n"
+"                        (default 1024), removing least recently used\n",
+"  --out-of-core mb      render the scene paged from the scene cache, its\n"
+"                        geometry kept within this many resident megabytes\n"
+"                        (for scenes larger than memory, once cached)\n",
+"  --farm workers        split the iterations among worker processes, with\n"
+"                        distinct seeds, then merge their images (not with\n"
+"                        --time-limit or --target-noise)\n"
+"  --worker-command cmd  shell command template for farm workers (default:\n"
+"                        this program, locally), with placeholders:\n"
+"                        {worker} {seed} {iterations} {model} {output}\n",
+"  --cameras pathname    render each view in this file (lines of:\n"
+"                        viewposition viewdirection viewangle) instead of\n"
+"                        the model's, sharing one scene, to numbered images\n",
+"  --animation pathname frames\n"
+"                        render frames along a camera path through the key\n"
+"                        views in this file (as --cameras, spaced evenly),\n"
+"                        sharing one scene, to numbered images\n"
+"  --threads n           render views on n threads (default: processors)\n",
+"  --serve pathname      run as a render daemon on this Unix socket (see\n"
+"                        src/Server.h for the protocol), caching scenes\n"
+"  --cache n             scenes kept loaded by the daemon (default 8)\n",
+"  --load-benchmark      only time loading the model, and loading it again\n"
+"                        as written in the plain model format (imports as\n"
+"                        triangles), and print triangles per second\n",
+0 };
+static const char FORMAT[] =
 "The model text file format is:\n"
 "  #MiniLight\n"
 "\n"
@@ -79,21 +140,115 @@ static const char EXAMPLE[] =
 "\n"
 "  (0 0 0) (0 1 0) (1 1 0)  (0.7 0.7 0.7) (0 0 0)\n"
 "\n";
+static const char INSTANCING[] =
+"Triangles can also be defined as a named object, and placed many times\n"
+"(transformed by its axes and origin), among the other triangles:\n"
+"\n"
+"  object name\n"
+"  vertex0 vertex1 vertex2 reflectivity emitivity\n"
+"  ...\n"
+"  end\n"
+"\n"
+"  instance name xaxis yaxis zaxis origin\n"
+"\n"
+"Triangles can be imported from a mesh file (Wavefront OBJ, or binary PLY)\n"
+"-- into the scene, or an object -- with a default material:\n"
+"\n"
+"  import pathname reflectivity emitivity\n"
+"\n";
+static const char PORTALS[] =
+"Openings the sky is seen through (windows) can be marked by portals --\n"
+"triangles that are not drawn -- so sky light is sampled through them,\n"
+"instead of over the whole sky:\n"
+"\n"
+"  portal vertex0 vertex1 vertex2\n"
+"\n";
 
 /* templates */
 static const char BANNER_MESSAGE[] = "\n  %s - %s\n\n";
 static const char HELP_MESSAGE[]   =
-   "\n%s  %s\n\n  %s\n  %s\n\n  %s\n%s\n%s\n\n%s%s";
+   "\n%s  %s\n\n  %s\n  %s\n\n  %s\n%s\n%s\n\n%s";
 
 
 
 
 /* constants ---------------------------------------------------------------- */
 
-static const char MODEL_FORMAT_ID[] = "#MiniLight";
+/* (other codes are the library's) */
+#define ERROR_OPTION ERROR_ARGUMENT
+
+/* default scene cache size */
+#define SCENE_CACHE_MEGABYTES 1024
+
+
+
 
-#define ERROR_FORMAT_UNREC 1
-#define ERROR_FILE         128
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Command-line settings.
+ */
+struct Options
+{
+   const char* sModelFilePathname;
+
+   /* absolute wall-clock seconds to finish by, or 0 */
+   real64      deadline;
+   /* relative noise to finish at, or 0 */
+   real64      targetNoise;
+
+   /* iterations to render, or -1 for the model's */
+   int32       iterations;
+   /* random seed, if isSeeded */
+   bool        isSeeded;
+   int32u      seed;
+   /* image file pathname, or 0 to generate */
+   const char* sImageFilePathname;
+   /* image part to render, if isRegion */
+   bool        isRegion;
+   int32       aRegion[4];
+   /* whether to trace bidirectionally, or to photon map, or to cache
+      irradiance, or to guide paths */
+   bool        isBidirectional;
+   bool        isPhotonMapping;
+   bool        isIrradianceCaching;
+   bool        isPathGuiding;
+
+   /* preview stream pathname, or 0; and update interval, in iterations, and
+      milliseconds (either, or 0) */
+   const char* sPreviewPathname;
+   int32       previewEvery;
+   int32       previewMs;
+
+   /* scene cache directory, or 0; and its size limit, in megabytes */
+   const char* sSceneCachePathname;
+   int32       sceneCacheMegabytes;
+   /* resident geometry limit, in megabytes, or 0 for not paged */
+   int32       outOfCoreMegabytes;
+
+   /* worker processes to split among, or 0 */
+   int32       farmWorkers;
+   /* shell command template for workers */
+   const char* sWorkerCommand;
+
+   /* camera file of views to render instead of the model's, or 0 */
+   const char* sCamerasFilePathname;
+   /* frames along a path through the camera file's views, or 0 for just the
+      views */
+   int32       animationFrames;
+   /* threads for rendering views, or 0 for the number of processors */
+   int32       threads;
+
+   /* socket to serve on (instead of rendering a model), or 0 */
+   const char* sServeSocketPathname;
+   /* scenes for the server to keep loaded */
+   int32       cacheLength;
+
+   /* whether to only time loading the model */
+   bool        isLoadBenchmark;
+};
+
+typedef struct Options Options;
 
 
 
@@ -118,101 +273,689 @@ void sigintHandler
 
 /* implementation ----------------------------------------------------------- */
 
+/**
+ * Wall-clock time, in seconds.
+ */
+static real64 wallSeconds()
+{
+   struct timespec t;
+   return clock_gettime( CLOCK_MONOTONIC, &t ) ? 0.0 :
+      (real64)t.tv_sec + ((real64)t.tv_nsec * 1e-9);
+}
+
+
+static real64 readPositiveReal
+(
+   jmp_buf     jmpBuf,
+   const char* sArg
+)
+{
+   real64 r = 0.0;
+   throwExceptions( jmpBuf, !sArg || (1 != sscanf( sArg, "%lf", &r )) ||
+      !(r > 0.0), ERROR_OPTION );
+
+   return r;
+}
+
+
+static int32 readPositiveInt
+(
+   jmp_buf     jmpBuf,
+   const char* sArg
+)
+{
+   int32 i = 0;
+   throwExceptions( jmpBuf, !sArg || (1 != sscanf( sArg, "%i", &i )) ||
+      (i < 1), ERROR_OPTION );
+
+   return i;
+}
+
+
+static void readOptions
+(
+   jmp_buf  jmpBuf,
+   int      argc,
+   char*    argv[],
+   real64   startTime,
+   Options* pOptions_o
+)
+{
+   int i;
+
+   pOptions_o->deadline             = 0.0;
+   pOptions_o->targetNoise          = 0.0;
+   pOptions_o->iterations           = -1;
+   pOptions_o->isSeeded             = false;
+   pOptions_o->seed                 = 0;
+   pOptions_o->sImageFilePathname   = 0;
+   pOptions_o->isRegion             = false;
+   pOptions_o->isBidirectional      = false;
+   pOptions_o->isPhotonMapping      = false;
+   pOptions_o->isIrradianceCaching  = false;
+   pOptions_o->isPathGuiding        = false;
+   pOptions_o->sPreviewPathname     = 0;
+   pOptions_o->previewEvery         = 0;
+   pOptions_o->previewMs            = 0;
+   pOptions_o->sSceneCachePathname  = 0;
+   pOptions_o->sceneCacheMegabytes  = SCENE_CACHE_MEGABYTES;
+   pOptions_o->outOfCoreMegabytes   = 0;
+   pOptions_o->farmWorkers          = 0;
+   pOptions_o->sWorkerCommand       = 0;
+   pOptions_o->sCamerasFilePathname = 0;
+   pOptions_o->animationFrames      = 0;
+   pOptions_o->threads              = 0;
+   pOptions_o->sServeSocketPathname = 0;
+   pOptions_o->cacheLength          = SERVER_CACHE_DEFAULT;
+   pOptions_o->isLoadBenchmark      = false;
+
+   /* options, then model file pathname last */
+   for( i = 1;  i < (argc - 1);  ++i )
+   {
+      if( !strcmp( argv[i], "--time-limit" ) )
+      {
+         pOptions_o->deadline = startTime +
+            readPositiveReal( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--target-noise" ) )
+      {
+         pOptions_o->targetNoise = readPositiveReal( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--iterations" ) )
+      {
+         pOptions_o->iterations = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--seed" ) )
+      {
+         ++i;
+         throwExceptions( jmpBuf, !argv[i] ||
+            (1 != sscanf( argv[i], "%x", &pOptions_o->seed )), ERROR_OPTION );
+         pOptions_o->isSeeded = true;
+      }
+      else if( !strcmp( argv[i], "--output" ) )
+      {
+         pOptions_o->sImageFilePathname = argv[++i];
+      }
+      else if( !strcmp( argv[i], "--region" ) )
+      {
+         int j;
+         for( j = 0;  j < 4;  ++j )
+         {
+            ++i;
+            throwExceptions( jmpBuf, (i >= (argc - 1)) || (1 != sscanf(
+               argv[i], "%i", &pOptions_o->aRegion[j] )) ||
+               (pOptions_o->aRegion[j] < 0), ERROR_OPTION );
+         }
+         pOptions_o->isRegion = true;
+      }
+      else if( !strcmp( argv[i], "--bidirectional" ) )
+      {
+         pOptions_o->isBidirectional = true;
+      }
+      else if( !strcmp( argv[i], "--photon-mapping" ) )
+      {
+         pOptions_o->isPhotonMapping = true;
+      }
+      else if( !strcmp( argv[i], "--irradiance-cache" ) )
+      {
+         pOptions_o->isIrradianceCaching = true;
+      }
+      else if( !strcmp( argv[i], "--path-guiding" ) )
+      {
+         pOptions_o->isPathGuiding = true;
+      }
+      else if( !strcmp( argv[i], "--preview" ) )
+      {
+         pOptions_o->sPreviewPathname = argv[++i];
+      }
+      else if( !strcmp( argv[i], "--preview-every" ) )
+      {
+         pOptions_o->previewEvery = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--preview-ms" ) )
+      {
+         pOptions_o->previewMs = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--scene-cache" ) )
+      {
+         pOptions_o->sSceneCachePathname = argv[++i];
+      }
+      else if( !strcmp( argv[i], "--scene-cache-size" ) )
+      {
+         pOptions_o->sceneCacheMegabytes = readPositiveInt( jmpBuf,
+            argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--out-of-core" ) )
+      {
+         pOptions_o->outOfCoreMegabytes = readPositiveInt( jmpBuf,
+            argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--farm" ) )
+      {
+         pOptions_o->farmWorkers = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--worker-command" ) )
+      {
+         pOptions_o->sWorkerCommand = argv[++i];
+      }
+      else if( !strcmp( argv[i], "--cameras" ) )
+      {
+         pOptions_o->sCamerasFilePathname = argv[++i];
+      }
+      else if( !strcmp( argv[i], "--animation" ) )
+      {
+         throwExceptions( jmpBuf, (i + 2) >= (argc - 1), ERROR_OPTION );
+         pOptions_o->sCamerasFilePathname = argv[++i];
+         pOptions_o->animationFrames = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--threads" ) )
+      {
+         pOptions_o->threads = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--serve" ) )
+      {
+         pOptions_o->sServeSocketPathname = argv[++i];
+      }
+      else if( !strcmp( argv[i], "--cache" ) )
+      {
+         pOptions_o->cacheLength = readPositiveInt( jmpBuf, argv[++i] );
+      }
+      else if( !strcmp( argv[i], "--load-benchmark" ) )
+      {
+         pOptions_o->isLoadBenchmark = true;
+      }
+      else
+      {
+         throwExceptions( jmpBuf, true, ERROR_OPTION );
+      }
+   }
+
+   /* serving takes no model file */
+   if( pOptions_o->sServeSocketPathname )
+   {
+      throwExceptions( jmpBuf, (i != argc), ERROR_OPTION );
+      pOptions_o->sModelFilePathname = 0;
+      return;
+   }
+
+   throwExceptions( jmpBuf, (i != (argc - 1)), ERROR_OPTION );
+   pOptions_o->sModelFilePathname = argv[argc - 1];
+
+   /* views are rendered here, for a fixed number of iterations */
+   throwExceptions( jmpBuf, pOptions_o->sCamerasFilePathname &&
+      (pOptions_o->farmWorkers || (pOptions_o->deadline > 0.0)),
+      ERROR_OPTION );
+
+   /* farming renders a fixed number of iterations (workers have no shared
+      clock or noise estimate) */
+   throwExceptions( jmpBuf, pOptions_o->farmWorkers &&
+      ((pOptions_o->deadline > 0.0) || (pOptions_o->targetNoise > 0.0)),
+      ERROR_OPTION );
+
+   /* photon mapping is of a single image, and instead of tracing
+      bidirectionally */
+   throwExceptions( jmpBuf, pOptions_o->isPhotonMapping &&
+      (pOptions_o->sCamerasFilePathname || pOptions_o->isBidirectional),
+      ERROR_OPTION );
+
+   /* irradiance caching is instead of photon mapping, and of tracing
+      bidirectionally */
+   throwExceptions( jmpBuf, pOptions_o->isIrradianceCaching &&
+      (pOptions_o->isPhotonMapping || pOptions_o->isBidirectional),
+      ERROR_OPTION );
+
+   /* path guiding is of a single image, and of plain path tracing */
+   throwExceptions( jmpBuf, pOptions_o->isPathGuiding &&
+      (pOptions_o->sCamerasFilePathname || pOptions_o->isBidirectional ||
+      pOptions_o->isPhotonMapping || pOptions_o->isIrradianceCaching),
+      ERROR_OPTION );
+
+   /* paging is from the scene cache, and of a scene rendered here */
+   throwExceptions( jmpBuf, pOptions_o->outOfCoreMegabytes &&
+      (!pOptions_o->sSceneCachePathname || pOptions_o->farmWorkers),
+      ERROR_OPTION );
+
+   /* previews are of a single image rendered here */
+   throwExceptions( jmpBuf, pOptions_o->sPreviewPathname &&
+      (pOptions_o->sCamerasFilePathname || pOptions_o->farmWorkers),
+      ERROR_OPTION );
+   if( !pOptions_o->previewEvery && !pOptions_o->previewMs )
+   {
+      pOptions_o->previewEvery = 1;
+   }
+}
+
+
+/**
+ * Default farm worker command: this program, run locally (with the same
+ * region, if any, and tracing).
+ */
+static char* makeWorkerCommand
+(
+   jmp_buf        jmpBuf,
+   const char*    sProgramPathname,
+   const Options* pOptions
+)
+{
+   static const char ARGS[] = " --seed {seed} --iterations {iterations} "
+      "--output \"{output}\" \"{model}\"";
+
+   /* (each fixed-width: a region's four ints, and a size's one) */
+   char sRegion[64]    = "";
+   char sCacheSize[48] = "";
+
+   /* tracing flags */
+   const char* asFlags[4];
+   int         flagsLength = 0;
+
+   const char* sCache = pOptions->sSceneCachePathname ?
+      pOptions->sSceneCachePathname : "";
+
+   char*  sCommand;
+   size_t length;
+   int    i;
+
+   if( pOptions->isRegion )
+   {
+      sprintf( sRegion, " --region %i %i %i %i", pOptions->aRegion[0],
+         pOptions->aRegion[1], pOptions->aRegion[2], pOptions->aRegion[3] );
+   }
+   if( pOptions->isBidirectional )
+   {
+      asFlags[flagsLength++] = " --bidirectional";
+   }
+   if( pOptions->isPhotonMapping )
+   {
+      asFlags[flagsLength++] = " --photon-mapping";
+   }
+   if( pOptions->isIrradianceCaching )
+   {
+      asFlags[flagsLength++] = " --irradiance-cache";
+   }
+   if( pOptions->isPathGuiding )
+   {
+      asFlags[flagsLength++] = " --path-guiding";
+   }
+   /* (workers share the scene cache) */
+   if( pOptions->sSceneCachePathname )
+   {
+      sprintf( sCacheSize, " --scene-cache-size %i --scene-cache",
+         pOptions->sceneCacheMegabytes );
+   }
+
+   /* size from all the parts (and quotes) */
+   length = strlen(sProgramPathname) + 2 + strlen(sRegion) + strlen(ARGS) +
+      (pOptions->sSceneCachePathname ? strlen(sCacheSize) + strlen(sCache) +
+      3 : 0);
+   for( i = 0;  i < flagsLength;  length += strlen(asFlags[i++]) ) {}
+
+   sCommand = (char*)throwAllocExceptions( jmpBuf,
+      calloc( length + 1, sizeof(char) ) );
+   strcat( strcat( strcpy( sCommand, "\"" ), sProgramPathname ), "\"" );
+   strcat( sCommand, sRegion );
+   for( i = 0;  i < flagsLength;  strcat( sCommand, asFlags[i++] ) ) {}
+   if( pOptions->sSceneCachePathname )
+   {
+      strcat( strcat( strcat( strcat( sCommand, sCacheSize ), " \"" ),
+         sCache ), "\"" );
+   }
+   strcat( sCommand, ARGS );
+
+   return sCommand;
+}
+
+
+/**
+ * Throw a library call's failure.
+ */
+static void check
+(
+   jmp_buf jmpBuf,
+   int     status
+)
+{
+   throwExceptions( jmpBuf, (MINILIGHT_OK != status), status );
+}
+
+
+/**
+ * Time loading the model (best of a few runs), then loading it as written in
+ * the plain model format (from memory, so imported mesh files are compared
+ * with the same triangles as text), and print each.
+ */
+static void benchmarkLoading
+(
+   jmp_buf     jmpBuf,
+   const char* sModelFilePathname
+)
+{
+   static const int   RUNS      = 3;
+   static const char* aNames[2] = { "model", "as text" };
+
+   char* pText      = 0;
+   long  textLength = 0;
+   int   pass;
+
+   for( pass = 0;  pass < 2;  ++pass )
+   {
+      real64 best      = REAL64_MAX;
+      int32  triangles = 0;
+      long64 instanced = 0;
+      int    run;
+
+      for( run = 0;  run < RUNS;  ++run )
+      {
+         MiniLight*    pML;
+         MiniLightInfo info;
+         real64        start;
+         int           status;
+
+         check( jmpBuf, MiniLightCreate( &pML ) );
+         start  = wallSeconds();
+         status = pass ? MiniLightLoad( pML, pText, (size_t)textLength ) :
+            MiniLightLoadFile( pML, sModelFilePathname );
+         best   = (wallSeconds() - start) < best ? (wallSeconds() - start) :
+            best;
+         check( jmpBuf, status );
+
+         check( jmpBuf, MiniLightGetInfo( pML, &info ) );
+         triangles = info.trianglesLength;
+         instanced = info.instancedTrianglesLength;
+
+         /* write as text, once */
+         if( !pText )
+         {
+            FILE* pOut = tmpfile();
+            throwExceptions( jmpBuf, !pOut, ERROR_FILE );
+            check( jmpBuf, MiniLightWriteModel( pML, pOut ) );
+
+            textLength = ftell( pOut );
+            throwExceptions( jmpBuf, (textLength <= 0), ERROR_FILE );
+            pText = (char*)throwAllocExceptions( jmpBuf,
+               malloc( (size_t)textLength ) );
+            rewind( pOut );
+            throwExceptions( jmpBuf, ((size_t)textLength != fread( pText, 1,
+               (size_t)textLength, pOut )), ERROR_READ_IO );
+            fclose( pOut );
+         }
+
+         MiniLightFree( pML );
+      }
+
+      printf( "load %-8s %i triangles (+ %.0f instanced), %.3f s, %.0f "
+         "triangles/s\n", aNames[pass], triangles, (real64)instanced, best,
+         (best > 0.0) ? (real64)(triangles + instanced) / best : 0.0 );
+   }
+
+   free( pText );
+}
+
+
+#ifdef MINILIGHT_STATS
+
+/**
+ * Write stats file alongside the image file ("name.stats" for "name.rgbe",
+ * or "name.stats" for "name").
+ */
+static void writeStats
+(
+   jmp_buf          jmpBuf,
+   const MiniLight* pML,
+   const char*      sImageFilePathname
+)
+{
+   FILE* pStatsFile;
+   size_t nameLength = strlen( sImageFilePathname );
+
+   char* sStatsFilePathname;
+   if( (nameLength >= 5) &&
+      !strcmp( sImageFilePathname + nameLength - 5, ".rgbe" ) )
+   {
+      nameLength -= 5;
+   }
+
+   sStatsFilePathname = (char*)throwAllocExceptions( jmpBuf,
+      calloc( nameLength + 7, sizeof(char) ) );
+   strncpy( sStatsFilePathname, sImageFilePathname, nameLength );
+   strcat( sStatsFilePathname, ".stats" );
+
+   pStatsFile = fopen( sStatsFilePathname, "w" );
+   free( sStatsFilePathname );
+   throwExceptions( jmpBuf, !pStatsFile, ERROR_FILE );
+
+   check( jmpBuf, MiniLightWriteStats( pML, pStatsFile ) );
+
+   throwExceptions( jmpBuf, (EOF == fclose( pStatsFile )), ERROR_FILE );
+}
+
+#endif
+
+
+/**
+ * Load the model, and set up the context for the options. (Not indexed when
+ * farming. Views are only read if a camera file is given.)
+ */
 static void makeRenderingObjects
 (
-   jmp_buf       jmpBuf,
-   char*         argv[],
-   Random*       pRandom_o,
-   char**        psImageFilePathname_o,
-   int32*        pIterations_o,
-   Image**       ppImage_o,
-   Camera*       pCamera_o,
-   const Scene** ppScene_o
+   jmp_buf         jmpBuf,
+   const Options*  pOptions,
+   MiniLight**     ppML_o,
+   char**          psImageFilePathname_o,
+   int32*          pIterations_o,
+   MiniLightView** paViews_o,
+   int32*          pViewsLength_o
 )
 {
-   FILE* pModelFile;
-   const char* sModelFilePathname = 0;
+   MiniLightInfo info;
+
+   *paViews_o      = 0;
+   *pViewsLength_o = 0;
+
+   /* make context, from model file */
+   check( jmpBuf, MiniLightCreate( ppML_o ) );
+   if( pOptions->sSceneCachePathname )
+   {
+      check( jmpBuf, MiniLightSetCache( *ppML_o,
+         pOptions->sSceneCachePathname,
+         (long64u)pOptions->sceneCacheMegabytes << 20 ) );
+      check( jmpBuf, MiniLightSetPaging( *ppML_o,
+         (long64u)pOptions->outOfCoreMegabytes << 20 ) );
+   }
+   if( pOptions->isSeeded )
+   {
+      check( jmpBuf, MiniLightSetSeed( *ppML_o, pOptions->seed ) );
+   }
+   check( jmpBuf, MiniLightLoadFile( *ppML_o,
+      pOptions->sModelFilePathname ) );
+   if( pOptions->isRegion )
+   {
+      throwExceptions( jmpBuf, (MINILIGHT_OK != MiniLightSetRegion( *ppML_o,
+         pOptions->aRegion )), ERROR_OPTION );
+   }
+   if( pOptions->targetNoise > 0.0 )
+   {
+      check( jmpBuf, MiniLightTrackNoise( *ppML_o ) );
+   }
+   check( jmpBuf, MiniLightSetBidirectional( *ppML_o,
+      pOptions->isBidirectional ) );
+   check( jmpBuf, MiniLightSetPhotonMapping( *ppML_o,
+      pOptions->isPhotonMapping ) );
+   check( jmpBuf, MiniLightSetIrradianceCaching( *ppML_o,
+      pOptions->isIrradianceCaching ) );
+   check( jmpBuf, MiniLightSetPathGuiding( *ppML_o,
+      pOptions->isPathGuiding ) );
 
-   /* make random generator */
-   *pRandom_o = RandomCreate();
+   check( jmpBuf, MiniLightGetInfo( *ppML_o, &info ) );
 
-   /* get/make file names */
-   sModelFilePathname = argv[ 1 ];
-   *psImageFilePathname_o = (char*)throwAllocExceptions( jmpBuf,
-      calloc( strlen(sModelFilePathname) + 15, sizeof(char) ) );
-   strcpy( *psImageFilePathname_o, sModelFilePathname );
-   strcat( strcat( *psImageFilePathname_o, "." ), RandomGetId( pRandom_o ) );
-   strcat( *psImageFilePathname_o, ".rgbe" );
+   /* get/make image file name */
+   if( pOptions->sImageFilePathname )
+   {
+      *psImageFilePathname_o = (char*)throwAllocExceptions( jmpBuf,
+         calloc( strlen(pOptions->sImageFilePathname) + 1, sizeof(char) ) );
+      strcpy( *psImageFilePathname_o, pOptions->sImageFilePathname );
+   }
+   else
+   {
+      *psImageFilePathname_o = (char*)throwAllocExceptions( jmpBuf,
+         calloc( strlen(pOptions->sModelFilePathname) + 15, sizeof(char) ) );
+      strcpy( *psImageFilePathname_o, pOptions->sModelFilePathname );
+      strcat( strcat( *psImageFilePathname_o, "." ), info.sId );
+      strcat( *psImageFilePathname_o, ".rgbe" );
+   }
+
+   /* iterations: option, else model's */
+   *pIterations_o = pOptions->iterations >= 0 ? pOptions->iterations :
+      info.modelIterations;
+
+   /* read views to render instead */
+   if( pOptions->sCamerasFilePathname )
+   {
+      check( jmpBuf, MiniLightReadViews( pOptions->sCamerasFilePathname,
+         paViews_o, pViewsLength_o ) );
 
-   /* open model file */
-   pModelFile = fopen( sModelFilePathname, "r" );
-   throwExceptions( jmpBuf, !pModelFile, ERROR_FILE );
+      /* replace keys with frames along their path */
+      if( pOptions->animationFrames )
+      {
+         MiniLightView* aFrames = 0;
+         check( jmpBuf, MiniLightMakePath( *paViews_o, *pViewsLength_o,
+            pOptions->animationFrames, &aFrames ) );
+
+         free( *paViews_o );
+         *paViews_o      = aFrames;
+         *pViewsLength_o = pOptions->animationFrames;
+      }
+   }
 
-   /* check model file format identifier at start of first line */
+   /* make index, for all views (scene times its own indexing) */
+   if( !pOptions->farmWorkers )
    {
-      long p;
-      /* read chars until a mismatch */
-      throwReadExceptions( pModelFile, jmpBuf, 0,
-         fscanf( pModelFile, MODEL_FORMAT_ID ) );
-      p = ftell( pModelFile );
-      throwExceptions( jmpBuf, (-1L == p), ERROR_FILE );
-      /* check if all chars were read */
-      throwExceptions( jmpBuf,
-         ((long)strlen( MODEL_FORMAT_ID ) != p), ERROR_FORMAT_UNREC );
+      check( jmpBuf, MiniLightBuildIndex( *ppML_o, *paViews_o,
+         *pViewsLength_o ) );
    }
+}
+
 
-   /* read and condition frame iterations */
-   *pIterations_o = 0;
-   throwReadExceptions( pModelFile, jmpBuf, 1,
-      fscanf( pModelFile, "%i", pIterations_o ) );
-   *pIterations_o = *pIterations_o < 0 ? 0 : *pIterations_o;
+static void saveImage
+(
+   jmp_buf          jmpBuf,
+   const MiniLight* pML,
+   const char*      sImageFilePathname
+)
+{
+   /* open image file */
+   FILE* pImageFile = fopen( sImageFilePathname, "wb" );
+   throwExceptions( jmpBuf, !pImageFile, ERROR_FILE );
 
-   /* create main rendering objects, from model file */
-   *ppImage_o = ImageConstruct( pModelFile, jmpBuf );
-   *pCamera_o = CameraCreate( pModelFile, jmpBuf );
-   *ppScene_o = SceneConstruct( pModelFile, jmpBuf,
-      &CameraEyePoint( pCamera_o ) );
+   /* write image frame to file */
+   check( jmpBuf, MiniLightWriteImage( pML, pImageFile ) );
 
-   /* close model file */
-   throwExceptions( jmpBuf, (EOF == fclose( pModelFile )), ERROR_FILE );
+   throwExceptions( jmpBuf, (EOF == fclose( pImageFile )), ERROR_FILE );
+
+#ifdef MINILIGHT_STATS
+   writeStats( jmpBuf, pML, sImageFilePathname );
+#endif
 }
 
 
-static void renderProgressively
+/**
+ * @return number of iterations done
+ */
+static int32 renderProgressively
 (
-   jmp_buf       jmpBuf,
-   const int32   iterations,
-   const Camera* pCamera,
-   const Scene*  pScene,
-   Random*       pRandom,
-   const char*   sImageFilePathname,
-   Image*        pImage_o
+   jmp_buf        jmpBuf,
+   const int32    iterations,
+   const Options* pOptions,
+   MiniLight*     pML,
+   const char*    sImageFilePathname
 )
 {
+   /* slowest iteration and slowest save so far, for keeping to deadline */
+   real64 iterationTime = 0.0, saveTime = 0.0;
+
+   /* stream of previews, if wanted, and when last posted */
+   Preview* pPreview = pOptions->sPreviewPathname ? PreviewConstruct( jmpBuf,
+      pOptions->sPreviewPathname, pML ) : 0;
+   real64   previewTime = wallSeconds();
+
+   int32 frameNo, doneNo = 0, savedNo = 0, previewedNo = 0;
+
    /* do progressive refinement render loop */
-   int32 frameNo;
    for( frameNo = 1;  frameNo <= iterations;  ++frameNo )
    {
+      real64 time = wallSeconds();
+      bool   isEnd;
+
+      /* stop if another iteration and its save would overrun deadline
+         (always do the first, to have an image at all) */
+      if( (pOptions->deadline > 0.0) && (frameNo > 1) &&
+         ((time + iterationTime + saveTime) > pOptions->deadline) )
+      {
+         break;
+      }
+
       /* display current iteration number */
       printf( "\riteration: %i", frameNo );
       fflush( stdout );
 
       /* render a frame */
-      CameraFrame( pCamera, pScene, pRandom, pImage_o );
+      check( jmpBuf, MiniLightRender( pML, 1 ) );
+      doneNo = frameNo;
+
+      time = wallSeconds() - time;
+      iterationTime = time > iterationTime ? time : iterationTime;
+
+      /* end if last iteration, or noise is low enough */
+      isEnd = (iterations == frameNo);
+      if( (pOptions->targetNoise > 0.0) && !isEnd )
+      {
+         MiniLightInfo info;
+         check( jmpBuf, MiniLightGetInfo( pML, &info ) );
+         isEnd = info.noise <= pOptions->targetNoise;
+      }
+
+      /* post preview at its interval (of iterations, or time), and at end */
+      if( pPreview && (isEnd || (pOptions->previewEvery &&
+         !(frameNo % pOptions->previewEvery)) || (pOptions->previewMs &&
+         ((wallSeconds() - previewTime) * 1000.0 >= pOptions->previewMs))) )
+      {
+         PreviewPost( pPreview, jmpBuf, pML );
+         previewedNo = frameNo;
+         previewTime = wallSeconds();
+      }
 
       /* save image at twice error-halving rate, and at start and end */
-      if( ((frameNo & (frameNo - 1)) == 0) | (iterations == frameNo) )
+      if( ((frameNo & (frameNo - 1)) == 0) | isEnd )
       {
-         /* open image file */
-         FILE* pImageFile = fopen( sImageFilePathname, "wb" );
-         throwExceptions( jmpBuf, !pImageFile, ERROR_FILE );
+         time = wallSeconds();
+         saveImage( jmpBuf, pML, sImageFilePathname );
+         savedNo = frameNo;
 
-         /* write image frame to file */
-         ImageFormatted( pImage_o, frameNo, jmpBuf, pImageFile );
+         time = wallSeconds() - time;
+         saveTime = time > saveTime ? time : saveTime;
+      }
 
-         throwExceptions( jmpBuf, (EOF == fclose( pImageFile )), ERROR_FILE );
+      if( isEnd )
+      {
+         break;
       }
    }
+
+   /* save last iteration, if stopped for time before it was saved */
+   if( savedNo < doneNo )
+   {
+      saveImage( jmpBuf, pML, sImageFilePathname );
+   }
+
+   if( pPreview )
+   {
+      if( previewedNo < doneNo )
+      {
+         PreviewPost( pPreview, jmpBuf, pML );
+      }
+      PreviewDestruct( pPreview );
+   }
+
+   return doneNo;
 }
 
 
@@ -228,60 +971,165 @@ int main
 {
    int returnValue = EXIT_FAILURE;
 
-   jmp_buf     jmpBuf;
-   const char* sException = 0;
+   jmp_buf   jmpBuf;
+   const int exception = setjmp( jmpBuf );
 
-   /* extract thrown value */
-   switch( setjmp( jmpBuf ) )
-   {
-      case 0                  : sException = 0;                           break;
-      case ERROR_READ_INVAL   : sException = "invalid model syntax";      break;
-      case ERROR_READ_TRUNC   : sException = "truncated model file";      break;
-      case ERROR_READ_IO      : sException = "I/O read error";            break;
-      case ERROR_WRITE_IO     : sException = "I/O write error";           break;
-      case ERROR_FORMAT_UNREC : sException = "unrecognised model format"; break;
-      case ERROR_FILE         : sException = "file error";                break;
-      case ERROR_ALLOC        : sException = "storage allocation error";  break;
-      default                 : sException = "(unspecified error)";       break;
-   }
    /* try */
-   if( !sException )
+   if( !exception )
    {
       /* check for help request */
       if( (argc <= 1) || !strcmp(argv[1], "-?") || !strcmp(argv[1], "--help") )
       {
+         int i;
          printf( HELP_MESSAGE, LINE, TITLE, AUTHOR, URL, DATE, LINE,
-            DESCRIPTION, USAGE, EXAMPLE );
+            DESCRIPTION, USAGE );
+         for( i = 0;  OPTIONS[i];  printf( "%s", OPTIONS[i++] ) ) {}
+         printf( "\n%s%s%s%s", FORMAT, EXAMPLE, INSTANCING, PORTALS );
       }
       /* execute */
       else
       {
-         Random       random;
-         char*        sImageFilePathname;
-         int32        iterations;
-         Image*       pImage;
-         Camera       camera;
-         const Scene* pScene;
+         Options        options;
+         MiniLight*     pML;
+         char*          sImageFilePathname;
+         int32          iterations;
+         MiniLightView* aViews;
+         int32          viewsLength;
+         real64         renderTime;
 
          printf( BANNER_MESSAGE, TITLE, URL );
 
+         readOptions( jmpBuf, argc, argv, wallSeconds(), &options );
+
+         /* a preview stream on stdout has it to itself */
+         if( options.sPreviewPathname &&
+            !strcmp( options.sPreviewPathname, "-" ) )
+         {
+            PreviewTakeStdout( jmpBuf );
+         }
+
          /* setup ctrl-c/interruption handler */
          signal( SIGINT, sigintHandler );
          /*throwExceptions( jmpBuf_g,
             (signal( SIGINT, sigintHandler ) == SIG_ERR), ERROR_UNSPECIFIED );*/
 
-         makeRenderingObjects( jmpBuf, argv, &random, &sImageFilePathname,
-            &iterations, &pImage, &camera, &pScene );
+         /* serve until interrupted */
+         if( options.sServeSocketPathname )
+         {
+            ServerRun( jmpBuf, options.sServeSocketPathname,
+               options.cacheLength );
+         }
+
+         /* only time loading */
+         if( options.isLoadBenchmark )
+         {
+            benchmarkLoading( jmpBuf, options.sModelFilePathname );
+            return EXIT_SUCCESS;
+         }
+
+         makeRenderingObjects( jmpBuf, &options, &pML, &sImageFilePathname,
+            &iterations, &aViews, &viewsLength );
+
+         /* scene size, and memory saved by sharing */
+         {
+            MiniLightInfo info;
+            check( jmpBuf, MiniLightGetInfo( pML, &info ) );
+            printf( "scene: %i triangles (+ %.0f in %i instances), "
+               "%i vertexs, %i materials -- %.0f KiB (unshared %.0f KiB), "
+               "index %.0f KiB\n", info.trianglesLength,
+               (real64)info.instancedTrianglesLength, info.instancesLength,
+               info.vertexsLength, info.materialsLength,
+               (real64)((info.geometryBytes + 1023) >> 10),
+               (real64)((info.unsharedGeometryBytes + 1023) >> 10),
+               (real64)((info.indexBytes + 1023) >> 10) );
+         }
+
+         renderTime = wallSeconds();
+
+         /* farm out to worker processes, and merge */
+         if( options.farmWorkers )
+         {
+            char* sWorkerCommand = options.sWorkerCommand ? 0 :
+               makeWorkerCommand( jmpBuf, argv[0], &options );
+
+            check( jmpBuf, MiniLightRenderFarm( pML, options.sWorkerCommand ?
+               options.sWorkerCommand : sWorkerCommand,
+               options.sModelFilePathname, iterations, options.farmWorkers ) );
+            free( sWorkerCommand );
 
-         printf( "output: %s\n", sImageFilePathname );
+            {
+               MiniLightInfo info;
+               check( jmpBuf, MiniLightGetInfo( pML, &info ) );
+               iterations = info.iterations;
+            }
 
-         renderProgressively( jmpBuf, iterations, &camera, pScene, &random,
-            sImageFilePathname, pImage );
+            printf( "output: (%i) %s\n", iterations, sImageFilePathname );
+            saveImage( jmpBuf, pML, sImageFilePathname );
+         }
+         /* render many views, sharing the scene */
+         else if( aViews )
+         {
+            printf( "views: %i\n", viewsLength );
+            fflush( stdout );
+
+            check( jmpBuf, MiniLightRenderViews( pML, aViews, viewsLength,
+               iterations, options.targetNoise, options.threads,
+               sImageFilePathname ) );
+         }
+         /* render here */
+         else
+         {
+            /* time limit replaces model iterations */
+            if( options.deadline > 0.0 )
+            {
+               iterations = 0x7FFFFFFF;
+            }
+
+            printf( "output: %s\n", sImageFilePathname );
+
+            iterations = renderProgressively( jmpBuf, iterations, &options,
+               pML, sImageFilePathname );
+         }
 
          printf( "\nfinished\n" );
 
-         SceneDestruct( (Scene*)pScene );
-         ImageDestruct( pImage );
+         /* irradiance cache size (if not only in the workers) */
+         if( options.isIrradianceCaching && !options.farmWorkers )
+         {
+            MiniLightInfo info;
+            check( jmpBuf, MiniLightGetInfo( pML, &info ) );
+            printf( "irradiance cache: %i records\n",
+               info.irradianceRecordsLength );
+         }
+
+         /* paging, and throughput with it */
+         if( options.outOfCoreMegabytes )
+         {
+            MiniLightInfo info;
+            real64        paths;
+
+            renderTime = wallSeconds() - renderTime;
+            check( jmpBuf, MiniLightGetInfo( pML, &info ) );
+            paths = (real64)(info.aRegion[2] - info.aRegion[0]) *
+               (real64)(info.aRegion[3] - info.aRegion[1]) *
+               (real64)iterations * (aViews ? (real64)viewsLength : 1.0);
+
+            printf( "paging: geometry %.0f MiB, resident %.0f MiB "
+               "(limit %i), released %.0f MiB, faults %.0f major %.0f minor "
+               "-- %.0f paths/s\n", (real64)(info.pagedBytes >> 20),
+               (real64)(info.residentBytes >> 20), options.outOfCoreMegabytes,
+               (real64)(info.releasedBytes >> 20), (real64)info.majorFaults,
+               (real64)info.minorFaults,
+               (renderTime > 0.0) ? paths / renderTime : 0.0 );
+         }
+
+#ifdef MINILIGHT_STATS
+         /* final stats, including everything up to exit */
+         writeStats( jmpBuf, pML, sImageFilePathname );
+#endif
+
+         MiniLightFree( pML );
+         free( aViews );
          free( sImageFilePathname );
       }
 
@@ -291,7 +1139,8 @@ int main
    else
    {
       /* print exception message */
-      printf( "\n*** execution failed:  %s\n", sException );
+      printf( "\n*** execution failed:  %s\n", (ERROR_OPTION == exception) ?
+         "invalid command-line option" : MiniLightMessage( exception ) );
 
       returnValue = EXIT_FAILURE;
    }
@@ -0,0 +1,1140 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Exceptions.h"
+#include "Stats.h"
+#include "Random.h"
+#include "Image.h"
+#include "Scene.h"
+#include "SceneCache.h"
+#include "Pager.h"
+#include "Camera.h"
+#include "PhotonMapper.h"
+#include "IrradianceCache.h"
+#include "PathGuide.h"
+#include "Batch.h"
+#include "RenderFarm.h"
+
+#include "MiniLightLib.h"
+
+
+
+
+/**
+ * Each function catches exceptions thrown from inside (setjmp/longjmp) and
+ * returns their code as the status.
+ */
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const char MODEL_FORMAT_ID[] = "#MiniLight";
+
+static const real64 DEGREES_PER_RADIAN = 180.0 / 3.14159265358979;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * @invariants
+ * * pImage is not 0 if pScene is not 0
+ * * iterations >= 0
+ */
+struct MiniLight
+{
+   /* scene (0 until loaded), and whether this context is its owner */
+   Scene*  pScene;
+   bool    isSceneOwner;
+   int32   modelIterations;
+
+   /* view and rendering (random made when loaded, if not seeded before) */
+   Camera  camera;
+   Random  random;
+   bool    isSeeded;
+   Image*  pImage;
+   int32   iterations;
+   bool    isBidirectional;
+   bool    isPhotonMapping;
+   bool    isIrradianceCaching;
+   bool    isPathGuiding;
+
+   /* photon mapping's progress (once rendering, if photon mapping) */
+   PhotonMapper* pPhotonMapper;
+
+   /* irradiance cache (once rendering, if caching, or shared), and whether
+      this context is its owner */
+   IrradianceCache* pIrradianceCache;
+   bool             isCacheOwner;
+
+   /* path guide (once rendering, if guiding) */
+   PathGuide*       pPathGuide;
+
+   /* scene cache directory (or 0), its size limit, and the loaded scene's
+      key in it */
+   char*   sCacheDirectory;
+   long64u cacheSizeLimit;
+   long64u sceneKey;
+
+   /* resident limit for the scene's geometry (or 0 for not paged), and its
+      keeper (once indexed, in the owner) */
+   long64u residentLimit;
+   Pager*  pPager;
+};
+
+
+
+
+/* state -------------------------------------------------------------------- */
+
+#ifdef MINILIGHT_STATS
+static bool isStatsStarted_g = false;
+#endif
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Make the irradiance cache, if not made or shared already.
+ */
+static void ensureIrradianceCache
+(
+   MiniLight* pML,
+   jmp_buf    jmpBuf
+)
+{
+   if( !pML->pIrradianceCache )
+   {
+      pML->pIrradianceCache = IrradianceCacheConstruct( jmpBuf,
+         pML->pScene );
+      pML->isCacheOwner     = true;
+   }
+}
+
+
+static Camera viewToCamera
+(
+   const MiniLightView* pView
+)
+{
+   Vector3f position, direction;
+   int i;
+   for( i = 3;  i-- > 0; )
+   {
+      position.xyz[i]  = pView->aPosition[i];
+      direction.xyz[i] = pView->aDirection[i];
+   }
+
+   return CameraCreateView( &position, &direction, pView->angle );
+}
+
+
+static MiniLightView cameraToView
+(
+   const Camera* pCamera
+)
+{
+   MiniLightView view;
+   int i;
+   for( i = 3;  i-- > 0; )
+   {
+      view.aPosition[i]  = pCamera->viewPosition.xyz[i];
+      view.aDirection[i] = pCamera->viewDirection.xyz[i];
+   }
+   view.angle = pCamera->viewAngle * DEGREES_PER_RADIAN;
+
+   return view;
+}
+
+
+static void load
+(
+   MiniLight* pML,
+   jmp_buf    jmpBuf,
+   FILE*      pIn
+)
+{
+   /* only once */
+   throwExceptions( jmpBuf, (0 != pML->pScene), ERROR_STATE );
+   if( pML->pImage )
+   {
+      ImageDestruct( pML->pImage );
+      pML->pImage = 0;
+   }
+
+   STATS_TIMER_BEGIN( STATS_PHASE_PARSE )
+
+   /* check model format identifier at start of first line */
+   {
+      long p;
+      /* read chars until a mismatch */
+      throwReadExceptions( pIn, jmpBuf, 0, fscanf( pIn, MODEL_FORMAT_ID ) );
+      p = ftell( pIn );
+      throwExceptions( jmpBuf, (-1L == p), ERROR_FILE );
+      /* check if all chars were read */
+      throwExceptions( jmpBuf,
+         ((long)strlen( MODEL_FORMAT_ID ) != p), ERROR_FORMAT_UNREC );
+   }
+
+   /* read and condition frame iterations */
+   pML->modelIterations = 0;
+   throwReadExceptions( pIn, jmpBuf, 1,
+      fscanf( pIn, "%i", &pML->modelIterations ) );
+   pML->modelIterations = pML->modelIterations < 0 ? 0 :
+      pML->modelIterations;
+
+   /* create main rendering objects, from model */
+   pML->pImage = ImageConstruct( pIn, jmpBuf );
+   pML->camera = CameraCreate( pIn, jmpBuf );
+
+   STATS_TIMER_END( STATS_PHASE_PARSE )
+
+   if( !pML->isSeeded )
+   {
+      pML->random   = RandomCreate();
+      pML->isSeeded = true;
+   }
+
+   /* (scene times its own parsing) */
+   pML->pScene       = pML->sCacheDirectory ? SceneCacheConstruct( jmpBuf,
+      pML->sCacheDirectory, pML->cacheSizeLimit, 0 != pML->residentLimit,
+      pIn, &pML->sceneKey ) :
+      SceneConstruct( pIn, jmpBuf );
+   pML->isSceneOwner = true;
+   pML->iterations   = 0;
+}
+
+
+static int loadStream
+(
+   MiniLight* pML,
+   FILE*      pIn
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      load( pML, jmpBuf, pIn );
+   }
+
+   return status;
+}
+
+
+/**
+ * Close a stream read from, keeping the first failure.
+ */
+static int closeStream
+(
+   FILE* pIn,
+   int   status
+)
+{
+   if( pIn && (EOF == fclose( pIn )) && !status )
+   {
+      status = ERROR_FILE;
+   }
+
+   return status;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+int MiniLightCreate
+(
+   MiniLight** ppML_o
+)
+{
+   *ppML_o = (MiniLight*)calloc( 1, sizeof(MiniLight) );
+   if( !*ppML_o )
+   {
+      return ERROR_ALLOC;
+   }
+
+#ifdef MINILIGHT_STATS
+   if( !isStatsStarted_g )
+   {
+      StatsInitialise();
+      isStatsStarted_g = true;
+   }
+#endif
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightCreateSharing
+(
+   MiniLight*  pOther,
+   MiniLight** ppML_o
+)
+{
+   MiniLight* volatile pML = 0;
+
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, !pOther->pScene || !pOther->pScene->pIndex,
+         ERROR_STATE );
+
+      pML = (MiniLight*)throwAllocExceptions( jmpBuf,
+         calloc( 1, sizeof(MiniLight) ) );
+
+      pML->pScene          = pOther->pScene;
+      pML->isSceneOwner    = false;
+      pML->modelIterations = pOther->modelIterations;
+      pML->camera          = pOther->camera;
+      pML->random          = RandomCreateSeeded(
+         (RandomInt32u( &pOther->random ) | 0x100u) & 0xFFFFFFFFu );
+      pML->isSeeded        = true;
+      pML->pImage          = ImageConstructBlank( pOther->pImage, jmpBuf );
+      pML->iterations      = 0;
+      pML->isBidirectional = pOther->isBidirectional;
+      pML->isPhotonMapping = pOther->isPhotonMapping;
+      pML->residentLimit   = pOther->residentLimit;
+
+      /* share the other's irradiance cache, if it uses one (making it if
+         needed) */
+      pML->isIrradianceCaching = pOther->isIrradianceCaching;
+      pML->isPathGuiding       = pOther->isPathGuiding;
+      if( pOther->isIrradianceCaching )
+      {
+         ensureIrradianceCache( pOther, jmpBuf );
+         pML->pIrradianceCache = pOther->pIrradianceCache;
+      }
+   }
+   /* catch */
+   else
+   {
+      free( pML );
+      pML = 0;
+   }
+
+   *ppML_o = pML;
+
+   return status;
+}
+
+
+void MiniLightFree
+(
+   MiniLight* pML
+)
+{
+   if( pML )
+   {
+      PhotonMapperDestruct( pML->pPhotonMapper );
+      PathGuideDestruct( pML->pPathGuide );
+      if( pML->isCacheOwner )
+      {
+         IrradianceCacheDestruct( pML->pIrradianceCache );
+      }
+      if( pML->pImage )
+      {
+         ImageDestruct( pML->pImage );
+      }
+      if( pML->pPager )
+      {
+         PagerDestruct( pML->pPager );
+      }
+      if( pML->pScene && pML->isSceneOwner )
+      {
+         SceneDestruct( pML->pScene );
+      }
+      free( pML->sCacheDirectory );
+
+      free( pML );
+   }
+}
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+int MiniLightSetCache
+(
+   MiniLight*  pML,
+   const char* sDirectory,
+   long64u     sizeLimit
+)
+{
+   char* sCopy = 0;
+
+   if( pML->pScene )
+   {
+      return ERROR_STATE;
+   }
+   if( sDirectory )
+   {
+      sCopy = (char*)malloc( strlen( sDirectory ) + 1 );
+      if( !sCopy )
+      {
+         return ERROR_ALLOC;
+      }
+      strcpy( sCopy, sDirectory );
+   }
+
+   free( pML->sCacheDirectory );
+   pML->sCacheDirectory = sCopy;
+   pML->cacheSizeLimit  = sizeLimit;
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightSetPaging
+(
+   MiniLight* pML,
+   long64u    residentLimit
+)
+{
+   if( pML->pScene || (residentLimit && !pML->sCacheDirectory) )
+   {
+      return ERROR_STATE;
+   }
+
+   pML->residentLimit = residentLimit;
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightLoad
+(
+   MiniLight*  pML,
+   const char* pModel,
+   size_t      modelLength
+)
+{
+   FILE* pIn = fmemopen( (void*)pModel, modelLength, "r" );
+
+   return closeStream( pIn, pIn ? loadStream( pML, pIn ) : ERROR_FILE );
+}
+
+
+int MiniLightLoadFile
+(
+   MiniLight*  pML,
+   const char* sModelFilePathname
+)
+{
+   FILE* pIn = fopen( sModelFilePathname, "r" );
+
+   return closeStream( pIn, pIn ? loadStream( pML, pIn ) : ERROR_FILE );
+}
+
+
+int MiniLightBuildIndex
+(
+   MiniLight*           pML,
+   const MiniLightView* aViews,
+   int32                viewsLength
+)
+{
+   Vector3f* volatile aEyes = 0;
+
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      int32 i;
+
+      throwExceptions( jmpBuf, !pML->pScene || !pML->isSceneOwner ||
+         pML->pScene->pIndex, ERROR_STATE );
+      throwExceptions( jmpBuf, (viewsLength < 0), ERROR_ARGUMENT );
+
+      /* current view, and any others */
+      aEyes = (Vector3f*)throwAllocExceptions( jmpBuf,
+         calloc( viewsLength + 1, sizeof(Vector3f) ) );
+      aEyes[0] = CameraEyePoint( &pML->camera );
+      for( i = viewsLength;  i-- > 0; )
+      {
+         const Camera c = viewToCamera( &aViews[i] );
+         aEyes[i + 1] = CameraEyePoint( &c );
+      }
+
+      if( pML->sCacheDirectory )
+      {
+         SceneCacheIndex( jmpBuf, pML->sCacheDirectory, pML->cacheSizeLimit,
+            0 != pML->residentLimit, pML->sceneKey, pML->pScene, aEyes,
+            viewsLength + 1 );
+
+         if( pML->residentLimit )
+         {
+            pML->pPager = PagerConstruct( jmpBuf, pML->pScene,
+               pML->residentLimit );
+         }
+      }
+      else
+      {
+         SceneIndex( pML->pScene, jmpBuf, aEyes, viewsLength + 1 );
+      }
+   }
+
+   free( aEyes );
+
+   return status;
+}
+
+
+int MiniLightSetView
+(
+   MiniLight*           pML,
+   const MiniLightView* pView
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      const Camera c = viewToCamera( pView );
+
+      throwExceptions( jmpBuf, !pML->pScene || pML->iterations, ERROR_STATE );
+      throwExceptions( jmpBuf, pML->pScene->pIndex &&
+         !SceneIsIndexed( pML->pScene, &CameraEyePoint( &c ) ),
+         ERROR_ARGUMENT );
+
+      pML->camera = c;
+   }
+
+   return status;
+}
+
+
+int MiniLightSetSeed
+(
+   MiniLight* pML,
+   int32u     seed
+)
+{
+   pML->random   = RandomCreateSeeded( seed );
+   pML->isSeeded = true;
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightSetRegion
+(
+   MiniLight*  pML,
+   const int32 aRegion[4]
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, !pML->pScene || pML->iterations, ERROR_STATE );
+      throwExceptions( jmpBuf, !ImageSetRegion( pML->pImage, jmpBuf,
+         aRegion ), ERROR_ARGUMENT );
+   }
+
+   return status;
+}
+
+
+int MiniLightTrackNoise
+(
+   MiniLight* pML
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, !pML->pScene || pML->iterations, ERROR_STATE );
+      ImageTrackNoise( pML->pImage, jmpBuf );
+   }
+
+   return status;
+}
+
+
+int MiniLightSetBidirectional
+(
+   MiniLight* pML,
+   bool       isBidirectional
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, pML->iterations, ERROR_STATE );
+      pML->isBidirectional = isBidirectional;
+   }
+
+   return status;
+}
+
+
+int MiniLightSetPhotonMapping
+(
+   MiniLight* pML,
+   bool       isPhotonMapping
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, pML->iterations, ERROR_STATE );
+      pML->isPhotonMapping = isPhotonMapping;
+   }
+
+   return status;
+}
+
+
+int MiniLightSetIrradianceCaching
+(
+   MiniLight* pML,
+   bool       isIrradianceCaching
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, pML->iterations, ERROR_STATE );
+      pML->isIrradianceCaching = isIrradianceCaching;
+   }
+
+   return status;
+}
+
+
+int MiniLightSetPathGuiding
+(
+   MiniLight* pML,
+   bool       isPathGuiding
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, pML->iterations, ERROR_STATE );
+      pML->isPathGuiding = isPathGuiding;
+   }
+
+   return status;
+}
+
+
+int MiniLightRender
+(
+   MiniLight* pML,
+   int32      iterations
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      int32 i;
+
+      throwExceptions( jmpBuf, !pML->pScene || !pML->pScene->pIndex,
+         ERROR_STATE );
+      throwExceptions( jmpBuf, (iterations < 0), ERROR_ARGUMENT );
+
+      if( pML->isPhotonMapping && !pML->pPhotonMapper )
+      {
+         pML->pPhotonMapper = PhotonMapperConstruct( jmpBuf, pML->pImage );
+      }
+      if( pML->isIrradianceCaching && !pML->isPhotonMapping )
+      {
+         ensureIrradianceCache( pML, jmpBuf );
+      }
+      if( pML->isPathGuiding && !(pML->isPhotonMapping |
+         pML->isIrradianceCaching | pML->isBidirectional) &&
+         !pML->pPathGuide )
+      {
+         pML->pPathGuide = PathGuideConstruct( jmpBuf, pML->pScene );
+      }
+
+      for( i = iterations;  i-- > 0;  ++pML->iterations )
+      {
+         STATS_TIMER_BEGIN( STATS_PHASE_TRACE )
+         if( pML->pPhotonMapper )
+         {
+            PhotonMapperFrame( pML->pPhotonMapper, jmpBuf, &pML->camera,
+               pML->pScene, BatchProcessorsCount(), &pML->random,
+               pML->pImage );
+         }
+         else
+         {
+            CameraFrame( &pML->camera, pML->pScene, 0 != pML->residentLimit,
+               pML->isBidirectional, pML->isIrradianceCaching ?
+               pML->pIrradianceCache : 0, pML->pPathGuide, &pML->random,
+               pML->pImage );
+            if( pML->pPathGuide )
+            {
+               PathGuideFrameEnd( pML->pPathGuide, jmpBuf );
+            }
+         }
+         STATS_TIMER_END( STATS_PHASE_TRACE )
+      }
+   }
+
+   return status;
+}
+
+
+int MiniLightRenderViews
+(
+   MiniLight*           pML,
+   const MiniLightView* aViews,
+   int32                viewsLength,
+   int32                iterations,
+   real64               targetNoise,
+   int32                threadsLength,
+   const char*          sImageFilePathname
+)
+{
+   Camera* volatile aCameras = 0;
+
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      int32 i;
+
+      throwExceptions( jmpBuf, !pML->pScene || !pML->pScene->pIndex ||
+         pML->isPhotonMapping || pML->isPathGuiding, ERROR_STATE );
+      throwExceptions( jmpBuf, (viewsLength < 1) || (iterations < 0),
+         ERROR_ARGUMENT );
+
+      /* every view must have been indexed for */
+      aCameras = (Camera*)throwAllocExceptions( jmpBuf,
+         calloc( viewsLength, sizeof(Camera) ) );
+      for( i = viewsLength;  i-- > 0; )
+      {
+         aCameras[i] = viewToCamera( &aViews[i] );
+         throwExceptions( jmpBuf, !SceneIsIndexed( pML->pScene,
+            &CameraEyePoint( &aCameras[i] ) ), ERROR_ARGUMENT );
+      }
+
+      if( pML->isIrradianceCaching )
+      {
+         ensureIrradianceCache( pML, jmpBuf );
+      }
+
+      BatchRender( jmpBuf, pML->pScene, 0 != pML->residentLimit,
+         pML->isBidirectional, pML->isIrradianceCaching ?
+         pML->pIrradianceCache : 0, aCameras, viewsLength, pML->pImage,
+         iterations, targetNoise,
+         threadsLength > 0 ? threadsLength : BatchProcessorsCount(),
+         &pML->random, sImageFilePathname );
+   }
+
+   free( aCameras );
+
+   return status;
+}
+
+
+int MiniLightRenderFarm
+(
+   MiniLight*  pML,
+   const char* sCommandTemplate,
+   const char* sModelFilePathname,
+   int32       iterations,
+   int32       workersLength
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, !pML->pScene || pML->iterations, ERROR_STATE );
+      throwExceptions( jmpBuf, (iterations < 1) || (workersLength < 1),
+         ERROR_ARGUMENT );
+
+      pML->iterations = RenderFarmRender( jmpBuf, sCommandTemplate,
+         sModelFilePathname, iterations, workersLength, &pML->random,
+         pML->pImage );
+   }
+
+   return status;
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+int MiniLightGetInfo
+(
+   const MiniLight* pML,
+   MiniLightInfo*   pInfo_o
+)
+{
+   if( !pML->pScene )
+   {
+      return ERROR_STATE;
+   }
+
+   strcpy( pInfo_o->sId, pML->random.sId );
+
+   pInfo_o->modelIterations = pML->modelIterations;
+
+   pInfo_o->width  = pML->pImage->width;
+   pInfo_o->height = pML->pImage->height;
+   memcpy( pInfo_o->aRegion, pML->pImage->aRegion, sizeof(pInfo_o->aRegion) );
+
+   pInfo_o->iterations = pML->iterations;
+   pInfo_o->noise      = pML->iterations >= IMAGE_NOISE_ITERATIONS_MIN ?
+      ImageNoise( pML->pImage, pML->iterations ) : REAL64_MAX;
+
+   pInfo_o->trianglesLength = pML->pScene->trianglesLength;
+   pInfo_o->emittersLength  = pML->pScene->emittersLength;
+   pInfo_o->portalsLength   = pML->pScene->portalsLength;
+
+   pInfo_o->irradianceRecordsLength = pML->pIrradianceCache ?
+      IrradianceCacheRecordsCount( pML->pIrradianceCache ) : 0;
+
+   {
+      const Scene* pS = pML->pScene;
+      int32        i, prototypeTriangles = 0;
+
+      pInfo_o->instancesLength          = pS->instancesLength;
+      pInfo_o->instancedTrianglesLength = 0;
+      for( i = pS->instancesLength;  i-- > 0; )
+      {
+         pInfo_o->instancedTrianglesLength +=
+            pS->aInstances[i].pPrototype->trianglesLength;
+      }
+      for( i = pS->prototypesLength;  i-- > 0; )
+      {
+         prototypeTriangles += pS->aPrototypes[i].trianglesLength;
+      }
+
+      pInfo_o->vertexsLength   = pS->vertexsLength;
+      pInfo_o->materialsLength = pS->materialsLength;
+      pInfo_o->geometryBytes   =
+         (((long64u)pS->trianglesLength + prototypeTriangles) *
+         sizeof(Triangle)) +
+         ((long64u)pS->vertexsLength * sizeof(Vector3f)) +
+         ((long64u)pS->materialsLength * sizeof(Material)) +
+         ((long64u)pS->prototypesLength * sizeof(Prototype)) +
+         ((long64u)pS->instancesLength * sizeof(Instance));
+      pInfo_o->unsharedGeometryBytes = (long64u)(pS->trianglesLength +
+         pInfo_o->instancedTrianglesLength) * ((3 * sizeof(Vector3f)) +
+         sizeof(Material));
+
+      pInfo_o->indexBytes = pS->pIndex ? SpatialIndexBytes( pS->pIndex ) : 0;
+      for( i = pS->prototypesLength;  i-- > 0; )
+      {
+         pInfo_o->indexBytes += SpatialIndexBytes(
+            pS->aPrototypes[i].pIndex );
+      }
+   }
+
+   pInfo_o->pagedBytes    = 0;
+   pInfo_o->residentBytes = 0;
+   pInfo_o->releasedBytes = 0;
+   pInfo_o->majorFaults   = 0;
+   pInfo_o->minorFaults   = 0;
+   if( pML->pPager )
+   {
+      PagerCounts( pML->pPager, &pInfo_o->pagedBytes, &pInfo_o->residentBytes,
+         &pInfo_o->releasedBytes, &pInfo_o->majorFaults,
+         &pInfo_o->minorFaults );
+   }
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightGetPixels
+(
+   const MiniLight* pML,
+   real32*          aRgb_o
+)
+{
+   real64 scale;
+   int32  i;
+
+   if( !pML->pScene )
+   {
+      return ERROR_STATE;
+   }
+
+   /* mean of iterations */
+   scale = pML->iterations > 0 ? 1.0 / (real64)pML->iterations : 0.0;
+
+   for( i = ImageRegionLength( pML->pImage );  i-- > 0; )
+   {
+      int j;
+      for( j = 3;  j-- > 0; )
+      {
+         aRgb_o[(i * 3) + j] =
+            (real32)(pML->pImage->aPixels[i].xyz[j] * scale);
+      }
+   }
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightGetRgbe
+(
+   const MiniLight* pML,
+   byteu*           aRgbe_o
+)
+{
+   if( !pML->pScene )
+   {
+      return ERROR_STATE;
+   }
+
+   ImageRgbe( pML->pImage, pML->iterations, aRgbe_o );
+
+   return MINILIGHT_OK;
+}
+
+
+int MiniLightWriteImage
+(
+   const MiniLight* pML,
+   FILE*            pOut_o
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, !pML->pScene, ERROR_STATE );
+
+      STATS_TIMER_BEGIN( STATS_PHASE_FORMAT )
+      ImageFormatted( pML->pImage, pML->iterations, jmpBuf, pOut_o );
+      STATS_TIMER_END( STATS_PHASE_FORMAT )
+   }
+
+   return status;
+}
+
+
+int MiniLightWriteModel
+(
+   const MiniLight* pML,
+   FILE*            pOut_o
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      throwExceptions( jmpBuf, !pML->pScene, ERROR_STATE );
+
+      throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o,
+         "%s\n\n%i\n\n%i %i\n", MODEL_FORMAT_ID, pML->modelIterations,
+         pML->pImage->width, pML->pImage->height ) );
+      Vector3fWrite( &pML->camera.viewPosition, jmpBuf, pOut_o );
+      throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+      Vector3fWrite( &pML->camera.viewDirection, jmpBuf, pOut_o );
+      throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " %.9g\n\n",
+         pML->camera.viewAngle * DEGREES_PER_RADIAN ) );
+
+      SceneWriteText( pML->pScene, jmpBuf, pOut_o );
+   }
+
+   return status;
+}
+
+
+int MiniLightWriteStats
+(
+   const MiniLight* pML,
+   FILE*            pOut_o
+)
+{
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+#ifdef MINILIGHT_STATS
+      StatsWrite( pML->iterations, jmpBuf, pOut_o );
+#else
+      /* (none compiled in, so nothing to write) */
+      throwExceptions( jmpBuf, (!pML || !pOut_o), ERROR_ARGUMENT );
+#endif
+   }
+
+   return status;
+}
+
+
+const char* MiniLightMessage
+(
+   int status
+)
+{
+   switch( status )
+   {
+      case MINILIGHT_OK               : return "ok";
+      case MINILIGHT_ERROR_FORMAT     : return "unrecognised model format";
+      case MINILIGHT_ERROR_ARGUMENT   : return "invalid argument";
+      case MINILIGHT_ERROR_FILE       : return "file error";
+      case MINILIGHT_ERROR_READ_IO    : return "I/O read error";
+      case MINILIGHT_ERROR_READ_TRUNC : return "truncated model file";
+      case MINILIGHT_ERROR_READ_INVAL : return "invalid model syntax";
+      case MINILIGHT_ERROR_WRITE_IO   : return "I/O write error";
+      case MINILIGHT_ERROR_ALLOC      : return "storage allocation error";
+      case MINILIGHT_ERROR_PROCESS    : return "worker process error";
+      case MINILIGHT_ERROR_STATE      : return "call out of order";
+      default                         : return "(unspecified error)";
+   }
+}
+
+
+
+
+/* utilities ---------------------------------------------------------------- */
+
+int MiniLightReadViews
+(
+   const char*     sFilePathname,
+   MiniLightView** paViews_o,
+   int32*          pViewsLength_o
+)
+{
+   Camera* volatile aCameras = 0;
+
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   *paViews_o      = 0;
+   *pViewsLength_o = 0;
+
+   /* try */
+   if( !status )
+   {
+      int32 length = 0, i;
+
+      aCameras   = BatchReadCameras( jmpBuf, sFilePathname, &length );
+      *paViews_o = (MiniLightView*)throwAllocExceptions( jmpBuf,
+         calloc( length, sizeof(MiniLightView) ) );
+      for( i = length;  i-- > 0; )
+      {
+         (*paViews_o)[i] = cameraToView( &aCameras[i] );
+      }
+      *pViewsLength_o = length;
+   }
+   /* catch */
+   else
+   {
+      free( *paViews_o );
+      *paViews_o = 0;
+   }
+
+   free( aCameras );
+
+   return status;
+}
+
+
+int MiniLightMakePath
+(
+   const MiniLightView* aKeys,
+   int32                keysLength,
+   int32                framesLength,
+   MiniLightView**      paFrames_o
+)
+{
+   Camera* volatile aCameras = 0;
+
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   *paFrames_o = 0;
+
+   /* try */
+   if( !status )
+   {
+      int32 i;
+
+      throwExceptions( jmpBuf, (keysLength < 1) || (framesLength < 1),
+         ERROR_ARGUMENT );
+
+      aCameras = (Camera*)throwAllocExceptions( jmpBuf,
+         calloc( keysLength, sizeof(Camera) ) );
+      for( i = keysLength;  i-- > 0;  aCameras[i] = viewToCamera( &aKeys[i] ) )
+      {}
+
+      *paFrames_o = (MiniLightView*)throwAllocExceptions( jmpBuf,
+         calloc( framesLength, sizeof(MiniLightView) ) );
+      for( i = framesLength;  i-- > 0; )
+      {
+         const Camera c = CameraCreateOnPath( aCameras, keysLength,
+            framesLength > 1 ? (real64)i / (real64)(framesLength - 1) : 0.0 );
+         (*paFrames_o)[i] = cameraToView( &c );
+      }
+   }
+   /* catch */
+   else
+   {
+      free( *paFrames_o );
+      *paFrames_o = 0;
+   }
+
+   free( aCameras );
+
+   return status;
+}
@@ -0,0 +1,475 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef MiniLightLib_h
+#define MiniLightLib_h
+
+
+#include <stddef.h>
+#include <stdio.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+
+/**
+ * Library interface: an embeddable render context.<br/><br/>
+ *
+ * Usage: create, load a model, build the index, (set view, seed, region),
+ * render iterations -- as many times as wanted, progressively -- and get the
+ * pixels or write the image, then free.<br/><br/>
+ *
+ * Every function returning int returns a status: MINILIGHT_OK, or an error
+ * code (see MiniLightMessage). A failed call leaves the context usable, but
+ * with its state as far as the call got.<br/><br/>
+ *
+ * Separate contexts can be used on separate threads. Contexts made by
+ * MiniLightCreateSharing share their original's scene and index, read-only
+ * (so the original must be freed last).
+ *
+ * The interface uses only standard C types (int for booleans and 32-bit
+ * counts), and its own for 64-bit ones -- nothing of the library's internal
+ * Primitives.h -- so it can be included alongside stdbool.h, or from C++.
+ */
+
+
+/* types -------------------------------------------------------------------- */
+
+typedef struct MiniLight MiniLight;
+
+/**
+ * 64-bit counts and sizes (as the library's own). (Print them cast to double,
+ * since C89 printf has no long long conversion.)
+ */
+__extension__ typedef signed long long   MiniLightLong64;
+__extension__ typedef unsigned long long MiniLightLong64u;
+
+/**
+ * View definition, as in the model file.
+ */
+struct MiniLightView
+{
+   double aPosition[3];
+   double aDirection[3];
+   /* degrees */
+   double angle;
+};
+
+typedef struct MiniLightView MiniLightView;
+
+/**
+ * Context state, as queried.
+ */
+struct MiniLightInfo
+{
+   /* random seed, as 8 hex digits */
+   char             sId[9];
+
+   /* iterations in the model file */
+   int              modelIterations;
+
+   /* whole frame, and part of it held (x0 y0 x1 y1, from top-left) */
+   int              width;
+   int              height;
+   int              aRegion[4];
+
+   /* rendered so far */
+   int              iterations;
+   /* relative noise, if tracked and over enough iterations (else the
+      maximum real) */
+   double           noise;
+
+   int              trianglesLength;
+   int              emittersLength;
+   int              portalsLength;
+
+   /* irradiance cache records made (by every context sharing it), or 0 */
+   int              irradianceRecordsLength;
+
+   /* instances, and the triangles they place (not held) */
+   int              instancesLength;
+   MiniLightLong64  instancedTrianglesLength;
+
+   /* shared by triangles, and memory for all their geometry and quality (and
+      as it would be without sharing: whole vertexs and material each, for
+      each placement) */
+   int              vertexsLength;
+   int              materialsLength;
+   MiniLightLong64u geometryBytes;
+   MiniLightLong64u unsharedGeometryBytes;
+   /* memory for the indexs (the scene's, once made, and its objects') */
+   MiniLightLong64u indexBytes;
+
+   /* paging (all 0 if not paged): size of the paged geometry, how much of it
+      is resident, how much was released, in total, and process page faults
+      (reading files, and not) since indexed */
+   MiniLightLong64u pagedBytes;
+   MiniLightLong64u residentBytes;
+   MiniLightLong64u releasedBytes;
+   MiniLightLong64u majorFaults;
+   MiniLightLong64u minorFaults;
+};
+
+typedef struct MiniLightInfo MiniLightInfo;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+int MiniLightCreate
+(
+   MiniLight** ppML_o
+);
+
+/**
+ * Make a context sharing another's (loaded and indexed) scene, with its own
+ * view (initially the other's), random generator (seeded from the other's),
+ * and image (of the same region, and tracking noise if it does), tracing as
+ * the other does.
+ */
+int MiniLightCreateSharing
+(
+   MiniLight*  pOther,
+   MiniLight** ppML_o
+);
+
+void MiniLightFree
+(
+   MiniLight* pML
+);
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+/**
+ * Keep read and indexed scenes in a directory (before loading), to be mapped
+ * instead of read and indexed again by later loads of the same model (in any
+ * process) -- see SceneCache.h.
+ *
+ * @param sDirectory or 0 for none (made if not existing)
+ * @param sizeLimit bytes to keep the directory within (removing least
+ *        recently used), or 0 for no limit
+ */
+int MiniLightSetCache
+(
+   MiniLight*       pML,
+   const char*      sDirectory,
+   MiniLightLong64u sizeLimit
+);
+
+/**
+ * Render from the scene as paged from its cache files (before loading, and
+ * after setting a cache), keeping its resident geometry within a limit --
+ * see Pager.h. Paths are then traced in tiles, to keep near rays together.
+ *
+ * @param residentLimit bytes, or 0 for not paged
+ */
+int MiniLightSetPaging
+(
+   MiniLight*       pML,
+   MiniLightLong64u residentLimit
+);
+
+/**
+ * Read a model (in the model file format) from memory.
+ */
+int MiniLightLoad
+(
+   MiniLight*  pML,
+   const char* pModel,
+   size_t      modelLength
+);
+
+int MiniLightLoadFile
+(
+   MiniLight*  pML,
+   const char* sModelFilePathname
+);
+
+/**
+ * Make index of the scene, able to render from the current view, and from
+ * any others given.
+ */
+int MiniLightBuildIndex
+(
+   MiniLight*           pML,
+   const MiniLightView* aViews,
+   int                  viewsLength
+);
+
+/**
+ * Change view (before rendering). Once indexed, it must be one the index was
+ * built for.
+ */
+int MiniLightSetView
+(
+   MiniLight*           pML,
+   const MiniLightView* pView
+);
+
+/**
+ * Restart the random generator from a seed (for repeatable or distinct
+ * renders). (Otherwise it is seeded uniquely when loading.)
+ */
+int MiniLightSetSeed
+(
+   MiniLight*   pML,
+   unsigned int seed
+);
+
+/**
+ * Render only a region of the frame (before rendering).
+ *
+ * @param aRegion x0 y0 x1 y1 (pixels, from top-left, x1 y1 exclusive)
+ */
+int MiniLightSetRegion
+(
+   MiniLight*  pML,
+   const int   aRegion[4]
+);
+
+/**
+ * Estimate noise (before rendering) -- see MiniLightInfo.
+ */
+int MiniLightTrackNoise
+(
+   MiniLight* pML
+);
+
+/**
+ * Trace by bidirectional path tracing, or not (the default) -- see
+ * BidirectionalTracer.h (before rendering). It finds small, enclosed, or
+ * indirectly seen emitters' light sooner, though each iteration takes longer.
+ */
+int MiniLightSetBidirectional
+(
+   MiniLight* pML,
+   int        isBidirectional
+);
+
+/**
+ * Render by progressive photon mapping, or not (the default) -- see
+ * PhotonMapper.h (before rendering, and instead of bidirectional tracing if
+ * both are set). Indirect light in interiors smooths out sooner, from the
+ * emitters and the sky. Each frame is spread over the processors, and noise
+ * tracking is only rough. Not for MiniLightRenderViews.
+ */
+int MiniLightSetPhotonMapping
+(
+   MiniLight* pML,
+   int        isPhotonMapping
+);
+
+/**
+ * Render with an irradiance cache, or not (the default) -- see
+ * IrradianceCache.h (before rendering, and instead of bidirectional tracing
+ * if both are set, but not of photon mapping). Indirect light smooths out
+ * much sooner, but converges to the cache's estimate. The cache lasts for
+ * every iteration and view, and contexts made sharing this one share it too.
+ */
+int MiniLightSetIrradianceCaching
+(
+   MiniLight* pML,
+   int        isIrradianceCaching
+);
+
+/**
+ * Trace by a path guide, or not (the default) -- see PathGuide.h (before
+ * rendering, and only for plain path tracing: the other ways take
+ * precedence). It learns where light comes from over the early iterations,
+ * and samples bounces toward it, for light reaching surfaces unevenly (gaining
+ * more the longer the render). Not for MiniLightRenderViews.
+ */
+int MiniLightSetPathGuiding
+(
+   MiniLight* pML,
+   int        isPathGuiding
+);
+
+/**
+ * Accumulate more iterations to the image.
+ */
+int MiniLightRender
+(
+   MiniLight* pML,
+   int        iterations
+);
+
+/**
+ * Render many views of the indexed scene (each as its own context would),
+ * on threads, each to an image file, numbered: "name.0000.rgbe" for
+ * "name.rgbe".
+ *
+ * @param targetNoise stop a view early at this relative noise, or 0
+ * @param threadsLength or 0 for the number of processors
+ */
+int MiniLightRenderViews
+(
+   MiniLight*           pML,
+   const MiniLightView* aViews,
+   int                  viewsLength,
+   int                  iterations,
+   double               targetNoise,
+   int                  threadsLength,
+   const char*          sImageFilePathname
+);
+
+/**
+ * Render by worker processes (without loading here) -- see RenderFarm.h.
+ * The image is the merge of theirs (MINILIGHT_ERROR_PROCESS if any worker
+ * fails).
+ */
+int MiniLightRenderFarm
+(
+   MiniLight*  pML,
+   const char* sCommandTemplate,
+   const char* sModelFilePathname,
+   int         iterations,
+   int         workersLength
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+int MiniLightGetInfo
+(
+   const MiniLight* pML,
+   MiniLightInfo*   pInfo_o
+);
+
+/**
+ * Copy out the image: mean radiance, RGB, by rows from top-left, of the
+ * region.
+ *
+ * @param aRgb_o region width * height * 3 reals
+ */
+int MiniLightGetPixels
+(
+   const MiniLight* pML,
+   float*           aRgb_o
+);
+
+/**
+ * Copy out the image as RGBE pixels (compact, and as written to file), by
+ * rows from top-left, of the region.
+ *
+ * @param aRgbe_o region width * height * 4 bytes
+ */
+int MiniLightGetRgbe
+(
+   const MiniLight* pML,
+   unsigned char*   aRgbe_o
+);
+
+/**
+ * Write the image in RGBE format.
+ */
+int MiniLightWriteImage
+(
+   const MiniLight* pML,
+   FILE*            pOut_o
+);
+
+/**
+ * Write the model in the model file format (with the loaded scene's imported
+ * triangles included as plain triangles).
+ */
+int MiniLightWriteModel
+(
+   const MiniLight* pML,
+   FILE*            pOut_o
+);
+
+/**
+ * Write the profiling timers and counters (when compiled in), as 'name value'
+ * lines.
+ */
+int MiniLightWriteStats
+(
+   const MiniLight* pML,
+   FILE*            pOut_o
+);
+
+/**
+ * Description of a status code.
+ */
+const char* MiniLightMessage
+(
+   int status
+);
+
+
+
+
+/* utilities ---------------------------------------------------------------- */
+
+/**
+ * Read view definitions from a camera file (lines of: viewposition
+ * viewdirection viewangle).
+ *
+ * @param paViews_o array (to be freed by caller, with free)
+ */
+int MiniLightReadViews
+(
+   const char*     sFilePathname,
+   MiniLightView** paViews_o,
+   int*            pViewsLength_o
+);
+
+/**
+ * Make frames along a path through key views (spaced evenly) -- see
+ * CameraCreateOnPath.
+ *
+ * @param paFrames_o array (to be freed by caller, with free)
+ */
+int MiniLightMakePath
+(
+   const MiniLightView* aKeys,
+   int                  keysLength,
+   int                  framesLength,
+   MiniLightView**      paFrames_o
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+#define MINILIGHT_OK                 0
+
+#define MINILIGHT_ERROR_FORMAT       1
+#define MINILIGHT_ERROR_ARGUMENT     2
+#define MINILIGHT_ERROR_FILE       128
+#define MINILIGHT_ERROR_READ_IO    256
+#define MINILIGHT_ERROR_READ_TRUNC 257
+#define MINILIGHT_ERROR_READ_INVAL 258
+#define MINILIGHT_ERROR_WRITE_IO   384
+#define MINILIGHT_ERROR_ALLOC      512
+#define MINILIGHT_ERROR_PROCESS    640
+#define MINILIGHT_ERROR_STATE      768
+
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
@@ -0,0 +1,278 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+/* (mincore and madvise are beyond POSIX) */
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "Exceptions.h"
+
+#include "Pager.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/* milliseconds between checks */
+#define CHECK_MS 50
+
+/* pages released at once */
+#define CHUNK_PAGES 256
+
+/* releasing goes down to this fraction of the limit (so it is not needed
+   again straight away) */
+static const real64 LOW_WATER = 0.75;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+struct Pager
+{
+   pthread_t       thread;
+   pthread_mutex_t mutex;
+   pthread_cond_t  closed;
+   bool            isClosing;
+
+   /* paged parts (their whole pages), and a residency byte per page (of all
+      the parts, in order) */
+   byteu*          apParts[2];
+   size_t          aPagesLengths[2];
+   int             partsLength;
+   size_t          pagesLength;
+   size_t          pageSize;
+   byteu*          aResidency;
+
+   long64u         residentLimit;
+
+   /* next page to release (of all the parts) */
+   size_t          hand;
+
+   /* counts (guarded by mutex) */
+   long64u         residentBytes;
+   long64u         releasedBytes;
+
+   /* process page faults when made */
+   struct rusage   usage;
+};
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Count resident pages, and release some if over the limit.
+ */
+static void keepToLimit
+(
+   Pager* pP
+)
+{
+   size_t resident = 0, released = 0, page = 0, visited;
+   int    i;
+
+   /* count */
+   for( i = 0;  i < pP->partsLength;  page += pP->aPagesLengths[i++] )
+   {
+      if( !mincore( pP->apParts[i], pP->aPagesLengths[i] * pP->pageSize,
+         (void*)(pP->aResidency + page) ) )
+      {
+         size_t j;
+         for( j = pP->aPagesLengths[i];  j-- > 0;
+            resident += pP->aResidency[page + j] & 1 ) {}
+      }
+   }
+
+   /* release chunks, from the hand on, until under the low water mark (or all
+      tried) */
+   if( (long64u)resident * pP->pageSize > pP->residentLimit )
+   {
+      const size_t target = (size_t)(((real64)pP->residentLimit * LOW_WATER) /
+         (real64)pP->pageSize);
+
+      for( visited = 0;  (resident > target) &&
+         (visited < pP->pagesLength); )
+      {
+         /* chunk: within a part */
+         const int    part   = (pP->hand < pP->aPagesLengths[0]) ? 0 : 1;
+         const size_t offset = pP->hand - (part ? pP->aPagesLengths[0] : 0);
+         const size_t length = (pP->aPagesLengths[part] - offset) <
+            CHUNK_PAGES ? (pP->aPagesLengths[part] - offset) : CHUNK_PAGES;
+
+         size_t in = 0, j;
+         for( j = length;  j-- > 0;  in += pP->aResidency[pP->hand + j] & 1 )
+         {}
+
+         if( in && !madvise( pP->apParts[part] + (offset * pP->pageSize),
+            length * pP->pageSize, MADV_DONTNEED ) )
+         {
+            resident -= in;
+            released += in;
+         }
+
+         visited += length;
+         pP->hand = (pP->hand + length) % pP->pagesLength;
+      }
+   }
+
+   pthread_mutex_lock( &pP->mutex );
+   pP->residentBytes  = (long64u)resident * pP->pageSize;
+   pP->releasedBytes += (long64u)released * pP->pageSize;
+   pthread_mutex_unlock( &pP->mutex );
+}
+
+
+/**
+ * Thread body: check periodically, until closed.
+ */
+static void* keepPages
+(
+   void* pPagerV
+)
+{
+   Pager* pP = (Pager*)pPagerV;
+
+   for( ;; )
+   {
+      bool isClosing;
+
+      /* wait for the next check (or end, if closing) */
+      pthread_mutex_lock( &pP->mutex );
+      if( !pP->isClosing )
+      {
+         struct timespec t;
+         clock_gettime( CLOCK_REALTIME, &t );
+         t.tv_nsec += CHECK_MS * 1000000L;
+         t.tv_sec  += t.tv_nsec / 1000000000L;
+         t.tv_nsec %= 1000000000L;
+         pthread_cond_timedwait( &pP->closed, &pP->mutex, &t );
+      }
+      isClosing = pP->isClosing;
+      pthread_mutex_unlock( &pP->mutex );
+
+      if( isClosing )
+      {
+         break;
+      }
+
+      keepToLimit( pP );
+   }
+
+   return 0;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+Pager* PagerConstruct
+(
+   jmp_buf      jmpBuf,
+   const Scene* pScene,
+   long64u      residentLimit
+)
+{
+   Pager*       pP = (Pager*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(Pager) ) );
+   const byteu* apParts[2];
+   size_t       aLengths[2];
+   const int    partsLength = SceneMappedParts( pScene, apParts, aLengths );
+   int          i;
+
+   pP->residentLimit = residentLimit;
+   pP->pageSize      = (size_t)sysconf( _SC_PAGESIZE );
+
+   /* whole pages within the parts (the index's blocks need not start on
+      one) */
+   for( i = 0;  i < partsLength;  ++i )
+   {
+      const size_t start = (((size_t)apParts[i] + pP->pageSize - 1) /
+         pP->pageSize) * pP->pageSize;
+      const size_t end   = (((size_t)apParts[i] + aLengths[i]) /
+         pP->pageSize) * pP->pageSize;
+
+      if( end > start )
+      {
+         pP->apParts[pP->partsLength]       = (byteu*)start;
+         pP->aPagesLengths[pP->partsLength] = (end - start) / pP->pageSize;
+         pP->pagesLength += pP->aPagesLengths[pP->partsLength++];
+      }
+   }
+   pP->aResidency = (byteu*)throwAllocExceptions( jmpBuf,
+      malloc( pP->pagesLength + 1 ) );
+
+   getrusage( RUSAGE_SELF, &pP->usage );
+
+   throwExceptions( jmpBuf, (0 != pthread_mutex_init( &pP->mutex, 0 )) ||
+      (0 != pthread_cond_init( &pP->closed, 0 )) ||
+      (0 != pthread_create( &pP->thread, 0, keepPages, pP )),
+      ERROR_PROCESS );
+
+   return pP;
+}
+
+
+void PagerDestruct
+(
+   Pager* pP
+)
+{
+   pthread_mutex_lock( &pP->mutex );
+   pP->isClosing = true;
+   pthread_cond_signal( &pP->closed );
+   pthread_mutex_unlock( &pP->mutex );
+
+   pthread_join( pP->thread, 0 );
+
+   pthread_cond_destroy( &pP->closed );
+   pthread_mutex_destroy( &pP->mutex );
+
+   free( pP->aResidency );
+   free( pP );
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+void PagerCounts
+(
+   Pager*   pP,
+   long64u* pPagedBytes_o,
+   long64u* pResidentBytes_o,
+   long64u* pReleasedBytes_o,
+   long64u* pMajorFaults_o,
+   long64u* pMinorFaults_o
+)
+{
+   struct rusage usage;
+   getrusage( RUSAGE_SELF, &usage );
+
+   *pPagedBytes_o  = (long64u)pP->pagesLength * pP->pageSize;
+   *pMajorFaults_o = (long64u)(usage.ru_majflt - pP->usage.ru_majflt);
+   *pMinorFaults_o = (long64u)(usage.ru_minflt - pP->usage.ru_minflt);
+
+   pthread_mutex_lock( &pP->mutex );
+   *pResidentBytes_o = pP->residentBytes;
+   *pReleasedBytes_o = pP->releasedBytes;
+   pthread_mutex_unlock( &pP->mutex );
+}
@@ -0,0 +1,94 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Pager_h
+#define Pager_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Scene.h"
+
+
+
+
+/**
+ * Keeper of a paged scene's resident memory within a limit.<br/><br/>
+ *
+ * A paged scene (see SceneCache) is held in mappings of its stored files.
+ * Their read-only parts -- vertexs, materials, and the index's leaf blocks:
+ * most of it -- are paged in on demand (see SceneMappedParts). The rest -- the
+ * index's nodes and item numbers, and the triangles -- is left resident, so
+ * every trace starts from memory.<br/><br/>
+ *
+ * A thread counts the parts' resident pages periodically, and when over the
+ * limit, releases chunks of them in turn (clock order) until a margin under
+ * it -- to be faulted in again from the files (or the system's file cache)
+ * when next touched. The process's page faults are counted too.
+ *
+ * @implementation
+ * Uses mincore and madvise( MADV_DONTNEED ) (not POSIX, but on Linux and the
+ * BSDs), which, for private mappings never written, only drops pages.
+ */
+
+typedef struct Pager Pager;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * Start keeping a scene's paged parts within a limit (the scene to outlive the
+ * pager).
+ *
+ * @param residentLimit bytes
+ */
+Pager* PagerConstruct
+(
+   jmp_buf      jmpBuf,
+   const Scene* pScene,
+   long64u      residentLimit
+);
+
+void PagerDestruct
+(
+   Pager*
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Counts, as of the last check.
+ *
+ * @param pPagedBytes_o size of the paged parts
+ * @param pResidentBytes_o how much of them is resident
+ * @param pReleasedBytes_o how much was released, in total
+ * @param pMajorFaults_o process page faults reading files, since made
+ * @param pMinorFaults_o process page faults not reading, since made
+ */
+void PagerCounts
+(
+   Pager*,
+   long64u* pPagedBytes_o,
+   long64u* pResidentBytes_o,
+   long64u* pReleasedBytes_o,
+   long64u* pMajorFaults_o,
+   long64u* pMinorFaults_o
+);
+
+
+
+
+#endif
@@ -0,0 +1,737 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Exceptions.h"
+
+#include "PathGuide.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const real64 PI = 3.14159265358979;
+
+/* just under 1 (keeping square coordinates inside) */
+static const real64 ALMOST_ONE = 1.0 - 1e-12;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Quadtree node: its quadrants' sums of radiance (or, once sampled from, their
+ * fractions of the node's), and their subnodes (or 0s).
+ */
+struct Node
+{
+   real64 aSums[4];
+   int32  aChildren[4];
+};
+
+typedef struct Node Node;
+
+
+/**
+ * Quadtree over the direction square (root first), or empty (and, if sampled
+ * from, empty where nothing was recorded).
+ */
+struct Quadtree
+{
+   Node* aNodes;
+   int32 nodesLength;
+};
+
+typedef struct Quadtree Quadtree;
+
+
+/**
+ * Spatial tree cell: its halves (or 0s), or, as a leaf, the directions it
+ * samples by, and the ones it records into, for each way surfaces face (and
+ * how many records).
+ */
+struct Cell
+{
+   int32    aChildren[2];
+
+   Quadtree aSampled[6];
+   Quadtree aRecorded[6];
+   real64   records;
+};
+
+typedef struct Cell Cell;
+
+
+struct PathGuide
+{
+   /* spatial tree (root first), and its bound */
+   Cell*    aCells;
+   int32    cellsLength;
+   Vector3f position;
+   Vector3f size;
+
+   /* frames so far of this pass, and in it, and passes so far */
+   int32    frames;
+   int32    passFrames;
+   int32    passes;
+   bool     isLearning;
+
+   /* for refining quadtrees into */
+   Node*    aScratch;
+   int32    scratchLength;
+};
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Which way a surface faces: its normal's largest axis, and its sign.
+ */
+static int32 facing
+(
+   const Vector3f* pNormal
+)
+{
+   const real64 x = fabs( pNormal->xyz[0] );
+   const real64 y = fabs( pNormal->xyz[1] );
+   const real64 z = fabs( pNormal->xyz[2] );
+   const int32  axis = (x >= y) ? ((x >= z) ? 0 : 2) : ((y >= z) ? 1 : 2);
+
+   return (axis * 2) + (pNormal->xyz[axis] < 0.0);
+}
+
+
+/**
+ * Position in the direction square (cosine of the angle from Z, and the angle
+ * around it, both scaled to 0 to 1).
+ */
+static void toSquare
+(
+   const Vector3f* pDirection,
+   real64*         pU_o,
+   real64*         pV_o
+)
+{
+   const real64 z   = pDirection->xyz[2];
+   const real64 u   = (z + 1.0) * 0.5;
+   const real64 v   = (atan2( pDirection->xyz[1], pDirection->xyz[0] ) + PI) /
+      (2.0 * PI);
+
+   *pU_o = u < 0.0 ? 0.0 : (u > ALMOST_ONE ? ALMOST_ONE : u);
+   *pV_o = v < 0.0 ? 0.0 : (v > ALMOST_ONE ? ALMOST_ONE : v);
+}
+
+
+static Vector3f fromSquare
+(
+   real64 u,
+   real64 v
+)
+{
+   const real64 z   = (2.0 * u) - 1.0;
+   const real64 r   = sqrt( (1.0 - (z * z)) > 0.0 ? 1.0 - (z * z) : 0.0 );
+   const real64 phi = (2.0 * PI * v) - PI;
+
+   Vector3f d;
+   d.xyz[0] = r * cos( phi );
+   d.xyz[1] = r * sin( phi );
+   d.xyz[2] = z;
+
+   return d;
+}
+
+
+/**
+ * Quadrant of a node a square position is in, and the position within it.
+ */
+static int32 quadrant
+(
+   real64* pU_io,
+   real64* pV_io
+)
+{
+   const int32 iu = *pU_io >= 0.5;
+   const int32 iv = *pV_io >= 0.5;
+
+   *pU_io = (*pU_io * 2.0) - (real64)iu;
+   *pV_io = (*pV_io * 2.0) - (real64)iv;
+
+   return iu | (iv << 1);
+}
+
+
+static real64 nodeSum
+(
+   const Node* pNode
+)
+{
+   return pNode->aSums[0] + pNode->aSums[1] + pNode->aSums[2] +
+      pNode->aSums[3];
+}
+
+
+/**
+ * Make a recorded quadtree's sums into fractions, to sample from (or empty it,
+ * if it has nothing).
+ */
+static void normalize
+(
+   Quadtree* pQ
+)
+{
+   if( (pQ->nodesLength > 0) && (nodeSum( &pQ->aNodes[0] ) > 0.0) )
+   {
+      int32 i;
+      for( i = pQ->nodesLength;  i-- > 0; )
+      {
+         Node*        pNode = &pQ->aNodes[i];
+         const real64 sum   = nodeSum( pNode );
+         int32        q;
+
+         /* (where nothing was recorded, even) */
+         for( q = 4;  q-- > 0; )
+         {
+            pNode->aSums[q] = (sum > 0.0) ? pNode->aSums[q] / sum : 0.25;
+         }
+      }
+   }
+   else
+   {
+      free( pQ->aNodes );
+      memset( pQ, 0, sizeof(Quadtree) );
+   }
+}
+
+
+/**
+ * Probability density (per solid angle) of a direction, from a trained
+ * quadtree.
+ */
+static real64 quadtreePdf
+(
+   const Quadtree* pQ,
+   const Vector3f* pDirection
+)
+{
+   real64 pdf = 1.0 / (4.0 * PI);
+   real64 u, v;
+   int32  node = 0;
+   toSquare( pDirection, &u, &v );
+
+   do
+   {
+      const int32 q = quadrant( &u, &v );
+      pdf *= 4.0 * pQ->aNodes[node].aSums[q];
+      node = pQ->aNodes[node].aChildren[q];
+   }
+   while( node );
+
+   return pdf;
+}
+
+
+/**
+ * Direction sampled from a trained quadtree, and its probability density (per
+ * solid angle).
+ */
+static Vector3f quadtreeSample
+(
+   const Quadtree* pQ,
+   Random*         pRandom,
+   real64*         pPdf_o
+)
+{
+   real64 u = 0.0, v = 0.0, size = 1.0;
+   int32  node = 0;
+
+   *pPdf_o = 1.0 / (4.0 * PI);
+   do
+   {
+      const Node* pNode = &pQ->aNodes[node];
+      real64      r     = RandomReal64( pRandom );
+      int32       q     = 0;
+
+      /* choose a quadrant by its fraction */
+      for( ;  (q < 3) && ((r >= pNode->aSums[q]) ||
+         (pNode->aSums[q] <= 0.0));  ++q )
+      {
+         r -= pNode->aSums[q];
+      }
+      *pPdf_o *= 4.0 * pNode->aSums[q];
+
+      size *= 0.5;
+      u += (real64)(q & 1) * size;
+      v += (real64)(q >> 1) * size;
+      node = pNode->aChildren[q];
+   }
+   while( node );
+
+   /* anywhere in the chosen cell */
+   return fromSquare( u + (RandomReal64( pRandom ) * size),
+      v + (RandomReal64( pRandom ) * size) );
+}
+
+
+static void quadtreeRecord
+(
+   Quadtree*       pQ,
+   const Vector3f* pDirection,
+   real64          radiance
+)
+{
+   real64 u, v;
+   int32  node = 0;
+   toSquare( pDirection, &u, &v );
+
+   if( pQ->nodesLength > 0 )
+   {
+      do
+      {
+         const int32 q = quadrant( &u, &v );
+         pQ->aNodes[node].aSums[q] += radiance;
+         node = pQ->aNodes[node].aChildren[q];
+      }
+      while( node );
+   }
+}
+
+
+/**
+ * Make a zeroed node into the scratch space, its quadrants subdivided (and
+ * theirs, recursively) where they have more than PATH_GUIDE_ENERGY of the
+ * whole (taking the fractions from an old quadtree, or its nearest node, split
+ * evenly).
+ *
+ * @return index of the node
+ */
+static int32 refineNode
+(
+   PathGuide*      pG,
+   const Quadtree* pOld,
+   int32           oldNode,
+   const real64    aEnergies[4],
+   int32           depth,
+   int32*          pLength_io
+)
+{
+   const int32 index = (*pLength_io)++;
+   int32       q;
+
+   for( q = 0;  q < 4;  ++q )
+   {
+      pG->aScratch[index].aSums[q]     = 0.0;
+      pG->aScratch[index].aChildren[q] = 0;
+
+      if( (aEnergies[q] > PATH_GUIDE_ENERGY) &&
+         (depth < PATH_GUIDE_DIRECTION_DEPTH_MAX) &&
+         (*pLength_io < pG->scratchLength) )
+      {
+         const int32 oldChild = (oldNode >= 0) ?
+            pOld->aNodes[oldNode].aChildren[q] : 0;
+         real64      aChildEnergies[4];
+         int32       c;
+         for( c = 4;  c-- > 0; )
+         {
+            aChildEnergies[c] = aEnergies[q] * (oldChild ?
+               pOld->aNodes[oldChild].aSums[c] : 0.25);
+         }
+
+         pG->aScratch[index].aChildren[q] = refineNode( pG, pOld,
+            oldChild ? oldChild : -1, aChildEnergies, depth + 1,
+            pLength_io );
+      }
+   }
+
+   return index;
+}
+
+
+/**
+ * Zeroed quadtree shaped for the radiance in a sampled one.
+ */
+static Quadtree refine
+(
+   PathGuide*      pG,
+   jmp_buf         jmpBuf,
+   const Quadtree* pOld
+)
+{
+   static const real64 ZEROS[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+   Quadtree q;
+   int32    length = 0;
+
+   if( pOld->nodesLength > 0 )
+   {
+      refineNode( pG, pOld, 0, pOld->aNodes[0].aSums, 1, &length );
+   }
+   else
+   {
+      refineNode( pG, pOld, -1, ZEROS, 1, &length );
+   }
+
+   q.aNodes = (Node*)throwAllocExceptions( jmpBuf,
+      malloc( length * sizeof(Node) ) );
+   memcpy( q.aNodes, pG->aScratch, length * sizeof(Node) );
+   q.nodesLength = length;
+
+   return q;
+}
+
+
+static Quadtree copy
+(
+   jmp_buf         jmpBuf,
+   const Quadtree* pQ
+)
+{
+   Quadtree q;
+   q.aNodes = (Node*)throwAllocExceptions( jmpBuf,
+      malloc( (pQ->nodesLength > 0 ? pQ->nodesLength : 1) * sizeof(Node) ) );
+   memcpy( q.aNodes, pQ->aNodes, pQ->nodesLength * sizeof(Node) );
+   q.nodesLength = pQ->nodesLength;
+
+   return q;
+}
+
+
+/**
+ * Leaf cell of the spatial tree containing a position (or nearest it).
+ */
+static int32 leaf
+(
+   const PathGuide* pG,
+   const Vector3f*  pPosition
+)
+{
+   Vector3f lower = pG->position;
+   Vector3f size  = pG->size;
+   int32    cell  = 0;
+   int32    depth = 0;
+
+   while( pG->aCells[cell].aChildren[0] )
+   {
+      /* halves of each axis in turn */
+      const int32 axis    = depth++ % 3;
+      const bool  isUpper = pPosition->xyz[axis] >= (lower.xyz[axis] +
+         (size.xyz[axis] * 0.5));
+
+      size.xyz[axis] *= 0.5;
+      lower.xyz[axis] += isUpper ? size.xyz[axis] : 0.0;
+      cell = pG->aCells[cell].aChildren[isUpper];
+   }
+
+   return cell;
+}
+
+
+static void freeQuadtrees
+(
+   Cell* pCell
+)
+{
+   int32 f;
+   for( f = 6;  f-- > 0; )
+   {
+      free( pCell->aSampled[f].aNodes );
+      free( pCell->aRecorded[f].aNodes );
+   }
+   memset( pCell->aSampled,  0, sizeof(pCell->aSampled) );
+   memset( pCell->aRecorded, 0, sizeof(pCell->aRecorded) );
+}
+
+
+/**
+ * Split a leaf cell in two, and them, while they have too many records (the
+ * halves each taking half, and copies of the quadtrees).
+ */
+static void split
+(
+   PathGuide* pG,
+   jmp_buf    jmpBuf,
+   int32      cell,
+   int32      depth,
+   real64     recordsMax
+)
+{
+   if( (pG->aCells[cell].records > recordsMax) &&
+      (depth < PATH_GUIDE_SPATIAL_DEPTH_MAX) )
+   {
+      const int32 first = pG->cellsLength;
+      int32       i;
+
+      pG->aCells = (Cell*)throwAllocExceptions( jmpBuf, realloc( pG->aCells,
+         (first + 2) * sizeof(Cell) ) );
+      memset( &pG->aCells[first], 0, 2 * sizeof(Cell) );
+      pG->cellsLength += 2;
+
+      for( i = 0;  i < 2;  ++i )
+      {
+         Cell* pHalf = &pG->aCells[first + i];
+         int32 f;
+         pHalf->records = pG->aCells[cell].records * 0.5;
+         for( f = 6;  f-- > 0; )
+         {
+            pHalf->aSampled[f]  = copy( jmpBuf,
+               &pG->aCells[cell].aSampled[f] );
+            pHalf->aRecorded[f] = copy( jmpBuf,
+               &pG->aCells[cell].aRecorded[f] );
+         }
+      }
+
+      /* (now not a leaf) */
+      freeQuadtrees( &pG->aCells[cell] );
+      pG->aCells[cell].aChildren[0] = first;
+      pG->aCells[cell].aChildren[1] = first + 1;
+
+      for( i = 0;  i < 2;  ++i )
+      {
+         split( pG, jmpBuf, first + i, depth + 1, recordsMax );
+      }
+   }
+
+   pG->aCells[cell].records = 0.0;
+}
+
+
+/**
+ * End a pass, in every leaf cell: sample by what was recorded, record into a
+ * refinement of it (if still learning), and split where many records were.
+ */
+static void endPass
+(
+   PathGuide* pG,
+   jmp_buf    jmpBuf,
+   int32      cell,
+   int32      depth,
+   bool       isLearning,
+   real64     recordsMax
+)
+{
+   if( pG->aCells[cell].aChildren[0] )
+   {
+      int32 i;
+      for( i = 0;  i < 2;  ++i )
+      {
+         endPass( pG, jmpBuf, pG->aCells[cell].aChildren[i], depth + 1,
+            isLearning, recordsMax );
+      }
+   }
+   else
+   {
+      Cell* pCell = &pG->aCells[cell];
+      int32 f;
+
+      for( f = 6;  f-- > 0; )
+      {
+         free( pCell->aSampled[f].aNodes );
+         pCell->aSampled[f] = pCell->aRecorded[f];
+         memset( &pCell->aRecorded[f], 0, sizeof(Quadtree) );
+         normalize( &pCell->aSampled[f] );
+
+         if( isLearning )
+         {
+            pCell->aRecorded[f] = refine( pG, jmpBuf, &pCell->aSampled[f] );
+         }
+      }
+
+      if( isLearning )
+      {
+         split( pG, jmpBuf, cell, depth, recordsMax );
+      }
+   }
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+PathGuide* PathGuideConstruct
+(
+   jmp_buf      jmpBuf,
+   const Scene* pScene
+)
+{
+   PathGuide* pG = (PathGuide*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(PathGuide) ) );
+
+   /* scratch space: enough for the most quadrants over the energy fraction
+      at each depth */
+   pG->scratchLength = 2 + (PATH_GUIDE_DIRECTION_DEPTH_MAX *
+      (int32)((1.0 / PATH_GUIDE_ENERGY) + 1.0));
+   pG->aScratch = (Node*)calloc( pG->scratchLength, sizeof(Node) );
+   pG->aCells   = (Cell*)calloc( 1, sizeof(Cell) );
+   if( !pG->aScratch || !pG->aCells )
+   {
+      PathGuideDestruct( pG );
+      throwExceptions( jmpBuf, true, ERROR_ALLOC );
+   }
+   pG->cellsLength = 1;
+
+   /* root: the scene index's bound */
+   {
+      const real64* aBound = pScene->pIndex->aBound;
+      int32 i;
+      for( i = 3;  i-- > 0; )
+      {
+         pG->position.xyz[i] = aBound[i];
+         pG->size.xyz[i]     = aBound[i + 3] - aBound[i];
+      }
+   }
+
+   pG->passFrames = 1;
+   pG->isLearning = true;
+
+   /* first pass records into single nodes */
+   {
+      int32 f;
+      for( f = 6;  f-- > 0; )
+      {
+         pG->aCells[0].aRecorded[f] = refine( pG, jmpBuf,
+            &pG->aCells[0].aSampled[f] );
+      }
+   }
+
+   return pG;
+}
+
+
+void PathGuideDestruct
+(
+   PathGuide* pG
+)
+{
+   if( pG )
+   {
+      int32 i;
+      for( i = pG->cellsLength;  i-- > 0; )
+      {
+         freeQuadtrees( &pG->aCells[i] );
+      }
+      free( pG->aCells );
+      free( pG->aScratch );
+
+      free( pG );
+   }
+}
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+void PathGuideRecord
+(
+   PathGuide*            pG,
+   const PathGuidePlace* pPlace,
+   const Vector3f*       pDirection,
+   real64                radiance
+)
+{
+   if( pG->isLearning )
+   {
+      Cell* pCell = &pG->aCells[pPlace->cell];
+      quadtreeRecord( &pCell->aRecorded[pPlace->facing], pDirection,
+         radiance );
+      pCell->records += 1.0;
+   }
+}
+
+
+void PathGuideFrameEnd
+(
+   PathGuide* pG,
+   jmp_buf    jmpBuf
+)
+{
+   if( pG->isLearning && (++pG->frames >= pG->passFrames) )
+   {
+      const bool isLearning = (pG->passes + 1) < PATH_GUIDE_PASSES;
+
+      /* (the next pass is twice as long, so its leaves can take more) */
+      endPass( pG, jmpBuf, 0, 0, isLearning, PATH_GUIDE_SPLIT_RECORDS *
+         sqrt( (real64)(pG->passFrames * 2) ) );
+
+      pG->frames      = 0;
+      pG->passFrames *= 2;
+      pG->passes     += 1;
+      pG->isLearning  = isLearning;
+   }
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+PathGuidePlace PathGuideLocate
+(
+   const PathGuide* pG,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal
+)
+{
+   PathGuidePlace place;
+   place.cell   = leaf( pG, pPosition );
+   place.facing = facing( pNormal );
+
+   return place;
+}
+
+
+bool PathGuideSample
+(
+   const PathGuide*      pG,
+   const PathGuidePlace* pPlace,
+   Random*               pRandom,
+   Vector3f*             pDirection_o,
+   real64*               pPdf_o
+)
+{
+   const Quadtree* pSampled  =
+      &pG->aCells[pPlace->cell].aSampled[pPlace->facing];
+   const bool      isSampled = pSampled->nodesLength > 0;
+
+   if( isSampled )
+   {
+      *pDirection_o = quadtreeSample( pSampled, pRandom, pPdf_o );
+   }
+
+   return isSampled;
+}
+
+
+bool PathGuidePdf
+(
+   const PathGuide*      pG,
+   const PathGuidePlace* pPlace,
+   const Vector3f*       pDirection,
+   real64*               pPdf_o
+)
+{
+   const Quadtree* pSampled  =
+      &pG->aCells[pPlace->cell].aSampled[pPlace->facing];
+   const bool      isSampled = pSampled->nodesLength > 0;
+
+   if( isSampled )
+   {
+      *pPdf_o = quadtreePdf( pSampled, pDirection );
+   }
+
+   return isSampled;
+}
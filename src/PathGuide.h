@@ -0,0 +1,201 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef PathGuide_h
+#define PathGuide_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Random.h"
+#include "Vector3f.h"
+#include "Scene.h"
+
+
+
+
+/**
+ * Path guide: a learned distribution of where light comes from, for sampling
+ * bounce directions toward it (an SD-tree).<br/><br/>
+ *
+ * Space (the scene index's bound) is a binary tree, split at the middle, by
+ * each axis in turn. Each leaf has a quadtree over directions (the sphere
+ * mapped to a square, equal-area: cosine of the angle from Z, and the angle
+ * around it) for each way surfaces there face (by their normal's largest
+ * axis), holding the radiance arriving times its cosine (what a diffuse
+ * surface reflects of it) -- refined where more than PATH_GUIDE_ENERGY of it
+ * is, so finest where light comes from most.<br/><br/>
+ *
+ * It learns from the paths traced, in passes of doubling frames: each pass
+ * records into fresh trees (shaped by the last), then becomes what is sampled
+ * from, with leaves split wherever many paths reached. After PATH_GUIDE_PASSES
+ * it stops learning, and stays as it is. (The learning frames are rendered as
+ * usual, guided by the pass before, so none are spent only on
+ * learning.)<br/><br/>
+ *
+ * Where a leaf has learned nothing yet, it has no distribution.<br/><br/>
+ *
+ * Mutable (one render at a time).
+ *
+ * @implementation
+ * 'Practical Path Guiding for Efficient Light-Transport Simulation'; Muller,
+ * Gross, Novak; EGSR 2017.
+ */
+
+typedef struct PathGuide PathGuide;
+
+
+/**
+ * Where a surface position is in a guide: its leaf cell, and which way the
+ * surface faces -- found once for all of a path vertex's uses (until the
+ * frame ends).
+ */
+struct PathGuidePlace
+{
+   int32 cell;
+   int32 facing;
+};
+
+typedef struct PathGuidePlace PathGuidePlace;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * Untrained guide for an indexed scene.
+ */
+PathGuide* PathGuideConstruct
+(
+   jmp_buf      jmpBuf,
+   const Scene* pScene
+);
+
+void PathGuideDestruct
+(
+   PathGuide*
+);
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+/**
+ * Record a path's sample of radiance arriving at a surface position (if
+ * learning).
+ *
+ * @param pDirection toward where the radiance comes from
+ * @param radiance scalar, times the cosine to the normal, divided by the
+ *        probability density of sampling its direction
+ */
+void PathGuideRecord
+(
+   PathGuide*,
+   const PathGuidePlace* pPlace,
+   const Vector3f*       pDirection,
+   real64                radiance
+);
+
+/**
+ * End a frame: at the end of a pass, what was recorded becomes what is
+ * sampled from.
+ */
+void PathGuideFrameEnd
+(
+   PathGuide*,
+   jmp_buf    jmpBuf
+);
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+/**
+ * Place of a surface position.
+ *
+ * @param pNormal of the surface, on the side the radiance arrives
+ */
+PathGuidePlace PathGuideLocate
+(
+   const PathGuide*,
+   const Vector3f*  pPosition,
+   const Vector3f*  pNormal
+);
+
+/**
+ * Sample a direction from the distribution at a place.
+ *
+ * @param pPdf_o probability density (per solid angle) of the direction
+ * @return whether there is a distribution there (else no direction)
+ */
+bool PathGuideSample
+(
+   const PathGuide*,
+   const PathGuidePlace* pPlace,
+   Random*               pRandom,
+   Vector3f*             pDirection_o,
+   real64*               pPdf_o
+);
+
+/**
+ * Probability density (per solid angle) of sampling a direction from the
+ * distribution at a place.
+ *
+ * @return whether there is a distribution there (else no density)
+ */
+bool PathGuidePdf
+(
+   const PathGuide*,
+   const PathGuidePlace* pPlace,
+   const Vector3f*       pDirection,
+   real64*               pPdf_o
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Fraction of bounces sampled by the guide (where it has a distribution),
+ * instead of by cosine.
+ */
+#define PATH_GUIDE_FRACTION 0.5
+
+/**
+ * Learning passes (of 1, 2, 4 ... frames).
+ */
+#define PATH_GUIDE_PASSES 6
+
+/**
+ * Records a leaf gets in a one-frame pass before splitting (scaled by the
+ * square root of a pass's frames).
+ */
+#define PATH_GUIDE_SPLIT_RECORDS 4000.0
+
+/**
+ * Fraction of a leaf's radiance a direction cell gets before refining.
+ */
+#define PATH_GUIDE_ENERGY 0.01
+
+/**
+ * Most depths of the spatial tree, and of the directional quadtrees.
+ */
+#define PATH_GUIDE_SPATIAL_DEPTH_MAX 48
+#define PATH_GUIDE_DIRECTION_DEPTH_MAX 16
+
+
+
+
+#endif
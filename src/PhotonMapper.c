@@ -0,0 +1,779 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "Exceptions.h"
+#include "Stats.h"
+#include "RayTracer.h"
+
+#include "PhotonMapper.h"
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const real64 PI = 3.14159265358979;
+
+/* cell coordinates are clamped to this (so they stay ints) */
+static const real64 CELL_COORD_MAX = 1e9;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Light arriving at a point, after at least one bounce.
+ */
+struct Photon
+{
+   Vector3f position;
+   /* back toward where it came from */
+   Vector3f direction;
+   Vector3f power;
+   /* of the surface it landed on */
+   Vector3f normal;
+};
+
+typedef struct Photon Photon;
+
+
+/**
+ * A pixel's visible point (this pass's), and its progressive statistics.
+ */
+struct Visible
+{
+   SurfacePoint point;
+   Vector3f     backDirection;
+   bool         isHit;
+   Vector3f     direct;
+
+   /* gathering radius (squared: 0 until first hit), photons counted (as
+      kept), and flux (times reflectance) gathered */
+   real64       radius2;
+   real64       photons;
+   Vector3f     flux;
+
+   /* indirect estimate as in the image (times passes) */
+   Vector3f     shown;
+};
+
+typedef struct Visible Visible;
+
+
+/**
+ * Photons kept by a chunk's tracing.
+ */
+struct Chunk
+{
+   Photon* aPhotons;
+   int32   length;
+   int32   capacity;
+};
+
+typedef struct Chunk Chunk;
+
+
+struct PhotonMapper
+{
+   /* region size, and its visible points (by rows, from the top) */
+   int32    width;
+   int32    height;
+   Visible* aVisibles;
+
+   /* photons emitted per pass, and in all passes */
+   int32    photonsPerPass;
+   real64   emitted;
+   int32    passes;
+
+   /* this pass's photons: as traced, by chunk */
+   Chunk*   aChunks;
+   int32    chunksLength;
+
+   /* ... and in a hash grid: sorted by cell, each cell's first (and the
+      end) indexed by its hash */
+   Photon*  aPhotons;
+   int32    photonsCapacity;
+   int32*   aCellStarts;
+   int32    cellsLength;
+   real64   cellSize;
+
+   /* a seed for each row or chunk */
+   int32u*  aSeeds;
+};
+
+
+/**
+ * Steps of a pass.
+ */
+enum Step
+{
+   STEP_EYES,
+   STEP_PHOTONS,
+   STEP_GATHER
+};
+
+
+/**
+ * Work of a step, shared by the threads.
+ */
+struct Pass
+{
+   PhotonMapper*  pM;
+   const Camera*  pCamera;
+   const Scene*   pScene;
+   Image*         pImage;
+
+   /* the step, done to each item (row or chunk) */
+   enum Step      step;
+   int32          itemsLength;
+
+   /* next item to take, and first exception thrown (or 0) */
+   volatile int32 next;
+   volatile int   exception;
+};
+
+typedef struct Pass Pass;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static int32 cellCoord
+(
+   real64 position,
+   real64 cellSize
+)
+{
+   const real64 c = floor( position / cellSize );
+
+   return (int32)(c < -CELL_COORD_MAX ? -CELL_COORD_MAX :
+      (c > CELL_COORD_MAX ? CELL_COORD_MAX : c));
+}
+
+
+static int32 cellHash
+(
+   const PhotonMapper* pM,
+   int32               x,
+   int32               y,
+   int32               z
+)
+{
+   return (int32)((((int32u)x * 73856093u) ^ ((int32u)y * 19349663u) ^
+      ((int32u)z * 83492791u)) & (int32u)(pM->cellsLength - 1));
+}
+
+
+/**
+ * Seed every item (row or chunk) of a step now, independently of thread
+ * scheduling.
+ */
+static void seed
+(
+   PhotonMapper* pM,
+   int32         itemsLength,
+   Random*       pRandom
+)
+{
+   int32 i;
+   for( i = 0;  i < itemsLength;  ++i )
+   {
+      pM->aSeeds[i] = (RandomInt32u( pRandom ) | 0x100u) & 0xFFFFFFFFu;
+   }
+}
+
+
+/**
+ * Eye step, for a row: find visible points, and their direct light.
+ */
+static void traceEyes
+(
+   const Pass* pPass,
+   int32       row
+)
+{
+   PhotonMapper*   pM        = pPass->pM;
+   const RayTracer rayTracer = RayTracerCreate( pPass->pScene );
+   const Vector3f  eye       = CameraEyePoint( pPass->pCamera );
+   Random          random    = RandomCreateSeeded( pM->aSeeds[row] );
+
+   /* frame y (bottom-left origin), and pixel-width per distance */
+   const int32  y           = pPass->pImage->height - 1 -
+      (pPass->pImage->aRegion[1] + row);
+   const real64 pixelWidth = 2.0 * tan( pPass->pCamera->viewAngle * 0.5 ) /
+      (real64)pPass->pImage->width;
+
+   int32 i;
+
+   for( i = 0;  i < pM->width;  ++i )
+   {
+      Visible*       pV        = &pM->aVisibles[(row * pM->width) + i];
+      const int32    x         = pPass->pImage->aRegion[0] + i;
+      const Vector3f direction = CameraSampleDirection( pPass->pCamera,
+         pPass->pImage, x, y, &random );
+
+      STATS_COUNT( STATS_RAYS_PRIMARY );
+      pV->isHit = SceneIntersection( pPass->pScene, &eye, &direction, 0,
+         &pV->point );
+      pV->backDirection = Vector3fNegative( &direction );
+
+      if( pV->isHit )
+      {
+         /* emission (whole), and light straight from emitters and sky */
+         const Vector3f emission = SurfacePointEmission( &pV->point, &eye,
+            &pV->backDirection, false );
+         const Vector3f direct   = RayTracerDirect( &rayTracer,
+            &pV->backDirection, &pV->point, &random );
+         pV->direct = Vector3fAdd( &emission, &direct );
+
+         STATS_COUNT( STATS_PATH_VERTEXES );
+
+         /* start the radius where first hit */
+         if( pV->radius2 <= 0.0 )
+         {
+            const Vector3f ray    = Vector3fSub( &pV->point.position, &eye );
+            const real64   radius = PHOTON_MAPPER_RADIUS_PIXELS * pixelWidth *
+               sqrt( Vector3fDot( &ray, &ray ) );
+            pV->radius2 = radius * radius;
+         }
+      }
+      else
+      {
+         pV->direct = SceneDefaultEmission( pPass->pScene,
+            &pV->backDirection );
+      }
+   }
+}
+
+
+/**
+ * Photon step, for a chunk: emit photons, and keep where they land after
+ * their first bounce.
+ */
+static void tracePhotons
+(
+   jmp_buf     jmpBuf,
+   const Pass* pPass,
+   int32       chunk
+)
+{
+   PhotonMapper* pM     = pPass->pM;
+   Chunk*        pChunk = &pM->aChunks[chunk];
+   Random        random = RandomCreateSeeded( pM->aSeeds[chunk] );
+
+   const int32 end = (pM->photonsPerPass - (chunk * PHOTON_MAPPER_CHUNK)) <
+      PHOTON_MAPPER_CHUNK ? (pM->photonsPerPass - (chunk *
+      PHOTON_MAPPER_CHUNK)) : PHOTON_MAPPER_CHUNK;
+
+   int32 i;
+
+   pChunk->length = 0;
+
+   for( i = end;  i-- > 0; )
+   {
+      /* from the sky (and ground), or from an emitter, chosen as for light
+         samples (with no draw if either is certain) */
+      const real64 skyProbability = SceneSkyProbability( pPass->pScene );
+      const bool   isSky = (skyProbability >= 1.0) || ((skyProbability > 0.0)
+         && (RandomReal64( &random ) < skyProbability));
+
+      SurfacePoint        last;
+      const SurfacePoint* pLast = 0;
+      Vector3f            position, direction, power;
+      bool                isEmitted;
+
+      if( isSky )
+      {
+         isEmitted = SceneSkyPhoton( pPass->pScene, &random, &position,
+            &direction, &power );
+         power = Vector3fMulF( &power, 1.0 / skyProbability );
+      }
+      else if( (isEmitted = SceneEmitter( pPass->pScene, &random, &last )) )
+      {
+         /* power: emitted radiance divided by the probability densities of
+            the point (per area) and direction (cosine-weighted, so only pi
+            is left of it) */
+         power = Vector3fMulF( &last.pTriangle->pMaterial->emitivity,
+            PI * SurfacePointArea( &last ) *
+            (real64)SceneEmittersCount( pPass->pScene ) /
+            (1.0 - skyProbability) );
+         direction = SurfacePointEmitDirection( &last, &random );
+         position  = last.position;
+         pLast     = &last;
+      }
+
+      if( isEmitted )
+      {
+         SurfacePoint hit;
+         int32        bounces;
+         for( bounces = 0;  (bounces < PHOTON_MAPPER_BOUNCES_MAX) &&
+            !Vector3fIsZero( &direction );  ++bounces )
+         {
+            Vector3f backDirection;
+
+            STATS_COUNT( STATS_RAYS_BOUNCE );
+            if( !SceneIntersection( pPass->pScene, &position, &direction,
+               pLast, &hit ) )
+            {
+               break;
+            }
+            backDirection = Vector3fNegative( &direction );
+
+            /* keep only indirect light (direct is sampled from the eye) */
+            if( bounces > 0 )
+            {
+               Photon* pPhoton;
+               if( pChunk->length == pChunk->capacity )
+               {
+                  const int32 capacity = (pChunk->capacity * 2) +
+                     PHOTON_MAPPER_CHUNK;
+                  pChunk->aPhotons = (Photon*)throwAllocExceptions( jmpBuf,
+                     realloc( pChunk->aPhotons, capacity * sizeof(Photon) ) );
+                  pChunk->capacity = capacity;
+               }
+
+               pPhoton = &pChunk->aPhotons[pChunk->length++];
+               pPhoton->position  = hit.position;
+               pPhoton->direction = backDirection;
+               pPhoton->power     = power;
+               pPhoton->normal    = SurfacePointNormal( &hit );
+            }
+
+            /* bounce on (as a trace does, with russian-roulette) */
+            {
+               Vector3f nextDirection, color;
+               if( !SurfacePointNextDirection( &hit, &random, &backDirection,
+                  &nextDirection, &color ) )
+               {
+                  break;
+               }
+               power     = Vector3fMulV( &power, &color );
+               direction = nextDirection;
+               position  = hit.position;
+               last      = hit;
+               pLast     = &last;
+            }
+         }
+      }
+   }
+}
+
+
+/**
+ * Gather step, for a row: collect photons at visible points, update their
+ * statistics, and add to the image.
+ */
+static void gatherPhotons
+(
+   const Pass* pPass,
+   int32       row
+)
+{
+   PhotonMapper* pM = pPass->pM;
+
+   const int32 y = pPass->pImage->height - 1 -
+      (pPass->pImage->aRegion[1] + row);
+
+   int32 i;
+
+   for( i = 0;  i < pM->width;  ++i )
+   {
+      Visible* pV = &pM->aVisibles[(row * pM->width) + i];
+      Vector3f indirect = Vector3fZERO;
+
+      if( pV->isHit && pM->cellsLength )
+      {
+         /* which side the surface is seen from, and its normal */
+         const bool     isBack = SurfacePointCosine( &pV->point,
+            &pV->backDirection ) < 0.0;
+         const Vector3f normal = SurfacePointNormal( &pV->point );
+
+         const real64 radius = sqrt( pV->radius2 );
+         int32 aLower[3], aUpper[3], cx, cy, cz, j;
+
+         Vector3f power  = Vector3fZERO;
+         real64   gained = 0.0;
+
+         for( j = 3;  j-- > 0; )
+         {
+            aLower[j] = cellCoord( pV->point.position.xyz[j] - radius,
+               pM->cellSize );
+            aUpper[j] = cellCoord( pV->point.position.xyz[j] + radius,
+               pM->cellSize );
+         }
+
+         /* every cell the radius overlaps */
+         for( cz = aLower[2];  cz <= aUpper[2];  ++cz )
+         {
+            for( cy = aLower[1];  cy <= aUpper[1];  ++cy )
+            {
+               for( cx = aLower[0];  cx <= aUpper[0];  ++cx )
+               {
+                  const int32 hash = cellHash( pM, cx, cy, cz );
+                  int32       p;
+                  for( p = pM->aCellStarts[hash];
+                     p < pM->aCellStarts[hash + 1];  ++p )
+                  {
+                     const Photon*  pPhoton = &pM->aPhotons[p];
+                     const Vector3f offset  = Vector3fSub( &pPhoton->position,
+                        &pV->point.position );
+
+                     /* within the radius, of this cell (not another with the
+                        same hash), arriving on the side seen, and on a
+                        surface facing the same way (not round a corner) */
+                     if( (Vector3fDot( &offset, &offset ) < pV->radius2) &&
+                        (cellCoord( pPhoton->position.xyz[0], pM->cellSize )
+                        == cx) &&
+                        (cellCoord( pPhoton->position.xyz[1], pM->cellSize )
+                        == cy) &&
+                        (cellCoord( pPhoton->position.xyz[2], pM->cellSize )
+                        == cz) &&
+                        ((SurfacePointCosine( &pV->point,
+                        &pPhoton->direction ) < 0.0) == isBack) &&
+                        (fabs( Vector3fDot( &pPhoton->normal, &normal ) ) >=
+                        PHOTON_MAPPER_NORMAL_COS) )
+                     {
+                        power   = Vector3fAdd( &power, &pPhoton->power );
+                        gained += 1.0;
+                     }
+                  }
+               }
+            }
+         }
+
+         /* shrink the radius, keeping alpha of the new photons, and scale
+            the flux to match */
+         if( gained > 0.0 )
+         {
+            const real64 photons = pV->photons +
+               (PHOTON_MAPPER_ALPHA * gained);
+            const real64 shrink  = photons / (pV->photons + gained);
+
+            /* ideal diffuse BRDF: reflectivity / pi */
+            const Vector3f reflected = Vector3fMulV( &power,
+               &pV->point.pTriangle->pMaterial->reflectivity );
+            const Vector3f flux      = Vector3fMulF( &reflected, 1.0 / PI );
+
+            pV->flux    = Vector3fAdd( &pV->flux, &flux );
+            pV->flux    = Vector3fMulF( &pV->flux, shrink );
+            pV->radius2 *= shrink;
+            pV->photons  = photons;
+         }
+      }
+
+      /* indirect estimate: flux over disc area and photons emitted */
+      if( (pV->radius2 > 0.0) && (pM->emitted > 0.0) )
+      {
+         indirect = Vector3fMulF( &pV->flux, (real64)pM->passes /
+            (PI * pV->radius2 * pM->emitted) );
+      }
+
+      /* add the direct light, and replace the last indirect estimate (so the
+         image mean has the latest) */
+      {
+         const Vector3f change = Vector3fSub( &indirect, &pV->shown );
+         const Vector3f sample = Vector3fAdd( &pV->direct, &change );
+         ImageAddToPixel( pPass->pImage, pPass->pImage->aRegion[0] + i, y,
+            &sample );
+         pV->shown = indirect;
+      }
+   }
+}
+
+
+/**
+ * Put this pass's photons into the hash grid, with cells a size for the
+ * visible points' radiuses.
+ */
+static void buildGrid
+(
+   PhotonMapper* pM,
+   jmp_buf       jmpBuf
+)
+{
+   int32  length = 0, cells = 1, i, j;
+   real64 radiuses = 0.0, hits = 0.0;
+
+   for( i = pM->chunksLength;  i-- > 0;  length += pM->aChunks[i].length ) {}
+
+   /* cells twice the mean radius (so a gather mostly covers two each way) */
+   for( i = pM->width * pM->height;  i-- > 0; )
+   {
+      if( pM->aVisibles[i].isHit )
+      {
+         radiuses += sqrt( pM->aVisibles[i].radius2 );
+         hits     += 1.0;
+      }
+   }
+   pM->cellSize = (radiuses > 0.0) ? 2.0 * radiuses / hits : 1.0;
+
+   /* at least as many hashes as photons (a power of two) */
+   while( cells < length )
+   {
+      cells *= 2;
+   }
+
+   if( length > pM->photonsCapacity )
+   {
+      free( pM->aPhotons );
+      pM->aPhotons        = 0;
+      pM->photonsCapacity = 0;
+      pM->aPhotons = (Photon*)throwAllocExceptions( jmpBuf,
+         calloc( length, sizeof(Photon) ) );
+      pM->photonsCapacity = length;
+   }
+   if( cells > pM->cellsLength )
+   {
+      free( pM->aCellStarts );
+      pM->aCellStarts = 0;
+      pM->cellsLength = 0;
+      pM->aCellStarts = (int32*)throwAllocExceptions( jmpBuf,
+         calloc( cells + 1, sizeof(int32) ) );
+   }
+   pM->cellsLength = length ? cells : 0;
+   if( !length )
+   {
+      return;
+   }
+
+   /* counting sort by hash: count, offset, then place (moving the starts on
+      to the ends, and back) */
+   memset( pM->aCellStarts, 0, (cells + 1) * sizeof(int32) );
+   for( i = pM->chunksLength;  i-- > 0; )
+   {
+      for( j = pM->aChunks[i].length;  j-- > 0; )
+      {
+         const Vector3f* pP = &pM->aChunks[i].aPhotons[j].position;
+         ++pM->aCellStarts[cellHash( pM, cellCoord( pP->xyz[0], pM->cellSize ),
+            cellCoord( pP->xyz[1], pM->cellSize ), cellCoord( pP->xyz[2],
+            pM->cellSize ) ) + 1];
+      }
+   }
+   for( i = 0;  i < cells;  ++i )
+   {
+      pM->aCellStarts[i + 1] += pM->aCellStarts[i];
+   }
+   for( i = 0;  i < pM->chunksLength;  ++i )
+   {
+      for( j = 0;  j < pM->aChunks[i].length;  ++j )
+      {
+         const Photon* pPhoton = &pM->aChunks[i].aPhotons[j];
+         const int32   hash    = cellHash( pM, cellCoord(
+            pPhoton->position.xyz[0], pM->cellSize ), cellCoord(
+            pPhoton->position.xyz[1], pM->cellSize ), cellCoord(
+            pPhoton->position.xyz[2], pM->cellSize ) );
+         pM->aPhotons[pM->aCellStarts[hash]++] = *pPhoton;
+      }
+   }
+   for( i = cells;  i-- > 0; )
+   {
+      pM->aCellStarts[i + 1] = pM->aCellStarts[i];
+   }
+   pM->aCellStarts[0] = 0;
+}
+
+
+/**
+ * Thread body: take and do items until none remain (or any thread has
+ * failed).
+ */
+static void* doItems
+(
+   void* pPassV
+)
+{
+   Pass* pPass = (Pass*)pPassV;
+
+   jmp_buf   jmpBuf;
+   const int exception = setjmp( jmpBuf );
+
+   /* try */
+   if( !exception )
+   {
+      int32 item;
+      while( !pPass->exception && ((item = __sync_fetch_and_add(
+         &pPass->next, 1 )) < pPass->itemsLength) )
+      {
+         switch( pPass->step )
+         {
+            case STEP_EYES    : traceEyes( pPass, item );             break;
+            case STEP_PHOTONS : tracePhotons( jmpBuf, pPass, item );  break;
+            case STEP_GATHER  : gatherPhotons( pPass, item );         break;
+         }
+      }
+   }
+   /* catch: keep the first, and stop the other threads */
+   else
+   {
+      __sync_bool_compare_and_swap( &pPass->exception, 0, exception );
+   }
+
+   return 0;
+}
+
+
+/**
+ * Do a step's items on threads (this one too).
+ */
+static void doStep
+(
+   jmp_buf   jmpBuf,
+   Pass*     pPass,
+   enum Step step,
+   int32     itemsLength,
+   int32     threadsLength
+)
+{
+   pthread_t* aThreads;
+   int32      started = 0, i;
+
+   pPass->step        = step;
+   pPass->itemsLength = itemsLength;
+   pPass->next        = 0;
+   pPass->exception   = 0;
+
+   threadsLength = threadsLength < itemsLength ? threadsLength : itemsLength;
+   aThreads = (pthread_t*)throwAllocExceptions( jmpBuf,
+      calloc( threadsLength > 0 ? threadsLength : 1, sizeof(pthread_t) ) );
+
+   /* start other threads (any that fail to start just leave more items for
+      the rest), and join in with this one */
+   for( i = 0;  i < (threadsLength - 1);  ++i )
+   {
+      if( !pthread_create( &aThreads[started], 0, doItems, pPass ) )
+      {
+         ++started;
+      }
+   }
+   doItems( pPass );
+
+   for( i = started;  i-- > 0;  pthread_join( aThreads[i], 0 ) ) {}
+
+   free( aThreads );
+
+   /* rethrow any thread's exception */
+   throwExceptions( jmpBuf, (bool)pPass->exception, pPass->exception );
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+PhotonMapper* PhotonMapperConstruct
+(
+   jmp_buf      jmpBuf,
+   const Image* pImage
+)
+{
+   PhotonMapper* volatile pM = 0;
+
+   jmp_buf   jmpBufLocal;
+   const int status = setjmp( jmpBufLocal );
+
+   /* try */
+   if( !status )
+   {
+      pM = (PhotonMapper*)throwAllocExceptions( jmpBufLocal,
+         calloc( 1, sizeof(PhotonMapper) ) );
+
+      pM->width  = ImageRegionWidth( pImage );
+      pM->height = ImageRegionHeight( pImage );
+      pM->aVisibles = (Visible*)throwAllocExceptions( jmpBufLocal,
+         calloc( pM->width * pM->height, sizeof(Visible) ) );
+
+      /* photons: as many as the whole frame's pixels */
+      pM->photonsPerPass = pImage->width * pImage->height;
+      pM->chunksLength   = (pM->photonsPerPass + PHOTON_MAPPER_CHUNK - 1) /
+         PHOTON_MAPPER_CHUNK;
+      pM->aChunks = (Chunk*)throwAllocExceptions( jmpBufLocal,
+         calloc( pM->chunksLength, sizeof(Chunk) ) );
+
+      pM->aSeeds = (int32u*)throwAllocExceptions( jmpBufLocal,
+         calloc( pM->chunksLength > pM->height ? pM->chunksLength :
+         pM->height, sizeof(int32u) ) );
+   }
+   /* catch */
+   else
+   {
+      PhotonMapperDestruct( pM );
+      throwExceptions( jmpBuf, true, status );
+   }
+
+   return pM;
+}
+
+
+void PhotonMapperDestruct
+(
+   PhotonMapper* pM
+)
+{
+   if( pM )
+   {
+      if( pM->aChunks )
+      {
+         int32 i;
+         for( i = pM->chunksLength;  i-- > 0;  free(
+            pM->aChunks[i].aPhotons ) ) {}
+      }
+
+      free( pM->aSeeds );
+      free( pM->aCellStarts );
+      free( pM->aPhotons );
+      free( pM->aChunks );
+      free( pM->aVisibles );
+
+      free( pM );
+   }
+}
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+void PhotonMapperFrame
+(
+   PhotonMapper* pM,
+   jmp_buf       jmpBuf,
+   const Camera* pCamera,
+   const Scene*  pScene,
+   int32         threadsLength,
+   Random*       pRandom,
+   Image*        pImage_o
+)
+{
+   Pass pass;
+   memset( &pass, 0, sizeof(Pass) );
+   pass.pM      = pM;
+   pass.pCamera = pCamera;
+   pass.pScene  = pScene;
+   pass.pImage  = pImage_o;
+
+   seed( pM, pM->height, pRandom );
+   doStep( jmpBuf, &pass, STEP_EYES, pM->height, threadsLength );
+
+   seed( pM, pM->chunksLength, pRandom );
+   doStep( jmpBuf, &pass, STEP_PHOTONS, pM->chunksLength, threadsLength );
+   pM->emitted += (real64)pM->photonsPerPass;
+   ++pM->passes;
+
+   buildGrid( pM, jmpBuf );
+
+   doStep( jmpBuf, &pass, STEP_GATHER, pM->height, threadsLength );
+}
@@ -0,0 +1,139 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef PhotonMapper_h
+#define PhotonMapper_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Random.h"
+#include "Image.h"
+#include "Scene.h"
+#include "Camera.h"
+
+
+
+
+/**
+ * Progressive photon mapper: an alternative to tracing paths per pixel, for
+ * interiors lit mostly indirectly (stochastic progressive photon mapping).
+ * <br/><br/>
+ *
+ * Each frame is a pass of three steps:
+ * * eye: a ray through every pixel (of the region) finds a visible point, and
+ *   its emission and direct light (as RayTracer's first step) are added
+ * * photons: as many as the whole frame has pixels are emitted from the
+ *   emitters (a point and a cosine-weighted direction, as emitter sampling
+ *   does) and the sky, and traced on with russian roulette -- being kept, in
+ *   a hash grid, wherever they land after their first bounce
+ * * gather: each visible point collects the kept photons within a radius of
+ *   it (on surfaces facing its way), as its indirect light
+ * <br/><br/>
+ *
+ * Each pixel's radius starts at a few pixels' width (where first seen), and
+ * shrinks every pass it gathers anything (keeping PHOTON_MAPPER_ALPHA of the
+ * new photons), with the gathered flux scaled to match -- so the indirect
+ * estimate converges, pass by pass, to the right answer (losing its bias as
+ * it loses its noise). The image holds every pass's direct light and the
+ * latest indirect estimate, as if each frame were an iteration of tracing.
+ * <br/><br/>
+ *
+ * The sky (and ground) sends photons as it takes light samples, by its share
+ * (see SceneSkyProbability): in through the portals, if any, else across the
+ * objects' bound (see SceneSkyPhoton).<br/><br/>
+ *
+ * Steps are spread over threads: each row and each chunk of photons has its
+ * own random sequence, so the result does not depend on the number of
+ * threads.<br/><br/>
+ *
+ * Mutable.
+ */
+
+typedef struct PhotonMapper PhotonMapper;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * For rendering to an image (or images of the same frame and region).
+ */
+PhotonMapper* PhotonMapperConstruct
+(
+   jmp_buf      jmpBuf,
+   const Image* pImage
+);
+
+void PhotonMapperDestruct
+(
+   PhotonMapper*
+);
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+/**
+ * Accumulate a frame (a pass) to the image (or just to its region).
+ *
+ * @param threadsLength at least one
+ */
+void PhotonMapperFrame
+(
+   PhotonMapper*,
+   jmp_buf       jmpBuf,
+   const Camera* pCamera,
+   const Scene*  pScene,
+   int32         threadsLength,
+   Random*       pRandom,
+   Image*        pImage_o
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Fraction of each pass's new photons kept in the radius-shrinking statistics
+ * (between 0 and 1: less shrinks sooner).
+ */
+#define PHOTON_MAPPER_ALPHA 0.7
+
+/**
+ * Starting radius, in pixel widths at the visible point's distance.
+ */
+#define PHOTON_MAPPER_RADIUS_PIXELS 4.0
+
+/**
+ * Least cosine between the surface a photon landed on and a visible point's,
+ * for it to be gathered there (so light does not leak round corners, as from
+ * outside a wall to inside it).
+ */
+#define PHOTON_MAPPER_NORMAL_COS 0.9
+
+/**
+ * Photons per chunk, traced by one thread, with its own random sequence.
+ */
+#define PHOTON_MAPPER_CHUNK 1024
+
+/**
+ * Most bounces a photon is traced through.
+ */
+#define PHOTON_MAPPER_BOUNCES_MAX 64
+
+
+
+
+#endif
@@ -0,0 +1,404 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "Exceptions.h"
+
+#include "Preview.h"
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+struct Preview
+{
+   pthread_t       thread;
+   pthread_mutex_t mutex;
+   pthread_cond_t  posted;
+
+   /* output: file descriptor (-1 while not open), and FIFO pathname (to open
+      when there is a reader), or 0 */
+   int             file;
+   char*           sFifoPathname;
+
+   /* frame size, and region held (x0 y0 x1 y1) */
+   int32           width;
+   int32           height;
+   int32           aRegion[4];
+
+   /* latest posted image (guarded by mutex) */
+   byteu*          aPosted;
+   int32           postedIteration;
+   bool            isPosted;
+   bool            isClosing;
+
+   /* writer thread's own: image being written, last written (if
+      isWritten), and message */
+   byteu*          aWriting;
+   byteu*          aWritten;
+   bool            isWritten;
+   byteu*          aMessage;
+};
+
+
+
+
+/* state -------------------------------------------------------------------- */
+
+/* stdout, once taken for a stream, or -1 */
+static int stdoutFile_g = -1;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static byteu* putNumber
+(
+   byteu* pOut,
+   int32u value,
+   int    bytes
+)
+{
+   while( bytes-- > 0 )
+   {
+      *(pOut++) = (byteu)((value >> (bytes * 8)) & 0xFFu);
+   }
+
+   return pOut;
+}
+
+
+/**
+ * Write all, or fail.
+ */
+static bool writeAll
+(
+   int          file,
+   const byteu* pBytes,
+   size_t       length
+)
+{
+   while( length > 0 )
+   {
+      const ssize_t written = write( file, pBytes, length );
+      if( written < 0 )
+      {
+         if( EINTR == errno )
+         {
+            continue;
+         }
+         return false;
+      }
+
+      pBytes += written;
+      length -= (size_t)written;
+   }
+
+   return true;
+}
+
+
+/**
+ * Build a message of the tiles changed since the last written, and write it.
+ */
+static bool writeUpdate
+(
+   Preview* pP,
+   int32    iteration
+)
+{
+   const int32 regionWidth  = pP->aRegion[2] - pP->aRegion[0];
+   const int32 regionHeight = pP->aRegion[3] - pP->aRegion[1];
+
+   byteu* pOut = pP->aMessage + 14;
+   int32  tilesLength = 0;
+   int32  tx, ty, y;
+
+   for( ty = 0;  ty < regionHeight;  ty += PREVIEW_TILE_SIZE )
+   {
+      for( tx = 0;  tx < regionWidth;  tx += PREVIEW_TILE_SIZE )
+      {
+         const int32 w = (regionWidth - tx) < PREVIEW_TILE_SIZE ?
+            (regionWidth - tx) : PREVIEW_TILE_SIZE;
+         const int32 h = (regionHeight - ty) < PREVIEW_TILE_SIZE ?
+            (regionHeight - ty) : PREVIEW_TILE_SIZE;
+         const size_t rowBytes = (size_t)w * 4;
+
+         /* changed if any row differs */
+         bool isChanged = !pP->isWritten;
+         for( y = ty;  !isChanged && (y < (ty + h));  ++y )
+         {
+            const size_t offset = (((size_t)y * regionWidth) + tx) * 4;
+            isChanged = 0 != memcmp( pP->aWriting + offset,
+               pP->aWritten + offset, rowBytes );
+         }
+
+         if( isChanged )
+         {
+            pOut = putNumber( pOut, pP->aRegion[0] + tx, 2 );
+            pOut = putNumber( pOut, pP->aRegion[1] + ty, 2 );
+            pOut = putNumber( pOut, w, 2 );
+            pOut = putNumber( pOut, h, 2 );
+            for( y = ty;  y < (ty + h);  ++y )
+            {
+               memcpy( pOut, pP->aWriting + ((((size_t)y * regionWidth) + tx)
+                  * 4), rowBytes );
+               pOut += rowBytes;
+            }
+            ++tilesLength;
+         }
+      }
+   }
+
+   /* header */
+   {
+      byteu* pHeader = pP->aMessage;
+      pHeader = putNumber( pHeader, (int32u)(pOut - pP->aMessage) - 4, 4 );
+      pHeader = putNumber( pHeader, iteration, 4 );
+      pHeader = putNumber( pHeader, pP->width, 2 );
+      pHeader = putNumber( pHeader, pP->height, 2 );
+      putNumber( pHeader, tilesLength, 2 );
+   }
+
+   /* keep what was written, for the next comparison */
+   {
+      byteu* aWritten = pP->aWritten;
+      pP->aWritten    = pP->aWriting;
+      pP->aWriting    = aWritten;
+      pP->isWritten   = true;
+   }
+
+   return writeAll( pP->file, pP->aMessage, (size_t)(pOut - pP->aMessage) );
+}
+
+
+/**
+ * Thread body: write posted images until closed.
+ */
+static void* writePreviews
+(
+   void* pPreviewV
+)
+{
+   Preview* pP = (Preview*)pPreviewV;
+
+   for( ;; )
+   {
+      int32 iteration = 0;
+      bool  isImage   = false;
+
+      /* wait for, and take, the latest posted image (or end, if closing) */
+      pthread_mutex_lock( &pP->mutex );
+      while( !pP->isPosted && !pP->isClosing )
+      {
+         pthread_cond_wait( &pP->posted, &pP->mutex );
+      }
+      if( pP->isPosted )
+      {
+         byteu* aWriting = pP->aWriting;
+         pP->aWriting    = pP->aPosted;
+         pP->aPosted     = aWriting;
+         iteration       = pP->postedIteration;
+         pP->isPosted    = false;
+         isImage         = true;
+      }
+      pthread_mutex_unlock( &pP->mutex );
+
+      if( !isImage )
+      {
+         break;
+      }
+
+      /* open FIFO, if it has a reader now (without waiting for one) */
+      if( (-1 == pP->file) && pP->sFifoPathname )
+      {
+         pP->file = open( pP->sFifoPathname, O_WRONLY | O_NONBLOCK );
+         if( -1 != pP->file )
+         {
+            fcntl( pP->file, F_SETFL, fcntl( pP->file, F_GETFL ) &
+               ~O_NONBLOCK );
+            pP->isWritten = false;
+         }
+      }
+
+      /* on failure, close (a FIFO can be reopened for another reader) */
+      if( (-1 != pP->file) && !writeUpdate( pP, iteration ) )
+      {
+         close( pP->file );
+         pP->file = -1;
+      }
+   }
+
+   return 0;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+Preview* PreviewConstruct
+(
+   jmp_buf          jmpBuf,
+   const char*      sPathname,
+   const MiniLight* pML
+)
+{
+   Preview*      pP = (Preview*)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(Preview) ) );
+   MiniLightInfo info;
+   size_t        regionBytes, tilesMax;
+
+   throwExceptions( jmpBuf, (MINILIGHT_OK != MiniLightGetInfo( pML, &info )),
+      ERROR_STATE );
+
+   pP->width  = info.width;
+   pP->height = info.height;
+   memcpy( pP->aRegion, info.aRegion, sizeof(pP->aRegion) );
+
+   regionBytes = (size_t)(info.aRegion[2] - info.aRegion[0]) *
+      (size_t)(info.aRegion[3] - info.aRegion[1]) * 4;
+   tilesMax    = (size_t)((info.aRegion[2] - info.aRegion[0] +
+      PREVIEW_TILE_SIZE - 1) / PREVIEW_TILE_SIZE) *
+      (size_t)((info.aRegion[3] - info.aRegion[1] + PREVIEW_TILE_SIZE - 1) /
+      PREVIEW_TILE_SIZE);
+
+   pP->aPosted  = (byteu*)throwAllocExceptions( jmpBuf,
+      malloc( regionBytes ) );
+   pP->aWriting = (byteu*)throwAllocExceptions( jmpBuf,
+      malloc( regionBytes ) );
+   pP->aWritten = (byteu*)throwAllocExceptions( jmpBuf,
+      malloc( regionBytes ) );
+   pP->aMessage = (byteu*)throwAllocExceptions( jmpBuf,
+      malloc( 14 + (tilesMax * 8) + regionBytes ) );
+
+   /* a reader leaving must not end the program */
+   signal( SIGPIPE, SIG_IGN );
+
+   /* stdout: take it, if not already */
+   if( !strcmp( sPathname, "-" ) )
+   {
+      PreviewTakeStdout( jmpBuf );
+      pP->file     = stdoutFile_g;
+      stdoutFile_g = -1;
+   }
+   else
+   {
+      struct stat status;
+
+      /* FIFO: open later, when it has a reader */
+      if( !stat( sPathname, &status ) && S_ISFIFO( status.st_mode ) )
+      {
+         pP->file          = -1;
+         pP->sFifoPathname = (char*)throwAllocExceptions( jmpBuf,
+            malloc( strlen( sPathname ) + 1 ) );
+         strcpy( pP->sFifoPathname, sPathname );
+      }
+      /* other file: open now */
+      else
+      {
+         pP->file = open( sPathname, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+         throwExceptions( jmpBuf, (-1 == pP->file), ERROR_WRITE_IO );
+      }
+   }
+
+   throwExceptions( jmpBuf, (0 != pthread_mutex_init( &pP->mutex, 0 )) ||
+      (0 != pthread_cond_init( &pP->posted, 0 )) ||
+      (0 != pthread_create( &pP->thread, 0, writePreviews, pP )),
+      ERROR_PROCESS );
+
+   return pP;
+}
+
+
+void PreviewDestruct
+(
+   Preview* pP
+)
+{
+   pthread_mutex_lock( &pP->mutex );
+   pP->isClosing = true;
+   pthread_cond_signal( &pP->posted );
+   pthread_mutex_unlock( &pP->mutex );
+
+   pthread_join( pP->thread, 0 );
+
+   if( -1 != pP->file )
+   {
+      close( pP->file );
+   }
+
+   pthread_cond_destroy( &pP->posted );
+   pthread_mutex_destroy( &pP->mutex );
+
+   free( pP->sFifoPathname );
+   free( pP->aMessage );
+   free( pP->aWritten );
+   free( pP->aWriting );
+   free( pP->aPosted );
+   free( pP );
+}
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+void PreviewTakeStdout
+(
+   jmp_buf jmpBuf
+)
+{
+   /* (without flushing, so anything buffered goes to stderr too) */
+   if( -1 == stdoutFile_g )
+   {
+      stdoutFile_g = dup( STDOUT_FILENO );
+      throwExceptions( jmpBuf, (-1 == stdoutFile_g) ||
+         (-1 == dup2( STDERR_FILENO, STDOUT_FILENO )), ERROR_WRITE_IO );
+   }
+}
+
+
+void PreviewPost
+(
+   Preview*         pP,
+   jmp_buf          jmpBuf,
+   const MiniLight* pML
+)
+{
+   MiniLightInfo info;
+   int           status;
+
+   throwExceptions( jmpBuf, (MINILIGHT_OK != MiniLightGetInfo( pML, &info )),
+      ERROR_STATE );
+
+   /* replace any not yet taken by the writer */
+   pthread_mutex_lock( &pP->mutex );
+   status = MiniLightGetRgbe( pML, pP->aPosted );
+   pP->postedIteration = info.iterations;
+   pP->isPosted        = (MINILIGHT_OK == status);
+   pthread_cond_signal( &pP->posted );
+   pthread_mutex_unlock( &pP->mutex );
+
+   throwExceptions( jmpBuf, (MINILIGHT_OK != status), status );
+}
@@ -0,0 +1,111 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Preview_h
+#define Preview_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "MiniLightLib.h"
+
+
+
+
+/**
+ * Stream of in-progress images, to a pipe (stdout, or a FIFO), for display
+ * while rendering.<br/><br/>
+ *
+ * Images are posted by the render loop and written by a separate thread, so
+ * rendering never waits on the reader: if it is slow, images not yet written
+ * are replaced by newer ones. A FIFO is opened only when it has a reader (so
+ * one can come and go); updates before then are dropped.<br/><br/>
+ *
+ * Stream format -- a message per update, all numbers unsigned big-endian:
+ * <pre>
+ *    length         4 bytes, of the rest of the message
+ *    iteration      4 bytes
+ *    frame width    2 bytes
+ *    frame height   2 bytes
+ *    tiles count    2 bytes
+ *    tiles:
+ *       x y width height   2 bytes each (pixels, in frame, from top-left)
+ *       pixels             width * height * 4 bytes of RGBE, by rows
+ * </pre>
+ * Only tiles (PREVIEW_TILE_SIZE square, of the rendered region) that have
+ * changed since the last update are sent -- so the first update (to each
+ * reader) has all of them.
+ */
+
+typedef struct Preview Preview;
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+/**
+ * @param sPathname FIFO or file pathname, or "-" for stdout (see
+ *        PreviewTakeStdout)
+ */
+Preview* PreviewConstruct
+(
+   jmp_buf          jmpBuf,
+   const char*      sPathname,
+   const MiniLight* pML
+);
+
+/**
+ * Finish writing the last posted image, and close.
+ */
+void PreviewDestruct
+(
+   Preview* pP
+);
+
+
+
+
+/* commands ----------------------------------------------------------------- */
+
+/**
+ * Take stdout for a "-" stream, moving the program's console messages to
+ * stderr. (Call early, before any messages are flushed, so all are moved.)
+ */
+void PreviewTakeStdout
+(
+   jmp_buf jmpBuf
+);
+
+/**
+ * Post the context's current image, to be written.
+ */
+void PreviewPost
+(
+   Preview*         pP,
+   jmp_buf          jmpBuf,
+   const MiniLight* pML
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Tile edge length, in pixels.
+ */
+#define PREVIEW_TILE_SIZE 32
+
+
+
+
+#endif
@@ -30,8 +30,10 @@ typedef  unsigned char   byteu;
 /*typedef  unsigned short  short16u;*/
 typedef  signed   int    int32;
 typedef  unsigned int    int32u;
-/*typedef  signed   long   long64;*/
-/*typedef  unsigned long   long64u;*/
+/* (long long is not C89, but is in every compiler this builds with -- and
+   long is only 32 bits on some) */
+__extension__ typedef  signed   long long  long64;
+__extension__ typedef  unsigned long long  long64u;
 
 typedef  float           real32;
 typedef  double          real64;
@@ -54,6 +56,12 @@ typedef  double          real64;
 #define REAL64_MAX     ((real64)(DBL_MAX))
 
 
+/* counts and indexs are int32 (sizes in bytes are size_t) */
+#ifndef INT32_MAX
+#define INT32_MAX ((int32)0x7FFFFFFF)
+#endif
+
+
 
 
 #endif
@@ -74,18 +74,13 @@ static void getSeed
 }
 
 
-
-
-/* initialisation ----------------------------------------------------------- */
-
-Random RandomCreate()
+static Random create
+(
+   const int32u seed[4]
+)
 {
    Random r;
 
-   /* get seed */
-   int32u seed[4] = { 0, 0, 0, 0 };
-   getSeed( seed );
-
    /* init state from seed */
    {
       int i;
@@ -107,6 +102,32 @@ Random RandomCreate()
 
 
 
+/* initialisation ----------------------------------------------------------- */
+
+Random RandomCreate()
+{
+   /* get seed */
+   int32u seed[4] = { 0, 0, 0, 0 };
+   getSeed( seed );
+
+   return create( seed );
+}
+
+
+Random RandomCreateSeeded
+(
+   int32u seed
+)
+{
+   int32u seeds[4];
+   seeds[0] = seeds[1] = seeds[2] = seeds[3] = seed;
+
+   return create( seeds );
+}
+
+
+
+
 /* queries ------------------------------------------------------------------ */
 
 /*
@@ -48,6 +48,15 @@ typedef struct Random Random;
  */
 Random RandomCreate();
 
+/**
+ * Create Random object, from a given seed (for repeatable or distinct
+ * sequences).
+ */
+Random RandomCreateSeeded
+(
+   int32u seed
+);
+
 
 
 
@@ -8,6 +8,7 @@
 ------------------------------------------------------------------------------*/
 
 
+#include "Stats.h"
 #include "SurfacePoint.h"
 
 #include "RayTracer.h"
@@ -17,6 +18,157 @@
 
 /* implementation ----------------------------------------------------------- */
 
+/**
+ * Multiple importance sampling weight for emitter (or sky) sampling, by the
+ * power heuristic: from the ratio of the other (hemisphere sampling's)
+ * probability density to its own.
+ */
+static real64 emitterWeight
+(
+   real64 pdfRatio
+)
+{
+   return 1.0 / (1.0 + (pdfRatio * pdfRatio));
+}
+
+
+/**
+ * Probability density (per solid angle) of light sampling choosing an
+ * emitter's direction, times its solid angle.
+ *
+ * @param probability of selecting the emitter
+ */
+static real64 emitterPdfBySolidAngle
+(
+   const RayTracer* pR,
+   real64           probability
+)
+{
+   return (1.0 - SceneSkyProbability( pR->pScene )) * probability;
+}
+
+
+/**
+ * Probability density (per solid angle) of light sampling choosing a sky (or
+ * ground) direction.
+ */
+static real64 skyPdf
+(
+   const RayTracer* pR,
+   const Vector3f*  pPosition,
+   const Vector3f*  pDirection
+)
+{
+   return SceneSkyProbability( pR->pScene ) * SceneSkyPdf( pR->pScene,
+      pPosition, pDirection );
+}
+
+
+/**
+ * Normal of a surface point, on the side of a direction.
+ */
+static Vector3f sideNormal
+(
+   const SurfacePoint* pSurfacePoint,
+   const Vector3f*     pDirection
+)
+{
+   const Vector3f normal = SurfacePointNormal( pSurfacePoint );
+
+   return (Vector3fDot( &normal, pDirection ) < 0.0) ?
+      Vector3fNegative( &normal ) : normal;
+}
+
+
+/**
+ * Place of a surface point in the path guide (if any).
+ */
+static PathGuidePlace guidePlace
+(
+   const RayTracer*    pR,
+   const SurfacePoint* pSurfacePoint,
+   const Vector3f*     pInDirection
+)
+{
+   PathGuidePlace place = { 0, 0 };
+
+   if( pR->pGuide )
+   {
+      const Vector3f normal = sideNormal( pSurfacePoint, pInDirection );
+      place = PathGuideLocate( pR->pGuide, &pSurfacePoint->position, &normal );
+   }
+
+   return place;
+}
+
+
+/**
+ * Sample a bounce's direction: by cosine, or by the path guide (where it has
+ * a distribution), with the color reweighted for the mixture.
+ *
+ * @param pPdf_o probability density (per solid angle) of the direction, by
+ *        the mixture
+ * @return whether the surface reflects (else no direction)
+ */
+static bool sampleDirection
+(
+   const RayTracer*      pR,
+   const PathGuidePlace* pPlace,
+   const SurfacePoint*   pSurfacePoint,
+   Random*               pRandom,
+   const Vector3f*       pInDirection,
+   Vector3f*             pOutDirection_o,
+   Vector3f*             pColor_o,
+   real64*               pPdf_o
+)
+{
+   /* russian roulette, and cosine sample */
+   bool isReflected = SurfacePointNextDirection( pSurfacePoint, pRandom,
+      pInDirection, pOutDirection_o, pColor_o );
+
+   if( isReflected )
+   {
+      if( pR->pGuide )
+      {
+         real64 guidePdf = 0.0;
+         bool   isGuided = false;
+
+         /* maybe instead a guided sample */
+         if( RandomReal64( pRandom ) < PATH_GUIDE_FRACTION )
+         {
+            isGuided = PathGuideSample( pR->pGuide, pPlace, pRandom,
+               pOutDirection_o, &guidePdf );
+         }
+
+         /* color was for the cosine probability density alone (and where
+            the surface does not reflect, a guided direction gives nothing) */
+         {
+            const real64 cosinePdf = SurfacePointNextDirectionPdf(
+               pSurfacePoint, pInDirection, pOutDirection_o );
+
+            *pPdf_o = ((cosinePdf > 0.0) && (isGuided || PathGuidePdf(
+               pR->pGuide, pPlace, pOutDirection_o, &guidePdf ))) ?
+               (PATH_GUIDE_FRACTION * guidePdf) + ((1.0 -
+               PATH_GUIDE_FRACTION) * cosinePdf) : cosinePdf;
+
+            isReflected = *pPdf_o > 0.0;
+            if( isReflected )
+            {
+               *pColor_o = Vector3fMulF( pColor_o, cosinePdf / *pPdf_o );
+            }
+         }
+      }
+      else
+      {
+         *pPdf_o = SurfacePointNextDirectionPdf( pSurfacePoint, pInDirection,
+            pOutDirection_o );
+      }
+   }
+
+   return isReflected;
+}
+
+
 /**
  * Radiance from an emitter sample.
  */
@@ -31,40 +183,47 @@ static Vector3f sampleEmitters
    Vector3f radiance = Vector3fZERO;
 
    /* single emitter sample, ideal diffuse BRDF:
-         reflected = (emitivity * solidangle) * (emitterscount) *
+         reflected = (emitivity * solidangle) / (emitterprobability) *
             (cos(emitdirection) / pi * reflectivity)
-      -- SurfacePoint does the first and last parts (in separate methods) */
+      -- SurfacePoint does the first and last parts (in separate methods) --
+      divided by the probability of sampling an emitter (instead of the sky),
+      and weighted against hemisphere sampling finding the same light */
 
-   /* get position on an emitter */
-   Vector3f        emitterPosition;
-   const Triangle* emitterId = 0;
-   SceneEmitter( pR->pScene, pRandom, &emitterPosition, &emitterId );
+   /* get position on an emitter (chosen by its contribution here) */
+   const Vector3f normal = sideNormal( pSurfacePoint, pRayBackDirection );
+   SurfacePoint   emitter;
+   real64         probability;
 
    /* check an emitter was found */
-   if( emitterId )
+   if( SceneEmitterToward( pR->pScene, &pSurfacePoint->position, &normal,
+      pRandom, &emitter, &probability ) )
    {
       /* make direction to emit point */
-      const Vector3f emitVector    = Vector3fSub( &emitterPosition,
+      const Vector3f emitVector    = Vector3fSub( &emitter.position,
          &pSurfacePoint->position );
       const Vector3f emitDirection = Vector3fUnitized( &emitVector );
 
       /* send shadow ray */
-      const Triangle* pHitObject = 0;
-      Vector3f        hitPosition;
-      SceneIntersection( pR->pScene, &pSurfacePoint->position, &emitDirection,
-         SurfacePointHitId( pSurfacePoint ), &pHitObject, &hitPosition );
+      SurfacePoint hit;
+      bool         isHit;
+      STATS_COUNT( STATS_RAYS_SHADOW );
+      isHit = SceneIntersection( pR->pScene, &pSurfacePoint->position,
+         &emitDirection, pSurfacePoint, &hit );
 
       /* check if unshadowed */
-      if( !pHitObject | (emitterId == pHitObject) )
+      if( !isHit || SurfacePointIsSame( &emitter, &hit ) )
       {
-         /* get inward emission value */
-         const SurfacePoint sp            = SurfacePointCreate( emitterId,
-            &emitterPosition );
+         /* get inward emission value (divided by the probability density
+            of sampling it) */
          const Vector3f backEmitDirection = Vector3fNegative( &emitDirection );
-         const Vector3f emissionIn        = SurfacePointEmission( &sp,
-            &pSurfacePoint->position, &backEmitDirection, true );
-         const Vector3f emissionAll       = Vector3fMulF( &emissionIn,
-            (real64)SceneEmittersCount( pR->pScene ) );
+         const real64   solidAngle        = SurfacePointSolidAngle( &emitter,
+            &pSurfacePoint->position, &backEmitDirection );
+         const real64   pdf               = emitterPdfBySolidAngle( pR,
+            probability ) / solidAngle;
+         const Vector3f emissionAll       = Vector3fMulF(
+            &emitter.pTriangle->pMaterial->emitivity, emitterWeight(
+            SurfacePointNextDirectionPdf( pSurfacePoint, pRayBackDirection,
+            &emitDirection ) / pdf ) / pdf );
 
          /* get amount reflected by surface */
          radiance = SurfacePointReflection( pSurfacePoint, &emitDirection,
@@ -76,63 +235,159 @@ static Vector3f sampleEmitters
 }
 
 
-
-
-/* initialisation ----------------------------------------------------------- */
-
-RayTracer RayTracerCreate
+/**
+ * Radiance from a sky (or ground) sample.
+ */
+static Vector3f sampleSky
 (
-   const Scene* pScene
+   const RayTracer*    pR,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   Random*             pRandom
 )
 {
-   RayTracer r;
-   r.pScene = pScene;
+   Vector3f radiance = Vector3fZERO;
 
-   return r;
+   /* single direction sample, as for an emitter, but the light found by
+      escaping the scene */
+
+   /* get direction, and check it faces the surface's ray side */
+   Vector3f     skyDirection;
+   const real64 pdf          = SceneSkyDirection( pR->pScene,
+      &pSurfacePoint->position, pRandom, &skyDirection ) *
+      SceneSkyProbability( pR->pScene );
+   const real64 directionPdf = (pdf > 0.0) ? SurfacePointNextDirectionPdf(
+      pSurfacePoint, pRayBackDirection, &skyDirection ) : 0.0;
+
+   if( directionPdf > 0.0 )
+   {
+      /* send shadow ray */
+      SurfacePoint hit;
+      bool         isHit;
+      STATS_COUNT( STATS_RAYS_SHADOW );
+      isHit = SceneIntersection( pR->pScene, &pSurfacePoint->position,
+         &skyDirection, pSurfacePoint, &hit );
+
+      /* check if unshadowed */
+      if( !isHit )
+      {
+         /* get inward emission value (divided by the probability density of
+            sampling it) */
+         const Vector3f backSkyDirection = Vector3fNegative( &skyDirection );
+         const Vector3f emission         = SceneDefaultEmission( pR->pScene,
+            &backSkyDirection );
+         const Vector3f emissionAll      = Vector3fMulF( &emission,
+            emitterWeight( directionPdf / pdf ) / pdf );
+
+         /* get amount reflected by surface */
+         radiance = SurfacePointReflection( pSurfacePoint, &skyDirection,
+            &emissionAll, pRayBackDirection );
+      }
+   }
+
+   return radiance;
 }
 
 
+/**
+ * Radiance from a light sample: of the sky, or an emitter, chosen by their
+ * powers.
+ */
+static Vector3f sampleLights
+(
+   const RayTracer*    pR,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   Random*             pRandom
+)
+{
+   Vector3f radiance;
 
+   STATS_TIMER_BEGIN( STATS_PHASE_EMITTERS )
+   {
+      const real64 skyProbability = SceneSkyProbability( pR->pScene );
+      radiance = ((skyProbability >= 1.0) || ((skyProbability > 0.0) &&
+         (RandomReal64( pRandom ) < skyProbability))) ?
+         sampleSky( pR, pRayBackDirection, pSurfacePoint, pRandom ) :
+         sampleEmitters( pR, pRayBackDirection, pSurfacePoint, pRandom );
+   }
+   STATS_TIMER_END( STATS_PHASE_EMITTERS )
 
-/* queries ------------------------------------------------------------------ */
+   return radiance;
+}
 
-Vector3f RayTracerRadiance
+
+/**
+ * Radiance returned along a ray, sampled by a probability density (or 0 from
+ * the eye) -- or only the light emitted along it (as weighted for a path).
+ */
+static Vector3f pathRadiance
 (
-   const RayTracer* pR,
-   const Vector3f*  pRayOrigin,
-   const Vector3f*  pRayDirection,
-   Random*          pRandom,
-   const void*      lastHit
+   const RayTracer*    pR,
+   const Vector3f*     pRayOrigin,
+   const Vector3f*     pRayDirection,
+   real64              directionPdf,
+   bool                isEmissionOnly,
+   Random*             pRandom,
+   const SurfacePoint* pLast
 )
 {
    Vector3f radiance;
 
    const Vector3f rayBackDirection = Vector3fNegative( pRayDirection );
 
-   /* intersect ray with scene */
-   const Triangle* pHitObject = 0;
-   Vector3f        hitPosition;
-   SceneIntersection( pR->pScene, pRayOrigin, pRayDirection, lastHit,
-      &pHitObject, &hitPosition );
+   /* intersect ray with scene, making surface point of intersection */
+   SurfacePoint surfacePoint;
+   bool         isHit;
+   STATS_COUNT( pLast ? STATS_RAYS_BOUNCE : STATS_RAYS_PRIMARY );
+   isHit = SceneIntersection( pR->pScene, pRayOrigin, pRayDirection, pLast,
+      &surfacePoint );
 
-   if( pHitObject )
+   if( isHit )
    {
-      /* make surface point of intersection */
-      const SurfacePoint surfacePoint = SurfacePointCreate( pHitObject,
-         &hitPosition );
-
-      /* local emission (only for first-hit) */
-      const Vector3f localEmission = lastHit ? Vector3fZERO :
-         SurfacePointEmission( &surfacePoint, pRayOrigin, &rayBackDirection,
-         false );
+      /* local emission (for first-hit whole, else weighted against emitter
+         sampling finding the same light) */
+      Vector3f localEmission = Vector3fZERO;
 
       /* emitter sample */
-      const Vector3f emitterSample = sampleEmitters( pR, &rayBackDirection,
-         &surfacePoint, pRandom );
+      Vector3f emitterSample = Vector3fZERO;
 
       /* recursed reflection */
       Vector3f recursedReflection = Vector3fZERO;
+
+      STATS_COUNT( STATS_PATH_VERTEXES );
+
+      if( !Vector3fIsZero( &surfacePoint.pTriangle->pMaterial->emitivity ) )
+      {
+         localEmission = SurfacePointEmission( &surfacePoint, pRayOrigin,
+            &rayBackDirection, false );
+         if( pLast )
+         {
+            /* (as the emitter sample from the last surface would choose) */
+            const Vector3f normal   = sideNormal( pLast, pRayDirection );
+            const real64   lightPdf = emitterPdfBySolidAngle( pR,
+               SceneEmitterProbability( pR->pScene, &pLast->position,
+               &normal, &surfacePoint ) );
+            localEmission = Vector3fMulF( &localEmission, 1.0 -
+               ((lightPdf > 0.0) ? emitterWeight( directionPdf *
+               SurfacePointSolidAngle( &surfacePoint, pRayOrigin,
+               &rayBackDirection ) / lightPdf ) : 0.0) );
+         }
+      }
+
+      /* (the rest, unless just emission is wanted) */
+      if( !isEmissionOnly )
       {
+         const PathGuidePlace place = guidePlace( pR, &surfacePoint,
+            &rayBackDirection );
+         Vector3f nextDirection;
+         Vector3f color;
+         real64   nextPdf;
+
+         /* (the sky, or an emitter, chosen by their powers) */
+         emitterSample = sampleLights( pR, &rayBackDirection, &surfacePoint,
+            pRandom );
+
          /* single hemisphere sample, ideal diffuse BRDF:
                reflected = (inradiance * pi) * (cos(in) / pi * color) *
                   reflectance
@@ -140,17 +395,29 @@ Vector3f RayTracerRadiance
             cos is importance sampled (both done by SurfacePoint),
             and the pi and 1/pi cancel out -- leaving just:
                inradiance * reflectance color */
-         Vector3f nextDirection;
-         Vector3f color;
          /* check surface reflects ray */
-         if( SurfacePointNextDirection( &surfacePoint, pRandom,
-            &rayBackDirection, &nextDirection, &color ) )
+         if( sampleDirection( pR, &place, &surfacePoint, pRandom,
+            &rayBackDirection, &nextDirection, &color, &nextPdf ) )
          {
-            /* recurse */
-            const Vector3f recursed = RayTracerRadiance( pR,
-               &surfacePoint.position, &nextDirection, pRandom,
-               SurfacePointHitId( &surfacePoint ) );
+            /* recurse (weighing against light samples by the cosine
+               probability density alone -- any weights summing to one will
+               do, and so light samples need not look up the guide) */
+            const Vector3f recursed = pathRadiance( pR,
+               &surfacePoint.position, &nextDirection,
+               SurfacePointNextDirectionPdf( &surfacePoint, &rayBackDirection,
+               &nextDirection ), false, pRandom, &surfacePoint );
             recursedReflection = Vector3fMulV( &recursed, &color );
+
+            /* teach the guide where light came from (and how much it
+               gives here, by cosine) */
+            if( pR->pGuide )
+            {
+               const Vector3f normal = sideNormal( &surfacePoint,
+                  &rayBackDirection );
+               PathGuideRecord( pR->pGuide, &place, &nextDirection,
+                  (Vector3fDot( &recursed, &Vector3fONE ) / 3.0) *
+                  Vector3fDot( &normal, &nextDirection ) / nextPdf );
+            }
          }
       }
 
@@ -160,9 +427,131 @@ Vector3f RayTracerRadiance
    }
    else
    {
-      /* no hit: default/background scene emission */
+      /* no hit: default/background scene emission (for first-hit whole, else
+         weighted against sky sampling finding the same light) */
+      const real64 pdf = pLast ? skyPdf( pR, pRayOrigin, pRayDirection ) :
+         0.0;
+
       radiance = SceneDefaultEmission( pR->pScene, &rayBackDirection );
+      if( pdf > 0.0 )
+      {
+         radiance = Vector3fMulF( &radiance, 1.0 - emitterWeight(
+            directionPdf / pdf ) );
+      }
    }
 
    return radiance;
 }
+
+
+/**
+ * Radiance reflected at a surface point: by a light sample, and a hemisphere
+ * sample (a path on, or only the light emitted where it lands).
+ */
+static Vector3f reflectedRadiance
+(
+   const RayTracer*    pR,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   bool                isEmissionOnly,
+   Random*             pRandom
+)
+{
+   const PathGuidePlace place = guidePlace( pR, pSurfacePoint,
+      pRayBackDirection );
+
+   /* light sample */
+   Vector3f radiance = sampleLights( pR, pRayBackDirection, pSurfacePoint,
+      pRandom );
+
+   /* hemisphere sample */
+   Vector3f nextDirection;
+   Vector3f color;
+   real64   nextPdf;
+   if( sampleDirection( pR, &place, pSurfacePoint, pRandom,
+      pRayBackDirection, &nextDirection, &color, &nextPdf ) )
+   {
+      const Vector3f incoming  = pathRadiance( pR, &pSurfacePoint->position,
+         &nextDirection, SurfacePointNextDirectionPdf( pSurfacePoint,
+         pRayBackDirection, &nextDirection ), isEmissionOnly, pRandom,
+         pSurfacePoint );
+      const Vector3f reflected = Vector3fMulV( &incoming, &color );
+      radiance = Vector3fAdd( &radiance, &reflected );
+   }
+
+   return radiance;
+}
+
+
+
+
+/* initialisation ----------------------------------------------------------- */
+
+RayTracer RayTracerCreate
+(
+   const Scene* pScene
+)
+{
+   RayTracer r;
+   r.pScene = pScene;
+   r.pGuide = 0;
+
+   return r;
+}
+
+
+RayTracer RayTracerCreateGuided
+(
+   const Scene* pScene,
+   PathGuide*   pGuide
+)
+{
+   RayTracer r;
+   r.pScene = pScene;
+   r.pGuide = pGuide;
+
+   return r;
+}
+
+
+
+
+/* queries ------------------------------------------------------------------ */
+
+Vector3f RayTracerRadiance
+(
+   const RayTracer* pR,
+   const Vector3f*  pRayOrigin,
+   const Vector3f*  pRayDirection,
+   Random*          pRandom
+)
+{
+   return pathRadiance( pR, pRayOrigin, pRayDirection, 0.0, false, pRandom,
+      0 );
+}
+
+
+Vector3f RayTracerDirect
+(
+   const RayTracer*    pR,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   Random*             pRandom
+)
+{
+   return reflectedRadiance( pR, pRayBackDirection, pSurfacePoint, true,
+      pRandom );
+}
+
+
+Vector3f RayTracerReflected
+(
+   const RayTracer*    pR,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   Random*             pRandom
+)
+{
+   return reflectedRadiance( pR, pRayBackDirection, pSurfacePoint, false,
+      pRandom );
+}
@@ -15,6 +15,7 @@
 #include "Random.h"
 #include "Vector3f.h"
 #include "Scene.h"
+#include "PathGuide.h"
 
 
 
@@ -26,7 +27,22 @@
  * from the eye into the scene with one sampling of emitters at each
  * node.<br/><br/>
  *
- * Constant.
+ * Emitters are found both ways -- by sampling them, and by the path hitting
+ * them -- each weighted by multiple importance sampling (the power heuristic,
+ * of the two ways' probability densities), so small lights are found mostly
+ * by sampling, and large or near ones mostly by hitting.<br/><br/>
+ *
+ * The sky (and ground) is a light too: each node's light sample is of it or
+ * an emitter, chosen by their estimated powers, and weighted against paths
+ * escaping to it the same way.<br/><br/>
+ *
+ * With a path guide, bounces are sampled by it (PATH_GUIDE_FRACTION of the
+ * time, where it has a distribution) or by cosine, and weighted by the
+ * mixture's probability density (one-sample multiple importance sampling) --
+ * but against light samples by the cosine's alone. Every bounce's radiance,
+ * by cosine, is recorded into the guide (while it learns).<br/><br/>
+ *
+ * Constant (but for the guide).
  *
  * @invariants
  * * pScene is not 0
@@ -35,6 +51,7 @@
 struct RayTracer
 {
    const Scene* pScene;
+   PathGuide*   pGuide;
 };
 
 typedef struct RayTracer RayTracer;
@@ -49,6 +66,15 @@ RayTracer RayTracerCreate
    const Scene*
 );
 
+/**
+ * Trace by a path guide, and teach it.
+ */
+RayTracer RayTracerCreateGuided
+(
+   const Scene* pScene,
+   PathGuide*   pGuide
+);
+
 
 
 
@@ -62,8 +88,35 @@ Vector3f RayTracerRadiance
    const RayTracer*,
    const Vector3f*  pRayOrigin,
    const Vector3f*  pRayDirection,
-   Random*          pRandom,
-   const void*      null
+   Random*          pRandom
+);
+
+/**
+ * Radiance reflected at a surface point straight from the emitters and sky
+ * (the first step of a trace, without going further).
+ *
+ * @param pRayBackDirection toward where the radiance is returned
+ */
+Vector3f RayTracerDirect
+(
+   const RayTracer*,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   Random*             pRandom
+);
+
+/**
+ * Radiance reflected at a surface point, from everywhere (a trace on from
+ * it, without its own emission).
+ *
+ * @param pRayBackDirection toward where the radiance is returned
+ */
+Vector3f RayTracerReflected
+(
+   const RayTracer*,
+   const Vector3f*     pRayBackDirection,
+   const SurfacePoint* pSurfacePoint,
+   Random*             pRandom
 );
 
 
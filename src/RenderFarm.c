@@ -0,0 +1,311 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "Exceptions.h"
+
+#include "RenderFarm.h"
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+struct Worker
+{
+   pid_t  pid;
+   char   sSeed[9];
+   int32  iterations;
+   char*  sImageFilePathname;
+};
+
+typedef struct Worker Worker;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * Substitute placeholders in the command template.
+ *
+ * @param asValues values for: worker, seed, iterations, model, output
+ */
+static char* makeCommand
+(
+   jmp_buf     jmpBuf,
+   const char* sTemplate,
+   const char* asValues[5]
+)
+{
+   static const char* NAMES[5] =
+      { "{worker}", "{seed}", "{iterations}", "{model}", "{output}" };
+
+   char* sCommand = 0;
+   int   pass;
+
+   /* first pass measures, second pass writes */
+   for( pass = 0;  pass < 2;  ++pass )
+   {
+      const char* pT = sTemplate;
+      size_t      length = 0;
+
+      while( *pT )
+      {
+         int n;
+         for( n = 5;  n-- > 0; )
+         {
+            if( !strncmp( pT, NAMES[n], strlen(NAMES[n]) ) ) break;
+         }
+
+         /* placeholder: copy value */
+         if( n >= 0 )
+         {
+            if( sCommand ) strcpy( sCommand + length, asValues[n] );
+            length += strlen( asValues[n] );
+            pT     += strlen( NAMES[n] );
+         }
+         /* other: copy char */
+         else
+         {
+            if( sCommand ) sCommand[length] = *pT;
+            ++length;
+            ++pT;
+         }
+      }
+
+      if( !sCommand )
+      {
+         sCommand = (char*)throwAllocExceptions( jmpBuf,
+            calloc( length + 1, sizeof(char) ) );
+      }
+   }
+
+   return sCommand;
+}
+
+
+/**
+ * Start a shell command as a separate process (with its stdout discarded).
+ */
+static pid_t launch
+(
+   jmp_buf     jmpBuf,
+   const char* sCommand
+)
+{
+   const pid_t pid = fork();
+   throwExceptions( jmpBuf, (-1 == pid), ERROR_PROCESS );
+
+   /* child: become the command */
+   if( 0 == pid )
+   {
+      const int nullFile = open( "/dev/null", O_WRONLY );
+      if( -1 != nullFile ) dup2( nullFile, STDOUT_FILENO );
+
+      execl( "/bin/sh", "sh", "-c", sCommand, (char*)0 );
+      _exit( 127 );
+   }
+
+   return pid;
+}
+
+
+/**
+ * Merge a worker's image file into the image, and remove the file.
+ *
+ * @return iterations read, or -1 if the file was missing or unreadable
+ */
+static int32 mergeImage
+(
+   Image*      pImage_o,
+   const char* sImageFilePathname
+)
+{
+   /* (volatile, since set between setjmp and longjmp) */
+   FILE* volatile  pImageFile     = 0;
+   volatile int32  iterationsRead = -1;
+
+   jmp_buf   jmpBufImage;
+   const int status = setjmp( jmpBufImage );
+
+   /* try */
+   if( !status )
+   {
+      pImageFile = fopen( sImageFilePathname, "rb" );
+      throwExceptions( jmpBufImage, !pImageFile, ERROR_FILE );
+
+      iterationsRead = ImageAddFormatted( pImage_o, jmpBufImage,
+         pImageFile );
+   }
+
+   /* finally: close and remove (a throw, or a failed close, being this
+      worker failing) */
+   if( pImageFile && (EOF == fclose( pImageFile )) )
+   {
+      iterationsRead = -1;
+   }
+   remove( sImageFilePathname );
+
+   return status ? -1 : iterationsRead;
+}
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+int32 RenderFarmRender
+(
+   jmp_buf     jmpBuf,
+   const char* sCommandTemplate,
+   const char* sModelFilePathname,
+   int32       iterations,
+   int32       workersLength,
+   Random*     pRandom,
+   Image*      pImage_o
+)
+{
+   /* no more workers than iterations */
+   const int32 fewer   = workersLength < iterations ? workersLength :
+      iterations;
+   const int32 workers = fewer < RENDERFARM_WORKERS_MAX ? fewer :
+      RENDERFARM_WORKERS_MAX;
+
+   /* (volatile, since set between setjmp and longjmp) */
+   Worker* volatile aWorkers = 0;
+   volatile int32   launched = 0;
+
+   int32 merged, i;
+   bool  isFailed;
+
+   jmp_buf   jmpBufLaunch;
+   const int status = setjmp( jmpBufLaunch );
+
+   /* try: launch workers */
+   if( !status )
+   {
+      aWorkers = (Worker*)throwAllocExceptions( jmpBufLaunch,
+         calloc( workers > 0 ? workers : 1, sizeof(Worker) ) );
+
+      for( i = 0;  i < workers;  ++i )
+      {
+         Worker* pW = &aWorkers[i];
+
+         /* distinct seed (large enough to be used as given) */
+         {
+            int32 j = -1;
+            while( j != i )
+            {
+               sprintf( pW->sSeed, "%08X",
+                  (RandomInt32u( pRandom ) | 0x100u) & 0xFFFFFFFFu );
+               for( j = 0;  (j < i) &&
+                  strcmp( pW->sSeed, aWorkers[j].sSeed );  ++j ) {}
+            }
+         }
+
+         /* share of iterations, remainder spread over the first */
+         pW->iterations = (iterations / workers) +
+            (i < (iterations % workers) ? 1 : 0);
+
+         /* image file name -- as a plain render with that seed would make */
+         pW->sImageFilePathname = (char*)throwAllocExceptions( jmpBufLaunch,
+            calloc( strlen(sModelFilePathname) + 15, sizeof(char) ) );
+         strcpy( pW->sImageFilePathname, sModelFilePathname );
+         strcat( strcat( pW->sImageFilePathname, "." ), pW->sSeed );
+         strcat( pW->sImageFilePathname, ".rgbe" );
+
+         {
+            char sWorker[12], sIterations[12];
+            const char* asValues[5];
+            char* sCommand;
+
+            sprintf( sWorker,     "%i", i );
+            sprintf( sIterations, "%i", pW->iterations );
+            asValues[0] = sWorker;
+            asValues[1] = pW->sSeed;
+            asValues[2] = sIterations;
+            asValues[3] = sModelFilePathname;
+            asValues[4] = pW->sImageFilePathname;
+
+            sCommand = makeCommand( jmpBufLaunch, sCommandTemplate,
+               asValues );
+            printf( "worker %i: (%i) %s\n", i, pW->iterations, sCommand );
+            fflush( stdout );
+
+            pW->pid = launch( jmpBufLaunch, sCommand );
+            free( sCommand );
+            launched = i + 1;
+         }
+      }
+   }
+
+   /* catch: stop the workers already started */
+   if( status )
+   {
+      for( i = launched;  i-- > 0;  kill( aWorkers[i].pid, SIGTERM ) ) {}
+   }
+
+   /* wait for all started workers, and merge their images (removing them) */
+   merged   = 0;
+   isFailed = false;
+   for( i = 0;  i < launched;  ++i )
+   {
+      Worker* pW = &aWorkers[i];
+
+      int waitStatus = 0;
+      const bool isDone = (waitpid( pW->pid, &waitStatus, 0 ) == pW->pid) &&
+         WIFEXITED( waitStatus ) && (0 == WEXITSTATUS( waitStatus ));
+
+      const int32 iterationsRead = (isDone && !status) ?
+         mergeImage( pImage_o, pW->sImageFilePathname ) : -1;
+      if( iterationsRead >= 0 )
+      {
+         merged += iterationsRead;
+         printf( "input: (%i) %s\n", iterationsRead, pW->sImageFilePathname );
+      }
+      else
+      {
+         printf( "worker %i failed\n", i );
+         isFailed = true;
+         remove( pW->sImageFilePathname );
+      }
+   }
+
+   /* finally: clean up */
+   if( aWorkers )
+   {
+      for( i = workers;  i-- > 0;
+         free( aWorkers[i].sImageFilePathname ) ) {}
+      free( aWorkers );
+   }
+
+   /* rethrow */
+   if( status )
+   {
+      longjmp( jmpBuf, status );
+   }
+
+   /* every worker must have succeeded (else the image is short of its
+      iterations) */
+   throwExceptions( jmpBuf, (isFailed || (merged < 1)), ERROR_PROCESS );
+
+   return merged;
+}
@@ -0,0 +1,79 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef RenderFarm_h
+#define RenderFarm_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Random.h"
+#include "Image.h"
+
+
+
+
+/**
+ * Coordinator for splitting a render among separate worker processes, by
+ * iterations.<br/><br/>
+ *
+ * Each worker renders a share of the iterations with a distinct seed, into
+ * its own image file; the files are then merged, weighted by iterations (as
+ * minilightmerge does), and removed. If any worker fails (exits non-zero, is
+ * killed, or leaves no image), the whole render fails -- rather than being
+ * short of iterations.<br/><br/>
+ *
+ * Workers are launched from a shell command template, so can be local
+ * processes or remote (by ssh etc.). The template placeholders are:
+ * <pre>
+ *    {worker}      worker number, from 0
+ *    {seed}        random seed, 8 hex digits
+ *    {iterations}  iterations to render
+ *    {model}       model file pathname
+ *    {output}      image file pathname to write
+ * </pre>
+ * A remote worker command must leave its image at {output} locally (by a
+ * shared filesystem, or copying it back).
+ */
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Run workers and merge their images (throwing ERROR_PROCESS if any fails).
+ *
+ * @return total iterations merged
+ */
+int32 RenderFarmRender
+(
+   jmp_buf     jmpBuf,
+   const char* sCommandTemplate,
+   const char* sModelFilePathname,
+   int32       iterations,
+   int32       workersLength,
+   Random*     pRandom,
+   Image*      pImage_o
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Maximum number of workers.
+ */
+#define RENDERFARM_WORKERS_MAX 256
+
+
+
+
+#endif
@@ -8,111 +8,1195 @@
 ------------------------------------------------------------------------------*/
 
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <sys/mman.h>
 
 #include "Exceptions.h"
+#include "Stats.h"
+
+#include "Import.h"
 
 #include "Scene.h"
 
 
 
 
+/* constants ---------------------------------------------------------------- */
+
+/* written form identifier (with its terminator, 8 bytes) */
+static const char WRITTEN_ID[] = "MLSCNE3";
+
+/* ITU-R BT.709 standard RGB luminance weighting */
+static const Vector3f RGB_LUMINANCE = {{ 0.2126, 0.7152, 0.0722 }};
+
+static const real64 PI = 3.14159265358979;
+
+/* probes of the light around the eyes, for weighing the sky against the
+   emitters, and the least share either is then given */
+#define SKY_PROBES 1024
+static const int32u SKY_PROBES_SEED = 0x5EED5C1Eu;
+static const real64 SKY_SHARE_MIN   = 0.02;
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Written form header: followed by sky emission, ground reflection, the
+ * vertexs, the materials, the triangles (as four indexs each: vertexs then
+ * material), and the portals' vertexs.
+ */
+struct WrittenHeader
+{
+   char  aId[8];
+   int32 realSize;
+   int32 vertexsLength;
+   int32 materialsLength;
+   int32 trianglesLength;
+   int32 portalsLength;
+   /* (keeping what follows 8-byte aligned) */
+   int32 padding;
+};
+
+typedef struct WrittenHeader WrittenHeader;
+
+
+/**
+ * Growable array of distinct items, with a hash table of their indexs (open
+ * addressing, -1 for empty), for finding equal ones.
+ */
+struct Welder
+{
+   byteu* aItems;
+   size_t itemSize;
+   int32  length;
+   int32  capacity;
+
+   int32* aSlots;
+   int32  slotsLength;
+};
+
+typedef struct Welder Welder;
+
+
+/**
+ * Triangles being read, as index quads (of vertexs then material).
+ */
+struct Quads
+{
+   int32* aIndexs;
+   int32  length;
+   int32  capacity;
+};
+
+typedef struct Quads Quads;
+
+
+/**
+ * Object definition being read, and placement of one.
+ */
+struct Definition
+{
+   char  sName[64];
+   Quads quads;
+};
+
+typedef struct Definition Definition;
+
+struct Placement
+{
+   int32    definition;
+   Vector3f aAxes[4];
+};
+
+typedef struct Placement Placement;
+
+
+/**
+ * Everything being read: shared items, the scene's own triangles, object
+ * definitions (defining is the one being read, or -1) and placements, and
+ * portals' vertexs.
+ */
+struct Reading
+{
+   Welder      vertexs;
+   Welder      materials;
+   Quads       quads;
+
+   Definition* aDefinitions;
+   int32       definitionsLength;
+   int32       defining;
+   Placement*  aPlacements;
+   int32       placementsLength;
+
+   Vector3f*   aPortalVertexs;
+   int32       portalsLength;
+};
+
+typedef struct Reading Reading;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static int32u hashItem
+(
+   const byteu* pItem,
+   size_t       itemSize
+)
+{
+   /* FNV-1a, 32 bit */
+   int32u hash = 2166136261u;
+   for( ;  itemSize-- > 0;  hash *= 16777619u )
+   {
+      hash ^= (int32u)*(pItem++);
+   }
+
+   return hash;
+}
+
+
+/**
+ * Double a capacity (from an initial one), within int32 counts.
+ */
+static int32 grow
+(
+   jmp_buf jmpBuf,
+   int32   capacity,
+   int32   initial
+)
+{
+   throwExceptions( jmpBuf, (capacity > (INT32_MAX / 2)), ERROR_ALLOC );
+
+   return capacity ? capacity * 2 : initial;
+}
+
+
+/**
+ * Put an item into the table (slots length is a power of two, and never
+ * full).
+ */
+static void welderInsert
+(
+   Welder* pW,
+   int32   index
+)
+{
+   int32u slot = hashItem( pW->aItems + ((size_t)index * pW->itemSize),
+      pW->itemSize );
+   for( ;;  ++slot )
+   {
+      slot &= (int32u)(pW->slotsLength - 1);
+      if( -1 == pW->aSlots[slot] )
+      {
+         pW->aSlots[slot] = index;
+         break;
+      }
+   }
+}
+
+
+/**
+ * Find the index of an equal item, else append it.
+ */
+static int32 weld
+(
+   Welder*     pW,
+   jmp_buf     jmpBuf,
+   const void* pItem
+)
+{
+   int32u slot = hashItem( (const byteu*)pItem, pW->itemSize );
+
+   /* look for equal item */
+   for( ;;  ++slot )
+   {
+      int32 index;
+
+      slot &= (int32u)(pW->slotsLength - 1);
+      index = pW->aSlots[slot];
+      if( -1 == index )
+      {
+         break;
+      }
+      if( !memcmp( pW->aItems + ((size_t)index * pW->itemSize), pItem,
+         pW->itemSize ) )
+      {
+         return index;
+      }
+   }
+
+   /* append item */
+   if( pW->length == pW->capacity )
+   {
+      pW->capacity = grow( jmpBuf, pW->capacity, 64 );
+      pW->aItems   = (byteu*)throwAllocExceptions( jmpBuf,
+         realloc( pW->aItems, (size_t)pW->capacity * pW->itemSize ) );
+   }
+   memcpy( pW->aItems + ((size_t)pW->length * pW->itemSize), pItem,
+      pW->itemSize );
+   pW->aSlots[slot] = pW->length++;
+
+   /* keep table at most half full, doubling it */
+   if( (pW->length * 2) > pW->slotsLength )
+   {
+      int32 i;
+
+      free( pW->aSlots );
+      pW->slotsLength = grow( jmpBuf, pW->slotsLength, 64 );
+      pW->aSlots = (int32*)throwAllocExceptions( jmpBuf,
+         malloc( (size_t)pW->slotsLength * sizeof(int32) ) );
+      memset( pW->aSlots, -1, (size_t)pW->slotsLength * sizeof(int32) );
+
+      for( i = 0;  i < pW->length;  welderInsert( pW, i++ ) ) {}
+   }
+
+   return pW->length - 1;
+}
+
+
+static void welderInit
+(
+   Welder* pW,
+   jmp_buf jmpBuf,
+   size_t  itemSize
+)
+{
+   memset( pW, 0, sizeof(Welder) );
+   pW->itemSize    = itemSize;
+   pW->slotsLength = 64;
+   pW->aSlots = (int32*)throwAllocExceptions( jmpBuf,
+      malloc( (size_t)pW->slotsLength * sizeof(int32) ) );
+   memset( pW->aSlots, -1, (size_t)pW->slotsLength * sizeof(int32) );
+}
+
+
+/**
+ * Free a reading's remaining parts (those not handed to the scene).
+ */
+static void readingFree
+(
+   Reading* pR
+)
+{
+   int32 i;
+
+   for( i = pR->definitionsLength;  i-- > 0; )
+   {
+      free( pR->aDefinitions[i].quads.aIndexs );
+   }
+   free( pR->aDefinitions );
+   free( pR->aPlacements );
+   free( pR->aPortalVertexs );
+   free( pR->quads.aIndexs );
+   free( pR->materials.aSlots );
+   free( pR->materials.aItems );
+   free( pR->vertexs.aSlots );
+   free( pR->vertexs.aItems );
+   free( pR );
+}
+
+
+/**
+ * Make triangles from index quads (of vertexs then material).
+ */
+static void makeTriangles
+(
+   const Scene* pS,
+   const int32* aIndexs,
+   int32        length,
+   Triangle*    aTriangles_o
+)
+{
+   int32 i, j;
+
+   for( i = 0;  i < length;  ++i, aIndexs += 4 )
+   {
+      for( j = 3;  j-- > 0; )
+      {
+         aTriangles_o[i].apVertexs[j] = &pS->aVertexs[aIndexs[j]];
+      }
+      aTriangles_o[i].pMaterial = &pS->aMaterials[aIndexs[3]];
+   }
+}
+
+
+/**
+ * Weld a triangle's vertexs and material, and append its indexs, to the scene
+ * or the definition being read (an ImportTriangleFunction).
+ */
+static void appendTriangle
+(
+   void*           pContext,
+   jmp_buf         jmpBuf,
+   const Vector3f  aVertexs[3],
+   const Material* pMaterial
+)
+{
+   Reading* pR     = (Reading*)pContext;
+   Quads*   pQuads = (pR->defining >= 0) ?
+      &pR->aDefinitions[pR->defining].quads : &pR->quads;
+   int32*   pIndexs;
+   int      j;
+
+   if( pQuads->length == pQuads->capacity )
+   {
+      pQuads->capacity = grow( jmpBuf, pQuads->capacity, 64 );
+      pQuads->aIndexs  = (int32*)throwAllocExceptions( jmpBuf,
+         realloc( pQuads->aIndexs, (size_t)pQuads->capacity * 4 *
+         sizeof(int32) ) );
+   }
+   pIndexs = pQuads->aIndexs + ((size_t)pQuads->length++ * 4);
+
+   for( j = 0;  j < 3;  ++j )
+   {
+      pIndexs[j] = weld( &pR->vertexs, jmpBuf, &aVertexs[j] );
+   }
+   pIndexs[3] = weld( &pR->materials, jmpBuf, pMaterial );
+}
+
+
+/**
+ * Append an emitter, if the triangle has non-zero emission and area.
+ */
+static void addEmitter
+(
+   Scene*          pS,
+   jmp_buf         jmpBuf,
+   const Triangle* pTriangle,
+   const Instance* pInstance
+)
+{
+   if( !Vector3fIsZero( &pTriangle->pMaterial->emitivity ) &&
+      (TriangleArea( pTriangle ) > 0.0) )
+   {
+      throwExceptions( jmpBuf, (INT32_MAX == pS->emittersLength),
+         ERROR_ALLOC );
+      ++pS->emittersLength;
+      pS->apEmitters = (const Triangle**)throwAllocExceptions( jmpBuf,
+         realloc( (Triangle**)pS->apEmitters, pS->emittersLength *
+         sizeof(Triangle*) ) );
+      pS->apEmitterInstances = (const Instance**)throwAllocExceptions(
+         jmpBuf, realloc( (Instance**)pS->apEmitterInstances,
+         pS->emittersLength * sizeof(Instance*) ) );
+
+      pS->apEmitters[pS->emittersLength - 1]         = pTriangle;
+      pS->apEmitterInstances[pS->emittersLength - 1] = pInstance;
+   }
+}
+
+
+static void findEmitters
+(
+   Scene*  pS,
+   jmp_buf jmpBuf
+)
+{
+   int32 i, j;
+
+   pS->apEmitters = (const Triangle**)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(Triangle*) ) );
+   pS->apEmitterInstances = (const Instance**)throwAllocExceptions( jmpBuf,
+      calloc( 1, sizeof(Instance*) ) );
+   pS->emittersLength = 0;
+
+   /* own triangles, then each instance's */
+   for( i = 0;  i < pS->trianglesLength;  ++i )
+   {
+      addEmitter( pS, jmpBuf, &pS->aTriangles[i], 0 );
+   }
+   for( i = 0;  i < pS->instancesLength;  ++i )
+   {
+      const Prototype* pP = pS->aInstances[i].pPrototype;
+      for( j = 0;  j < pP->trianglesLength;  ++j )
+      {
+         addEmitter( pS, jmpBuf, &pP->aTriangles[j], &pS->aInstances[i] );
+      }
+   }
+
+   pS->pLightTree = LightTreeConstruct( jmpBuf, pS->apEmitters,
+      pS->apEmitterInstances, pS->emittersLength );
+}
+
+
+/**
+ * Index of an emitter, or -1 if not one -- found by bisection, since they are
+ * in order of instance (own first), then triangle.
+ */
+static int32 emitterIndex
+(
+   const Scene*        pS,
+   const SurfacePoint* pEmitter
+)
+{
+   const int32 instance = pEmitter->pInstance ?
+      (int32)(pEmitter->pInstance - pS->aInstances) + 1 : 0;
+   const int32 triangle = (int32)(pEmitter->pTriangle - pS->aTriangles);
+   int32       low      = 0;
+   int32       high     = pS->emittersLength;
+
+   while( low < high )
+   {
+      const int32 middle = low + ((high - low) / 2);
+      const int32 i      = pS->apEmitterInstances[middle] ?
+         (int32)(pS->apEmitterInstances[middle] - pS->aInstances) + 1 : 0;
+      const int32 t      = (int32)(pS->apEmitters[middle] - pS->aTriangles);
+
+      if( (i < instance) || ((i == instance) && (t < triangle)) )
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle;
+      }
+   }
+
+   return ((low < pS->emittersLength) &&
+      (pS->apEmitters[low] == pEmitter->pTriangle) &&
+      (pS->apEmitterInstances[low] == pEmitter->pInstance)) ? low : -1;
+}
+
+
+/**
+ * Point on an emitter (as placed).
+ */
+static SurfacePoint emitterPoint
+(
+   const Scene* pS,
+   int32        index,
+   Random*      pRandom
+)
+{
+   Vector3f aVertexs[3], position;
+   Triangle placed;
+
+   if( pS->apEmitterInstances[index] )
+   {
+      InstanceTriangle( pS->apEmitterInstances[index],
+         pS->apEmitters[index], aVertexs, &placed );
+      position = TriangleSamplePoint( &placed, pRandom );
+   }
+   else
+   {
+      position = TriangleSamplePoint( pS->apEmitters[index], pRandom );
+   }
+
+   return SurfacePointCreate( pS->apEmitters[index],
+      pS->apEmitterInstances[index], &position );
+}
+
+
+/**
+ * Probability density (per solid angle) of a sky (or ground) direction, within
+ * its hemisphere: the mean of uniform and cosine-weighted.
+ *
+ * @param height of the direction above (or below) the horizon, 0 to 1
+ */
+static real64 hemispherePdf
+(
+   real64 height
+)
+{
+   return (0.5 / (PI * 2.0)) + (0.5 * height / PI);
+}
+
+
+/**
+ * Choose a portal, by area.
+ */
+static const Triangle* choosePortal
+(
+   const Scene* pS,
+   Random*      pRandom
+)
+{
+   const real64 area = RandomReal64( pRandom ) * pS->portalsArea;
+   int32        i;
+   for( i = 0;  (i < pS->portalsLength - 1) &&
+      (area >= pS->aPortalAreas[i]);  ++i ) {}
+
+   return &pS->aPortals[i];
+}
+
+
+/**
+ * Unit direction square to a unit direction (and its cross with it, square to
+ * both).
+ */
+static void squareTo
+(
+   const Vector3f* pDirection,
+   Vector3f*       pU_o,
+   Vector3f*       pV_o
+)
+{
+   /* (across the axis the direction is least along) */
+   const real64 x    = fabs( pDirection->xyz[0] );
+   const real64 y    = fabs( pDirection->xyz[1] );
+   const real64 z    = fabs( pDirection->xyz[2] );
+   Vector3f     axis = Vector3fZERO;
+   axis.xyz[(x < y) ? (x < z ? 0 : 2) : (y < z ? 1 : 2)] = 1.0;
+
+   *pU_o = Vector3fCross( pDirection, &axis );
+   *pU_o = Vector3fUnitized( pU_o );
+   *pV_o = Vector3fCross( pDirection, pU_o );
+}
+
+
+/**
+ * Probability density (per solid angle) of a direction through the portals:
+ * the area density, of each one it passes through, converted by its distance
+ * and slant.
+ */
+static real64 portalsPdf
+(
+   const Scene*    pS,
+   const Vector3f* pPosition,
+   const Vector3f* pDirection
+)
+{
+   real64 pdf = 0.0;
+   int32  i;
+
+   for( i = pS->portalsLength;  i-- > 0; )
+   {
+      real64 distance;
+      if( TriangleIntersection( &pS->aPortals[i], pPosition, pDirection,
+         &distance ) )
+      {
+         const Vector3f normal = TriangleNormal( &pS->aPortals[i] );
+         const real64   slant  = fabs( Vector3fDot( pDirection, &normal ) );
+
+         /* (with infinity clamped-out) */
+         pdf += (distance * distance) / ((slant >= 1e-6 ? slant : 1e-6) *
+            pS->portalsArea);
+      }
+   }
+
+   return pdf;
+}
+
+
+/**
+ * Estimate the direct light (luminance) reaching surfaces seen from the eyes,
+ * from the sky (and ground), and from the emitters: at points hit by rays
+ * from the eyes in uniform directions, by a light sample of each (as
+ * RayTracer's, unweighted), shadowed. So what blocks either (walls around
+ * lamps, a roof over a sky) counts, as powers alone cannot tell.
+ *
+ * @return whether any probe found either
+ */
+static bool probeLights
+(
+   const Scene*    pS,
+   const Vector3f* aEyePositions,
+   int32           eyesLength,
+   real64*         pSky_o,
+   real64*         pEmitters_o
+)
+{
+   Random random = RandomCreateSeeded( SKY_PROBES_SEED );
+   int32  i;
+
+   *pSky_o      = 0.0;
+   *pEmitters_o = 0.0;
+
+   for( i = 0;  i < SKY_PROBES;  ++i )
+   {
+      /* uniform direction on the sphere */
+      const real64 z   = 1.0 - (2.0 * RandomReal64( &random ));
+      const real64 r   = sqrt( 1.0 - (z * z) );
+      const real64 phi = 2.0 * PI * RandomReal64( &random );
+
+      SurfacePoint point, hit;
+      Vector3f     ray;
+      ray.xyz[0] = r * cos( phi );
+      ray.xyz[1] = r * sin( phi );
+      ray.xyz[2] = z;
+
+      if( SceneIntersection( pS, &aEyePositions[i % eyesLength], &ray, 0,
+         &point ) )
+      {
+         Vector3f     direction, normal = SurfacePointNormal( &point );
+         SurfacePoint emitter;
+         real64       pdf;
+
+         /* (the side seen) */
+         if( Vector3fDot( &normal, &ray ) > 0.0 )
+         {
+            normal = Vector3fNegative( &normal );
+         }
+
+         /* sky sample */
+         pdf = SceneSkyDirection( pS, &point.position, &random, &direction );
+         if( (pdf > 0.0) && (Vector3fDot( &direction, &normal ) > 0.0) &&
+            !SceneIntersection( pS, &point.position, &direction, &point,
+            &hit ) )
+         {
+            const Vector3f back     = Vector3fNegative( &direction );
+            const Vector3f emission = SceneDefaultEmission( pS, &back );
+            *pSky_o += Vector3fDot( &emission, &RGB_LUMINANCE ) *
+               Vector3fDot( &direction, &normal ) / pdf;
+         }
+
+         /* emitter sample */
+         if( SceneEmitterToward( pS, &point.position, &normal, &random,
+            &emitter, &pdf ) )
+         {
+            const Vector3f toward = Vector3fSub( &emitter.position,
+               &point.position );
+            direction = Vector3fUnitized( &toward );
+
+            if( (Vector3fDot( &direction, &normal ) > 0.0) &&
+               (!SceneIntersection( pS, &point.position, &direction, &point,
+               &hit ) || SurfacePointIsSame( &emitter, &hit )) )
+            {
+               const Vector3f back = Vector3fNegative( &direction );
+               *pEmitters_o += Vector3fDot(
+                  &emitter.pTriangle->pMaterial->emitivity, &RGB_LUMINANCE ) *
+                  Vector3fDot( &direction, &normal ) * SurfacePointSolidAngle(
+                  &emitter, &point.position, &back ) / pdf;
+            }
+         }
+      }
+   }
+
+   return (*pSky_o + *pEmitters_o) > 0.0;
+}
+
+
+/**
+ * Set the bound of the reflectors: own triangles that are not emitters, and
+ * instances (empty, inverted, if there are none).
+ */
+static void makeReflectorsBound
+(
+   Scene* pS
+)
+{
+   real64* aB = pS->aReflectorsBound;
+   int32   i;
+   int     j, k;
+
+   for( j = 3;  j-- > 0;  aB[j] = REAL64_MAX, aB[j + 3] = -REAL64_MAX ) {}
+
+   for( i = pS->trianglesLength;  i-- > 0; )
+   {
+      const Triangle* pT = &pS->aTriangles[i];
+      if( Vector3fIsZero( &pT->pMaterial->emitivity ) )
+      {
+         for( k = 3;  k-- > 0; )
+         {
+            for( j = 3;  j-- > 0; )
+            {
+               const real64 v = pT->apVertexs[k]->xyz[j];
+               aB[j]     = v < aB[j]     ? v : aB[j];
+               aB[j + 3] = v > aB[j + 3] ? v : aB[j + 3];
+            }
+         }
+      }
+   }
+   for( i = pS->instancesLength;  i-- > 0; )
+   {
+      for( j = 3;  j-- > 0; )
+      {
+         const real64* aI = pS->aInstances[i].aBound;
+         aB[j]     = aI[j]     < aB[j]     ? aI[j]     : aB[j];
+         aB[j + 3] = aI[j + 3] > aB[j + 3] ? aI[j + 3] : aB[j + 3];
+      }
+   }
+}
+
+
+/**
+ * Set the probability of sampling the sky (and ground) instead of an emitter,
+ * as its share of the direct light they give around the eyes (see
+ * probeLights) -- kept between SKY_SHARE_MIN and 1 - SKY_SHARE_MIN, for light
+ * the probes missed. If the probes found none, it is the share of their
+ * estimated powers (luminance fluxes, leaving out pi): of the emitters, their
+ * radiances by areas; of the sky and ground, their radiances by half the
+ * surface area of the scene bound (what a uniform hemisphere of light sends
+ * into a box) -- or, if there are portals, by half their area (what a uniform
+ * sphere of light sends through an opening).
+ */
+static void weighSky
+(
+   Scene*          pS,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+)
+{
+   real64 aBound[6], emittersPower = 0.0, skyPower;
+   int32  i;
+   int    j;
+
+   /* scene bound: own triangles', and instances' */
+   for( j = 6;  j-- > 0;  aBound[j] = pS->pIndex->aBound[j] ) {}
+   for( i = 0;  i < pS->instancesLength;  ++i )
+   {
+      for( j = 0;  j < 6;  ++j )
+      {
+         const real64 b = pS->aInstances[i].aBound[j];
+         aBound[j] = ((j < 3) ? (b < aBound[j]) : (b > aBound[j])) ? b :
+            aBound[j];
+      }
+   }
+
+   for( i = 0;  i < pS->emittersLength;  ++i )
+   {
+      Vector3f        aVertexs[3];
+      Triangle        placed;
+      const Triangle* pT = pS->apEmitters[i];
+      if( pS->apEmitterInstances[i] )
+      {
+         InstanceTriangle( pS->apEmitterInstances[i], pT, aVertexs, &placed );
+         pT = &placed;
+      }
+
+      emittersPower += Vector3fDot( &pT->pMaterial->emitivity,
+         &RGB_LUMINANCE ) * TriangleArea( pT );
+   }
+
+   {
+      const Vector3f ground = Vector3fMulV( &pS->skyEmission,
+         &pS->groundReflection );
+      const real64   x      = aBound[3] - aBound[0];
+      const real64   y      = aBound[4] - aBound[1];
+      const real64   z      = aBound[5] - aBound[2];
+
+      skyPower = (Vector3fDot( &pS->skyEmission, &RGB_LUMINANCE ) +
+         Vector3fDot( &ground, &RGB_LUMINANCE )) * ((pS->portalsArea > 0.0) ?
+         pS->portalsArea * 0.5 : (x * y) + (y * z) + (z * x));
+   }
+
+   /* (exactly 0 or 1 if either has none) */
+   pS->skyProbability = (skyPower > 0.0) ? (emittersPower > 0.0 ?
+      skyPower / (skyPower + emittersPower) : 1.0) : 0.0;
+
+   /* both: by what reaches around the eyes, if anything */
+   if( (skyPower > 0.0) && (emittersPower > 0.0) )
+   {
+      real64 sky, emitters;
+      if( probeLights( pS, aEyePositions, eyesLength, &sky, &emitters ) )
+      {
+         const real64 share = sky / (sky + emitters);
+         pS->skyProbability = share < SKY_SHARE_MIN ? SKY_SHARE_MIN :
+            (share > (1.0 - SKY_SHARE_MIN) ? 1.0 - SKY_SHARE_MIN : share);
+      }
+   }
+}
+
+
+/**
+ * Make triangles of the portals' vertexs (with no material), and total their
+ * areas.
+ */
+static void makePortals
+(
+   Scene*  pS,
+   jmp_buf jmpBuf
+)
+{
+   int32 i;
+   int   j;
+
+   pS->aPortals = (Triangle*)throwAllocExceptions( jmpBuf,
+      calloc( pS->portalsLength + 1, sizeof(Triangle) ) );
+   pS->aPortalAreas = (real64*)throwAllocExceptions( jmpBuf,
+      calloc( pS->portalsLength + 1, sizeof(real64) ) );
+   pS->portalsArea = 0.0;
+
+   for( i = 0;  i < pS->portalsLength;  ++i )
+   {
+      for( j = 3;  j-- > 0;  pS->aPortals[i].apVertexs[j] =
+         &pS->aPortalVertexs[(i * 3) + j] ) {}
+      pS->portalsArea += TriangleArea( &pS->aPortals[i] );
+      pS->aPortalAreas[i] = pS->portalsArea;
+   }
+}
+
+
+/**
+ * Read a keyword, and what follows it: "object name" starts a definition
+ * (its triangles read up to "end"), "instance name axes origin" places one,
+ * "import pathname reflectivity emitivity" reads a mesh file's triangles
+ * (see Import), and "portal vertex0 vertex1 vertex2" marks one (in the scene,
+ * not a definition).
+ */
+static void readKeyword
+(
+   FILE*    pIn,
+   jmp_buf  jmpBuf,
+   Reading* pR
+)
+{
+   char sKeyword[16], sName[1024];
+   int  i;
+
+   throwExceptions( jmpBuf, (1 != fscanf( pIn, "%15s", sKeyword )),
+      ERROR_READ_INVAL );
+
+   /* end a definition */
+   if( !strcmp( sKeyword, "end" ) )
+   {
+      throwExceptions( jmpBuf, (pR->defining < 0) ||
+         (pR->aDefinitions[pR->defining].quads.length <= 0),
+         ERROR_READ_INVAL );
+      pR->defining = -1;
+      return;
+   }
+
+   /* import into the scene, or the definition */
+   if( !strcmp( sKeyword, "import" ) )
+   {
+      Vector3f reflectivity, emitivity;
+      Material material;
+
+      throwExceptions( jmpBuf, (1 != fscanf( pIn, "%1023s", sName )),
+         ERROR_READ_INVAL );
+      reflectivity = Vector3fRead( pIn, jmpBuf );
+      emitivity    = Vector3fRead( pIn, jmpBuf );
+      material     = MaterialCreate( &reflectivity, &emitivity );
+
+      ImportRead( jmpBuf, sName, &material, appendTriangle, pR );
+      return;
+   }
+
+   /* mark a portal */
+   if( !strcmp( sKeyword, "portal" ) )
+   {
+      throwExceptions( jmpBuf, (pR->defining >= 0), ERROR_READ_INVAL );
+      throwExceptions( jmpBuf, (pR->portalsLength >= (INT32_MAX / 3) - 1),
+         ERROR_ALLOC );
+
+      pR->aPortalVertexs = (Vector3f*)throwAllocExceptions( jmpBuf,
+         realloc( pR->aPortalVertexs, (size_t)(pR->portalsLength + 1) * 3 *
+         sizeof(Vector3f) ) );
+      for( i = 0;  i < 3;  ++i )
+      {
+         pR->aPortalVertexs[(pR->portalsLength * 3) + i] = Vector3fRead( pIn,
+            jmpBuf );
+      }
+      ++pR->portalsLength;
+      return;
+   }
+
+   throwExceptions( jmpBuf, (1 != fscanf( pIn, "%63s", sName )) ||
+      (pR->defining >= 0), ERROR_READ_INVAL );
+
+   /* find named definition */
+   for( i = pR->definitionsLength;  i-- > 0; )
+   {
+      if( !strcmp( pR->aDefinitions[i].sName, sName ) )
+      {
+         break;
+      }
+   }
+
+   /* start a definition (of a new name) */
+   if( !strcmp( sKeyword, "object" ) )
+   {
+      Definition* pD;
+
+      throwExceptions( jmpBuf, (i >= 0), ERROR_READ_INVAL );
+
+      pR->aDefinitions = (Definition*)throwAllocExceptions( jmpBuf,
+         realloc( pR->aDefinitions, (pR->definitionsLength + 1) *
+         sizeof(Definition) ) );
+      pR->defining = pR->definitionsLength++;
+
+      pD = &pR->aDefinitions[pR->defining];
+      memset( pD, 0, sizeof(Definition) );
+      strcpy( pD->sName, sName );
+   }
+   /* place a (defined) object */
+   else if( !strcmp( sKeyword, "instance" ) )
+   {
+      Placement* pP;
+      int        j;
+
+      throwExceptions( jmpBuf, (i < 0), ERROR_READ_INVAL );
+
+      pR->aPlacements = (Placement*)throwAllocExceptions( jmpBuf,
+         realloc( pR->aPlacements, (pR->placementsLength + 1) *
+         sizeof(Placement) ) );
+
+      pP = &pR->aPlacements[pR->placementsLength++];
+      pP->definition = i;
+      for( j = 0;  j < 4;  pP->aAxes[j++] = Vector3fRead( pIn, jmpBuf ) ) {}
+   }
+   else
+   {
+      throwExceptions( jmpBuf, true, ERROR_READ_INVAL );
+   }
+}
+
+
+
+
 /* initialisation ----------------------------------------------------------- */
 
-const Scene* SceneConstruct
+Scene* SceneConstruct
 (
    FILE*           pIn,
-   jmp_buf         jmpBuf,
-   const Vector3f* pEyePosition
+   jmp_buf         jmpBuf
 )
 {
-   Scene* pS = (Scene*)throwAllocExceptions( jmpBuf,
-      calloc( 1, sizeof(Scene) ) );
-
-   /* read and condition background sky and ground values */
-   {
-      pS->skyEmission      = Vector3fRead( pIn, jmpBuf );
-      pS->groundReflection = Vector3fRead( pIn, jmpBuf );
+   /* (volatile, since set between setjmp and longjmp) */
+   Scene*   volatile pS = 0;
+   Reading* volatile pR = 0;
 
-      pS->skyEmission = Vector3fClamped( &pS->skyEmission,
-         &Vector3fZERO, &pS->skyEmission );
-      pS->groundReflection = Vector3fClamped( &pS->groundReflection,
-         &Vector3fZERO, &Vector3fONE );
-   }
+   jmp_buf   jmpBufScene;
+   const int status = setjmp( jmpBufScene );
 
-   /* read objects, until end of file or until maximum reached */
+   /* try */
+   if( !status )
    {
-      int32 i;
+      pS = (Scene*)throwAllocExceptions( jmpBufScene,
+         calloc( 1, sizeof(Scene) ) );
+
+      /* read and condition background sky and ground values */
+      {
+         pS->skyEmission      = Vector3fRead( pIn, jmpBufScene );
+         pS->groundReflection = Vector3fRead( pIn, jmpBufScene );
 
-      pS->aTriangles = (Triangle*)throwAllocExceptions( jmpBuf,
-         calloc( 0, sizeof(Triangle) ) );
-      pS->trianglesLength = 0;
+         pS->skyEmission = Vector3fClamped( &pS->skyEmission,
+            &Vector3fZERO, &pS->skyEmission );
+         pS->groundReflection = Vector3fClamped( &pS->groundReflection,
+            &Vector3fZERO, &Vector3fONE );
+      }
 
-      for( i = 0;  i < MAX_TRIANGLES;  ++i )
+      /* read objects, until end of file, welding their vertexs and
+         materials */
+      STATS_TIMER_BEGIN( STATS_PHASE_PARSE )
       {
-         /* stop reading if no more objects */
-         {
-            /* read next non blank char */
-            char s[2];
-            const int r = fscanf( pIn, "%1s", s );
+         int32 i, total;
 
-            /* throw non-EOF failure */
-            const int code = ferror( pIn ) ? ERROR_READ_IO : 0;
-            clearerr( pIn );
-            throwExceptions( jmpBuf, (bool)code, code );
+         pR = (Reading*)throwAllocExceptions( jmpBufScene,
+            calloc( 1, sizeof(Reading) ) );
+         pR->defining = -1;
+         welderInit( &pR->vertexs, jmpBufScene, sizeof(Vector3f) );
+         welderInit( &pR->materials, jmpBufScene, sizeof(Material) );
 
-            /* if char was found, put back, else end reading */
-            if( 1 == r )
+         for( ;; )
+         {
+            /* stop reading if no more objects */
             {
-               throwExceptions( jmpBuf, (EOF == ungetc( s[0], pIn )),
-                  ERROR_READ_IO );
+               /* read next non blank char */
+               char s[2];
+               const int r = fscanf( pIn, "%1s", s );
+
+               /* throw non-EOF failure */
+               const int code = ferror( pIn ) ? ERROR_READ_IO : 0;
+               clearerr( pIn );
+               throwExceptions( jmpBufScene, (bool)code, code );
+
+               /* if char was found, put back, else end reading */
+               if( 1 == r )
+               {
+                  throwExceptions( jmpBufScene,
+                     (EOF == ungetc( s[0], pIn )), ERROR_READ_IO );
+               }
+               else
+               {
+                  break;
+               }
+
+               /* a keyword instead of an object */
+               if( '(' != s[0] )
+               {
+                  readKeyword( pIn, jmpBufScene, pR );
+                  continue;
+               }
             }
-            else
+
+            /* read an object, into the scene or the definition */
             {
-               break;
+               Vector3f aVertexs[3];
+               Material material;
+
+               TriangleRead( pIn, jmpBufScene, aVertexs, &material );
+               appendTriangle( pR, jmpBufScene, aVertexs, &material );
             }
          }
+         throwExceptions( jmpBufScene, (pR->defining >= 0),
+            ERROR_READ_INVAL );
+
+         /* keep shared items (handing them to the scene), and make
+            triangles of them: the scene's own, then each definition's */
+         pS->aVertexs        = (Vector3f*)pR->vertexs.aItems;
+         pS->vertexsLength   = pR->vertexs.length;
+         pS->aMaterials      = (Material*)pR->materials.aItems;
+         pS->materialsLength = pR->materials.length;
+         pR->vertexs.aItems   = 0;
+         pR->materials.aItems = 0;
+         free( pR->vertexs.aSlots );
+         free( pR->materials.aSlots );
+         pR->vertexs.aSlots   = 0;
+         pR->materials.aSlots = 0;
+
+         pS->trianglesLength = pR->quads.length;
+         for( i = 0, total = pR->quads.length;  i < pR->definitionsLength;
+            total += pR->aDefinitions[i++].quads.length )
+         {
+            throwExceptions( jmpBufScene, (pR->aDefinitions[i].quads.length
+               >= (INT32_MAX - total)), ERROR_ALLOC );
+         }
+
+         pS->aTriangles = (Triangle*)throwAllocExceptions( jmpBufScene,
+            calloc( total + 1, sizeof(Triangle) ) );
+         makeTriangles( pS, pR->quads.aIndexs, pR->quads.length,
+            pS->aTriangles );
+         free( pR->quads.aIndexs );
+         pR->quads.aIndexs = 0;
 
-         /* read an object */
+         /* make prototypes (indexing each), and instances of them */
+         pS->aPrototypes = (Prototype*)throwAllocExceptions( jmpBufScene,
+            calloc( pR->definitionsLength + 1, sizeof(Prototype) ) );
+         for( i = 0, total = pR->quads.length;
+            i < pR->definitionsLength;  ++i )
          {
-            const Triangle t = TriangleCreate( pIn, jmpBuf );
+            Quads* pQuads = &pR->aDefinitions[i].quads;
+            makeTriangles( pS, pQuads->aIndexs, pQuads->length,
+               pS->aTriangles + total );
+            free( pQuads->aIndexs );
+            pQuads->aIndexs = 0;
 
-            /* append to objects storage */
-            pS->aTriangles = (Triangle*)throwAllocExceptions( jmpBuf,
-               realloc( pS->aTriangles, ++pS->trianglesLength *
-               sizeof(Triangle) ) );
-            pS->aTriangles[pS->trianglesLength - 1] = t;
+            pS->aPrototypes[pS->prototypesLength++] = PrototypeCreate(
+               pS->aTriangles + total, pQuads->length, jmpBufScene );
+            total += pQuads->length;
          }
+         free( pR->aDefinitions );
+         pR->aDefinitions      = 0;
+         pR->definitionsLength = 0;
+
+         pS->aInstances = (Instance*)throwAllocExceptions( jmpBufScene,
+            calloc( pR->placementsLength + 1, sizeof(Instance) ) );
+         for( i = 0;  i < pR->placementsLength;  ++i )
+         {
+            pS->aInstances[pS->instancesLength++] = InstanceCreate(
+               &pS->aPrototypes[pR->aPlacements[i].definition],
+               pR->aPlacements[i].aAxes, jmpBufScene );
+         }
+         free( pR->aPlacements );
+         pR->aPlacements = 0;
+
+         pS->pInstanceIndex = pS->instancesLength ? InstanceIndexConstruct(
+            pS->aInstances, pS->instancesLength, jmpBufScene ) : 0;
+
+         pS->aPortalVertexs = pR->aPortalVertexs;
+         pS->portalsLength  = pR->portalsLength;
+         pR->aPortalVertexs = 0;
+         makePortals( pS, jmpBufScene );
       }
+      STATS_TIMER_END( STATS_PHASE_PARSE )
+
+      /* find emitting objects */
+      findEmitters( pS, jmpBufScene );
    }
 
-   /* find emitting objects */
+   /* finally: clean up what is left of the reading (and, on failure, the
+      scene) */
+   if( pR )
    {
-      int32 i;
+      readingFree( pR );
+   }
+   if( status && pS )
+   {
+      SceneDestruct( pS );
+   }
+
+   /* rethrow */
+   if( status )
+   {
+      longjmp( jmpBuf, status );
+   }
+
+   return pS;
+}
+
+
+Scene* SceneConstructMapped
+(
+   void*           pMap,
+   size_t          mapLength,
+   jmp_buf         jmpBuf
+)
+{
+   const WrittenHeader* pHeader = (const WrittenHeader*)pMap;
+   Vector3f*            aBackground;
+   const int32*         aIndexs;
+
+   Scene* pS;
+   size_t i;
+
+   /* check header, against this platform, and length */
+   if( (mapLength < sizeof(WrittenHeader)) ||
+      memcmp( pHeader->aId, WRITTEN_ID, sizeof(pHeader->aId) ) ||
+      (pHeader->realSize != (int32)sizeof(real64)) ||
+      (pHeader->trianglesLength < 0) ||
+      (pHeader->trianglesLength == INT32_MAX) ||
+      (pHeader->vertexsLength < 0) ||
+      ((long64)pHeader->vertexsLength >
+      ((long64)pHeader->trianglesLength * 3)) ||
+      (pHeader->materialsLength < 0) ||
+      (pHeader->materialsLength > pHeader->trianglesLength) ||
+      (pHeader->portalsLength < 0) ||
+      (pHeader->portalsLength >= (INT32_MAX / 3) - 1) ||
+      (mapLength != (sizeof(WrittenHeader) + (2 * sizeof(Vector3f)) +
+      ((size_t)pHeader->vertexsLength * sizeof(Vector3f)) +
+      ((size_t)pHeader->materialsLength * sizeof(Material)) +
+      ((size_t)pHeader->trianglesLength * 4 * sizeof(int32)) +
+      ((size_t)pHeader->portalsLength * 3 * sizeof(Vector3f)))) )
+   {
+      return 0;
+   }
 
-      pS->apEmitters = (Triangle**)throwAllocExceptions( jmpBuf,
-         calloc( 0, sizeof(Triangle*) ) );
-      pS->emittersLength = 0;
+   aBackground = (Vector3f*)((char*)pMap + sizeof(WrittenHeader));
+   aIndexs     = (const int32*)((Material*)(aBackground + 2 +
+      pHeader->vertexsLength) + pHeader->materialsLength);
 
-      for( i = 0;  i < pS->trianglesLength;  ++i )
+   /* check indexs */
+   for( i = (size_t)pHeader->trianglesLength * 4;  i-- > 0; )
+   {
+      if( (aIndexs[i] < 0) || (aIndexs[i] >= ((3 == (i & 3)) ?
+         pHeader->materialsLength : pHeader->vertexsLength)) )
       {
-         /* has non-zero emission and area */
-         if( !Vector3fIsZero( &pS->aTriangles[i].emitivity ) &&
-            (TriangleArea( &pS->aTriangles[i] ) > 0.0) )
-         {
-            /* append to emitters storage */
-            pS->apEmitters = (Triangle**)throwAllocExceptions( jmpBuf,
-               realloc( pS->apEmitters, ++pS->emittersLength *
-               sizeof(Triangle*) ) );
-            pS->apEmitters[pS->emittersLength - 1] = &(pS->aTriangles[i]);
-         }
+         return 0;
       }
    }
 
-   /* make index of objects */
-   pS->pIndex = (SpatialIndex*)SpatialIndexConstruct( pEyePosition,
-      pS->aTriangles, pS->trianglesLength, jmpBuf );
+   pS = (Scene*)throwAllocExceptions( jmpBuf, calloc( 1, sizeof(Scene) ) );
+
+   pS->skyEmission      = aBackground[0];
+   pS->groundReflection = aBackground[1];
+
+   /* use vertexs and materials in place, and make triangles of them */
+   pS->aVertexs         = aBackground + 2;
+   pS->vertexsLength    = pHeader->vertexsLength;
+   pS->aMaterials       = (Material*)(pS->aVertexs + pS->vertexsLength);
+   pS->materialsLength  = pHeader->materialsLength;
+   pS->trianglesLength  = pHeader->trianglesLength;
+   pS->pObjectsMap      = pMap;
+   pS->objectsMapLength = mapLength;
+
+   pS->aTriangles = (Triangle*)throwAllocExceptions( jmpBuf,
+      calloc( pS->trianglesLength + 1, sizeof(Triangle) ) );
+   makeTriangles( pS, aIndexs, pS->trianglesLength, pS->aTriangles );
+   findEmitters( pS, jmpBuf );
+
+   /* use portals' vertexs in place too */
+   pS->aPortalVertexs = (Vector3f*)(aIndexs + ((size_t)pS->trianglesLength *
+      4));
+   pS->portalsLength  = pHeader->portalsLength;
+   makePortals( pS, jmpBuf );
 
    return pS;
 }
@@ -123,9 +1207,44 @@ void SceneDestruct
    Scene* pS
 )
 {
-   SpatialIndexDestruct( pS->pIndex );
-   free( pS->apEmitters );
+   if( pS->pIndexMap )
+   {
+      munmap( pS->pIndexMap, pS->indexMapLength );
+   }
+   else if( pS->pIndex )
+   {
+      SpatialIndexDestruct( pS->pIndex );
+   }
+   if( pS->pInstanceIndex )
+   {
+      InstanceIndexDestruct( pS->pInstanceIndex );
+   }
+   {
+      int32 i;
+      for( i = pS->prototypesLength;  i-- > 0; )
+      {
+         SpatialIndexDestruct( (SpatialIndex*)pS->aPrototypes[i].pIndex );
+      }
+   }
+   free( pS->aInstances );
+   free( pS->aPrototypes );
+
+   LightTreeDestruct( pS->pLightTree );
+   free( (Instance**)pS->apEmitterInstances );
+   free( (Triangle**)pS->apEmitters );
    free( pS->aTriangles );
+   free( pS->aPortalAreas );
+   free( pS->aPortals );
+   if( pS->pObjectsMap )
+   {
+      munmap( pS->pObjectsMap, pS->objectsMapLength );
+   }
+   else
+   {
+      free( pS->aPortalVertexs );
+      free( pS->aMaterials );
+      free( pS->aVertexs );
+   }
 
    free( pS );
 }
@@ -133,29 +1252,295 @@ void SceneDestruct
 
 
 
+/* commands ----------------------------------------------------------------- */
+
+void SceneIndex
+(
+   Scene*          pS,
+   jmp_buf         jmpBuf,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+)
+{
+   STATS_TIMER_BEGIN( STATS_PHASE_INDEX )
+   pS->pIndex = (SpatialIndex*)SpatialIndexConstruct( aEyePositions,
+      eyesLength, pS->aTriangles, pS->trianglesLength, jmpBuf );
+   STATS_TIMER_END( STATS_PHASE_INDEX )
+
+   makeReflectorsBound( pS );
+   weighSky( pS, aEyePositions, eyesLength );
+}
+
+
+bool SceneIndexMapped
+(
+   Scene*          pS,
+   void*           pMap,
+   size_t          mapLength,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+)
+{
+   STATS_TIMER_BEGIN( STATS_PHASE_INDEX )
+   pS->pIndex = (SpatialIndex*)SpatialIndexConstructMapped( pMap, mapLength,
+      pS->aTriangles, pS->trianglesLength );
+   STATS_TIMER_END( STATS_PHASE_INDEX )
+
+   if( pS->pIndex )
+   {
+      pS->pIndexMap      = pMap;
+      pS->indexMapLength = mapLength;
+
+      makeReflectorsBound( pS );
+      weighSky( pS, aEyePositions, eyesLength );
+   }
+
+   return 0 != pS->pIndex;
+}
+
+
+
+
 /* queries ------------------------------------------------------------------ */
 
-void SceneIntersection
+void SceneWrite
+(
+   const Scene* pS,
+   jmp_buf      jmpBuf,
+   FILE*        pOut_o
+)
+{
+   WrittenHeader header;
+   int32         i;
+
+   memset( &header, 0, sizeof(header) );
+   memcpy( header.aId, WRITTEN_ID, sizeof(header.aId) );
+   header.realSize        = (int32)sizeof(real64);
+   header.vertexsLength   = pS->vertexsLength;
+   header.materialsLength = pS->materialsLength;
+   header.trianglesLength = pS->trianglesLength;
+   header.portalsLength   = pS->portalsLength;
+
+   throwExceptions( jmpBuf,
+      (1 != fwrite( &header, sizeof(header), 1, pOut_o )) ||
+      (1 != fwrite( &pS->skyEmission, sizeof(Vector3f), 1, pOut_o )) ||
+      (1 != fwrite( &pS->groundReflection, sizeof(Vector3f), 1, pOut_o )) ||
+      ((size_t)pS->vertexsLength != fwrite( pS->aVertexs, sizeof(Vector3f),
+      pS->vertexsLength, pOut_o )) ||
+      ((size_t)pS->materialsLength != fwrite( pS->aMaterials,
+      sizeof(Material), pS->materialsLength, pOut_o )), ERROR_WRITE_IO );
+
+   /* triangles, as indexs */
+   for( i = 0;  i < pS->trianglesLength;  ++i )
+   {
+      const Triangle* pT = &pS->aTriangles[i];
+      int32 aIndexs[4];
+
+      aIndexs[0] = (int32)(pT->apVertexs[0] - pS->aVertexs);
+      aIndexs[1] = (int32)(pT->apVertexs[1] - pS->aVertexs);
+      aIndexs[2] = (int32)(pT->apVertexs[2] - pS->aVertexs);
+      aIndexs[3] = (int32)(pT->pMaterial - pS->aMaterials);
+
+      throwExceptions( jmpBuf, (1 != fwrite( aIndexs, sizeof(aIndexs), 1,
+         pOut_o )), ERROR_WRITE_IO );
+   }
+
+   throwExceptions( jmpBuf, ((size_t)pS->portalsLength * 3 != fwrite(
+      pS->aPortalVertexs, sizeof(Vector3f), (size_t)pS->portalsLength * 3,
+      pOut_o )), ERROR_WRITE_IO );
+}
+
+
+void SceneWriteText
+(
+   const Scene* pS,
+   jmp_buf      jmpBuf,
+   FILE*        pOut_o
+)
+{
+   int32 i, j;
+   int   k;
+
+   Vector3fWrite( &pS->skyEmission, jmpBuf, pOut_o );
+   throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+   Vector3fWrite( &pS->groundReflection, jmpBuf, pOut_o );
+   throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, "\n\n" ) );
+
+   /* own triangles, then each prototype's, as a definition */
+   for( i = -1;  i < pS->prototypesLength;  ++i )
+   {
+      const Triangle* aTriangles = (i < 0) ? pS->aTriangles :
+         pS->aPrototypes[i].aTriangles;
+      const int32     length     = (i < 0) ? pS->trianglesLength :
+         pS->aPrototypes[i].trianglesLength;
+
+      if( i >= 0 )
+      {
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o,
+            "\nobject p%i\n", i ) );
+      }
+
+      for( j = 0;  j < length;  ++j )
+      {
+         for( k = 0;  k < 3;  ++k )
+         {
+            Vector3fWrite( aTriangles[j].apVertexs[k], jmpBuf, pOut_o );
+            throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+         }
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+         Vector3fWrite( &aTriangles[j].pMaterial->reflectivity, jmpBuf,
+            pOut_o );
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+         Vector3fWrite( &aTriangles[j].pMaterial->emitivity, jmpBuf,
+            pOut_o );
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, "\n" ) );
+      }
+
+      if( i >= 0 )
+      {
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, "end\n" ) );
+      }
+   }
+
+   /* instances: axes and origin are the to-world transform's columns */
+   for( i = 0;  i < pS->instancesLength;  ++i )
+   {
+      const Instance* pI = &pS->aInstances[i];
+
+      throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o,
+         "\ninstance p%i", (int)(pI->pPrototype - pS->aPrototypes) ) );
+      for( k = 0;  k < 4;  ++k )
+      {
+         Vector3f column;
+         for( j = 3;  j-- > 0;  column.xyz[j] = pI->aToWorld[(j * 4) + k] ) {}
+
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+         Vector3fWrite( &column, jmpBuf, pOut_o );
+      }
+   }
+
+   for( i = 0;  i < pS->portalsLength;  ++i )
+   {
+      throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, "\nportal" ) );
+      for( k = 0;  k < 3;  ++k )
+      {
+         throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, " " ) );
+         Vector3fWrite( pS->aPortals[i].apVertexs[k], jmpBuf, pOut_o );
+      }
+   }
+   throwWriteExceptions( pOut_o, jmpBuf, fprintf( pOut_o, "\n" ) );
+}
+
+
+void SceneWriteIndex
+(
+   const Scene* pS,
+   jmp_buf      jmpBuf,
+   FILE*        pOut_o
+)
+{
+   SpatialIndexWrite( pS->pIndex, jmpBuf, pOut_o );
+}
+
+
+int SceneMappedParts
+(
+   const Scene*  pS,
+   const byteu*  apParts_o[2],
+   size_t        aLengths_o[2]
+)
+{
+   int parts = 0;
+
+   if( pS->pObjectsMap )
+   {
+      apParts_o[parts]    = (const byteu*)pS->pObjectsMap;
+      aLengths_o[parts++] = pS->objectsMapLength;
+   }
+   if( pS->pIndexMap )
+   {
+      const size_t offset = SpatialIndexMappedBlocks( pS->pIndexMap );
+      apParts_o[parts]    = (const byteu*)pS->pIndexMap + offset;
+      aLengths_o[parts++] = pS->indexMapLength - offset;
+   }
+
+   return parts;
+}
+
+
+bool SceneIsIndexed
 (
-   const Scene*     pS,
-   const Vector3f*  pRayOrigin,
-   const Vector3f*  pRayDirection,
-   const void*      lastHit,
-   const Triangle** ppHitObject_o,
-   Vector3f*        pHitPosition_o
+   const Scene*    pS,
+   const Vector3f* pEyePosition
+)
+{
+   int i;
+   for( i = 6;  pS->pIndex && (i-- > 0); )
+   {
+      const real64 p = pEyePosition->xyz[i % 3];
+      if( (i > 2) ? (p > pS->pIndex->aBound[i]) : (p < pS->pIndex->aBound[i]) )
+      {
+         return false;
+      }
+   }
+
+   return 0 != pS->pIndex;
+}
+
+
+bool SceneIntersection
+(
+   const Scene*        pS,
+   const Vector3f*     pRayOrigin,
+   const Vector3f*     pRayDirection,
+   const SurfacePoint* pLast,
+   SurfacePoint*       pHit_o
 )
 {
-   SpatialIndexIntersection( pS->pIndex, pRayOrigin, pRayDirection, lastHit,
-      0, ppHitObject_o, pHitPosition_o );
+   const Triangle* pHitObject   = 0;
+   const Instance* pHitInstance = 0;
+   Vector3f        hitPosition  = Vector3fZERO, start;
+
+   /* own triangles (a ray from an instance may start outside their index) */
+   if( !(pLast && pLast->pInstance) )
+   {
+      SpatialIndexIntersection( pS->pIndex, pRayOrigin, pRayDirection,
+         pLast ? pLast->pTriangle : 0, 0, &pHitObject, &hitPosition );
+   }
+   else if( SpatialIndexEnter( pS->pIndex, pRayOrigin, pRayDirection,
+      REAL64_MAX, &start ) )
+   {
+      SpatialIndexIntersection( pS->pIndex, pRayOrigin, pRayDirection, 0,
+         &start, &pHitObject, &hitPosition );
+   }
+
+   /* instances' triangles, if nearer */
+   if( pS->pInstanceIndex )
+   {
+      const Vector3f ray      = Vector3fSub( &hitPosition, pRayOrigin );
+      real64         distance = pHitObject ?
+         sqrt( Vector3fDot( &ray, &ray ) ) : REAL64_MAX;
+
+      InstanceIndexIntersection( pS->pInstanceIndex, pRayOrigin,
+         pRayDirection, pLast ? pLast->pTriangle : 0, pLast ?
+         pLast->pInstance : 0, &distance, &pHitObject, &pHitInstance,
+         &hitPosition );
+   }
+
+   if( pHitObject )
+   {
+      *pHit_o = SurfacePointCreate( pHitObject, pHitInstance, &hitPosition );
+   }
+
+   return 0 != pHitObject;
 }
 
 
-void SceneEmitter
+bool SceneEmitter
 (
-   const Scene*     pS,
-   Random*          pRandom,
-   Vector3f*        pPosition_o,
-   const Triangle** pId_o
+   const Scene*        pS,
+   Random*             pRandom,
+   SurfacePoint*       pEmitter_o
 )
 {
    if( pS->emittersLength > 0 )
@@ -166,14 +1551,49 @@ void SceneEmitter
       index = index < pS->emittersLength ? index : pS->emittersLength - 1;
 
       /* choose position on emitter */
-      *pPosition_o = TriangleSamplePoint( pS->apEmitters[index], pRandom );
-      *pId_o       = pS->apEmitters[index];
+      *pEmitter_o = emitterPoint( pS, index, pRandom );
    }
-   else
+
+   return pS->emittersLength > 0;
+}
+
+
+bool SceneEmitterToward
+(
+   const Scene*        pS,
+   const Vector3f*     pPosition,
+   const Vector3f*     pNormal,
+   Random*             pRandom,
+   SurfacePoint*       pEmitter_o,
+   real64*             pProbability_o
+)
+{
+   /* select emitter */
+   const int32 index = LightTreeSelect( pS->pLightTree, pPosition, pNormal,
+      pRandom, pProbability_o );
+
+   /* choose position on emitter */
+   if( index >= 0 )
    {
-      *pPosition_o = Vector3fZERO;
-      *pId_o       = 0;
+      *pEmitter_o = emitterPoint( pS, index, pRandom );
    }
+
+   return index >= 0;
+}
+
+
+real64 SceneEmitterProbability
+(
+   const Scene*        pS,
+   const Vector3f*     pPosition,
+   const Vector3f*     pNormal,
+   const SurfacePoint* pEmitter
+)
+{
+   const int32 index = emitterIndex( pS, pEmitter );
+
+   return (index >= 0) ? LightTreeProbability( pS->pLightTree, pPosition,
+      pNormal, index ) : 0.0;
 }
 
 
@@ -187,3 +1607,168 @@ Vector3f SceneDefaultEmission
    return (pBackDirection->xyz[1] < 0.0) ?
       pS->skyEmission : Vector3fMulV( &pS->skyEmission, &pS->groundReflection );
 }
+
+
+real64 SceneSkyDirection
+(
+   const Scene*    pS,
+   const Vector3f* pPosition,
+   Random*         pRandom,
+   Vector3f*       pDirection_o
+)
+{
+   const Vector3f ground    = Vector3fMulV( &pS->skyEmission,
+      &pS->groundReflection );
+   const real64   skyLum    = Vector3fDot( &pS->skyEmission, &RGB_LUMINANCE );
+   const real64   groundLum = Vector3fDot( &ground, &RGB_LUMINANCE );
+   real64         pdf       = 0.0;
+
+   if( ((skyLum + groundLum) > 0.0) && (pS->portalsArea > 0.0) )
+   {
+      /* choose portal, by area, and a point on it */
+      Vector3f toPoint = TriangleSamplePoint( choosePortal( pS, pRandom ),
+         pRandom );
+      toPoint = Vector3fSub( &toPoint, pPosition );
+      *pDirection_o = Vector3fUnitized( &toPoint );
+
+      /* (any other portals it passes through count too) */
+      pdf = Vector3fIsZero( pDirection_o ) ? 0.0 : portalsPdf( pS, pPosition,
+         pDirection_o );
+   }
+   else if( (skyLum + groundLum) > 0.0 )
+   {
+      /* choose sky (upward) or ground (downward), by luminance */
+      const real64 skyChance = skyLum / (skyLum + groundLum);
+      const bool   isSky     = RandomReal64( pRandom ) < skyChance;
+
+      /* half uniform over the hemisphere (for light through openings), half
+         cosine-weighted about the vertical (for light onto open ground) */
+      const real64 r      = RandomReal64( pRandom );
+      const real64 height = (RandomReal64( pRandom ) < 0.5) ? r :
+         sqrt( 1.0 - r );
+      const real64 radius = sqrt( 1.0 - (height * height) );
+      const real64 round  = PI * 2.0 * RandomReal64( pRandom );
+
+      pDirection_o->xyz[0] = cos( round ) * radius;
+      pDirection_o->xyz[1] = isSky ? height : -height;
+      pDirection_o->xyz[2] = sin( round ) * radius;
+
+      pdf = (isSky ? skyChance : 1.0 - skyChance) * hemispherePdf( height );
+   }
+
+   return pdf;
+}
+
+
+real64 SceneSkyPdf
+(
+   const Scene*    pS,
+   const Vector3f* pPosition,
+   const Vector3f* pDirection
+)
+{
+   const Vector3f ground    = Vector3fMulV( &pS->skyEmission,
+      &pS->groundReflection );
+   const real64   skyLum    = Vector3fDot( &pS->skyEmission, &RGB_LUMINANCE );
+   const real64   groundLum = Vector3fDot( &ground, &RGB_LUMINANCE );
+
+   /* (upward as SceneDefaultEmission sees the sky) */
+   return ((skyLum + groundLum) > 0.0) ? ((pS->portalsArea > 0.0) ?
+      portalsPdf( pS, pPosition, pDirection ) : ((pDirection->xyz[1] > 0.0 ?
+      skyLum : groundLum) / (skyLum + groundLum)) *
+      hemispherePdf( fabs( pDirection->xyz[1] ) )) : 0.0;
+}
+
+
+bool SceneSkyPhoton
+(
+   const Scene* pS,
+   Random*      pRandom,
+   Vector3f*    pPosition_o,
+   Vector3f*    pDirection_o,
+   Vector3f*    pPower_o
+)
+{
+   real64   scale = 0.0;
+   Vector3f u, v, emission;
+
+   if( pS->portalsArea > 0.0 )
+   {
+      /* a point on a portal, and a cosine-weighted direction about its
+         normal, on either side */
+      const Triangle* pPortal = choosePortal( pS, pRandom );
+      const real64    round   = PI * 2.0 * RandomReal64( pRandom );
+      const real64    radius  = sqrt( RandomReal64( pRandom ) );
+      const real64    height  = sqrt( 1.0 - (radius * radius) ) *
+         (RandomReal64( pRandom ) < 0.5 ? 1.0 : -1.0);
+      const Vector3f  normal  = TriangleNormal( pPortal );
+      Vector3f        back;
+      SurfacePoint    hit;
+
+      *pPosition_o = TriangleSamplePoint( pPortal, pRandom );
+      squareTo( &normal, &u, &v );
+      u = Vector3fMulF( &u, cos( round ) * radius );
+      v = Vector3fMulF( &v, sin( round ) * radius );
+      *pDirection_o = Vector3fMulF( &normal, height );
+      *pDirection_o = Vector3fAdd( pDirection_o, &u );
+      *pDirection_o = Vector3fAdd( pDirection_o, &v );
+
+      /* only if the sky is seen back through it (so going in, not out);
+         densities: of area 1 / portals' area, of projected solid angle
+         1 / 2pi */
+      back = Vector3fNegative( pDirection_o );
+      if( !SceneIntersection( pS, pPosition_o, &back, 0, &hit ) )
+      {
+         scale = PI * 2.0 * pS->portalsArea;
+      }
+   }
+   else
+   {
+      /* a direction from the sky or ground, and a point on a disc square to
+         it, across the reflectors' bounding sphere, just outside it */
+      const real64* aB = pS->aReflectorsBound;
+      Vector3f      centre, toSky;
+      real64        sphere, pdf = 0.0;
+      int           j;
+
+      for( j = 3;  j-- > 0;  centre.xyz[j] = (aB[j] + aB[j + 3]) * 0.5 ) {}
+      sphere = 1.01 * 0.5 * sqrt( ((aB[3] - aB[0]) * (aB[3] - aB[0])) +
+         ((aB[4] - aB[1]) * (aB[4] - aB[1])) +
+         ((aB[5] - aB[2]) * (aB[5] - aB[2])) );
+
+      if( aB[0] <= aB[3] )
+      {
+         pdf = SceneSkyDirection( pS, &centre, pRandom, &toSky );
+      }
+      if( pdf > 0.0 )
+      {
+         SurfacePoint hit;
+         const real64 round  = PI * 2.0 * RandomReal64( pRandom );
+         const real64 radius = sphere * sqrt( RandomReal64( pRandom ) );
+
+         squareTo( &toSky, &u, &v );
+         u = Vector3fMulF( &u, cos( round ) * radius );
+         v = Vector3fMulF( &v, sin( round ) * radius );
+         *pPosition_o = Vector3fMulF( &toSky, sphere );
+         *pPosition_o = Vector3fAdd( pPosition_o, &centre );
+         *pPosition_o = Vector3fAdd( pPosition_o, &u );
+         *pPosition_o = Vector3fAdd( pPosition_o, &v );
+         *pDirection_o = Vector3fNegative( &toSky );
+
+         /* only if the sky is seen back (past any emitters outside);
+            densities: of area 1 / disc's area, of direction pdf (the disc
+            being square to it) */
+         if( !SceneIntersection( pS, pPosition_o, &toSky, 0, &hit ) )
+         {
+            scale = PI * sphere * sphere / pdf;
+         }
+      }
+   }
+
+   /* (SceneDefaultEmission takes the direction the light goes) */
+   emission  = (scale > 0.0) ? SceneDefaultEmission( pS, pDirection_o ) :
+      Vector3fZERO;
+   *pPower_o = Vector3fMulF( &emission, scale );
+
+   return !Vector3fIsZero( pPower_o );
+}
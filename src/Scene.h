@@ -12,6 +12,7 @@
 #define Scene_h
 
 
+#include <stddef.h>
 #include <stdio.h>
 #include <setjmp.h>
 
@@ -20,6 +21,10 @@
 #include "Vector3f.h"
 #include "Triangle.h"
 #include "SpatialIndex.h"
+#include "Instance.h"
+#include "InstanceIndex.h"
+#include "LightTree.h"
+#include "SurfacePoint.h"
 
 
 
@@ -27,30 +32,95 @@
 /**
  * Collection of objects in the environment.<br/><br/>
  *
+ * Triangles share vertexs and materials: equal ones (exactly, bit for bit)
+ * are welded when read, so each is held once.<br/><br/>
+ *
+ * Objects defined once can be placed many times, by instances: their
+ * triangles and indexs are held once, whatever the number of instances (see
+ * Instance and InstanceIndex).<br/><br/>
+ *
+ * Triangles can also be imported from mesh files made by other programs (see
+ * Import), into the scene or a definition.<br/><br/>
+ *
+ * Openings the sky is seen through (windows) can be marked by portals:
+ * triangles that are not objects (nothing hits them), only for sampling the
+ * sky through, instead of over its whole hemisphere.<br/><br/>
+ *
+ * The objects and index can be written, and used again from memory mappings
+ * of what was written (see SceneCache).<br/><br/>
+ *
+ * There is no set maximum of objects: counts and indexs are int32 (so up to
+ * 2^31 - 1 of each), and sizes in bytes are size_t; beyond that, reading
+ * fails as for lack of memory.<br/><br/>
+ *
  * Constant.
  *
  * @invariants
- * * trianglesLength < MAX_TRIANGLES and >= 0
- * * emittersLength  < MAX_TRIANGLES and >= 0
- * * pIndex is not 0
+ * * trianglesLength < INT32_MAX and >= 0
+ * * vertexsLength   <= trianglesLength * 3 and >= 0
+ * * materialsLength <= trianglesLength and >= 0
+ * * pInstanceIndex is not 0 if instancesLength > 0
+ * * emittersLength  >= 0
+ * * portalsLength   >= 0
+ * * pIndex is not 0 (once indexed)
  * * skyEmission      >= 0
  * * groundReflection >= 0 and <= 1
+ * * skyProbability   >= 0 and <= 1
  */
 
 struct Scene
 {
-   /* objects */
-   Triangle*     aTriangles;
-   int32         trianglesLength;
-
-   Triangle**    apEmitters;
-   int32         emittersLength;
-
-   SpatialIndex* pIndex;
+   /* objects, and what they share */
+   Triangle*        aTriangles;
+   int32            trianglesLength;
+
+   Vector3f*        aVertexs;
+   int32            vertexsLength;
+   Material*        aMaterials;
+   int32            materialsLength;
+
+   /* prototypes (their triangles following the scene's own, in
+      aTriangles), and instances placing them, with their index */
+   Prototype*       aPrototypes;
+   int32            prototypesLength;
+   Instance*        aInstances;
+   int32            instancesLength;
+   InstanceIndex*   pInstanceIndex;
+
+   /* emitting triangles, and instances placing them (or 0), with a tree
+      over them */
+   const Triangle** apEmitters;
+   const Instance** apEmitterInstances;
+   int32            emittersLength;
+   LightTree*       pLightTree;
+
+   SpatialIndex*    pIndex;
+
+   /* portals, with their vertexs (three each), running totals of their
+      areas, and total area */
+   Triangle*        aPortals;
+   int32            portalsLength;
+   Vector3f*        aPortalVertexs;
+   real64*          aPortalAreas;
+   real64           portalsArea;
 
    /* background */
-   Vector3f      skyEmission;
-   Vector3f      groundReflection;
+   Vector3f         skyEmission;
+   Vector3f         groundReflection;
+
+   /* probability of sampling the sky (and ground) instead of an emitter --
+      by the light each gives around the eyes -- and bound of the objects
+      that are not emitters, which sky photons are sent across (both set
+      when indexed) */
+   real64           skyProbability;
+   real64           aReflectorsBound[6];
+
+   /* mappings holding the vertexs and materials, and index, instead of
+      allocations, or 0 */
+   void*            pObjectsMap;
+   size_t           objectsMapLength;
+   void*            pIndexMap;
+   size_t           indexMapLength;
 };
 
 typedef struct Scene Scene;
@@ -60,11 +130,27 @@ typedef struct Scene Scene;
 
 /* initialisation ----------------------------------------------------------- */
 
-const Scene* SceneConstruct
+/**
+ * Read objects (without indexing them -- see SceneIndex).
+ */
+Scene* SceneConstruct
 (
    FILE*           pIn,
-   jmp_buf         jmpBuf,
-   const Vector3f* pEyePosition
+   jmp_buf         jmpBuf
+);
+
+/**
+ * Make from a mapping of what SceneWrite wrote, using its vertexs and
+ * materials in place (the scene takes the mapping, and unmaps it when
+ * destructed).
+ *
+ * @return 0 if the mapping is not a valid scene (and then not taken)
+ */
+Scene* SceneConstructMapped
+(
+   void*           pMap,
+   size_t          mapLength,
+   jmp_buf         jmpBuf
 );
 
 void SceneDestruct
@@ -75,30 +161,161 @@ void SceneDestruct
 
 
 
+/* commands ----------------------------------------------------------------- */
+
+/**
+ * Make index of objects (before any queries).
+ *
+ * @param aEyePositions all viewpoints to be rendered from (at least one)
+ */
+void SceneIndex
+(
+   Scene*          pS,
+   jmp_buf         jmpBuf,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+);
+
+
+
+
+/**
+ * Take index from a mapping of what SceneWriteIndex wrote (instead of
+ * SceneIndex) -- see SpatialIndexConstructMapped.
+ *
+ * @param aEyePositions as for SceneIndex
+ * @return whether the mapping was a valid index (else it is not taken)
+ */
+bool SceneIndexMapped
+(
+   Scene*          pS,
+   void*           pMap,
+   size_t          mapLength,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+);
+
+
+
+
 /* queries ------------------------------------------------------------------ */
 
+/**
+ * Write objects and background, for SceneConstructMapped (on the same
+ * platform).
+ */
+void SceneWrite
+(
+   const Scene*,
+   jmp_buf          jmpBuf,
+   FILE*            pOut_o
+);
+
+/**
+ * Write objects and background in the model file format (the scene part of
+ * it: with instances, but imported triangles included as plain triangles).
+ */
+void SceneWriteText
+(
+   const Scene*,
+   jmp_buf          jmpBuf,
+   FILE*            pOut_o
+);
+
+/**
+ * Write index, for SceneIndexMapped.
+ */
+void SceneWriteIndex
+(
+   const Scene*,
+   jmp_buf          jmpBuf,
+   FILE*            pOut_o
+);
+
+/**
+ * Parts of the mappings (see SceneConstructMapped and SceneIndexMapped) that
+ * are only read -- all the objects', and the index's leaf blocks -- so can be
+ * released and paged in again from their files.
+ *
+ * @param apParts_o start of each part
+ * @param aLengths_o bytes of each part
+ * @return number of parts (0 to 2)
+ */
+int SceneMappedParts
+(
+   const Scene*,
+   const byteu*      apParts_o[2],
+   size_t            aLengths_o[2]
+);
+
+/**
+ * Whether a viewpoint is inside the index (so can be rendered from).
+ */
+bool SceneIsIndexed
+(
+   const Scene*,
+   const Vector3f* pEyePosition
+);
+
 /**
  * Find nearest intersection of ray with object.
+ *
+ * @param pRayDirection unitized
+ * @param pLast surface ray starts from (not to be hit), or 0
+ * @return whether hit (and then pHit_o set)
  */
-void SceneIntersection
+bool SceneIntersection
 (
    const Scene*,
-   const Vector3f*  pRayOrigin,
-   const Vector3f*  pRayDirection,
-   const void*      lastHit,
-   const Triangle** ppHitObject_o,
-   Vector3f*        pHitPosition_o
+   const Vector3f*     pRayOrigin,
+   const Vector3f*     pRayDirection,
+   const SurfacePoint* pLast,
+   SurfacePoint*       pHit_o
 );
 
 /**
  * Monte-carlo sample point on monte-carlo selected emitting object.
+ *
+ * @return whether any emitter (and then pEmitter_o set)
  */
-void SceneEmitter
+bool SceneEmitter
 (
    const Scene*,
-   Random*          pRandom,
-   Vector3f*        pPosition_o,
-   const Triangle** pId_o
+   Random*             pRandom,
+   SurfacePoint*       pEmitter_o
+);
+
+/**
+ * Monte-carlo sample point on an emitting object, selected by its estimated
+ * contribution to a surface point (see LightTree).
+ *
+ * @param pNormal of the surface, on the side light is received
+ * @param pProbability_o probability of selecting the object
+ * @return whether any emitter (and then pEmitter_o set)
+ */
+bool SceneEmitterToward
+(
+   const Scene*,
+   const Vector3f*     pPosition,
+   const Vector3f*     pNormal,
+   Random*             pRandom,
+   SurfacePoint*       pEmitter_o,
+   real64*             pProbability_o
+);
+
+/**
+ * Probability of SceneEmitterToward selecting an emitting object.
+ *
+ * @param pNormal as for SceneEmitterToward
+ * @param pEmitter point on the object
+ * @return probability (0 if not an emitter)
+ */
+real64 SceneEmitterProbability
+(
+   const Scene*,
+   const Vector3f*     pPosition,
+   const Vector3f*     pNormal,
+   const SurfacePoint* pEmitter
 );
 
 /**
@@ -106,6 +323,11 @@ void SceneEmitter
  */
 #define SceneEmittersCount( pS ) ((pS)->emittersLength)
 
+/**
+ * Probability of sampling the sky (and ground) instead of an emitter.
+ */
+#define SceneSkyProbability( pS ) ((pS)->skyProbability)
+
 /**
  * Default/'background' light of scene universe.
  */
@@ -115,16 +337,53 @@ Vector3f SceneDefaultEmission
    const Vector3f* pBackDirection
 );
 
+/**
+ * Monte-carlo direction toward the sky or ground: through a portal (chosen by
+ * area), if any, else into the sky's or ground's hemisphere (chosen by their
+ * luminances).
+ *
+ * @return probability density (per solid angle), or 0 if neither emits, or
+ * the direction is degenerate (and then pDirection_o not usable)
+ */
+real64 SceneSkyDirection
+(
+   const Scene*,
+   const Vector3f* pPosition,
+   Random*         pRandom,
+   Vector3f*       pDirection_o
+);
 
-
-
-/* constants ---------------------------------------------------------------- */
+/**
+ * Probability density (per solid angle) of SceneSkyDirection choosing a
+ * direction.
+ */
+real64 SceneSkyPdf
+(
+   const Scene*,
+   const Vector3f* pPosition,
+   const Vector3f* pDirection
+);
 
 /**
- * Maximum number of objects in Scene.
- * (2^24 ~= 16 million)
+ * Monte-carlo photon of the sky's (and ground's) light coming into the scene:
+ * through a portal (chosen by area), if any, in a cosine-weighted direction
+ * either way, else across the bounding sphere of the objects that are not
+ * emitters (so a far sun does not thin them), from a direction as
+ * SceneSkyDirection chooses -- either only if the sky is seen back from where
+ * it starts.
+ *
+ * @param pPower_o its power: radiance divided by the probability densities of
+ * its position (per area) and direction (per projected solid angle)
+ * @return whether there is one (else the outputs are not usable)
  */
-#define MAX_TRIANGLES ((int32)0x1000000)
+bool SceneSkyPhoton
+(
+   const Scene*,
+   Random*         pRandom,
+   Vector3f*       pPosition_o,
+   Vector3f*       pDirection_o,
+   Vector3f*       pPower_o
+);
 
 
 
@@ -0,0 +1,505 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "Exceptions.h"
+#include "Hash.h"
+
+#include "SceneCache.h"
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Stored file, for eviction.
+ */
+struct Stored
+{
+   char*           sPathname;
+   long64u         size;
+   struct timespec used;
+};
+
+typedef struct Stored Stored;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static bool hasSuffix
+(
+   const char* s,
+   const char* sSuffix
+)
+{
+   const size_t length = strlen( s ), suffixLength = strlen( sSuffix );
+
+   return (length >= suffixLength) &&
+      !strcmp( s + length - suffixLength, sSuffix );
+}
+
+
+/**
+ * @return pathname (to be freed), or 0 if allocation failed
+ */
+static char* makePathname
+(
+   const char* sDirectory,
+   const char* sName
+)
+{
+   char* sPathname = (char*)malloc( strlen( sDirectory ) + strlen( sName ) +
+      2 );
+   if( sPathname )
+   {
+      sprintf( sPathname, "%s/%s", sDirectory, sName );
+   }
+
+   return sPathname;
+}
+
+
+/**
+ * Read all the rest of a stream into memory (terminated, after its length).
+ */
+static char* readRest
+(
+   jmp_buf jmpBuf,
+   FILE*   pIn,
+   size_t* pLength_o
+)
+{
+   size_t capacity = 4096;
+   char*  pText    = (char*)throwAllocExceptions( jmpBuf, malloc( capacity ) );
+
+   *pLength_o = 0;
+   for( ;; )
+   {
+      *pLength_o += fread( pText + *pLength_o, 1, capacity - *pLength_o, pIn );
+      if( *pLength_o < capacity )
+      {
+         break;
+      }
+
+      capacity *= 2;
+      pText = (char*)throwAllocExceptions( jmpBuf, realloc( pText,
+         capacity ) );
+   }
+   throwExceptions( jmpBuf, (bool)ferror( pIn ), ERROR_READ_IO );
+
+   /* (less than capacity, so there is room) */
+   pText[*pLength_o] = 0;
+
+   return pText;
+}
+
+
+/**
+ * Add the identity (pathname, size, and modification time) of each mesh file
+ * the model text imports to a hash -- so a stored scene is of the files as
+ * they were.
+ */
+static long64u hashImports
+(
+   const char* pText,
+   long64u     hash
+)
+{
+   const char* p;
+   for( p = pText;  (p = strstr( p, "import" ));  p += 6 )
+   {
+      char        sName[1024];
+      struct stat status;
+
+      /* (anything else containing the word only adds to the hash) */
+      if( (1 == sscanf( p + 6, "%1023s", sName )) && !stat( sName, &status ) )
+      {
+         hash = HashBytes( sName, strlen( sName ), hash );
+         hash = HashBytes( &status.st_size, sizeof(status.st_size), hash );
+         hash = HashBytes( &status.st_mtim, sizeof(status.st_mtim), hash );
+      }
+   }
+
+   return hash;
+}
+
+
+/**
+ * Map a stored file, privately, and mark it as used.
+ *
+ * @return mapping, or 0 if none
+ */
+static void* mapFile
+(
+   const char* sPathname,
+   bool        isWritable,
+   size_t*     pLength_o
+)
+{
+   void*     pMap = 0;
+   const int file = open( sPathname, O_RDONLY );
+
+   if( -1 != file )
+   {
+      struct stat status;
+      if( !fstat( file, &status ) && (status.st_size > 0) )
+      {
+         *pLength_o = (size_t)status.st_size;
+         pMap = mmap( 0, *pLength_o, PROT_READ | (isWritable ? PROT_WRITE : 0),
+            MAP_PRIVATE, file, 0 );
+         pMap = (MAP_FAILED != pMap) ? pMap : 0;
+
+         /* (modification time serves as last use) */
+         futimens( file, 0 );
+      }
+      close( file );
+   }
+
+   return pMap;
+}
+
+
+static int compareUse
+(
+   const void* pA,
+   const void* pB
+)
+{
+   const struct timespec* a = &((const Stored*)pA)->used;
+   const struct timespec* b = &((const Stored*)pB)->used;
+
+   return (a->tv_sec != b->tv_sec) ? (a->tv_sec < b->tv_sec ? -1 : 1) :
+      (a->tv_nsec < b->tv_nsec ? -1 : (a->tv_nsec > b->tv_nsec ? 1 : 0));
+}
+
+
+/**
+ * Delete least recently used files until all are within the size limit.
+ */
+static void evict
+(
+   const char* sDirectory,
+   long64u     sizeLimit
+)
+{
+   DIR*    pDirectory = opendir( sDirectory );
+   Stored* aStored    = 0;
+   int32   length     = 0, i;
+   long64u total      = 0;
+
+   if( !pDirectory )
+   {
+      return;
+   }
+
+   /* list stored files */
+   for( ;; )
+   {
+      const struct dirent* pEntry = readdir( pDirectory );
+      struct stat status;
+      Stored*     aMore;
+      char*       sPathname;
+
+      if( !pEntry )
+      {
+         break;
+      }
+      if( !hasSuffix( pEntry->d_name, ".scene" ) &&
+         !hasSuffix( pEntry->d_name, ".index" ) )
+      {
+         continue;
+      }
+
+      sPathname = makePathname( sDirectory, pEntry->d_name );
+      aMore     = (Stored*)realloc( aStored, (length + 1) * sizeof(Stored) );
+      aStored   = aMore ? aMore : aStored;
+      if( !sPathname || !aMore || stat( sPathname, &status ) ||
+         !S_ISREG( status.st_mode ) )
+      {
+         free( sPathname );
+         continue;
+      }
+
+      aStored[length].sPathname = sPathname;
+      aStored[length].size      = (long64u)status.st_size;
+      aStored[length].used      = status.st_mtim;
+      total += aStored[length].size;
+      ++length;
+   }
+   closedir( pDirectory );
+
+   /* delete, oldest first */
+   qsort( aStored, length, sizeof(Stored), compareUse );
+   for( i = 0;  (i < length) && (total > sizeLimit);  ++i )
+   {
+      if( !unlink( aStored[i].sPathname ) )
+      {
+         total -= aStored[i].size;
+      }
+   }
+
+   for( i = length;  i-- > 0;  free( aStored[i].sPathname ) ) {}
+   free( aStored );
+}
+
+
+/**
+ * Write to the directory (whole, then renamed into place), and keep to the
+ * size limit -- ignoring any failure. Can also map what was written (before
+ * keeping to the limit, so the mapping stays usable even if it is deleted).
+ *
+ * @param pMapLength_o 0, or where to put the length of a mapping wanted
+ * @return mapping (writable, if isWritable), or 0 if none
+ */
+static void* store
+(
+   const char*  sDirectory,
+   long64u      sizeLimit,
+   const char*  sPathname,
+   const Scene* pScene,
+   void         (*write)( const Scene*, jmp_buf, FILE* ),
+   bool         isWritable,
+   size_t*      pMapLength_o
+)
+{
+   /* (volatile, since set between setjmp and longjmp) */
+   char* volatile sTemporary = 0;
+   FILE* volatile pOut       = 0;
+   void* volatile pMap       = 0;
+
+   jmp_buf   jmpBuf;
+   const int status = setjmp( jmpBuf );
+
+   /* try */
+   if( !status )
+   {
+      FILE* pClosing;
+
+      mkdir( sDirectory, 0777 );
+
+      sTemporary = (char*)throwAllocExceptions( jmpBuf,
+         malloc( strlen( sPathname ) + 32 ) );
+      sprintf( sTemporary, "%s.%ld.tmp", sPathname, (long)getpid() );
+
+      pOut = fopen( sTemporary, "wb" );
+      throwExceptions( jmpBuf, !pOut, ERROR_WRITE_IO );
+
+      write( pScene, jmpBuf, pOut );
+
+      pClosing = pOut;
+      pOut     = 0;
+      throwExceptions( jmpBuf, (EOF == fclose( pClosing )) ||
+         (0 != rename( sTemporary, sPathname )), ERROR_WRITE_IO );
+
+      if( pMapLength_o )
+      {
+         pMap = mapFile( sPathname, isWritable, pMapLength_o );
+      }
+
+      if( sizeLimit > 0 )
+      {
+         evict( sDirectory, sizeLimit );
+      }
+   }
+   /* catch: clean up */
+   else
+   {
+      if( pOut )
+      {
+         fclose( pOut );
+      }
+      if( sTemporary )
+      {
+         remove( sTemporary );
+      }
+   }
+
+   free( sTemporary );
+
+   return pMap;
+}
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+Scene* SceneCacheConstruct
+(
+   jmp_buf     jmpBuf,
+   const char* sDirectory,
+   long64u     sizeLimit,
+   bool        isPaged,
+   FILE*       pIn,
+   long64u*    pKey_o
+)
+{
+   /* (volatile, since set between setjmp and longjmp) */
+   char*  volatile pText     = 0;
+   char*  volatile sPathname = 0;
+   FILE*  volatile pTextIn   = 0;
+   Scene* volatile pS        = 0;
+
+   jmp_buf   jmpBufCache;
+   const int status = setjmp( jmpBufCache );
+
+   /* try */
+   if( !status )
+   {
+      size_t length = 0, mapLength = 0;
+      char   sName[32];
+      void*  pMap;
+
+      pText   = readRest( jmpBufCache, pIn, &length );
+      *pKey_o = hashImports( pText, HashBytes( pText, length,
+         HASH_START ) );
+      HashWrite( *pKey_o, sName );
+      strcat( sName, ".scene" );
+      sPathname = (char*)throwAllocExceptions( jmpBufCache,
+         makePathname( sDirectory, sName ) );
+
+      /* use stored scene, if there is a valid one */
+      pMap = mapFile( sPathname, false, &mapLength );
+      if( pMap && !(pS = SceneConstructMapped( pMap, mapLength,
+         jmpBufCache )) )
+      {
+         munmap( pMap, mapLength );
+      }
+
+      /* else read, and store */
+      if( !pS )
+      {
+         pTextIn = length ? fmemopen( pText, length, "r" ) : 0;
+         throwExceptions( jmpBufCache, !pTextIn, length ? ERROR_FILE :
+            ERROR_READ_TRUNC );
+
+         pS = SceneConstruct( pTextIn, jmpBufCache );
+         fclose( pTextIn );
+         pTextIn = 0;
+
+         /* (instanced scenes are not stored -- their prototypes are only
+            made when read) */
+         if( !pS->prototypesLength )
+         {
+            pMap = store( sDirectory, sizeLimit, sPathname, pS, SceneWrite,
+               false, isPaged ? &mapLength : 0 );
+
+            /* paged: use the stored copy instead */
+            if( pMap )
+            {
+               Scene* pMapped = SceneConstructMapped( pMap, mapLength,
+                  jmpBufCache );
+               if( pMapped )
+               {
+                  SceneDestruct( pS );
+                  pS = pMapped;
+               }
+               else
+               {
+                  munmap( pMap, mapLength );
+               }
+            }
+         }
+      }
+   }
+
+   /* finally: clean up (and, on failure, the scene) */
+   if( pTextIn )
+   {
+      fclose( pTextIn );
+   }
+   free( sPathname );
+   free( pText );
+   if( status && pS )
+   {
+      SceneDestruct( pS );
+   }
+
+   /* rethrow */
+   if( status )
+   {
+      longjmp( jmpBuf, status );
+   }
+
+   return pS;
+}
+
+
+void SceneCacheIndex
+(
+   jmp_buf         jmpBuf,
+   const char*     sDirectory,
+   long64u         sizeLimit,
+   bool            isPaged,
+   long64u         key,
+   Scene*          pScene,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+)
+{
+   size_t mapLength = 0;
+   char   sName[48];
+   char*  sPathname;
+   void*  pMap;
+
+   HashWrite( key, sName );
+   sName[16] = '-';
+   HashWrite( HashBytes( aEyePositions, (size_t)eyesLength *
+      sizeof(Vector3f), HASH_START ), sName + 17 );
+   strcat( sName, ".index" );
+   sPathname = (char*)throwAllocExceptions( jmpBuf,
+      makePathname( sDirectory, sName ) );
+
+   /* use stored index, if there is a valid one, else make, and store */
+   pMap = mapFile( sPathname, true, &mapLength );
+   if( !pMap || !SceneIndexMapped( pScene, pMap, mapLength, aEyePositions,
+      eyesLength ) )
+   {
+      if( pMap )
+      {
+         munmap( pMap, mapLength );
+      }
+
+      SceneIndex( pScene, jmpBuf, aEyePositions, eyesLength );
+      pMap = store( sDirectory, sizeLimit, sPathname, pScene, SceneWriteIndex,
+         true, isPaged ? &mapLength : 0 );
+
+      /* paged: use the stored copy instead */
+      if( pMap )
+      {
+         SpatialIndex* pBuilt = pScene->pIndex;
+         if( SceneIndexMapped( pScene, pMap, mapLength, aEyePositions,
+            eyesLength ) )
+         {
+            SpatialIndexDestruct( pBuilt );
+         }
+         else
+         {
+            munmap( pMap, mapLength );
+            pScene->pIndex = pBuilt;
+         }
+      }
+   }
+
+   free( sPathname );
+}
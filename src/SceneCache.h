@@ -0,0 +1,91 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef SceneCache_h
+#define SceneCache_h
+
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "Primitives.h"
+#include "Vector3f.h"
+#include "Scene.h"
+
+
+
+
+/**
+ * Directory of read and indexed scenes, kept across runs.<br/><br/>
+ *
+ * A scene is stored under a hash of its model text (the part SceneConstruct
+ * reads); an index under that and a hash of the eye positions it was made
+ * for (since they shape it). Later loads of the same text, and indexings for
+ * the same eyes, map the stored files instead of reading and building.
+ * <br/><br/>
+ *
+ * Files are named: "sceneHash.scene" and "sceneHash-eyesHash.index" (hashes
+ * as 16 hex digits). They are written whole then renamed, so concurrent runs
+ * can share a directory. Storing deletes the least recently used files
+ * (by modification time, updated on each use) until the total size is within
+ * the limit.<br/><br/>
+ *
+ * Failing to store or use files is not an error: it only falls back to
+ * reading and building. Scenes with instances are not stored (only their
+ * indexes). For scenes importing mesh files, the hash also covers each file's
+ * pathname, size, and modification time.<br/><br/>
+ *
+ * Paged: the stored copies are used even when just made, so the scene is held
+ * in the mappings -- whose read-only parts are paged in from the files on
+ * demand, and can be released again (see Pager) -- instead of in memory.
+ */
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Read a scene from the rest of a model stream, or its stored copy.
+ *
+ * @param sizeLimit bytes for the directory, or 0 for no limit
+ * @param isPaged whether to always use the stored copy
+ * @param pKey_o hash of the scene text (for SceneCacheIndex)
+ */
+Scene* SceneCacheConstruct
+(
+   jmp_buf     jmpBuf,
+   const char* sDirectory,
+   long64u     sizeLimit,
+   bool        isPaged,
+   FILE*       pIn,
+   long64u*    pKey_o
+);
+
+/**
+ * Index a scene (as SceneIndex), or take its stored index.
+ *
+ * @param isPaged whether to always use the stored index
+ * @param key as given by SceneCacheConstruct
+ */
+void SceneCacheIndex
+(
+   jmp_buf         jmpBuf,
+   const char*     sDirectory,
+   long64u         sizeLimit,
+   bool            isPaged,
+   long64u         key,
+   Scene*          pScene,
+   const Vector3f* aEyePositions,
+   int32           eyesLength
+);
+
+
+
+
+#endif
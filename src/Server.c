@@ -0,0 +1,737 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Exceptions.h"
+#include "Hash.h"
+#include "MiniLightLib.h"
+
+#include "Server.h"
+
+
+
+
+/* types -------------------------------------------------------------------- */
+
+/**
+ * Cached scene: loaded and indexed context, and its model text (for
+ * re-indexing for other views).
+ */
+struct Entry
+{
+   long64u    hash;
+   char*      pModel;
+   size_t     modelLength;
+   MiniLight* pML;
+
+   /* jobs using it now, and when last used (for eviction) */
+   int32      users;
+   long64u    lastUse;
+};
+
+typedef struct Entry Entry;
+
+struct Server
+{
+   pthread_mutex_t mutex;
+
+   Entry**         apEntries;
+   int32           entriesLength;
+   int32           cacheLength;
+   long64u         clock;
+};
+
+typedef struct Server Server;
+
+struct Connection
+{
+   Server* pServer;
+   int     socket;
+};
+
+typedef struct Connection Connection;
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+#define LINE_MAX_   1024
+#define TOKENS_MAX  32
+
+
+
+
+/* state -------------------------------------------------------------------- */
+
+/* for removing at exit */
+static char sSocketPathname_g[sizeof(((struct sockaddr_un*)0)->sun_path)];
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static void removeSocket()
+{
+   unlink( sSocketPathname_g );
+}
+
+
+static void freeEntry
+(
+   Entry* pEntry
+)
+{
+   MiniLightFree( pEntry->pML );
+   free( pEntry->pModel );
+   free( pEntry );
+}
+
+
+/**
+ * Add entry to cache, evicting the least recently used unused ones over the
+ * limit -- other than the one added. (Call with mutex locked.)
+ */
+static bool addEntry
+(
+   Server* pServer,
+   Entry*  pEntry
+)
+{
+   Entry** apEntries = (Entry**)realloc( pServer->apEntries,
+      (pServer->entriesLength + 1) * sizeof(Entry*) );
+   if( !apEntries )
+   {
+      return false;
+   }
+   pServer->apEntries = apEntries;
+   pServer->apEntries[pServer->entriesLength++] = pEntry;
+
+   while( pServer->entriesLength > pServer->cacheLength )
+   {
+      int32 i, lru = -1;
+      for( i = pServer->entriesLength;  i-- > 0; )
+      {
+         if( !pServer->apEntries[i]->users &&
+            (pServer->apEntries[i] != pEntry) && ((lru < 0) ||
+            (pServer->apEntries[i]->lastUse <
+            pServer->apEntries[lru]->lastUse)) )
+         {
+            lru = i;
+         }
+      }
+
+      /* all in use: stay over the limit for now */
+      if( lru < 0 )
+      {
+         break;
+      }
+
+      freeEntry( pServer->apEntries[lru] );
+      pServer->apEntries[lru] = pServer->apEntries[--pServer->entriesLength];
+   }
+
+   return true;
+}
+
+
+/**
+ * Make entry: load and index a model. (Call with mutex unlocked.)
+ *
+ * @param pView to index for, or 0 for the model's
+ * @return status
+ */
+static int makeEntry
+(
+   Server*              pServer,
+   const char*          pModel,
+   size_t               modelLength,
+   long64u              hash,
+   const MiniLightView* pView,
+   Entry**              ppEntry_o
+)
+{
+   int status = MINILIGHT_ERROR_ALLOC;
+
+   Entry* pEntry = (Entry*)calloc( 1, sizeof(Entry) );
+   if( pEntry )
+   {
+      pEntry->hash        = hash;
+      pEntry->modelLength = modelLength;
+      pEntry->pModel      = (char*)malloc( modelLength + 1 );
+
+      status = pEntry->pModel ? MiniLightCreate( &pEntry->pML ) :
+         MINILIGHT_ERROR_ALLOC;
+      if( MINILIGHT_OK == status )
+      {
+         memcpy( pEntry->pModel, pModel, modelLength );
+
+         status = MiniLightLoad( pEntry->pML, pModel, modelLength );
+      }
+      if( MINILIGHT_OK == status )
+      {
+         status = MiniLightBuildIndex( pEntry->pML, pView, pView ? 1 : 0 );
+      }
+
+      if( MINILIGHT_OK != status )
+      {
+         freeEntry( pEntry );
+         pEntry = 0;
+      }
+      else
+      {
+         /* used now: so not the first evicted */
+         pthread_mutex_lock( &pServer->mutex );
+         pEntry->lastUse = ++pServer->clock;
+         pthread_mutex_unlock( &pServer->mutex );
+      }
+   }
+
+   *ppEntry_o = pEntry;
+
+   return status;
+}
+
+
+/**
+ * Find a cached scene, and make a job context from it (with the view, if
+ * given). For irradiance caching, the scene's context is set to it too, so
+ * all such jobs on it share its cache. (Call with mutex locked.)
+ *
+ * @param ppJob_o 0 if the scene is cached, but not indexed for the view
+ * @return the entry, or 0 if not cached
+ */
+static Entry* findEntry
+(
+   Server*              pServer,
+   long64u              hash,
+   const MiniLightView* pView,
+   bool                 isIrradianceCaching,
+   MiniLight**          ppJob_o
+)
+{
+   Entry* pFound = 0;
+   int32  i;
+
+   *ppJob_o = 0;
+
+   for( i = pServer->entriesLength;  (i-- > 0) && !*ppJob_o; )
+   {
+      Entry* pEntry = pServer->apEntries[i];
+      if( pEntry->hash == hash )
+      {
+         pFound = pEntry;
+
+         if( isIrradianceCaching )
+         {
+            MiniLightSetIrradianceCaching( pEntry->pML, true );
+         }
+
+         if( MINILIGHT_OK == MiniLightCreateSharing( pEntry->pML, ppJob_o ) )
+         {
+            if( pView && (MINILIGHT_OK != MiniLightSetView( *ppJob_o,
+               pView )) )
+            {
+               MiniLightFree( *ppJob_o );
+               *ppJob_o = 0;
+            }
+            else
+            {
+               pEntry->users  += 1;
+               pEntry->lastUse = ++pServer->clock;
+            }
+         }
+      }
+   }
+
+   return pFound;
+}
+
+
+static bool reply
+(
+   FILE*       pOut,
+   const char* sFormat,
+   const char* sValue
+)
+{
+   return (fprintf( pOut, sFormat, sValue ) >= 0) && !fflush( pOut );
+}
+
+
+/**
+ * LOAD length -- cache model, if not already.
+ */
+static void load
+(
+   Server* pServer,
+   char*   asTokens[],
+   int32   tokensLength,
+   FILE*   pIn,
+   FILE*   pOut
+)
+{
+   unsigned long length = 0;
+   char*         pModel = 0;
+   char          sId[17];
+
+   if( (2 != tokensLength) || (1 != sscanf( asTokens[1], "%lu", &length )) ||
+      (length > SERVER_MODEL_MAX) )
+   {
+      reply( pOut, "ERROR %s\n", MiniLightMessage( MINILIGHT_ERROR_ARGUMENT ) );
+      return;
+   }
+
+   pModel = (char*)malloc( length + 1 );
+   if( !pModel )
+   {
+      reply( pOut, "ERROR %s\n", MiniLightMessage( MINILIGHT_ERROR_ALLOC ) );
+      return;
+   }
+
+   if( length == fread( pModel, 1, length, pIn ) )
+   {
+      const long64u hash = HashBytes( pModel, length, HASH_START );
+      Entry* pEntry = 0;
+      int32  i;
+
+      HashWrite( hash, sId );
+
+      /* cached already */
+      pthread_mutex_lock( &pServer->mutex );
+      for( i = pServer->entriesLength;  (i-- > 0) && !pEntry; )
+      {
+         if( pServer->apEntries[i]->hash == hash )
+         {
+            pEntry = pServer->apEntries[i];
+            pEntry->lastUse = ++pServer->clock;
+         }
+      }
+      pthread_mutex_unlock( &pServer->mutex );
+
+      /* else load (unlocked, so others can continue) and add */
+      if( !pEntry )
+      {
+         const int status = makeEntry( pServer, pModel, length, hash, 0,
+            &pEntry );
+         if( MINILIGHT_OK == status )
+         {
+            bool isAdded;
+            pthread_mutex_lock( &pServer->mutex );
+            isAdded = addEntry( pServer, pEntry );
+            pthread_mutex_unlock( &pServer->mutex );
+            if( !isAdded )
+            {
+               freeEntry( pEntry );
+            }
+         }
+         else
+         {
+            reply( pOut, "ERROR %s\n", MiniLightMessage( status ) );
+            free( pModel );
+            return;
+         }
+      }
+
+      reply( pOut, "OK %s\n", sId );
+   }
+
+   free( pModel );
+}
+
+
+/**
+ * Send the image so far.
+ */
+static bool sendFrame
+(
+   const MiniLight* pJob,
+   int32            iteration,
+   FILE*            pOut
+)
+{
+   char*  pImage = 0;
+   size_t length = 0;
+   bool   isSent = false;
+
+   FILE* pImageOut = open_memstream( &pImage, &length );
+   if( pImageOut )
+   {
+      const int status = MiniLightWriteImage( pJob, pImageOut );
+      if( !fclose( pImageOut ) && (MINILIGHT_OK == status) )
+      {
+         isSent = (fprintf( pOut, "FRAME %i %lu\n", iteration,
+            (unsigned long)length ) >= 0) &&
+            (length == fwrite( pImage, 1, length, pOut )) && !fflush( pOut );
+      }
+      free( pImage );
+   }
+
+   return isSent;
+}
+
+
+/**
+ * RENDER sceneId iterations [seed hex] [view x y z dx dy dz angle]
+ * [region x0 y0 x1 y1] [bidirectional | photons | irradiance | guided]
+ */
+static void render
+(
+   Server* pServer,
+   char*   asTokens[],
+   int32   tokensLength,
+   FILE*   pOut
+)
+{
+   long64u       hash = 0;
+   int32         iterations = 0;
+   bool          isSeeded = false, isViewed = false, isRegion = false;
+   bool          isBidirectional = false, isPhotonMapping = false;
+   bool          isIrradianceCaching = false, isPathGuiding = false;
+   int32u        seed = 0;
+   MiniLightView view;
+   int32         aRegion[4];
+
+   MiniLight* pJob   = 0;
+   Entry*     pEntry = 0;
+   int        status = MINILIGHT_ERROR_ARGUMENT;
+
+   /* read request */
+   {
+      bool  isValid = (tokensLength >= 3) &&
+         HashRead( asTokens[1], &hash ) &&
+         (1 == sscanf( asTokens[2], "%i", &iterations )) && (iterations > 0);
+      int32 i;
+      for( i = 3;  isValid && (i < tokensLength); )
+      {
+         if( !strcmp( asTokens[i], "seed" ) && ((i + 1) < tokensLength) )
+         {
+            isValid  = (1 == sscanf( asTokens[i + 1], "%x", &seed ));
+            isSeeded = true;
+            i += 2;
+         }
+         else if( !strcmp( asTokens[i], "view" ) && ((i + 7) < tokensLength) )
+         {
+            int32 j;
+            for( j = 0;  j < 7;  ++j )
+            {
+               isValid &= (1 == sscanf( asTokens[i + 1 + j], "%lf", j < 3 ?
+                  &view.aPosition[j] : (j < 6 ? &view.aDirection[j - 3] :
+                  &view.angle) ));
+            }
+            isViewed = true;
+            i += 8;
+         }
+         else if( !strcmp( asTokens[i], "region" ) &&
+            ((i + 4) < tokensLength) )
+         {
+            int32 j;
+            for( j = 0;  j < 4;  ++j )
+            {
+               isValid &= (1 == sscanf( asTokens[i + 1 + j], "%i",
+                  &aRegion[j] ));
+            }
+            isRegion = true;
+            i += 5;
+         }
+         else if( !strcmp( asTokens[i], "bidirectional" ) )
+         {
+            isBidirectional = true;
+            i += 1;
+         }
+         else if( !strcmp( asTokens[i], "photons" ) )
+         {
+            isPhotonMapping = true;
+            i += 1;
+         }
+         else if( !strcmp( asTokens[i], "irradiance" ) )
+         {
+            isIrradianceCaching = true;
+            i += 1;
+         }
+         else if( !strcmp( asTokens[i], "guided" ) )
+         {
+            isPathGuiding = true;
+            i += 1;
+         }
+         else
+         {
+            isValid = false;
+         }
+      }
+
+      if( !isValid )
+      {
+         reply( pOut, "ERROR %s\n", MiniLightMessage( status ) );
+         return;
+      }
+   }
+
+   /* get job context from cached scene */
+   pthread_mutex_lock( &pServer->mutex );
+   pEntry = findEntry( pServer, hash, isViewed ? &view : 0,
+      isIrradianceCaching, &pJob );
+   if( pEntry && !pJob )
+   {
+      /* keep while re-indexing */
+      pEntry->users += 1;
+   }
+   pthread_mutex_unlock( &pServer->mutex );
+
+   if( !pEntry )
+   {
+      reply( pOut, "ERROR %s\n", "unknown scene id" );
+      return;
+   }
+
+   /* view outside cached index: make another entry, indexed for it */
+   if( !pJob )
+   {
+      Entry* pNew = 0;
+      status = makeEntry( pServer, pEntry->pModel, pEntry->modelLength,
+         hash, &view, &pNew );
+
+      pthread_mutex_lock( &pServer->mutex );
+      pEntry->users -= 1;
+      if( pNew )
+      {
+         if( addEntry( pServer, pNew ) )
+         {
+            pEntry = findEntry( pServer, hash, &view, isIrradianceCaching,
+               &pJob );
+         }
+         else
+         {
+            freeEntry( pNew );
+         }
+      }
+      pthread_mutex_unlock( &pServer->mutex );
+
+      if( !pJob )
+      {
+         reply( pOut, "ERROR %s\n", MiniLightMessage( status ) );
+         return;
+      }
+   }
+
+   /* set up and render, streaming progressive frames */
+   status = isSeeded ? MiniLightSetSeed( pJob, seed ) : MINILIGHT_OK;
+   if( (MINILIGHT_OK == status) && isRegion )
+   {
+      status = MiniLightSetRegion( pJob, aRegion );
+   }
+   if( MINILIGHT_OK == status )
+   {
+      status = MiniLightSetBidirectional( pJob, isBidirectional );
+   }
+   if( MINILIGHT_OK == status )
+   {
+      status = MiniLightSetPhotonMapping( pJob, isPhotonMapping );
+   }
+   if( MINILIGHT_OK == status )
+   {
+      status = MiniLightSetIrradianceCaching( pJob, isIrradianceCaching );
+   }
+   if( MINILIGHT_OK == status )
+   {
+      status = MiniLightSetPathGuiding( pJob, isPathGuiding );
+   }
+   if( MINILIGHT_OK == status )
+   {
+      int32 frameNo;
+      for( frameNo = 1;  frameNo <= iterations;  ++frameNo )
+      {
+         status = MiniLightRender( pJob, 1 );
+
+         /* send at twice error-halving rate, and at end (stop if client has
+            gone) */
+         if( (MINILIGHT_OK != status) || ((((frameNo & (frameNo - 1)) == 0) |
+            (iterations == frameNo)) && !sendFrame( pJob, frameNo, pOut )) )
+         {
+            break;
+         }
+      }
+
+      if( MINILIGHT_OK == status )
+      {
+         char sIterations[12];
+         sprintf( sIterations, "%i", frameNo - 1 );
+         reply( pOut, "END %s\n", sIterations );
+      }
+   }
+   if( MINILIGHT_OK != status )
+   {
+      reply( pOut, "ERROR %s\n", MiniLightMessage( status ) );
+   }
+
+   MiniLightFree( pJob );
+
+   pthread_mutex_lock( &pServer->mutex );
+   pEntry->users  -= 1;
+   pEntry->lastUse = ++pServer->clock;
+   pthread_mutex_unlock( &pServer->mutex );
+}
+
+
+/**
+ * Thread body: serve requests until the connection ends.
+ */
+static void* serveConnection
+(
+   void* pConnectionV
+)
+{
+   const Connection connection = *(Connection*)pConnectionV;
+
+   FILE* pIn  = fdopen( connection.socket, "r" );
+   FILE* pOut = pIn ? fdopen( dup( connection.socket ), "w" ) : 0;
+
+   free( pConnectionV );
+
+   if( pOut )
+   {
+      char sLine[LINE_MAX_];
+
+      while( fgets( sLine, sizeof(sLine), pIn ) )
+      {
+         char* asTokens[TOKENS_MAX];
+         int32 tokensLength = 0;
+         char* pSave = 0;
+
+         /* split into words */
+         char* sToken = strtok_r( sLine, " \t\r\n", &pSave );
+         for( ;  sToken && (tokensLength < TOKENS_MAX);
+            sToken = strtok_r( 0, " \t\r\n", &pSave ) )
+         {
+            asTokens[tokensLength++] = sToken;
+         }
+
+         if( !tokensLength )
+         {
+            continue;
+         }
+         else if( !strcmp( asTokens[0], "LOAD" ) )
+         {
+            load( connection.pServer, asTokens, tokensLength, pIn, pOut );
+         }
+         else if( !strcmp( asTokens[0], "RENDER" ) )
+         {
+            render( connection.pServer, asTokens, tokensLength, pOut );
+         }
+         else if( !strcmp( asTokens[0], "QUIT" ) )
+         {
+            break;
+         }
+         else
+         {
+            reply( pOut, "ERROR %s\n", "unknown request" );
+         }
+      }
+
+      fclose( pOut );
+   }
+
+   if( pIn )
+   {
+      fclose( pIn );
+   }
+   else
+   {
+      close( connection.socket );
+   }
+
+   return 0;
+}
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+void ServerRun
+(
+   jmp_buf     jmpBuf,
+   const char* sSocketPathname,
+   int32       cacheLength
+)
+{
+   Server             server;
+   struct sockaddr_un address;
+   int                listener;
+
+   server.apEntries     = 0;
+   server.entriesLength = 0;
+   server.cacheLength   = cacheLength > 0 ? cacheLength : 1;
+   server.clock         = 0;
+   throwExceptions( jmpBuf, (0 != pthread_mutex_init( &server.mutex, 0 )),
+      ERROR_PROCESS );
+
+   /* a client leaving mid-reply must not end the server */
+   signal( SIGPIPE, SIG_IGN );
+
+   /* listen on socket (replacing any left from before) */
+   throwExceptions( jmpBuf, (strlen( sSocketPathname ) >=
+      sizeof(address.sun_path)), ERROR_ARGUMENT );
+   memset( &address, 0, sizeof(address) );
+   address.sun_family = AF_UNIX;
+   strcpy( address.sun_path, sSocketPathname );
+
+   listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+   throwExceptions( jmpBuf, (-1 == listener), ERROR_FILE );
+
+   unlink( sSocketPathname );
+   throwExceptions( jmpBuf, (0 != bind( listener, (struct sockaddr*)&address,
+      sizeof(address) )) || (0 != listen( listener, 16 )), ERROR_FILE );
+
+   strcpy( sSocketPathname_g, sSocketPathname );
+   atexit( removeSocket );
+
+   printf( "serving: %s\n", sSocketPathname );
+   fflush( stdout );
+
+   /* serve each connection on its own thread */
+   for( ;; )
+   {
+      const int connected = accept( listener, 0, 0 );
+      if( -1 != connected )
+      {
+         pthread_t   thread;
+         Connection* pConnection = (Connection*)calloc( 1,
+            sizeof(Connection) );
+         if( pConnection )
+         {
+            pConnection->pServer = &server;
+            pConnection->socket  = connected;
+         }
+
+         if( !pConnection || pthread_create( &thread, 0, serveConnection,
+            pConnection ) )
+         {
+            free( pConnection );
+            close( connected );
+         }
+         else
+         {
+            pthread_detach( thread );
+         }
+      }
+   }
+}
@@ -0,0 +1,83 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Server_h
+#define Server_h
+
+
+#include <setjmp.h>
+
+#include "Primitives.h"
+
+
+
+
+/**
+ * Render daemon, on a Unix domain socket.<br/><br/>
+ *
+ * Loaded scenes (and their indexes) are cached, keyed by a hash of the model
+ * text, so a model is only parsed and indexed once (until evicted, least
+ * recently used first). Each connection is served by its own thread; jobs on
+ * the same scene share it.<br/><br/>
+ *
+ * Protocol -- requests are text lines, any number per connection:
+ * <pre>
+ *    LOAD length\n  then length bytes of model text
+ *       -> OK sceneId\n
+ *    RENDER sceneId iterations [seed hex] [view x y z dx dy dz angle]
+ *           [region x0 y0 x1 y1]
+ *           [bidirectional | photons | irradiance | guided]\n
+ *       -> FRAME iteration length\n  then length bytes of RGBE image
+ *          (at each power-of-two iteration, and the last)
+ *          ...
+ *          END iteration\n
+ *    QUIT\n
+ * </pre>
+ * Any request can instead get: ERROR message\n<br/><br/>
+ *
+ * A view outside a cached scene's index makes another entry for that scene,
+ * indexed for it. Irradiance-cached jobs on the same entry share one cache,
+ * kept with the entry.
+ */
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Serve until interrupted.
+ *
+ * @param cacheLength maximum scenes to keep loaded (while unused)
+ */
+void ServerRun
+(
+   jmp_buf     jmpBuf,
+   const char* sSocketPathname,
+   int32       cacheLength
+);
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+/**
+ * Default maximum scenes to keep loaded.
+ */
+#define SERVER_CACHE_DEFAULT 8
+
+/**
+ * Maximum model text length accepted.
+ */
+#define SERVER_MODEL_MAX ((size_t)0x40000000)
+
+
+
+
+#endif
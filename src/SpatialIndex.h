@@ -12,6 +12,8 @@
 #define SpatialIndex_h
 
 
+#include <stddef.h>
+#include <stdio.h>
 #include <setjmp.h>
 
 #include "Primitives.h"
@@ -30,9 +32,6 @@
  * Constant.<br/><br/>
  *
  * @implementation
- * A crude State pattern: typed by isBranch field to be either a branch
- * or leaf cell.<br/><br/>
- *
  * Octree: axis-aligned, cubical. Subcells are numbered thusly:
  * <pre>      110---111
  *            /|    /|
@@ -41,7 +40,22 @@
  *    |/    |/    | /
  *    .-x  000---001      </pre><br/><br/>
  *
- * Each cell stores its bound (fatter data, but simpler code).<br/><br/>
+ * Compact nodes (20 bytes), all in one array, a branch's subcells adjacent
+ * (present ones only, in order, found by counting the bits of a mask below
+ * theirs). Cells' bounds are not stored, but made while descending, by halving
+ * the root's -- exactly as when built. Each node holds instead a bound of its
+ * contents, quantised to 8 bits a side within its parent's cell (rounded
+ * outward, so conservative), and rays are tested against it before entering,
+ * so skip the empty parts of cells.<br/><br/>
+ *
+ * Each leaf also stores its items' geometry as a block (see Triangle), so
+ * intersecting them is one vectorisable loop over contiguous data (the items
+ * themselves only being read for the hit one), and their numbers in one array
+ * of slots.<br/><br/>
+ *
+ * Holds only numbers, no pointers, so can be written in a flat form (a header,
+ * then the arrays) and used again from a memory mapping of it, with only the
+ * header filled in.<br/><br/>
  *
  * Calculations for building and tracing are absolute rather than incremental --
  * so quite numerically solid. Uses tolerances in: bounding triangles (in
@@ -51,20 +65,24 @@
  *
  * @invariants
  * * aBound[0-2] <= aBound[3-5]
- * * bound encompasses the cell's contents
- * if isBranch
- * * apArray elements are SpatialIndex pointers or zeros
- * * length (of apArray) is 8
- * else
- * * apArray elements are non-zero Triangle pointers
+ * * aBound (the root cell) encompasses all items
+ * * nodesLength >= 1 (the root first)
+ * * a branch's subcells come after it
+ * * aSlots elements are item numbers (of aItems)
  */
 
 struct SpatialIndex
 {
-   bool         isBranch;
-   real64       aBound[6];
-   const void** apArray;
-   int32        length;
+   real64                    aBound[6];
+
+   const struct SpatialNode* aNodes;
+   const int32*              aSlots;
+   const real32*             aBlocks;
+   const Triangle*           aItems;
+
+   int32                     nodesLength;
+   int32                     slotsLength;
+   int32                     groupsLength;
 };
 
 typedef struct SpatialIndex SpatialIndex;
@@ -74,14 +92,33 @@ typedef struct SpatialIndex SpatialIndex;
 
 /* initialisation ----------------------------------------------------------- */
 
+/**
+ * @param aEyePositions all viewpoints rays will start from (at least one)
+ */
 const SpatialIndex* SpatialIndexConstruct
 (
-   const Vector3f* pEyePosition,
+   const Vector3f* aEyePositions,
+   int32           eyesLength,
    const Triangle* aItems,
    int32           itemsLength,
    jmp_buf         jmpBuf
 );
 
+/**
+ * Make from a mapping of what SpatialIndexWrite wrote, filling in its header
+ * (so the mapping must be private and writable, and outlive the index -- which
+ * is then not to be destructed, only unmapped).
+ *
+ * @return 0 if the mapping is not a valid index of the items
+ */
+const SpatialIndex* SpatialIndexConstructMapped
+(
+   void*           pMap,
+   size_t          mapLength,
+   const Triangle* aItems,
+   int32           itemsLength
+);
+
 void SpatialIndexDestruct
 (
    SpatialIndex*
@@ -92,8 +129,54 @@ void SpatialIndexDestruct
 
 /* queries ------------------------------------------------------------------ */
 
+/**
+ * Write in the flat form, for SpatialIndexConstructMapped (on the same
+ * platform).
+ */
+void SpatialIndexWrite
+(
+   const SpatialIndex*,
+   jmp_buf             jmpBuf,
+   FILE*               pOut_o
+);
+
+/**
+ * Memory held: nodes, slots, and blocks.
+ */
+long64u SpatialIndexBytes
+(
+   const SpatialIndex*
+);
+
+/**
+ * Offset of the leafs' blocks in a mapping (as SpatialIndexConstructMapped
+ * took) -- they run to its end, and are never written, so can be released
+ * and paged in again.
+ */
+size_t SpatialIndexMappedBlocks
+(
+   const void* pMap
+);
+
+/**
+ * Where a ray starting outside the index enters it (SpatialIndexIntersection
+ * needs a start inside).
+ *
+ * @return whether the ray enters before the distance (then pStart_o set)
+ */
+bool SpatialIndexEnter
+(
+   const SpatialIndex*,
+   const Vector3f*     pRayOrigin,
+   const Vector3f*     pRayDirection,
+   real64              distance,
+   Vector3f*           pStart_o
+);
+
 /**
  * Find nearest intersection of ray with item.
+ *
+ * @param null start (inside the index) if the origin is outside it, else 0
  */
 void SpatialIndexIntersection
 (
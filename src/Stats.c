@@ -0,0 +1,169 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+/* (for clock_gettime, where there is one) */
+#define _POSIX_C_SOURCE 199309L
+
+#include <time.h>
+
+#include "Exceptions.h"
+
+#include "Stats.h"
+
+
+
+
+/* (only compiled in for profiling -- see Stats.h) */
+#ifdef MINILIGHT_STATS
+
+
+
+
+/* constants ---------------------------------------------------------------- */
+
+static const char* PHASE_NAMES[STATS_PHASES_LENGTH] =
+   { "parse", "index", "trace", "emitters", "format" };
+
+static const char* COUNTER_NAMES[STATS_COUNTERS_LENGTH] =
+   { "rays.primary", "rays.bounce", "rays.shadow", "triangle.tests",
+     "node.visits", "path.vertexes" };
+
+
+
+
+/* state -------------------------------------------------------------------- */
+
+static volatile long64u phaseTicks_g[STATS_PHASES_LENGTH];
+static volatile long64u counters_g[STATS_COUNTERS_LENGTH];
+
+static long64u startTicks_g   = 0;
+static real64  startSeconds_g = 0.0;
+
+
+
+
+/* implementation ----------------------------------------------------------- */
+
+static real64 wallSeconds()
+{
+#ifdef CLOCK_MONOTONIC
+   struct timespec t;
+   return clock_gettime( CLOCK_MONOTONIC, &t ) ? 0.0 :
+      (real64)t.tv_sec + ((real64)t.tv_nsec * 1e-9);
+#else
+   /* (processor time: only right for one thread) */
+   return (real64)clock() / (real64)CLOCKS_PER_SEC;
+#endif
+}
+
+
+static void add
+(
+   volatile long64u* pValue,
+   long64u           amount
+)
+{
+#ifdef __GNUC__
+   __sync_fetch_and_add( pValue, amount );
+#else
+   *pValue += amount;
+#endif
+}
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+void StatsInitialise()
+{
+   startSeconds_g = wallSeconds();
+   startTicks_g   = StatsTicks();
+}
+
+
+long64u StatsTicks()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+   return (long64u)__builtin_ia32_rdtsc();
+#else
+   return (long64u)(wallSeconds() * 1e9);
+#endif
+}
+
+
+void StatsAddTicks
+(
+   int     phase,
+   long64u ticks
+)
+{
+   add( &phaseTicks_g[phase], ticks );
+}
+
+
+void StatsAdd
+(
+   int     counter,
+   long64u amount
+)
+{
+   add( &counters_g[counter], amount );
+}
+
+
+void StatsWrite
+(
+   int32   iteration,
+   jmp_buf jmpBuf,
+   FILE*   pOut_o
+)
+{
+   /* calibrate ticks against wall-clock, over whole run so far */
+   const real64 elapsed = wallSeconds() - startSeconds_g;
+   const long64u ticks  = StatsTicks() - startTicks_g;
+   const real64 secondsPerTick = (ticks > 0) ? elapsed / (real64)ticks : 0.0;
+
+   int i;
+
+   throwWriteExceptions( pOut_o, jmpBuf,
+      fprintf( pOut_o, "iteration %i\n", iteration ) );
+   throwWriteExceptions( pOut_o, jmpBuf,
+      fprintf( pOut_o, "elapsed.seconds %.6f\n", elapsed ) );
+
+   for( i = 0;  i < STATS_PHASES_LENGTH;  ++i )
+   {
+      throwWriteExceptions( pOut_o, jmpBuf,
+         fprintf( pOut_o, "phase.%s.ticks %.0f\n", PHASE_NAMES[i],
+         (real64)phaseTicks_g[i] ) );
+      throwWriteExceptions( pOut_o, jmpBuf,
+         fprintf( pOut_o, "phase.%s.seconds %.6f\n", PHASE_NAMES[i],
+         (real64)phaseTicks_g[i] * secondsPerTick ) );
+   }
+
+   for( i = 0;  i < STATS_COUNTERS_LENGTH;  ++i )
+   {
+      throwWriteExceptions( pOut_o, jmpBuf,
+         fprintf( pOut_o, "%s %.0f\n", COUNTER_NAMES[i],
+         (real64)counters_g[i] ) );
+   }
+
+   /* path length is vertexes per primary ray */
+   throwWriteExceptions( pOut_o, jmpBuf,
+      fprintf( pOut_o, "path.length.mean %.6f\n",
+      counters_g[STATS_RAYS_PRIMARY] ?
+      (real64)counters_g[STATS_PATH_VERTEXES] /
+      (real64)counters_g[STATS_RAYS_PRIMARY] : 0.0 ) );
+}
+
+
+
+
+#endif
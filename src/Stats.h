@@ -0,0 +1,126 @@
+/*------------------------------------------------------------------------------
+
+   MiniLight C : minimal global illumination renderer
+   Harrison Ainsworth / HXA7241 : 2009, 2011, 2013
+
+   http://www.hxa.name/minilight
+
+------------------------------------------------------------------------------*/
+
+
+#ifndef Stats_h
+#define Stats_h
+
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "Primitives.h"
+
+
+
+
+/**
+ * Per-phase timers and event counters, for profiling.<br/><br/>
+ *
+ * The instrumentation macros, and these functions, are only compiled in when
+ * MINILIGHT_STATS is defined -- otherwise the macros expand to nothing (or to
+ * plain blocks), and no cost, or platform dependence, remains.<br/><br/>
+ *
+ * Timers are cycle counters where available (x86 rdtsc), converted to seconds
+ * when written. Counters are added atomically where available (GCC builtins),
+ * so are safe to use from more than one thread.<br/><br/>
+ *
+ * Timed phases nest: emitter sampling is part of tracing.
+ */
+
+
+/* phases and counters ------------------------------------------------------ */
+
+enum StatsPhase
+{
+   STATS_PHASE_PARSE,
+   STATS_PHASE_INDEX,
+   STATS_PHASE_TRACE,
+   STATS_PHASE_EMITTERS,
+   STATS_PHASE_FORMAT,
+
+   STATS_PHASES_LENGTH
+};
+
+enum StatsCounter
+{
+   STATS_RAYS_PRIMARY,
+   STATS_RAYS_BOUNCE,
+   STATS_RAYS_SHADOW,
+   STATS_TRIANGLE_TESTS,
+   STATS_NODE_VISITS,
+   STATS_PATH_VERTEXES,
+
+   STATS_COUNTERS_LENGTH
+};
+
+
+
+
+/* functions ---------------------------------------------------------------- */
+
+/**
+ * Start the clock (for calibrating ticks to seconds).
+ */
+void StatsInitialise();
+
+long64u StatsTicks();
+
+void StatsAddTicks
+(
+   int     phase,
+   long64u ticks
+);
+
+void StatsAdd
+(
+   int     counter,
+   long64u amount
+);
+
+/**
+ * Write all values, as 'name value' lines.
+ */
+void StatsWrite
+(
+   int32   iteration,
+   jmp_buf jmpBuf,
+   FILE*   pOut_o
+);
+
+
+
+
+/* instrumentation ---------------------------------------------------------- */
+
+#ifdef MINILIGHT_STATS
+
+/* BEGIN opens a block that END closes */
+#define STATS_TIMER_BEGIN( phase ) \
+   { const long64u statsStart_ = StatsTicks();
+#define STATS_TIMER_END( phase ) \
+   StatsAddTicks( (phase), StatsTicks() - statsStart_ ); }
+
+#define STATS_COUNT( counter )         StatsAdd( (counter), 1u )
+#define STATS_ADD( counter, amount )   StatsAdd( (counter), (amount) )
+
+#else
+
+#define STATS_TIMER_BEGIN( phase )     {
+#define STATS_TIMER_END( phase )       }
+
+#define STATS_COUNT( counter )
+#define STATS_ADD( counter, amount )
+
+#endif
+
+
+
+
+#endif
@@ -22,16 +22,84 @@ static const real64 PI = 3.14159265358979;
 
 
 
+/* implementation ----------------------------------------------------------- */
+
+/**
+ * The triangle in world space: its own, or as placed (made of given vertexs
+ * storage).
+ */
+static const Triangle* worldTriangle
+(
+   const SurfacePoint* pS,
+   Vector3f            aVertexs[3],
+   Triangle*           pPlaced
+)
+{
+   if( pS->pInstance )
+   {
+      InstanceTriangle( pS->pInstance, pS->pTriangle, aVertexs, pPlaced );
+      return pPlaced;
+   }
+
+   return pS->pTriangle;
+}
+
+
+/**
+ * Cosine-weighted direction over the hemisphere on one side of a triangle.
+ */
+static Vector3f cosineDirection
+(
+   const Triangle* pT,
+   bool            isBack,
+   Random*         pRandom
+)
+{
+   const real64 _2pr1 = PI * 2.0 * RandomReal64( pRandom );
+   const real64 sr2   = sqrt( RandomReal64( pRandom ) );
+
+   /* make coord frame coefficients (z in normal direction) */
+   const real64 x = cos( _2pr1 ) * sr2;
+   const real64 y = sin( _2pr1 ) * sr2;
+   const real64 z = sqrt( 1.0 - (sr2 * sr2) );
+
+   /* make coord frame */
+   const Vector3f t = TriangleTangent( pT );
+   Vector3f       n = TriangleNormal( pT );
+   Vector3f       c;
+   if( isBack )
+   {
+      n = Vector3fNegative( &n );
+   }
+   c = Vector3fCross( &n, &t );
+
+   {
+      /* scale frame by coefficients */
+      const Vector3f tx = Vector3fMulF( &t, x );
+      const Vector3f cy = Vector3fMulF( &c, y );
+      const Vector3f nz = Vector3fMulF( &n, z );
+
+      /* make direction from sum of scaled components */
+      const Vector3f sum = Vector3fAdd( &tx, &cy );
+      return Vector3fAdd( &sum, &nz );
+   }
+}
+
+
+
+
 /* initialisation ----------------------------------------------------------- */
 
 SurfacePoint SurfacePointCreate
 (
    const Triangle* pTriangle,
+   const Instance* pInstance,
    const Vector3f* pPosition
 )
 {
    SurfacePoint s;
    s.pTriangle = pTriangle;
+   s.pInstance = pInstance;
    s.position  = *pPosition;
 
    return s;
@@ -50,18 +118,47 @@ Vector3f SurfacePointEmission
    bool                isSolidAngle
 )
 {
-   const Vector3f ray       = Vector3fSub( pToPosition, &pS->position );
-   const real64   distance2 = Vector3fDot( &ray, &ray );
-   const Vector3f normal    = TriangleNormal( pS->pTriangle );
-   const real64   cosOut    = Vector3fDot( pOutDirection, &normal );
-   const real64   area      = TriangleArea( pS->pTriangle );
-
-   /* emit from front face of surface only */
-   const real64 solidAngle = (real64)(cosOut > 0.0) * (isSolidAngle ?
-      /* with infinity clamped-out */
-      (cosOut * area) / (distance2 >= 1e-6 ? distance2 : 1e-6) : 1.0);
+   real64 solidAngle;
+
+   if( isSolidAngle )
+   {
+      solidAngle = SurfacePointSolidAngle( pS, pToPosition, pOutDirection );
+   }
+   else
+   {
+      Vector3f        aVertexs[3];
+      Triangle        placed;
+      const Triangle* pT     = worldTriangle( pS, aVertexs, &placed );
+      const Vector3f  normal = TriangleNormal( pT );
+
+      /* emit from front face of surface only */
+      solidAngle = (real64)(Vector3fDot( pOutDirection, &normal ) > 0.0);
+   }
 
-   return Vector3fMulF( &pS->pTriangle->emitivity, solidAngle );
+   return Vector3fMulF( &pS->pTriangle->pMaterial->emitivity, solidAngle );
+}
+
+
+real64 SurfacePointSolidAngle
+(
+   const SurfacePoint* pS,
+   const Vector3f*     pToPosition,
+   const Vector3f*     pOutDirection
+)
+{
+   Vector3f        aVertexs[3];
+   Triangle        placed;
+   const Triangle* pT        = worldTriangle( pS, aVertexs, &placed );
+   const Vector3f  ray       = Vector3fSub( pToPosition, &pS->position );
+   const real64    distance2 = Vector3fDot( &ray, &ray );
+   const Vector3f  normal    = TriangleNormal( pT );
+   const real64    cosOut    = Vector3fDot( pOutDirection, &normal );
+   const real64    area      = TriangleArea( pT );
+
+   /* front face of surface only */
+   return (real64)(cosOut > 0.0) *
+      /* with infinity clamped-out */
+      ((cosOut * area) / (distance2 >= 1e-6 ? distance2 : 1e-6));
 }
 
 
@@ -73,16 +170,20 @@ Vector3f SurfacePointReflection
    const Vector3f*     pOutDirection
 )
 {
-   const Vector3f normal = TriangleNormal( pS->pTriangle );
-   const real64   inDot  = Vector3fDot( pInDirection,  &normal );
-   const real64   outDot = Vector3fDot( pOutDirection, &normal );
+   Vector3f        aVertexs[3];
+   Triangle        placed;
+   const Triangle* pT     = worldTriangle( pS, aVertexs, &placed );
+   const Vector3f  normal = TriangleNormal( pT );
+   const real64    inDot  = Vector3fDot( pInDirection,  &normal );
+   const real64    outDot = Vector3fDot( pOutDirection, &normal );
 
    /* directions must be on same side of surface (no transmission) */
    const bool isSameSide = !( (inDot < 0.0) ^ (outDot < 0.0) );
 
    /* ideal diffuse BRDF:
       radiance scaled by reflectivity, cosine, and 1/pi  */
-   const Vector3f r = Vector3fMulV( pInRadiance, &pS->pTriangle->reflectivity );
+   const Vector3f r = Vector3fMulV( pInRadiance,
+      &pS->pTriangle->pMaterial->reflectivity );
    return Vector3fMulF( &r, (fabs( inDot ) / PI) * (real64)isSameSide );
 }
 
@@ -97,50 +198,104 @@ bool SurfacePointNextDirection
 )
 {
    const real64 reflectivityMean =
-      Vector3fDot( &pS->pTriangle->reflectivity, &Vector3fONE ) / 3.0;
+      Vector3fDot( &pS->pTriangle->pMaterial->reflectivity, &Vector3fONE ) /
+      3.0;
 
    /* russian-roulette for reflectance 'magnitude' */
    const bool isAlive = RandomReal64( pRandom ) < reflectivityMean;
 
    if( isAlive )
    {
-      /* cosine-weighted importance sample hemisphere */
-
-      const real64 _2pr1 = PI * 2.0 * RandomReal64( pRandom );
-      const real64 sr2   = sqrt( RandomReal64( pRandom ) );
-
-      /* make coord frame coefficients (z in normal direction) */
-      const real64 x = cos( _2pr1 ) * sr2;
-      const real64 y = sin( _2pr1 ) * sr2;
-      const real64 z = sqrt( 1.0 - (sr2 * sr2) );
-
-      /* make coord frame */
-      const Vector3f t = TriangleTangent( pS->pTriangle );
-      Vector3f       n = TriangleNormal( pS->pTriangle );
-      Vector3f       c;
-      /* put normal on inward ray side of surface (preventing transmission) */
-      if( Vector3fDot( &n, pInDirection ) < 0.0 )
-      {
-         n = Vector3fNegative( &n );
-      }
-      c = Vector3fCross( &n, &t );
-
-      {
-         /* scale frame by coefficients */
-         const Vector3f tx = Vector3fMulF( &t, x );
-         const Vector3f cy = Vector3fMulF( &c, y );
-         const Vector3f nz = Vector3fMulF( &n, z );
-
-         /* make direction from sum of scaled components */
-         const Vector3f sum = Vector3fAdd( &tx, &cy );
-         *pOutDirection_o = Vector3fAdd( &sum, &nz );
-      }
+      Vector3f        aVertexs[3];
+      Triangle        placed;
+      const Triangle* pT     = worldTriangle( pS, aVertexs, &placed );
+      const Vector3f  normal = TriangleNormal( pT );
+
+      /* cosine-weighted importance sample hemisphere, on inward ray side of
+         surface (preventing transmission) */
+      *pOutDirection_o = cosineDirection( pT,
+         Vector3fDot( &normal, pInDirection ) < 0.0, pRandom );
 
       /* make color by dividing-out mean from reflectivity */
-      *pColor_o = Vector3fMulF( &pS->pTriangle->reflectivity,
+      *pColor_o = Vector3fMulF( &pS->pTriangle->pMaterial->reflectivity,
          1.0 / reflectivityMean );
    }
 
    /* discluding degenerate result direction */
    return isAlive && !Vector3fIsZero( pOutDirection_o );
 }
+
+
+real64 SurfacePointNextDirectionPdf
+(
+   const SurfacePoint* pS,
+   const Vector3f*     pInDirection,
+   const Vector3f*     pOutDirection
+)
+{
+   Vector3f        aVertexs[3];
+   Triangle        placed;
+   const Triangle* pT     = worldTriangle( pS, aVertexs, &placed );
+   const Vector3f  normal = TriangleNormal( pT );
+   const real64    inDot  = Vector3fDot( pInDirection,  &normal );
+   const real64    outDot = Vector3fDot( pOutDirection, &normal );
+
+   /* cosine-weighted, on the inward ray side of the surface only (the russian
+      roulette aside) */
+   return (real64)!((inDot < 0.0) ^ (outDot < 0.0)) * (fabs( outDot ) / PI);
+}
+
+
+Vector3f SurfacePointEmitDirection
+(
+   const SurfacePoint* pS,
+   Random*             pRandom
+)
+{
+   Vector3f        aVertexs[3];
+   Triangle        placed;
+   const Triangle* pT = worldTriangle( pS, aVertexs, &placed );
+
+   /* cosine-weighted, from front face of surface */
+   return cosineDirection( pT, false, pRandom );
+}
+
+
+real64 SurfacePointCosine
+(
+   const SurfacePoint* pS,
+   const Vector3f*     pDirection
+)
+{
+   Vector3f        aVertexs[3];
+   Triangle        placed;
+   const Triangle* pT     = worldTriangle( pS, aVertexs, &placed );
+   const Vector3f  normal = TriangleNormal( pT );
+
+   return Vector3fDot( pDirection, &normal );
+}
+
+
+Vector3f SurfacePointNormal
+(
+   const SurfacePoint* pS
+)
+{
+   Vector3f        aVertexs[3];
+   Triangle        placed;
+   const Triangle* pT = worldTriangle( pS, aVertexs, &placed );
+
+   return TriangleNormal( pT );
+}
+
+
+real64 SurfacePointArea
+(
+   const SurfacePoint* pS
+)
+{
+   Vector3f aVertexs[3];
+   Triangle placed;
+
+   return TriangleArea( worldTriangle( pS, aVertexs, &placed ) );
+}
@@ -16,6 +16,7 @@
 #include "Random.h"
 #include "Vector3f.h"
 #include "Triangle.h"
+#include "Instance.h"
 
 
 
@@ -25,6 +26,10 @@
  *
  * All direction parameters are away from surface.<br/><br/>
  *
+ * The triangle is either the scene's own, or a prototype's placed by an
+ * instance (its geometry then transformed to world space when needed).
+ * <br/><br/>
+ *
  * Constant.<br/><br/>
   *
  * @invariants
@@ -34,6 +39,7 @@
 struct SurfacePoint
 {
    const Triangle* pTriangle;
+   const Instance* pInstance;
    Vector3f        position;
 };
 
@@ -44,9 +50,13 @@ typedef struct SurfacePoint SurfacePoint;
 
 /* initialisation ----------------------------------------------------------- */
 
+/**
+ * @param pInstance instance placing the triangle, or 0 if none
+ */
 SurfacePoint SurfacePointCreate
 (
    const Triangle* pTriangle,
+   const Instance* pInstance,
    const Vector3f* pPosition
 );
 
@@ -66,6 +76,17 @@ Vector3f SurfacePointEmission
    bool                isSolidAngle
 );
 
+/**
+ * Solid angle the surface's triangle subtends from a position, as if all at
+ * this point (0 if facing away).
+ */
+real64 SurfacePointSolidAngle
+(
+   const SurfacePoint*,
+   const Vector3f*     pToPosition,
+   const Vector3f*     pOutDirection
+);
+
 /**
  * Light reflection from ray to ray by surface.
  */
@@ -89,7 +110,58 @@ bool SurfacePointNextDirection
    Vector3f*           pColor_o
 );
 
-#define SurfacePointHitId( pS ) ((const void*)(pS)->pTriangle)
+/**
+ * Probability density (per solid angle) of SurfacePointNextDirection choosing
+ * a direction, were the ray reflected.
+ */
+real64 SurfacePointNextDirectionPdf
+(
+   const SurfacePoint*,
+   const Vector3f*     pInDirection,
+   const Vector3f*     pOutDirection
+);
+
+/**
+ * Monte-carlo direction of emission from surface (cosine-weighted, from the
+ * front face).
+ */
+Vector3f SurfacePointEmitDirection
+(
+   const SurfacePoint*,
+   Random*             pRandom
+);
+
+/**
+ * Cosine of a direction to the surface normal (positive to the front face).
+ */
+real64 SurfacePointCosine
+(
+   const SurfacePoint*,
+   const Vector3f*     pDirection
+);
+
+/**
+ * Normal of the surface (of its front face, as placed).
+ */
+Vector3f SurfacePointNormal
+(
+   const SurfacePoint*
+);
+
+/**
+ * Area of the surface's triangle (as placed).
+ */
+real64 SurfacePointArea
+(
+   const SurfacePoint*
+);
+
+/**
+ * Whether on the same surface (triangle, as placed).
+ */
+#define SurfacePointIsSame( pA, pB ) \
+   (((pA)->pTriangle == (pB)->pTriangle) & \
+   ((pA)->pInstance == (pB)->pInstance))
 
 
 
@@ -33,8 +33,8 @@ static Vector3f TriangleNormalV
    const Triangle* pT
 )
 {
-   const Vector3f edge1 = Vector3fSub( &pT->aVertexs[1], &pT->aVertexs[0] );
-   const Vector3f edge3 = Vector3fSub( &pT->aVertexs[2], &pT->aVertexs[1] );
+   const Vector3f edge1 = Vector3fSub( pT->apVertexs[1], pT->apVertexs[0] );
+   const Vector3f edge3 = Vector3fSub( pT->apVertexs[2], pT->apVertexs[1] );
    return Vector3fCross( &edge1, &edge3 );
 }
 
@@ -43,32 +43,42 @@ static Vector3f TriangleNormalV
 
 /* initialisation ----------------------------------------------------------- */
 
-Triangle TriangleCreate
+void TriangleRead
 (
-   FILE*   pIn,
-   jmp_buf jmpBuf
+   FILE*     pIn,
+   jmp_buf   jmpBuf,
+   Vector3f  aVertexs_o[3],
+   Material* pMaterial_o
 )
 {
-   Triangle t;
-
    /* read geometry */
    {
       int i;
-      for( i = 0;  i < 3;  t.aVertexs[i++] = Vector3fRead( pIn, jmpBuf ) ) {}
+      for( i = 0;  i < 3;  aVertexs_o[i++] = Vector3fRead( pIn, jmpBuf ) ) {}
    }
 
-   /* read and condition quality */
+   /* read quality */
    {
-      t.reflectivity = Vector3fRead( pIn, jmpBuf );
-      t.reflectivity = Vector3fClamped( &t.reflectivity,
-         &Vector3fZERO, &Vector3fONE );
-
-      t.emitivity = Vector3fRead( pIn, jmpBuf );
-      t.emitivity = Vector3fClamped( &t.emitivity,
-         &Vector3fZERO, &t.emitivity );
+      const Vector3f reflectivity = Vector3fRead( pIn, jmpBuf );
+      const Vector3f emitivity    = Vector3fRead( pIn, jmpBuf );
+      *pMaterial_o = MaterialCreate( &reflectivity, &emitivity );
    }
+}
 
-   return t;
+
+Material MaterialCreate
+(
+   const Vector3f* pReflectivity,
+   const Vector3f* pEmitivity
+)
+{
+   /* condition quality */
+   Material m;
+   m.reflectivity = Vector3fClamped( pReflectivity, &Vector3fZERO,
+      &Vector3fONE );
+   m.emitivity    = Vector3fClamped( pEmitivity, &Vector3fZERO, pEmitivity );
+
+   return m;
 }
 
 
@@ -85,7 +95,7 @@ void TriangleBound
    int i, j, d, m;
 
    /* initialise to one vertex */
-   for( i = 6;  i-- > 0;  aBound_o[i] = pT->aVertexs[2].xyz[i % 3] ) {}
+   for( i = 6;  i-- > 0;  aBound_o[i] = pT->apVertexs[2]->xyz[i % 3] ) {}
 
    /* expand to surround all vertexs */
    for( i = 0;  i < 3;  ++i )
@@ -93,7 +103,7 @@ void TriangleBound
       for( j = 0, d = 0, m = 0;  j < 6;  ++j, d = j / 3, m = j % 3 )
       {
          /* include some tolerance */
-         const real64 v = pT->aVertexs[i].xyz[m] + ((d ? 1.0 : -1.0) *
+         const real64 v = pT->apVertexs[i]->xyz[m] + ((d ? 1.0 : -1.0) *
             TOLERANCE);
          aBound_o[j] = (aBound_o[j] > v) ^ d ? v : aBound_o[j];
       }
@@ -101,6 +111,78 @@ void TriangleBound
 }
 
 
+/**
+ * @implementation
+ * Separating axis test: the triangle's normal, the box's axes, and the cross
+ * products of the two sets of edge directions. Disjoint if the projections,
+ * relative to the box centre, are apart along any. (Written out, rather than
+ * with Vector3f, as index building calls it for most items in most cells.)
+ */
+bool TriangleOverlaps
+(
+   const Triangle* pT,
+   const real64    aBound[6]
+)
+{
+   real64 aVertexs[3][3], aEdges[3][3], aHalf[3];
+   bool   isApart = false;
+   int    i, j;
+
+   /* vertexs relative to box centre, and edges */
+   for( i = 3;  i-- > 0; )
+   {
+      aHalf[i] = ((aBound[i + 3] - aBound[i]) * 0.5) + TOLERANCE;
+      for( j = 3;  j-- > 0;  aVertexs[j][i] = pT->apVertexs[j]->xyz[i] -
+         ((aBound[i] + aBound[i + 3]) * 0.5) ) {}
+   }
+   for( j = 3;  j-- > 0; )
+   {
+      for( i = 3;  i-- > 0;  aEdges[j][i] = aVertexs[(j + 1) % 3][i] -
+         aVertexs[j][i] ) {}
+   }
+
+   /* normal, then box axes, then edge crosses (box axis i / 3 x edge i % 3)
+      -- most likely to separate first */
+   for( i = 13;  !isApart & (i-- > 0); )
+   {
+      real64 aAxis[3], radius = 0.0, lo = 0.0, hi = 0.0;
+
+      if( 12 == i )
+      {
+         for( j = 3;  j-- > 0;  aAxis[j] = (aEdges[0][(j + 1) % 3] *
+            aEdges[1][(j + 2) % 3]) - (aEdges[0][(j + 2) % 3] *
+            aEdges[1][(j + 1) % 3]) ) {}
+      }
+      else if( i >= 9 )
+      {
+         for( j = 3;  j-- > 0;  aAxis[j] = (i - 9) == j ? 1.0 : 0.0 ) {}
+      }
+      else
+      {
+         const int     b = ((i / 3) + 1) % 3, c = ((i / 3) + 2) % 3;
+         const real64* e = aEdges[i % 3];
+         aAxis[i / 3] = 0.0;
+         aAxis[b]     = -e[c];
+         aAxis[c]     =  e[b];
+      }
+
+      /* (box projection is symmetric about the centre) */
+      for( j = 3;  j-- > 0; )
+      {
+         const real64 p = (aAxis[0] * aVertexs[j][0]) +
+            (aAxis[1] * aVertexs[j][1]) + (aAxis[2] * aVertexs[j][2]);
+         lo = (j == 2) || (p < lo) ? p : lo;
+         hi = (j == 2) || (p > hi) ? p : hi;
+         radius += aHalf[j] * fabs( aAxis[j] );
+      }
+
+      isApart = (lo > radius) | (hi < -radius);
+   }
+
+   return !isApart;
+}
+
+
 /**
  * @implementation
  * Adapted from:
@@ -118,8 +200,8 @@ bool TriangleIntersection
 )
 {
    /* make vectors for two edges sharing vert0 */
-   const Vector3f edge1 = Vector3fSub( &pT->aVertexs[1], &pT->aVertexs[0] );
-   const Vector3f edge2 = Vector3fSub( &pT->aVertexs[2], &pT->aVertexs[0] );
+   const Vector3f edge1 = Vector3fSub( pT->apVertexs[1], pT->apVertexs[0] );
+   const Vector3f edge2 = Vector3fSub( pT->apVertexs[2], pT->apVertexs[0] );
 
    /* begin calculating determinant - also used to calculate U parameter */
    const Vector3f pvec = Vector3fCross( pRayDirection, &edge2 );
@@ -133,7 +215,7 @@ bool TriangleIntersection
       const real64 inv_det = 1.0 / det;
 
       /* calculate distance from vertex 0 to ray origin */
-      const Vector3f tvec = Vector3fSub( pRayOrigin, &pT->aVertexs[0] );
+      const Vector3f tvec = Vector3fSub( pRayOrigin, pT->apVertexs[0] );
 
       /* calculate U parameter and test bounds */
       const real64 u = Vector3fDot( &tvec, &pvec ) * inv_det;
@@ -159,6 +241,107 @@ bool TriangleIntersection
 }
 
 
+void TriangleBlockWrite
+(
+   const Triangle* const* apTriangles,
+   int32                  length,
+   real32*                aBlock_o
+)
+{
+   int32 i, c;
+   for( i = TriangleBlockGroups( length ) * TRIANGLE_BLOCK_WIDTH;  i-- > 0; )
+   {
+      real32* pGroup = aBlock_o + ((i / TRIANGLE_BLOCK_WIDTH) *
+         TRIANGLE_BLOCK_GROUP) + (i % TRIANGLE_BLOCK_WIDTH);
+
+      /* vertexs (padding: degenerate) */
+      for( c = 9;  c-- > 0; )
+      {
+         pGroup[c * TRIANGLE_BLOCK_WIDTH] = (i < length) ?
+            (real32)apTriangles[i]->apVertexs[c / 3]->xyz[c % 3] : 0.0f;
+      }
+   }
+}
+
+
+/**
+ * @implementation
+ * TriangleIntersection's algorithm, made branchless (computing everything,
+ * then selecting), so the inner loop, over a group, can be vectorised. Edges
+ * are made in double, as TriangleIntersection makes them.
+ */
+void TriangleBlockIntersections
+(
+   const real32*   aBlock,
+   int32           groupsLength,
+   const Vector3f* pRayOrigin,
+   const Vector3f* pRayDirection,
+   real64*         aDistances_o
+)
+{
+   const real64 ox = pRayOrigin->xyz[0];
+   const real64 oy = pRayOrigin->xyz[1];
+   const real64 oz = pRayOrigin->xyz[2];
+   const real64 dx = pRayDirection->xyz[0];
+   const real64 dy = pRayDirection->xyz[1];
+   const real64 dz = pRayDirection->xyz[2];
+
+   for( ;  groupsLength-- > 0;  aBlock += TRIANGLE_BLOCK_GROUP,
+      aDistances_o += TRIANGLE_BLOCK_WIDTH )
+   {
+      const real32* v0x = aBlock + (0 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v0y = aBlock + (1 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v0z = aBlock + (2 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v1x = aBlock + (3 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v1y = aBlock + (4 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v1z = aBlock + (5 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v2x = aBlock + (6 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v2y = aBlock + (7 * TRIANGLE_BLOCK_WIDTH);
+      const real32* v2z = aBlock + (8 * TRIANGLE_BLOCK_WIDTH);
+
+      int i;
+      for( i = 0;  i < TRIANGLE_BLOCK_WIDTH;  ++i )
+      {
+         /* edges */
+         const real64 e1x = (real64)v1x[i] - (real64)v0x[i];
+         const real64 e1y = (real64)v1y[i] - (real64)v0y[i];
+         const real64 e1z = (real64)v1z[i] - (real64)v0z[i];
+         const real64 e2x = (real64)v2x[i] - (real64)v0x[i];
+         const real64 e2y = (real64)v2y[i] - (real64)v0y[i];
+         const real64 e2z = (real64)v2z[i] - (real64)v0z[i];
+
+         /* determinant (pvec = direction x edge2) */
+         const real64 px  = (dy * e2z) - (dz * e2y);
+         const real64 py  = (dz * e2x) - (dx * e2z);
+         const real64 pz  = (dx * e2y) - (dy * e2x);
+         const real64 det = (e1x * px) + (e1y * py) + (e1z * pz);
+
+         /* (avoiding division by zero) */
+         const bool   isFacing = (det <= -EPSILON) | (det >= EPSILON);
+         const real64 inv_det  = 1.0 / (isFacing ? det : 1.0);
+
+         /* U parameter (tvec = origin - vertex0) */
+         const real64 tx = ox - v0x[i];
+         const real64 ty = oy - v0y[i];
+         const real64 tz = oz - v0z[i];
+         const real64 u  = ((tx * px) + (ty * py) + (tz * pz)) * inv_det;
+
+         /* V parameter, and distance (qvec = tvec x edge1) */
+         const real64 qx = (ty * e1z) - (tz * e1y);
+         const real64 qy = (tz * e1x) - (tx * e1z);
+         const real64 qz = (tx * e1y) - (ty * e1x);
+         const real64 v  = ((dx * qx) + (dy * qy) + (dz * qz)) * inv_det;
+         const real64 t  = ((e2x * qx) + (e2y * qy) + (e2z * qz)) *
+            inv_det;
+
+         /* only in bounds, and in the forward ray direction */
+         aDistances_o[i] = isFacing & (u >= 0.0) & (u <= 1.0) & (v >= 0.0) &
+            (u + v <= 1.0) & (t >= 0.0) ? t : REAL64_MAX;
+      }
+   }
+}
+
+
 Vector3f TriangleSamplePoint
 (
    const Triangle* pT,
@@ -175,8 +358,8 @@ Vector3f TriangleSamplePoint
    /*const real64 c2 = r2 * sqr1;*/
 
    /* make barycentric axes */
-   const Vector3f a0 = Vector3fSub( &pT->aVertexs[1], &pT->aVertexs[0] );
-   const Vector3f a1 = Vector3fSub( &pT->aVertexs[2], &pT->aVertexs[0] );
+   const Vector3f a0 = Vector3fSub( pT->apVertexs[1], pT->apVertexs[0] );
+   const Vector3f a1 = Vector3fSub( pT->apVertexs[2], pT->apVertexs[0] );
 
    /* scale axes by coords */
    const Vector3f ac0 = Vector3fMulF( &a0, c0 );
@@ -184,7 +367,7 @@ Vector3f TriangleSamplePoint
 
    /* sum scaled components, and offset from corner */
    const Vector3f sum = Vector3fAdd( &ac0, &ac1 );
-   return Vector3fAdd( &sum, &pT->aVertexs[0] );
+   return Vector3fAdd( &sum, pT->apVertexs[0] );
 }
 
 
@@ -203,7 +386,7 @@ Vector3f TriangleTangent
    const Triangle* pT
 )
 {
-   const Vector3f edge1 = Vector3fSub( &pT->aVertexs[1], &pT->aVertexs[0] );
+   const Vector3f edge1 = Vector3fSub( pT->apVertexs[1], pT->apVertexs[0] );
    return Vector3fUnitized( &edge1 );
 }
 
@@ -23,9 +23,17 @@
 
 
 /**
- * Simple, explicit/non-vertex-shared triangle.<br/><br/>
+ * Simple triangle, of shared vertexs and material.<br/><br/>
  *
- * Includes geometry and quality.<br/><br/>
+ * Refers to its geometry and quality, which are held (deduplicated) by the
+ * Scene, so must outlive it.<br/><br/>
+ *
+ * Geometry of many can also be laid out as a block, for intersecting in one
+ * loop: groups of TRIANGLE_BLOCK_WIDTH triangles, each group holding, for
+ * each component of the three vertexs, the value for every triangle in turn
+ * (SoA, in SIMD-width pieces). The last group is padded with degenerate
+ * triangles, which are never hit. Values are single precision, as vertexs are
+ * read, so exact (and half the size of double edges).<br/><br/>
  *
  * Constant.<br/><br/>
  *
@@ -35,33 +43,64 @@
  * Moller, Trumbore;
  * Journal of Graphics Tools, v2 n1 p21; 1997.
  * http://www.acm.org/jgt/papers/MollerTrumbore97/</cite>
- *
- * @invariants
- * * reflectivity >= 0 and <= 1
- * * emitivity    >= 0
  */
 
 struct Triangle
 {
    /* geometry */
-   Vector3f aVertexs[3];
+   const Vector3f* apVertexs[3];
 
    /* quality */
+   const struct Material* pMaterial;
+};
+
+typedef struct Triangle Triangle;
+
+
+
+
+/**
+ * Surface quality, of triangles.<br/><br/>
+ *
+ * Constant.
+ *
+ * @invariants
+ * * reflectivity >= 0 and <= 1
+ * * emitivity    >= 0
+ */
+
+struct Material
+{
    Vector3f reflectivity;
    Vector3f emitivity;
 };
 
-typedef struct Triangle Triangle;
+typedef struct Material Material;
 
 
 
 
 /* initialisation ----------------------------------------------------------- */
 
-Triangle TriangleCreate
+/**
+ * Read a triangle's vertexs and material (conditioned to the invariants), to
+ * be shared.
+ */
+void TriangleRead
+(
+   FILE*     pIn,
+   jmp_buf   jmpBuf,
+   Vector3f  aVertexs_o[3],
+   Material* pMaterial_o
+);
+
+/**
+ * Material from any values (conditioned to the invariants).
+ */
+Material MaterialCreate
 (
-   FILE*   pIn,
-   jmp_buf jmpBuf
+   const Vector3f* pReflectivity,
+   const Vector3f* pEmitivity
 );
 
 
@@ -69,6 +108,37 @@ Triangle TriangleCreate
 
 /* queries ------------------------------------------------------------------ */
 
+/**
+ * Write triangles' geometry as a block.
+ *
+ * @param aBlock_o TriangleBlockGroups( length ) * TRIANGLE_BLOCK_GROUP reals
+ */
+void TriangleBlockWrite
+(
+   const Triangle* const* apTriangles,
+   int32                  length,
+   real32*                aBlock_o
+);
+
+/**
+ * Intersection distances of ray with each triangle of a block (as
+ * TriangleIntersection, but all in one loop).
+ *
+ * @param aDistances_o groupsLength * TRIANGLE_BLOCK_WIDTH reals: distance,
+ *        or REAL64_MAX where not hit
+ */
+void TriangleBlockIntersections
+(
+   const real32*   aBlock,
+   int32           groupsLength,
+   const Vector3f* pRayOrigin,
+   const Vector3f* pRayDirection,
+   real64*         aDistances_o
+);
+
+#define TriangleBlockGroups( length ) \
+   (((length) + TRIANGLE_BLOCK_WIDTH - 1) / TRIANGLE_BLOCK_WIDTH)
+
 /**
  * Axis-aligned bounding box of triangle.
  *
@@ -80,6 +150,18 @@ void TriangleBound
    real64          aBound_o[6]
 );
 
+/**
+ * Whether triangle overlaps an axis-aligned box (expanded by TOLERANCE, as
+ * TriangleBound is) -- exactly, not just by bounds.
+ *
+ * @param aBound lower corner in [0-2], upper corner in [3-5]
+ */
+bool TriangleOverlaps
+(
+   const Triangle*,
+   const real64    aBound[6]
+);
+
 /**
  * Intersection point of ray with triangle.
  */
@@ -131,6 +213,13 @@ real64 TriangleArea
  */
 #define TOLERANCE (1.0 / 1024.0)
 
+/**
+ * Triangles in a block group (enough for common SIMD widths), and reals for
+ * them.
+ */
+#define TRIANGLE_BLOCK_WIDTH 4
+#define TRIANGLE_BLOCK_GROUP (TRIANGLE_BLOCK_WIDTH * 9)
+
 
 
 
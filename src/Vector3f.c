@@ -254,7 +254,7 @@ Vector3f Vector3fRead
 }
 
 
-/*void Vector3fWrite
+void Vector3fWrite
 (
    const Vector3f* pV,
    jmp_buf         jmpBuf,
@@ -262,5 +262,5 @@ Vector3f Vector3fRead
 )
 {
    throwWriteExceptions( pOut, jmpBuf, fprintf( pOut,
-      "(% #6.6g % #6.6g % #6.6g)", pV->xyz[0], pV->xyz[1], pV->xyz[2] ) );
-}*/
+      "(%.9g %.9g %.9g)", pV->xyz[0], pV->xyz[1], pV->xyz[2] ) );
+}
@@ -162,12 +162,15 @@ Vector3f Vector3fRead
 );
 
 
-/*void Vector3fWrite
+/**
+ * Write in the model format (exactly, for single precision values).
+ */
+void Vector3fWrite
 (
    const Vector3f* pV,
    jmp_buf         jmpBuf,
    FILE*           pOut
-);*/
+);
 
 
 